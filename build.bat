@@ -1,6 +1,13 @@
 @echo off
 setlocal
 
+REM =========================================================
+REM Usage: build.bat [tiny|default|server]  build and run with a footprint profile
+REM        build.bat sizes                  .text, .data and .bss of the library per profile
+REM =========================================================
+set PROFILE=%1
+if "%PROFILE%"=="" set PROFILE=default
+
 REM =========================================================
 REM Directories & filenames
 REM =========================================================
@@ -14,6 +21,25 @@ set CC=gcc
 set CFLAGS=-Wall -Wextra -DDEBUG
 set LIBS=-lws2_32
 
+REM =========================================================
+REM Sources, the tiny profile only builds the core (see include\tnfs_config.h)
+REM =========================================================
+set CORE=tnfs.c netw_win32.c
+set MODULES=tnfs_warm.c ^
+    tnfs_pool.c ^
+    tnfs_journal.c ^
+    tnfs_checksum.c ^
+    tnfs_trace.c ^
+    tnfs_timeline.c ^
+    tnfs_stream.c ^
+    tnfs_find.c ^
+    tnfs_listing.c ^
+    tnfs_sync.c ^
+    tnfs_sched.c ^
+    tnfs_block.c ^
+    tnfs_relay.c
+set TOOLS=tnfs_memserver.c
+
 REM =========================================================
 REM Create build directory if it doesn't exist
 REM =========================================================
@@ -22,16 +48,29 @@ if not exist %BUILD_DIR% (
     mkdir %BUILD_DIR%
 )
 
+REM =========================================================
+REM Size report
+REM =========================================================
+if /I "%PROFILE%"=="sizes" (
+    echo profile     .text    .data     .bss
+    for %%P in (tiny default server) do call :size %%P
+    exit /b 0
+)
+
 REM =========================================================
 REM Build
 REM =========================================================
-echo [BUILD] Compiling TNFS test client (DEBUG)...
+call :profile %PROFILE%
+if errorlevel 1 exit /b 1
+if /I not "%PROFILE%"=="tiny" set SOURCES=%SOURCES% %TOOLS%
+
+echo [BUILD] Compiling TNFS test client (DEBUG, %PROFILE% profile)...
 
 %CC% ^
     %CFLAGS% ^
+    %DEFINE% ^
     main.c ^
-    tnfs.c ^
-    netw_win32.c ^
+    %SOURCES% ^
     %LIBS% ^
     -o %BUILD_DIR%\%OUT%
 
@@ -50,3 +89,32 @@ echo ----------------------------------------
 %BUILD_DIR%\%OUT%
 
 endlocal
+exit /b 0
+
+REM =========================================================
+REM Sets DEFINE and SOURCES for a profile
+REM =========================================================
+:profile
+set DEFINE=
+set SOURCES=%CORE% %MODULES%
+if /I "%1"=="tiny" (
+    set DEFINE=-DTNFS_PROFILE_TINY
+    set SOURCES=%CORE%
+) else if /I "%1"=="server" (
+    set DEFINE=-DTNFS_PROFILE_SERVER
+) else if /I not "%1"=="default" (
+    echo [ERROR] Unknown profile "%1", use tiny, default, server or sizes.
+    exit /b 1
+)
+exit /b 0
+
+REM =========================================================
+REM Compiles the library of a profile and prints its totals
+REM =========================================================
+:size
+call :profile %1
+if exist %BUILD_DIR%\%1 rmdir /s /q %BUILD_DIR%\%1
+mkdir %BUILD_DIR%\%1
+for %%F in (%SOURCES%) do %CC% -Os %DEFINE% -c %%F -o %BUILD_DIR%\%1\%%~nF.o
+for /f "tokens=1-3" %%A in ('size -t %BUILD_DIR%\%1\*.o ^| findstr TOTALS') do echo %1	%%A	%%B	%%C
+exit /b 0
@@ -2,15 +2,78 @@
 
 set -e  # stop bij fouten
 
+# usage: ./build.sh [tiny|default|server]   builds and runs the demo client with a footprint profile
+#        ./build.sh sizes                   reports the .text, .data and .bss of the library for each profile
+#        ./build.sh preload                 builds the LD_PRELOAD shim build/libtnfs_preload.so (Linux only)
+#        ./build.sh test                    builds and runs the tests in tests/ (Linux only)
+#        ./build.sh bench                   builds and runs the benchmarks in tests/ (Linux only)
+PROFILE=${1:-default}
 BUILD_DIR=build
 OUT=client
 CFLAGS="-Wall -Wextra -DDEBUG"
 
+CORE="tnfs.c netw.c"
+MODULES="tnfs_warm.c tnfs_pool.c tnfs_journal.c tnfs_checksum.c tnfs_trace.c tnfs_timeline.c tnfs_stream.c tnfs_find.c tnfs_listing.c tnfs_sync.c tnfs_sched.c tnfs_block.c tnfs_relay.c"
+TOOLS="tnfs_memserver.c"
+
+# sets the define and the library sources of a profile, see include/tnfs_config.h
+profile() {
+    case "$1" in
+        tiny)    DEFINE="-DTNFS_PROFILE_TINY";   SOURCES="$CORE" ;;
+        default) DEFINE="";                      SOURCES="$CORE $MODULES" ;;
+        server)  DEFINE="-DTNFS_PROFILE_SERVER"; SOURCES="$CORE $MODULES" ;;
+        *)       echo "unknown profile '$1', use tiny, default, server, sizes, preload, test or bench"; exit 1 ;;
+    esac
+}
+
 mkdir -p "$BUILD_DIR"
 
-gcc $CFLAGS main.c tnfs.c netw.c -o "$BUILD_DIR/$OUT"
+if [ "$PROFILE" = "sizes" ]; then
+    printf "%-8s %8s %8s %8s\n" profile .text .data .bss
+    for p in tiny default server; do
+        profile $p
+        rm -rf "$BUILD_DIR/$p"
+        mkdir -p "$BUILD_DIR/$p"
+        for src in $SOURCES; do
+            gcc -Os $DEFINE -c "$src" -o "$BUILD_DIR/$p/${src%.c}.o"
+        done
+        size -t "$BUILD_DIR/$p/"*.o | awk -v p=$p '/TOTALS/ { printf "%-8s %8d %8d %8d\n", p, $1, $2, $3 }'
+    done
+    exit 0
+fi
+
+if [ "$PROFILE" = "preload" ]; then
+    gcc -O2 -Wall -Wextra -shared -fPIC tnfs_preload.c $CORE $MODULES -o "$BUILD_DIR/libtnfs_preload.so" -ldl -lpthread
+    echo "[OK] $BUILD_DIR/libtnfs_preload.so"
+    exit 0
+fi
+
+# every tests/test_*.c or tests/bench_*.c is a program of its own, linked with the library and tests/tnfs_test.c
+if [ "$PROFILE" = "test" ] || [ "$PROFILE" = "bench" ]; then
+    if [ "$PROFILE" = "test" ]; then
+        PROGRAMS=$(ls tests/test_*.c)
+        gcc -O2 -shared -fPIC tnfs_preload.c $CORE $MODULES -o "$BUILD_DIR/libtnfs_preload.so" -ldl -lpthread
+    else
+        PROGRAMS=$(ls tests/bench_*.c)
+    fi
+    FAILED=0
+    for src in $PROGRAMS; do
+        name=$(basename "${src%.c}")
+        gcc -O2 -Wall -Wextra "$src" tests/tnfs_test.c $CORE $MODULES $TOOLS -o "$BUILD_DIR/$name"
+        "./$BUILD_DIR/$name" || FAILED=$((FAILED + 1))
+    done
+    [ $FAILED -eq 0 ] || { echo "$FAILED program(s) failed"; exit 1; }
+    exit 0
+fi
+
+profile "$PROFILE"
+if [ "$PROFILE" != "tiny" ]; then
+    SOURCES="$SOURCES $TOOLS"
+fi
+
+gcc $CFLAGS $DEFINE main.c $SOURCES -o "$BUILD_DIR/$OUT"
 
 echo
-echo "[RUN] Starting $BUILD_DIR/$OUT"
+echo "[RUN] Starting $BUILD_DIR/$OUT ($PROFILE profile)"
 echo "----------------------------------------"
 "./$BUILD_DIR/$OUT"
@@ -6,8 +6,16 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include "tnfs_config.h"
 
 #define NETW_ERR_TIMEOUT -2   // timeout error code
+#define NETW_ERR_CLOSED  -3   // the socket reported an error or the server has closed the connection
+#define NETW_ERR_CONNECT -4   // the server could not be resolved or connected to
+
+#define NETW_MAX_IP_LEN 46            // longest textual IPv6 address including the terminating zero
+#define NETW_MAX_ADDRESSES 8          // maximum number of resolved addresses tried by netw_connect()
+#define NETW_EYEBALLS_DELAY_MS 250    // head start of a connection attempt before the next address is tried
+#define NETW_CONNECT_TIMEOUT_MS 5000  // give up connecting when no address succeeded within this time
 
 #ifdef _WIN32
 
@@ -29,16 +37,71 @@
 #include <netdb.h>
 #include <unistd.h>
 #include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
 
 #endif
 
+/* one resolved address of the server */
+struct netw_address {
+    struct sockaddr_storage addr;
+    socklen_t len;
+};
+
+/* the connection of the sockets backend, each context of tnfs_context_switch() keeps its own */
+struct netw_state {
+#ifdef _WIN32
+    SOCKET fd;
+    bool wsa;		// the connection called WSAStartup()
+#else
+    int  fd;
+#endif
+    bool stream;	// TCP
+    int  timeout;	// milliseconds
+};
+
+/* one datagram of netw_sendBatch() or netw_recvBatch() */
+struct netw_datagram {
+    uint8_t* buffer;
+    int length;   // bytes to send, or bytes received
+    int size;     // size of buffer when receiving
+};
+
+/*
+ * a network backend: the sockets of netw.c or netw_win32.c (netw_sockets), or one of your own given to
+ * tnfs_setTransport(). recv() and recvBatch() return NETW_ERR_TIMEOUT when nothing arrived within the timeout
+ */
+struct netw_transport {
+    int  (*connect)(char* host, int port, bool useTCP);
+    void (*disconnect)();
+    int  (*send)(const uint8_t* buffer, int length);
+    int  (*recv)(uint8_t* buffer, int buffer_size);
+    int  (*sendBatch)(struct netw_datagram* d, int count);
+    int  (*recvBatch)(struct netw_datagram* d, int count);
+    void (*setTimeout)(int t);
+};
+
+/* the sockets backend */
+extern const struct netw_transport netw_sockets;
+
 /* function prototypes */
 void setTimeoutTime(int t);
-void netw_send(const uint8_t* buffer, int length);
+int  netw_send(const uint8_t* buffer, int length);
 int  netw_recv(uint8_t* buffer, int buffer_size);
+int  netw_sendBatch(struct netw_datagram* d, int count);
+int  netw_recvBatch(struct netw_datagram* d, int count);
+bool netw_setBusyPoll(int budget, int core);
 bool netw_isValidIpAddress(char* ipAddress);
 bool netw_getIpAddress(char* ip, char* hostname);
-void netw_connect(char* host, int port, bool useTCP);
+void netw_setProbe(const uint8_t* buffer, int length);
+const char* netw_getCachedAddress(int* port, bool* useTCP, struct netw_address* a);
+void netw_setCachedAddress(const char* host, int port, bool useTCP, struct netw_address* a);
+int  netw_connect(char* host, int port, bool useTCP);
+uint32_t netw_millis();
+uint32_t netw_micros();
 void netw_disconnect();
+void netw_saveState(struct netw_state* s);
+void netw_loadState(const struct netw_state* s);
 
 #endif /* __netw_h__ */
@@ -14,11 +14,16 @@
 extern "C" {
 #endif
 
+/* buffer sizes, limits and optional parts are set by the footprint profile, see tnfs_config.h */
 #define TNFS_PORT 16384		// port 16384 is the standard port for the tnfs protocol
-#define TNFS_MAX_PATH_LEN 256	// maximum length of a complete file path
-#define TNFS_BUFFERSIZE 16384	// 16 kibibytes buffer to send and receive tnfs data
+#define TNFS_BLOCKSIZE 512	// default amount of data in one READ or WRITE request
+#define TNFS_HEADER_SIZE 8	// largest header in front of the data of a READ response or a WRITE request
 #define TNFS_SEND_RETRIES 5	// repeat sending commands up to x times before giving up
 #define TNFS_NET_TIMEOUT_MS 2000// timeout in microseconds if the server doesn't respond.
+#define TNFS_MIN_TIMEOUT_MS 100	// the timeout tuned from the round trip time never gets shorter than this
+#define TNFS_RECOVER_ATTEMPTS 3	// remount and replay a request up to x times when the session was lost
+#define TNFS_RECOVER_REQUEST_LEN (8 + TNFS_MAX_PATH_LEN + 2 * TNFS_MAX_CRED_LEN)	// longest request of a recovery, a MOUNT or an OPEN
+#define TNFS_KEEPALIVE_MS 60000	// idle time after which tnfs_keepalive() sends a request, well below the session timeout of servers
 
 #define TNFS_DIRENTRY_DIR       0x01
 #define TNFS_DIRENTRY_HIDDEN    0x02
@@ -33,6 +38,11 @@ struct dirx_data {
     uint16_t dirpos; 	// Position of first entry as given by TELLDIR
     uint16_t needle;	// points somewhere in tnfs_buffer to remember the starting point of current directory entry that we are reading with dirx_next()
     uint16_t entry;	// current directory entry
+    char*    batch;	// prefetch mode: buffer with the current entries, see tnfs_prefetchdirx()
+    char*    spare;	// prefetch mode: buffer that receives the READDIRX response sent ahead
+    uint16_t batchsize;	// prefetch mode: size of both buffers, zero when the entries are read from tnfs_buffer
+    int16_t  fetched;	// prefetch mode: length of the response in spare, zero while on its way, negative on an error
+    bool     ahead;	// prefetch mode: a READDIRX was sent ahead
 };
 
 /* structure that holds information about one file or directory */
@@ -53,8 +63,8 @@ struct fstat {
     uint32_t atime;     // 4 bytes: Access time in seconds since the epoch, little endian
     uint32_t mtime;     // 4 bytes: Modification time (as above)
     uint32_t ctime;     // 4 bytes: Time of last status change (as above)
-    char uidstring[32]; // 0 or more bytes: Null terminated user id string
-    char gidstring[32]; // 0 or more bytes: Null terminated group id string
+    char uidstring[TNFS_STAT_NAME_LEN]; // 0 or more bytes: Null terminated user id string
+    char gidstring[TNFS_STAT_NAME_LEN]; // 0 or more bytes: Null terminated group id string
 };
 
 /* response codes from the TNFS server */
@@ -122,22 +132,61 @@ struct fstat {
 #define TNFS_SEEK_CUR	0x01	// Go to a relative offset from the current position
 #define TNFS_SEEK_END	0x02	// Seek to EOF
 
+/* states of the session, see tnfs_getSession() */
+#define TNFS_SESSION_NONE	0x00	// not mounted
+#define TNFS_SESSION_LAZY	0x01	// tnfs_lazyMount() was called, connect and mount wait for the first request
+#define TNFS_SESSION_MOUNTED	0x02	// mounted, the server answered the last request
+#define TNFS_SESSION_OFFLINE	0x03	// mounted, the last request got no response and the next one tries to recover
+
+/* details of the session as given by tnfs_getSession() */
+struct tnfs_session {
+    uint8_t  state;		// TNFS_SESSION_*
+    uint16_t id;		// session id given by the server, zero while not mounted
+    uint32_t idle;		// milliseconds since the last response of the server
+    uint32_t keepalives;	// requests sent by tnfs_keepalive()
+    uint32_t recoveries;	// times the session was lost and mounted again
+};
+
+/* a connection and mount of its own, the library works on the current one (see tnfs_context_switch()) */
+struct tnfs_context;
+
 /* private functions (do not use them) */
 int  tnfs_sendReceive(int length);
 void tnfs_prepareCommand(uint8_t cmd);
 int  tnfs_readdirx(struct dirx_data* data);
+void tnfs_setProbe();
+int  tnfs_recover(bool reconnect);
+int  tnfs_wake();
+bool tnfs_getTiming(uint16_t* srtt, uint16_t* rttvar, uint16_t* retry_time);
+void tnfs_setTiming(uint16_t srtt, uint16_t rttvar, uint16_t retry_time);
+void tnfs_getServer(const char** host, uint16_t* port, const char** dir);
+int  tnfs_tell(uint8_t handle, uint32_t* position);
+const char* tnfs_getPath(uint8_t handle);
+bool tnfs_isFileCommand(uint8_t cmd);
+bool tnfs_isDirCommand(uint8_t cmd);
 
 /* public functions */
 char* tnfs_get_buffer();
-void tnfs_connect(char* host, bool useTCP);
+int  tnfs_connect(char* host, bool useTCP);
 void tnfs_disconnect();
+void tnfs_setTransport(const struct netw_transport* transport);
+struct tnfs_context* tnfs_context_create();
+struct tnfs_context* tnfs_context_createPool(uint16_t requests, uint16_t bufsize);
+struct tnfs_context* tnfs_context_current();
+void tnfs_context_switch(struct tnfs_context* context);
+void tnfs_context_free(struct tnfs_context* context);
 int  tnfs_mount(const char* dir, const char* username, const char* password);
 int  tnfs_umount();
+int  tnfs_lazyMount(char* host, bool useTCP, const char* dir, const char* username, const char* password);
+void tnfs_setKeepalive(uint32_t interval);
+int  tnfs_keepalive();
+uint8_t tnfs_getSession(struct tnfs_session* session);
 int  tnfs_opendir(const char* dir);
 int  tnfs_readdir(char handle, char* dest);
 int  tnfs_opendirx(char* dir, char* pattern, uint8_t diropts, uint8_t sortopts, struct dirx_data* data);
 int  tnfs_closedir(char handle);
 int  tnfs_nextdirx(struct dirx_data* data, struct dirx_item* xitem);
+int  tnfs_prefetchdirx(struct dirx_data* data, char* buffers, uint16_t size);
 int  tnfs_telldir(char handle, uint32_t* position);
 int  tnfs_seekdir(char handle, uint32_t position);
 int  tnfs_mkdir(char* dir);
@@ -153,6 +202,7 @@ int  tnfs_chmod(uint16_t mode, char* filename);
 int  tnfs_rename(char* source, char* destination);
 int  tnfs_size(uint32_t* kb);
 int  tnfs_free(uint32_t* kb);
+bool tnfs_isOnline();
 const char* tnfs_error_string(int error);
 
 #ifdef __cplusplus
@@ -0,0 +1,56 @@
+#ifndef __tnfs_block_h__
+#define __tnfs_block_h__
+
+#include "tnfs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TNFS_BLOCK_SECTOR 512		// bytes in one sector of a disk image
+#define TNFS_BLOCK_CACHE 64		// sectors in the cache of each block device
+#define TNFS_BLOCK_FIT ((TNFS_BUFFERSIZE - 7) / TNFS_BLOCK_SECTOR)	// sectors that fit in one WRITE request
+#define TNFS_BLOCK_RUN (TNFS_BLOCK_FIT < 1 ? 1 : TNFS_BLOCK_FIT > 8 ? 8 : TNFS_BLOCK_FIT)	// most sectors in one READ or WRITE request
+#define TNFS_BLOCK_READAHEAD 8		// sectors read ahead when the sectors are read one after the other
+#define TNFS_MAX_BLOCKDEVS 2		// maximum number of block devices that can be open at the same time
+
+/* flags of a cache line */
+#define TNFS_BLOCK_VALID 0x01	// the line holds a sector
+#define TNFS_BLOCK_DIRTY 0x02	// the sector was changed and has not been written to the server yet
+
+/* one sector in the cache */
+struct tnfs_block_line {
+    uint32_t sector;	// sector number in the image
+    uint32_t used;	// value of the clock of the device when the line was last used
+    uint8_t  flags;	// TNFS_BLOCK_VALID, TNFS_BLOCK_DIRTY
+};
+
+/* a disk image opened with tnfs_block_open(), addressed in sectors of TNFS_BLOCK_SECTOR bytes */
+struct tnfs_blockdev {
+    int16_t  handle;		// file handle as returned by tnfs_open(), -1 for a free device
+    bool     readonly;		// opened without write access
+    uint32_t sectors;		// size of the image in sectors, for a read-only device including a partial last sector
+    uint32_t size;		// size of the image in bytes at open
+    uint32_t position;		// offset of the file on the server, saves an LSEEK when the access is sequential
+    uint32_t next;		// sector after the last read, a read that starts there triggers read-ahead
+    uint32_t clock;		// counts cache accesses, for least recently used replacement
+    uint16_t dirty;		// dirty lines in the cache
+    uint32_t hits;		// sectors read from the cache
+    uint32_t misses;		// sectors read from the server
+    uint32_t requests;		// READ and WRITE requests sent to the server
+    struct tnfs_block_line lines[TNFS_BLOCK_CACHE];
+    char     data[TNFS_BLOCK_CACHE][TNFS_BLOCK_SECTOR];
+};
+
+/* public functions */
+struct tnfs_blockdev* tnfs_block_open(char* filename, bool readonly);
+int  tnfs_block_close(struct tnfs_blockdev* b);
+int  tnfs_block_read(struct tnfs_blockdev* b, uint32_t sector, uint16_t count, char* data);
+int  tnfs_block_write(struct tnfs_blockdev* b, uint32_t sector, uint16_t count, const char* data);
+int  tnfs_block_flush(struct tnfs_blockdev* b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __tnfs_block_h__ */
@@ -0,0 +1,50 @@
+#ifndef __tnfs_checksum_h__
+#define __tnfs_checksum_h__
+
+#include "tnfs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* algorithms for tnfs_checksum_start(), they can be combined */
+#define TNFS_CHECKSUM_CRC32C 0x01	// CRC-32C (Castagnoli), with the CRC instructions of SSE4.2 or ARMv8 when available
+#define TNFS_CHECKSUM_XXH64  0x02	// xxHash64 with seed 0
+
+/* digest of the data read from or written to one file handle */
+struct tnfs_checksum {
+    uint8_t  algorithms;	// TNFS_CHECKSUM_CRC32C and/or TNFS_CHECKSUM_XXH64, zero when not started
+    bool     active;		// false once the file was closed
+    bool     sequential;	// false when a seek made the data skip or repeat a part of the file
+    uint32_t position;		// file offset where the next data should start
+    char     name[TNFS_MAX_PATH_LEN];	// file name without its directories, to find it in a checksum file
+    uint32_t crc;		// CRC-32C of the data so far
+    uint64_t acc[4];		// xxHash64 accumulators
+    uint64_t total;		// xxHash64 bytes so far
+    uint8_t  buffered;		// xxHash64 bytes waiting in stripe until there are 32
+    uint8_t  stripe[32];
+};
+
+#if TNFS_USE_METRICS
+extern bool tnfs_checksum_used;
+extern int  tnfs_crc32c_hardware;
+#else
+#define tnfs_checksum_used false	// the hooks in tnfs.c compile to nothing
+#endif
+
+/* private functions (do not use them) */
+void tnfs_checksum_update(uint8_t handle, uint32_t position, const char* data, uint16_t length);
+void tnfs_checksum_close(uint8_t handle);
+
+/* public functions */
+int  tnfs_checksum_start(uint8_t handle, uint8_t algorithms);
+int  tnfs_checksum_result(uint8_t handle, uint32_t* crc32c, uint64_t* xxh64);
+int  tnfs_checksum_verify(uint8_t handle, char* sidecar);
+uint32_t tnfs_crc32c(uint32_t crc, const void* data, size_t length);
+uint64_t tnfs_xxh64(const void* data, size_t length, uint64_t seed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __tnfs_checksum_h__ */
@@ -0,0 +1,94 @@
+#ifndef __tnfs_config_h__
+#define __tnfs_config_h__
+
+/*
+ * Footprint profiles, chosen at compile time:
+ *
+ *   -DTNFS_PROFILE_TINY    8/16-bit machines and bridges with a few tens of KiB of RAM: small buffers, few handles and
+ *                          only the core (tnfs.c and a netw backend), without caches, pipelining or metrics
+ *   (nothing)              the default for desktop systems, every module
+ *   -DTNFS_PROFILE_SERVER  hosts that keep many files open and run long bursts, like a mirror or a gateway
+ *
+ * Each value below can also be set on its own with -D, that value wins over the profile. build.sh and build.bat take
+ * the profile name as argument and "sizes" reports the .text, .data and .bss of the library for each profile.
+ */
+
+#if defined(TNFS_PROFILE_TINY)
+#define TNFS_PROFILE_NAME          "tiny"
+#define TNFS_PROFILE_BUFFERSIZE    1024	// a READ of TNFS_BLOCKSIZE or a few directory entries
+#define TNFS_PROFILE_MAX_PATH_LEN  128
+#define TNFS_PROFILE_MAX_HANDLES   4
+#define TNFS_PROFILE_MAX_HOST_LEN  32
+#define TNFS_PROFILE_MAX_CRED_LEN  16
+#define TNFS_PROFILE_STAT_NAME_LEN 8
+#define TNFS_PROFILE_DIRX_BATCH    6	// 10 + (13 + 128) * 6 bytes fit in the buffer
+#define TNFS_PROFILE_MAX_BATCH     1
+#define TNFS_PROFILE_FEATURES      0
+#elif defined(TNFS_PROFILE_SERVER)
+#define TNFS_PROFILE_NAME          "server"
+#define TNFS_PROFILE_BUFFERSIZE    16384
+#define TNFS_PROFILE_MAX_PATH_LEN  1024
+#define TNFS_PROFILE_MAX_HANDLES   64
+#define TNFS_PROFILE_MAX_HOST_LEN  256
+#define TNFS_PROFILE_MAX_CRED_LEN  64
+#define TNFS_PROFILE_STAT_NAME_LEN 32
+#define TNFS_PROFILE_DIRX_BATCH    58
+#define TNFS_PROFILE_MAX_BATCH     32
+#define TNFS_PROFILE_FEATURES      1
+#else
+#define TNFS_PROFILE_NAME          "default"
+#define TNFS_PROFILE_BUFFERSIZE    16384
+#define TNFS_PROFILE_MAX_PATH_LEN  256
+#define TNFS_PROFILE_MAX_HANDLES   16
+#define TNFS_PROFILE_MAX_HOST_LEN  64
+#define TNFS_PROFILE_MAX_CRED_LEN  32
+#define TNFS_PROFILE_STAT_NAME_LEN 32
+#define TNFS_PROFILE_DIRX_BATCH    58	// 10 + (13 + 256) * 58 bytes fit in the buffer
+#define TNFS_PROFILE_MAX_BATCH     8
+#define TNFS_PROFILE_FEATURES      1
+#endif
+
+/* sizes */
+#ifndef TNFS_BUFFERSIZE
+#define TNFS_BUFFERSIZE TNFS_PROFILE_BUFFERSIZE		// buffer to send and receive tnfs data
+#endif
+#ifndef TNFS_MAX_PATH_LEN
+#define TNFS_MAX_PATH_LEN TNFS_PROFILE_MAX_PATH_LEN	// maximum length of a complete file path
+#endif
+#ifndef TNFS_MAX_HANDLES
+#define TNFS_MAX_HANDLES TNFS_PROFILE_MAX_HANDLES	// maximum number of files and directories that can be open at the same time
+#endif
+#ifndef TNFS_MAX_HOST_LEN
+#define TNFS_MAX_HOST_LEN TNFS_PROFILE_MAX_HOST_LEN	// maximum length of the server hostname remembered by tnfs_connect()
+#endif
+#ifndef TNFS_MAX_CRED_LEN
+#define TNFS_MAX_CRED_LEN TNFS_PROFILE_MAX_CRED_LEN	// maximum length of the username and password remembered by tnfs_mount()
+#endif
+#ifndef TNFS_STAT_NAME_LEN
+#define TNFS_STAT_NAME_LEN TNFS_PROFILE_STAT_NAME_LEN	// room for the user and group names in struct fstat, longer names are cut
+#endif
+#ifndef TNFS_DIRX_BATCH
+#define TNFS_DIRX_BATCH TNFS_PROFILE_DIRX_BATCH		// most entries asked for with one READDIRX, their names must fit in TNFS_BUFFERSIZE
+#endif
+#ifndef NETW_MAX_BATCH
+#define NETW_MAX_BATCH TNFS_PROFILE_MAX_BATCH		// maximum number of datagrams sent or received with one call of the batch functions
+#endif
+
+/* optional parts of tnfs.c, the modules that need them are left out of the build without them */
+#ifndef TNFS_USE_WARM
+#define TNFS_USE_WARM TNFS_PROFILE_FEATURES		// listings recorded for the warm-start cache, tnfs_warm.c
+#endif
+#ifndef TNFS_USE_JOURNAL
+#define TNFS_USE_JOURNAL TNFS_PROFILE_FEATURES		// offline journal, tnfs_journal.c
+#endif
+#ifndef TNFS_USE_PIPELINE
+#define TNFS_USE_PIPELINE TNFS_PROFILE_FEATURES	// bursts of requests (tnfs_batch(), tnfs_readv(), ...), tnfs_pool.c and its users
+#endif
+#ifndef TNFS_USE_CONTEXTS
+#define TNFS_USE_CONTEXTS TNFS_PROFILE_FEATURES	// more than one connection and mount (tnfs_context_switch()), tnfs_relay.c
+#endif
+#ifndef TNFS_USE_METRICS
+#define TNFS_USE_METRICS TNFS_PROFILE_FEATURES		// checksums, wire traces and the timeline, tnfs_checksum.c, tnfs_trace.c and tnfs_timeline.c
+#endif
+
+#endif /* __tnfs_config_h__ */
@@ -0,0 +1,31 @@
+#ifndef __tnfs_find_h__
+#define __tnfs_find_h__
+
+#include "tnfs_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TNFS_FIND_PARALLEL 4	// directories opened with one burst of OPENDIRX requests
+
+/* outcome of tnfs_find() */
+struct tnfs_find_result {
+    uint32_t matches;	// files that matched the pattern
+    uint32_t dirs;	// directories searched
+    uint32_t entries;	// directory entries sent by the server: the matches and all subdirectories
+    uint32_t bytes;	// bytes of READDIRX responses sent by the server
+    uint32_t failed;	// directories that could not be searched
+};
+
+/* called by tnfs_find() for every match with its complete path, return false to stop the search */
+typedef bool (*tnfs_find_callback)(const char* path, struct dirx_item* item, void* user);
+
+/* public functions */
+int tnfs_find(char* root, char* pattern, uint8_t diropts, tnfs_find_callback found, void* user, struct tnfs_find_result* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __tnfs_find_h__ */
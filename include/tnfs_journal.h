@@ -0,0 +1,71 @@
+#ifndef __tnfs_journal_h__
+#define __tnfs_journal_h__
+
+#include "tnfs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TNFS_JOURNAL_MERGE TNFS_BLOCKSIZE	// small consecutive writes are merged into one entry up to this size
+#define TNFS_JOURNAL_PROBE_MS 5000		// while offline, try to reach the server again after this many milliseconds
+#define TNFS_JOURNAL_STAT_MS 1000		// an online write asks the modification time at most once in this many milliseconds
+#define TNFS_JOURNAL_CHECKED 64			// files whose modification time is compared during one replay
+#define TNFS_JOURNAL_APPEND 0xFFFFFFFF		// offset of a write to a file opened with TNFS_O_APPEND
+#define TNFS_JOURNAL_COPIES 16			// files with a copy in the overlay, see tnfs_journal_seed()
+#define TNFS_JOURNAL_EXTENTS 16			// ranges of a file that its overlay copy holds, the smallest is dropped beyond this
+#define TNFS_JOURNAL_UNKNOWN 0xFFFFFFFF		// size of a file that the overlay copy doesn't know
+
+/* operations in the journal */
+#define TNFS_JOURNAL_OPEN	0x01	// open (create or truncate) a file
+#define TNFS_JOURNAL_WRITE	0x02	// write data at an offset
+#define TNFS_JOURNAL_MKDIR	0x03
+#define TNFS_JOURNAL_RMDIR	0x04
+#define TNFS_JOURNAL_UNLINK	0x05
+#define TNFS_JOURNAL_RENAME	0x06
+
+/* one mutation in the journal, followed by length bytes of data on disk */
+struct tnfs_journal_entry {
+    uint8_t  op;			// TNFS_JOURNAL_*
+    uint16_t flags;			// open() flags of TNFS_JOURNAL_OPEN
+    uint16_t mode;			// open() mode of TNFS_JOURNAL_OPEN, seconds after mtime of our own online writes for TNFS_JOURNAL_WRITE
+    uint16_t length;			// amount of data of TNFS_JOURNAL_WRITE
+    uint32_t offset;			// file offset of TNFS_JOURNAL_WRITE or TNFS_JOURNAL_APPEND
+    uint32_t mtime;			// modification time of the file as we left it online, zero when unknown
+    char     path[TNFS_MAX_PATH_LEN];	// file or directory
+    char     path2[TNFS_MAX_PATH_LEN];	// destination of TNFS_JOURNAL_RENAME
+};
+
+/* outcome of tnfs_journal_replay() */
+struct tnfs_journal_result {
+    uint32_t applied;	// entries applied to the server
+    uint32_t conflicts;	// entries moved to the conflicts file because the server copy changed meanwhile
+    uint32_t failed;	// entries moved to the conflicts file because the server refused them
+    uint32_t remaining;	// entries still in the journal because the server went away again
+};
+
+/* private functions (do not use them) */
+bool tnfs_journal_active();
+bool tnfs_journal_due();
+int  tnfs_journal_add(struct tnfs_journal_entry* e, const char* data);
+int  tnfs_journal_read(const char* path, uint32_t offset, char* data, uint16_t maxlen);
+void tnfs_journal_seed(const char* path, uint32_t size);
+void tnfs_journal_mirror(const char* path, uint32_t offset, const char* data, uint16_t length);
+void tnfs_journal_release(const char* path);
+int  tnfs_journal_flush();
+
+/* public functions */
+int  tnfs_journal_open(const char* journal, const char* overlay);
+int  tnfs_journal_replay(struct tnfs_journal_result* result);
+uint32_t tnfs_journal_pending();
+void tnfs_journal_close();
+
+#if !TNFS_USE_JOURNAL
+#define tnfs_journal_active() false	// the client never goes offline, tnfs_journal.c is not built
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __tnfs_journal_h__ */
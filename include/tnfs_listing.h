@@ -0,0 +1,45 @@
+#ifndef __tnfs_listing_h__
+#define __tnfs_listing_h__
+
+#include "tnfs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* one directory entry in a listing */
+struct tnfs_listing_entry {
+    uint32_t name;	// offset of the name in the names of the listing
+    uint32_t size;
+    uint32_t modified;
+    uint32_t created;
+    uint8_t  flags;	// TNFS_DIRENTRY_DIR, TNFS_DIRENTRY_HIDDEN, TNFS_DIRENTRY_SPECIAL
+};
+
+/* a directory read once with tnfs_listing_load(), it can be sorted and filtered again without the server */
+struct tnfs_listing {
+    struct tnfs_listing_entry* entries;	// in the order the server sent them
+    uint32_t count;
+    uint32_t capacity;
+    char*    names;			// all names, each with a terminating zero
+    uint32_t used;
+    uint32_t room;
+    uint32_t* order;			// entries in the order of the last tnfs_listing_sort(), only the visible ones
+    uint32_t visible;			// entries in order
+};
+
+/* private functions (do not use them) */
+bool tnfs_listing_add(struct tnfs_listing* l, struct dirx_item* item);
+
+/* public functions */
+int  tnfs_listing_load(struct tnfs_listing* l, char* path, uint8_t diropts);
+int  tnfs_listing_sort(struct tnfs_listing* l, const char* pattern, uint8_t diropts, uint8_t sortopts);
+bool tnfs_listing_item(struct tnfs_listing* l, uint32_t i, struct dirx_item* item);
+bool tnfs_listing_match(const char* name, const char* pattern, bool caseSensitive);
+void tnfs_listing_free(struct tnfs_listing* l);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __tnfs_listing_h__ */
@@ -0,0 +1,49 @@
+#ifndef __tnfs_memserver_h__
+#define __tnfs_memserver_h__
+
+#include "tnfs.h"
+#include "tnfs_listing.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TNFS_MEMSERVER_HANDLES 32	// open files, and separately open directories, of the stand-in server
+#define TNFS_MEMSERVER_QUEUE (NETW_MAX_BATCH + 1)	// responses waiting to be received: a burst and a READDIRX sent ahead
+#define TNFS_MEMSERVER_BUCKETS 4096	// hash buckets to find a name in a directory
+#define TNFS_MEMSERVER_SESSION 0x5A5A	// first session id handed out by MOUNT
+
+/* a file or directory of the stand-in server */
+struct tnfs_memserver_node {
+    char*    name;		// NULL when the node is free
+    int32_t  parent;		// directory, -1 for the root
+    int32_t  child;		// first entry of a directory, -1 when empty
+    int32_t  next;		// next entry in the same directory, -1 at the end
+    int32_t  previous;		// previous entry in the same directory, -1 at the start
+    int32_t  bucket;		// next node in the same hash bucket, -1 at the end
+    bool     isDir;
+    bool     detached;		// unlinked while a handle still had it open
+    uint8_t  opened;		// file handles that refer to the node
+    uint16_t mode;		// permissions
+    uint32_t mtime;
+    uint32_t ctime;
+    uint8_t* data;		// contents of a file
+    uint32_t size;
+    uint32_t room;		// allocated size of data
+};
+
+/* the memory transport, give it to tnfs_setTransport() before tnfs_connect() */
+extern const struct netw_transport tnfs_memserver_transport;
+
+/* private functions (do not use them) */
+int  tnfs_memserver_handle(const uint8_t* req, int length, uint8_t* out);
+
+/* public functions */
+void tnfs_memserver_reset();
+int  tnfs_memserver_put(const char* path, const void* data, uint32_t size, uint32_t mtime);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __tnfs_memserver_h__ */
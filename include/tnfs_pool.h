@@ -0,0 +1,78 @@
+#ifndef __tnfs_pool_h__
+#define __tnfs_pool_h__
+
+#include "tnfs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TNFS_POOL_REQUESTS NETW_MAX_BATCH			// request descriptors in the default pool, one for each request of a full burst
+#define TNFS_BATCH_SLICE 1024					// receive space for each response of tnfs_batch(), larger responses fail with -TNFS_ENOBUFS
+#define TNFS_POOL_BUFSIZE TNFS_BATCH_SLICE			// size of the buffer that comes with each descriptor in the default pool
+
+/* states of a request descriptor */
+#define TNFS_REQ_FREE	0x00	// in the free list of the pool
+#define TNFS_REQ_READY	0x01	// taken from the pool, the request is being built
+#define TNFS_REQ_SENT	0x02	// sent to the server, waiting for the response
+#define TNFS_REQ_DONE	0x03	// the response is in the buffer
+
+/* state of one in-flight request */
+struct tnfs_request {
+    struct tnfs_request* next;	// next descriptor in the free list or in a queue
+    uint8_t* buffer;		// request and, once it arrived, response
+    void*    user;		// owner of the request
+    uint32_t sent;		// netw_millis() of the last time the request was sent
+    uint32_t queued;		// netw_micros() when the request was queued by the scheduler, only while the timeline runs
+    uint16_t length;		// length of the request or the response in buffer
+    int16_t  status;		// zero or the negative TNFS error code of the response
+    uint8_t  id;		// request id (sequence number) as sent to the server
+    uint8_t  cmd;		// TNFS command
+    uint8_t  state;		// TNFS_REQ_FREE, TNFS_REQ_READY, TNFS_REQ_SENT or TNFS_REQ_DONE
+    uint8_t  retries;		// amount of times the request was sent again
+};
+
+/* fixed-size pool of request descriptors with one buffer each, never allocates from the heap */
+struct tnfs_pool {
+    struct tnfs_request* free;	// free list
+    struct tnfs_request* requests; // all descriptors
+    uint8_t* buffers;		// count * bufsize bytes, one buffer for each descriptor
+    uint16_t count;		// amount of descriptors
+    uint16_t bufsize;		// size of each buffer
+    uint16_t used;		// descriptors taken from the pool right now
+    uint16_t peak;		// highest value of used since the pool was initialized
+    uint32_t gets;		// successful tnfs_pool_get() calls
+    uint32_t misses;		// tnfs_pool_get() calls that found the pool empty
+};
+
+/* the pool used by the pipelined functions of the library, and the pool of the current context when it has one */
+extern struct tnfs_pool tnfs_default_pool;
+extern struct tnfs_pool* tnfs_current_pool;
+
+/* private functions (do not use them) */
+void tnfs_prepareRequest(struct tnfs_request* req, uint8_t cmd);
+int  tnfs_sendBatch(struct tnfs_request** reqs, int count);
+int  tnfs_waitBatch(struct tnfs_pool* pool, struct tnfs_request** reqs, int count);
+
+/* public functions */
+void tnfs_pool_init(struct tnfs_pool* pool, struct tnfs_request* requests, uint8_t* buffers, uint16_t count, uint16_t bufsize);
+struct tnfs_pool* tnfs_pool_create(uint16_t count, uint16_t bufsize);
+struct tnfs_request* tnfs_pool_get(struct tnfs_pool* pool);
+void tnfs_pool_put(struct tnfs_pool* pool, struct tnfs_request* req);
+struct tnfs_pool* tnfs_pool_default();
+int  tnfs_batch(struct tnfs_pool* pool, struct tnfs_request** reqs, int count);
+int  tnfs_statv(char** filenames, struct fstat* st, int* results, int count);
+int  tnfs_readv(uint8_t* handles, char** data, uint16_t maxlen, int* results, int count);
+int  tnfs_opendirxv(char** paths, char* pattern, uint8_t diropts, uint8_t sortopts, struct dirx_data* data, int* results, int count);
+int  tnfs_prepareRead(struct tnfs_request* req, uint8_t handle, uint16_t maxlen);
+int  tnfs_takeRead(struct tnfs_request* req, uint8_t handle, char* data);
+int  tnfs_prepareWrite(struct tnfs_request* req, uint8_t handle, const char* data, uint16_t length, uint16_t bufsize);
+int  tnfs_takeWrite(struct tnfs_request* req, uint8_t handle, const char* data);
+int  tnfs_prepareStat(struct tnfs_request* req, const char* filename, uint16_t bufsize);
+int  tnfs_takeStat(struct tnfs_request* req, struct fstat* st);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __tnfs_pool_h__ */
@@ -0,0 +1,33 @@
+#ifndef __tnfs_preload_h__
+#define __tnfs_preload_h__
+
+#include "tnfs.h"
+#include "tnfs_block.h"
+#include "tnfs_listing.h"
+#include "tnfs_warm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* environment of the process that loads the shim */
+#define TNFS_PRELOAD_ENV_HOST   "TNFS_PRELOAD_HOST"	// server, without it the shim passes everything on
+#define TNFS_PRELOAD_ENV_PREFIX "TNFS_PRELOAD_PREFIX"	// local path the mount appears under, TNFS_PRELOAD_PREFIX by default
+#define TNFS_PRELOAD_ENV_MOUNT  "TNFS_PRELOAD_MOUNT"	// directory on the server to mount, "/" by default
+#define TNFS_PRELOAD_ENV_TCP    "TNFS_PRELOAD_TCP"	// "1" for TCP instead of UDP
+#define TNFS_PRELOAD_ENV_WARM   "TNFS_PRELOAD_WARM"	// warm-start cache file shared by the processes, see tnfs_warm_open()
+#define TNFS_PRELOAD_ENV_FDS    "TNFS_PRELOAD_FDS"	// set by the shim for a program it starts: the descriptors that program inherits
+
+#define TNFS_PRELOAD_PREFIX "/tnfs"		// default local path of the mount
+#define TNFS_PRELOAD_FILES 32			// files and directories open at the same time
+#define TNFS_PRELOAD_DESCS 64			// descriptors of those, with the ones made by dup()
+#define TNFS_PRELOAD_LISTINGS 8			// directory listings kept to answer stat() without a request
+#define TNFS_PRELOAD_STREAMS 8			// directory streams (opendir()) open at the same time
+#define TNFS_PRELOAD_TTL_MS 2000		// age after which a kept listing is read again
+#define TNFS_PRELOAD_SECTORS 16			// sectors copied from a block device at a time
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __tnfs_preload_h__ */
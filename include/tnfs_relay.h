@@ -0,0 +1,32 @@
+#ifndef __tnfs_relay_h__
+#define __tnfs_relay_h__
+
+#include "tnfs_pool.h"
+#include "tnfs_listing.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TNFS_RELAY_LANES NETW_MAX_BATCH		// reads, and writes, in flight at the same time
+#define TNFS_RELAY_CHUNK TNFS_BLOCKSIZE		// data moved by one READ and one WRITE
+#define TNFS_RELAY_SEGMENT (64 * 1024)		// least size of a segment, a larger file is copied through more lanes at once
+#define TNFS_RELAY_MODE 0644			// permissions of the files created on the destination
+
+/* outcome of tnfs_relay_copy() and tnfs_relay_tree() */
+struct tnfs_relay_result {
+    uint32_t files;		// files copied
+    uint32_t dirs;		// directories created or already there
+    uint32_t failed;		// files and directories that could not be copied
+    uint64_t bytes;		// bytes written to the destination
+};
+
+/* public functions */
+int tnfs_relay_copy(struct tnfs_context* src, const char* from, struct tnfs_context* dst, const char* to, struct tnfs_relay_result* result);
+int tnfs_relay_tree(struct tnfs_context* src, const char* from, struct tnfs_context* dst, const char* to, struct tnfs_relay_result* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __tnfs_relay_h__ */
@@ -0,0 +1,39 @@
+#ifndef __tnfs_sched_h__
+#define __tnfs_sched_h__
+
+#include "tnfs_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TNFS_SCHED_SLOTS NETW_MAX_BATCH	// requests in flight during one round of tnfs_sched_run()
+#define TNFS_SCHED_METADATA 64		// cost in bytes of a request without data, like STAT or READDIRX
+
+/* priority classes, a lower number has a higher default weight */
+#define TNFS_SCHED_INTERACTIVE	0	// metadata a user is waiting for: stat, listings
+#define TNFS_SCHED_FOREGROUND	1	// reads a user is waiting for
+#define TNFS_SCHED_BULK		2	// background copies
+#define TNFS_SCHED_CLASSES	3
+#define TNFS_SCHED_SERVER	0xFF	// tnfs_sched_limit(): the limit of all classes together
+
+/* called by tnfs_sched_run() for every request that completed or failed, req->user tells which job it belongs to */
+typedef void (*tnfs_sched_done)(struct tnfs_request* req);
+
+#if TNFS_USE_PIPELINE
+extern uint32_t (*tnfs_sched_clock)();
+#endif
+
+/* public functions */
+int  tnfs_sched_submit(struct tnfs_request* req, uint8_t cls);
+void tnfs_sched_weight(uint8_t cls, uint16_t weight);
+void tnfs_sched_limit(uint8_t cls, uint32_t rate, uint32_t burst);
+int  tnfs_sched_run(tnfs_sched_done done);
+uint32_t tnfs_sched_delay();
+uint16_t tnfs_sched_queued(uint8_t cls);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __tnfs_sched_h__ */
@@ -0,0 +1,46 @@
+#ifndef __tnfs_stream_h__
+#define __tnfs_stream_h__
+
+#include <stdarg.h>
+#include "tnfs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TNFS_MAX_STREAMS 4		// maximum number of streams that can be open at the same time
+#define TNFS_STREAM_BUFSIZE TNFS_BLOCKSIZE	// size of the read buffer and of the write buffer of each stream
+
+/* a file opened with tnfs_fopen(), buffers reads and writes into requests of TNFS_STREAM_BUFSIZE bytes */
+struct tnfs_stream {
+    int16_t  handle;		// file handle as returned by tnfs_open(), -1 for a free stream
+    bool     append;		// opened with "a", every write goes to the end of the file
+    bool     eof;		// the server returned end of file
+    bool     moved;		// an "a" stream was read or seeked away from the end, the next write seeks back to it
+    uint32_t position;		// offset in the file as seen by the caller
+    uint16_t rpos;		// next unread byte in rbuf
+    uint16_t rlen;		// bytes in rbuf
+    uint16_t wlen;		// bytes in wbuf that still have to be written
+    char     rbuf[TNFS_STREAM_BUFSIZE];
+    char     wbuf[TNFS_STREAM_BUFSIZE];
+};
+
+/* public functions */
+struct tnfs_stream* tnfs_fopen(char* filename, const char* mode);
+int   tnfs_fclose(struct tnfs_stream* s);
+int   tnfs_fflush(struct tnfs_stream* s);
+int   tnfs_fread(void* data, uint16_t size, struct tnfs_stream* s);
+int   tnfs_fwrite(const void* data, uint16_t size, struct tnfs_stream* s);
+int   tnfs_fgetc(struct tnfs_stream* s);
+char* tnfs_fgets(char* str, int size, struct tnfs_stream* s);
+int   tnfs_fputs(const char* str, struct tnfs_stream* s);
+int   tnfs_fprintf(struct tnfs_stream* s, const char* format, ...);
+int   tnfs_fseek(struct tnfs_stream* s, uint8_t seektype, int32_t offset);
+uint32_t tnfs_ftell(struct tnfs_stream* s);
+bool  tnfs_feof(struct tnfs_stream* s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __tnfs_stream_h__ */
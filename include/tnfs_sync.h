@@ -0,0 +1,34 @@
+#ifndef __tnfs_sync_h__
+#define __tnfs_sync_h__
+
+#include "tnfs_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TNFS_SYNC_PARALLEL NETW_MAX_BATCH	// files downloaded at the same time
+
+/* options for tnfs_sync() */
+#define TNFS_SYNC_TRUST_DIRS 0x01	// don't list a directory whose modification time is the same as in the manifest
+#define TNFS_SYNC_NO_DELETE  0x02	// keep local files and directories that are gone from the server
+
+/* outcome of tnfs_sync() */
+struct tnfs_sync_result {
+    uint32_t dirs;		// directories on the server
+    uint32_t listed;		// directories that were listed, the others were unchanged according to the manifest
+    uint32_t files;		// files on the server
+    uint32_t downloaded;	// files that were new or changed
+    uint32_t deleted;		// local files and directories that were removed
+    uint32_t failed;		// directories that could not be listed and files that could not be downloaded
+    uint64_t bytes;		// bytes downloaded
+};
+
+/* public functions */
+int tnfs_sync(const char* remote, const char* local, const char* manifest, uint8_t options, struct tnfs_sync_result* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __tnfs_sync_h__ */
@@ -0,0 +1,63 @@
+#ifndef __tnfs_timeline_h__
+#define __tnfs_timeline_h__
+
+#include "tnfs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* kinds of spans */
+#define TNFS_SPAN_REQUEST 0x00	// a whole request of the blocking path, from sending until the response is checked
+#define TNFS_SPAN_ENCODE  0x01	// building a request, from tnfs_prepareCommand() until it is sent
+#define TNFS_SPAN_DRAIN   0x02	// queued behind a READDIRX that was sent ahead, until its response is in
+#define TNFS_SPAN_SEND    0x03	// the first attempt to send a request or a burst
+#define TNFS_SPAN_RESEND  0x04	// an attempt to send again after a timeout
+#define TNFS_SPAN_WAIT    0x05	// waiting in netw_recv() or netw_recvBatch()
+#define TNFS_SPAN_RECOVER 0x06	// mounting again and reopening the handles after the session was lost
+#define TNFS_SPAN_DECODE  0x07	// parsing a response
+#define TNFS_SPAN_COPY    0x08	// copying the data of a READ response to the caller, including its checksums
+#define TNFS_SPAN_FLIGHT  0x09	// a request of a burst, from sending until its response was dispatched
+#define TNFS_SPAN_QUEUED  0x0A	// a request in a queue of the request scheduler
+#define TNFS_SPAN_BATCH   0x0B	// a whole burst of tnfs_batch()
+
+/* lanes, a thread in the viewer for each */
+#define TNFS_LANE_BLOCKING 0	// tnfs_sendReceive() and everything around it
+#define TNFS_LANE_PREFETCH 1	// READDIRX requests sent ahead by the prefetch mode of tnfs_nextdirx()
+#define TNFS_LANE_BATCH    2	// tnfs_batch() bursts
+#define TNFS_LANE_FLIGHT   3	// first of NETW_MAX_BATCH lanes with the requests of a burst
+#define TNFS_LANE_QUEUED   (TNFS_LANE_FLIGHT + NETW_MAX_BATCH)	// first of the lanes of the scheduler classes
+
+/* one finished span, times in microseconds of netw_micros() */
+struct tnfs_span {
+    uint32_t start;
+    uint32_t duration;
+    uint8_t  kind;	// TNFS_SPAN_*
+    uint8_t  lane;	// TNFS_LANE_*
+    uint8_t  seq;	// sequence number of the request
+    uint8_t  cmd;	// TNFS command, 0xFF for spans without a request like a whole burst
+    uint8_t  attempt;	// attempt of SEND, RESEND and WAIT, or requests in a burst
+};
+
+#if TNFS_USE_METRICS
+extern bool tnfs_timeline_used;
+#else
+#define tnfs_timeline_used false	// the hooks in tnfs.c compile to nothing
+#endif
+extern uint32_t tnfs_timeline_encode;
+
+/* private functions (do not use them) */
+void tnfs_timeline_span(uint8_t kind, uint8_t lane, uint32_t start, uint8_t seq, uint8_t cmd, uint8_t attempt);
+
+/* public functions */
+int  tnfs_timeline_start(uint32_t capacity);
+void tnfs_timeline_stop();
+int  tnfs_timeline_export(char* filename);
+uint32_t tnfs_timeline_dropped();
+void tnfs_timeline_free();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __tnfs_timeline_h__ */
@@ -0,0 +1,56 @@
+#ifndef __tnfs_trace_h__
+#define __tnfs_trace_h__
+
+#include "tnfs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TNFS_TRACE_MAGIC "TNFSTRC\x01"	// first 8 bytes of a trace file
+#define TNFS_TRACE_COMMANDS 0x40		// commands 0x00 to 0x3F get their own statistics in a replay
+#define TNFS_TRACE_KEPT 7			// bytes kept of READ responses and WRITE requests with TNFS_TRACE_NO_DATA
+
+/* options for tnfs_trace_start() */
+#define TNFS_TRACE_NO_DATA 0x01	// leave the file data out of READ responses and WRITE requests, only their lengths are kept
+
+/* kinds of records in a trace file */
+#define TNFS_TRACE_RECEIVED  0x01	// a datagram from the server, otherwise one sent to the server
+#define TNFS_TRACE_TRUNCATED 0x02	// only the first bytes of the datagram were stored, the original length follows
+
+/* one command in the outcome of tnfs_trace_replay(), times in microseconds */
+struct tnfs_trace_stat {
+    uint32_t count;	// requests replayed
+    uint64_t recorded;	// total time from request to response in the recording
+    uint64_t replayed;	// total time of the calls in the replay
+};
+
+/* outcome of tnfs_trace_replay() */
+struct tnfs_trace_result {
+    uint32_t replayed;		// requests replayed through the client functions
+    uint32_t skipped;		// retransmissions, mounts, unknown commands and requests for handles that failed to open
+    uint32_t differed;		// replayed requests with another status than in the recording
+    uint32_t recorded_ms;	// duration of the recording
+    uint32_t elapsed_ms;	// duration of the replay
+    struct tnfs_trace_stat commands[TNFS_TRACE_COMMANDS];
+};
+
+#if TNFS_USE_METRICS
+extern bool tnfs_trace_used;
+#else
+#define tnfs_trace_used false	// the hooks in tnfs.c compile to nothing
+#endif
+
+/* private functions (do not use them) */
+void tnfs_trace_record(uint8_t kind, const uint8_t* data, int length);
+
+/* public functions */
+int  tnfs_trace_start(char* filename, uint8_t options);
+int  tnfs_trace_stop();
+int  tnfs_trace_replay(char* filename, uint16_t pace, struct tnfs_trace_result* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __tnfs_trace_h__ */
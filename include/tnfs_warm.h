@@ -0,0 +1,39 @@
+#ifndef __tnfs_warm_h__
+#define __tnfs_warm_h__
+
+#include "tnfs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TNFS_WARM_SNAPSHOTS 4		// number of directory listings kept in the warm-start cache
+#define TNFS_WARM_SNAPSHOT_SIZE 4096	// maximum size in bytes of one directory listing in the cache
+#define TNFS_WARM_MAX_AGE 3600		// ignore a cache file older than this many seconds
+#define TNFS_WARM_SERVER_LEN (TNFS_MAX_HOST_LEN + 6)	// "host:port" of a server
+#define TNFS_WARM_KEY_LEN (TNFS_WARM_SERVER_LEN + 2 * TNFS_MAX_PATH_LEN)	// server, mounted directory, path and pattern
+
+/* iterator over a directory listing from the warm-start cache */
+struct tnfs_warm_dir {
+    const char* next;	// next entry in the snapshot
+    const char* end;	// end of the snapshot
+    uint16_t entries;	// amount of entries in the snapshot
+    uint32_t age;	// seconds since the listing was taken from the server
+};
+
+/* private functions (do not use them) */
+void tnfs_warm_connected(const char* host, uint16_t port);
+void tnfs_warm_record(const char* path, const char* pattern, uint16_t opts, uint16_t dirpos, uint8_t count, uint8_t status, const char* entries, int length);
+
+/* public functions */
+int  tnfs_warm_open(const char* filename);
+int  tnfs_warm_save();
+void tnfs_warm_close();
+int  tnfs_warm_opendirx(char* path, char* pattern, uint8_t diropts, uint8_t sortopts, struct tnfs_warm_dir* dir);
+int  tnfs_warm_nextdirx(struct tnfs_warm_dir* dir, struct dirx_item* xitem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __tnfs_warm_h__ */
@@ -30,9 +30,12 @@ int main(/* int argc, char const* argv[] */)
     char hmodified[20];
     int fh;
     
-    // netw_connect("tnfs.fujinet.online", TNFS_PORT, true);    
-    netw_connect("192.168.178.10", TNFS_PORT, false);    
-    // netw_connect("127.0.0.1", TNFS_PORT, false);    
+    // tnfs_connect("tnfs.fujinet.online", true);
+    // tnfs_connect("127.0.0.1", false);
+    if(tnfs_connect("192.168.178.10", false) != 0) {
+        printf("Could not connect to the server\n");
+        return -1;
+    }
     tnfs_mount("/Atari ST", "", "");
     
     if(tnfs_dir_exists("/BOLO")) {
@@ -163,7 +166,7 @@ int main(/* int argc, char const* argv[] */)
 */
 
     tnfs_umount();
-    netw_disconnect();
+    tnfs_disconnect();
 
     return 0;
 }
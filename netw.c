@@ -1,15 +1,27 @@
+#define _GNU_SOURCE	// sendmmsg(), recvmmsg() and sched_setaffinity()
 #include "include/netw.h"
 
+#include <sched.h>	// sched_yield(), on Linux sched_setaffinity()
+
 /* global variables */
 int	timeout_time = 1000;	// the time that the we would like to wait on a respond from the server in milliseconds
-int     client_fd;		// our file descriptor of the tcp or udp socket
+int     client_fd = -1;		// our file descriptor of the tcp or udp socket
 struct  pollfd pfds[1];		// our poll file descriptor structure, used to determine if received data from the server
+uint8_t probe[64];		// request sent to every address when connecting with UDP, see netw_setProbe()
+int     probe_length = 0;	// length of the probe request, zero to connect without probing
+struct  netw_address cached;	// address that won the last connection race
+char    cached_host[256];	// host, port and protocol of the cached address
+int     cached_port = 0;
+bool    cached_tcp = false;
+bool    stream = false;		// true when client_fd is a TCP socket
+int     busy_budget = 0;	// microseconds to spin on the socket before sleeping in poll(), zero to never spin
 
-/* shows an error and quits */
-void ExitError(char* errMessage)
+/* shows an error, closes the socket and returns NETW_ERR_CONNECT */
+int netw_fail(char* errMessage)
 {
-    printf("\n%s\n", errMessage);
-    exit(-1);
+    fprintf(stderr, "\n%s\n", errMessage);
+    netw_disconnect();
+    return NETW_ERR_CONNECT;
 }
 
 /* sets a new timeout time in milliseconds */
@@ -18,12 +30,82 @@ void setTimeoutTime(int t)
     timeout_time = t;
 }
 
+/* returns a monotonic clock in microseconds */
+uint32_t netw_micros()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+/* sets SO_BUSY_POLL on the socket so the kernel polls the network device too, where supported */
+void netw_applyBusyPoll()
+{
+#ifdef SO_BUSY_POLL
+    if (client_fd >= 0 && busy_budget > 0) {
+        setsockopt(client_fd, SOL_SOCKET, SO_BUSY_POLL, &busy_budget, sizeof(busy_budget));
+    }
+#endif
+}
+
+/*
+ * low-latency mode: netw_recv() spins on the socket for budget microseconds before it sleeps in poll(), which saves
+ * the wakeup latency at the cost of a busy CPU. Zero disables it. When core is not negative the calling thread is
+ * pinned to that core so the spinning receive path doesn't migrate. Returns false when pinning failed.
+ */
+bool netw_setBusyPoll(int budget, int core)
+{
+    bool pinned = true;
+
+    busy_budget = budget > 0 ? budget : 0;
+    netw_applyBusyPoll();
+
+    if (core >= 0) {
+#ifdef __linux__
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET(core, &set);
+        pinned = sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+        pinned = false;
+#endif
+    }
+
+    return pinned;
+}
+
+/* waits until the socket is readable, in low-latency mode by spinning first. Returns like poll() */
+int netw_wait()
+{
+    uint32_t start;
+    int rpoll;
+
+    if (busy_budget > 0) {
+        start = netw_micros();
+        do {
+            rpoll = poll(pfds, 1, 0);
+            if (rpoll != 0)
+                return rpoll;
+            sched_yield();	// a server or sender on the same core must still get to run
+        } while (netw_micros() - start < (uint32_t)busy_budget);
+    }
+
+    return poll(pfds, 1, timeout_time);
+}
+
 /* sends a package */
-void netw_send(const uint8_t* buffer, int length)
+int netw_send(const uint8_t* buffer, int length)
 {
-    if(send(client_fd, buffer, length, 0) == -1) {
+    int sent = send(client_fd, buffer, length, 0);
+
+    if(sent == -1) {
     	perror("netw_send");
+    	return NETW_ERR_CLOSED;
     }
+
+    return sent;
 }
 
 /* Waits for a response from the server and reads the package */
@@ -33,17 +115,16 @@ int netw_recv(uint8_t* buffer, int buffer_size)
     int length;
     
     /* now wait for a response */
-    rpoll = poll(pfds, 1, timeout_time);
+    rpoll = netw_wait();
     
     /* timeout */
     if(rpoll == 0) {
-	// ExitError("Server timeout!");
 	return NETW_ERR_TIMEOUT;
     }
     
     /* in case of an error or in case the server has closed the connection */
-    if(rpoll > 0 && pfds[0].revents & (POLLERR | POLLHUP)) {
-	ExitError("Socket was closed, server may be down!");
+    if(rpoll < 0 || pfds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+	return NETW_ERR_CLOSED;
     }
     
     /* read the received data into the buffer */
@@ -51,80 +132,419 @@ int netw_recv(uint8_t* buffer, int buffer_size)
     
     if(length == -1) {
     	perror("netw_recv");
+    	return NETW_ERR_CLOSED;
+    }
+
+    /* a stream socket reads zero bytes when the server has closed the connection */
+    if(length == 0) {
+    	return NETW_ERR_CLOSED;
     }
 
     return length;
 }
 
-/* tries to distinguish an IP address from a domain name */
+/* sends a burst of datagrams, with UDP on Linux in one system call. Returns the amount sent or NETW_ERR_CLOSED */
+int netw_sendBatch(struct netw_datagram* d, int count)
+{
+    int sent = 0;
+
+#ifdef __linux__
+    struct mmsghdr msgs[NETW_MAX_BATCH];
+    struct iovec iov[NETW_MAX_BATCH];
+    int n;
+
+    if (!stream) {
+        if (count > NETW_MAX_BATCH)
+            count = NETW_MAX_BATCH;
+
+        memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < count; i++) {
+            iov[i].iov_base = d[i].buffer;
+            iov[i].iov_len = d[i].length;
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        /* sendmmsg() may stop early when the socket buffer is full */
+        while (sent < count) {
+            n = sendmmsg(client_fd, &msgs[sent], count - sent, 0);
+            if (n == -1) {
+                perror("netw_sendBatch");
+                return sent > 0 ? sent : NETW_ERR_CLOSED;
+            }
+            sent += n;
+        }
+
+        return sent;
+    }
+#endif
+
+    for (; sent < count; sent++) {
+        if (netw_send(d[sent].buffer, d[sent].length) < 0)
+            return sent > 0 ? sent : NETW_ERR_CLOSED;
+    }
+
+    return sent;
+}
+
+/*
+ * waits for a datagram and reads it together with all datagrams that are ready by then, with UDP on Linux in one
+ * system call. length is set for each datagram, it is larger than size when a datagram was truncated. Returns the
+ * amount received, NETW_ERR_TIMEOUT or NETW_ERR_CLOSED. A TCP connection delivers what one read gets, so a stream
+ * should have only one request in flight.
+ */
+int netw_recvBatch(struct netw_datagram* d, int count)
+{
+    int received = 0;
+    int length;
+
+    if (stream || count <= 1) {
+        length = netw_recv(d[0].buffer, d[0].size);
+        if (length < 0)
+            return length;
+        d[0].length = length;
+        return 1;
+    }
+
+    if (count > NETW_MAX_BATCH)
+        count = NETW_MAX_BATCH;
+
+    length = netw_wait();
+    if (length == 0)
+        return NETW_ERR_TIMEOUT;
+    if (length < 0 || pfds[0].revents & (POLLERR | POLLHUP | POLLNVAL))
+        return NETW_ERR_CLOSED;
+
+#ifdef __linux__
+    struct mmsghdr msgs[NETW_MAX_BATCH];
+    struct iovec iov[NETW_MAX_BATCH];
+
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < count; i++) {
+        iov[i].iov_base = d[i].buffer;
+        iov[i].iov_len = d[i].size;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    received = recvmmsg(client_fd, msgs, count, MSG_DONTWAIT, NULL);
+    if (received == -1) {
+        perror("netw_recvBatch");
+        return NETW_ERR_CLOSED;
+    }
+
+    for (int i = 0; i < received; i++) {
+        d[i].length = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) ? d[i].size + 1 : (int)msgs[i].msg_len;
+    }
+#else
+    for (; received < count; received++) {
+        length = recv(client_fd, d[received].buffer, d[received].size, MSG_DONTWAIT);
+        if (length == -1)
+            break;
+        d[received].length = length;
+    }
+    if (received == 0)
+        return NETW_ERR_CLOSED;
+#endif
+
+    return received;
+}
+
+/* returns a monotonic clock in milliseconds */
+uint32_t netw_millis()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+/* tries to distinguish an IP address (IPv4 or IPv6) from a domain name */
 bool netw_isValidIpAddress(char *ipAddress)
 {
-    struct sockaddr_in sa;
-    int result = inet_pton(AF_INET, ipAddress, &(sa.sin_addr));
-    return result != 0;
+    struct in6_addr addr;
+
+    return inet_pton(AF_INET, ipAddress, &addr) == 1 || inet_pton(AF_INET6, ipAddress, &addr) == 1;
 }
 
-/* finds an IP address from a given domain name */
+/* finds the first IP address of a given domain name, ip must hold NETW_MAX_IP_LEN characters */
 bool netw_getIpAddress(char* ip, char* hostname)
 {
-    struct hostent *hp = gethostbyname(hostname);
+    struct addrinfo hints;
+    struct addrinfo* result = NULL;
+    bool found;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
 
-    if (hp == NULL)
+    if (getaddrinfo(hostname, NULL, &hints, &result) != 0)
        return false;
-       
-    unsigned int i=0;
-    while ( hp -> h_addr_list[i] != NULL) {
-        sprintf(ip, "%s ", inet_ntoa( *( struct in_addr*)( hp -> h_addr_list[i])));
-        i++;
+
+    found = getnameinfo(result->ai_addr, result->ai_addrlen, ip, NETW_MAX_IP_LEN, NULL, 0, NI_NUMERICHOST) == 0;
+    freeaddrinfo(result);
+
+    return found;
+}
+
+/* resolves host into at most NETW_MAX_ADDRESSES addresses, alternating between IPv6 and IPv4 as recommended by RFC 8305 */
+int netw_resolve(char* host, int port, int sockType, struct netw_address* addrs)
+{
+    struct addrinfo hints;
+    struct addrinfo* result = NULL;
+    struct addrinfo* ai;
+    struct netw_address v6[NETW_MAX_ADDRESSES];
+    struct netw_address v4[NETW_MAX_ADDRESSES];
+    char service[8];
+    int n6 = 0, n4 = 0, n = 0;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = sockType;
+    hints.ai_flags = AI_ADDRCONFIG;
+    sprintf(service, "%d", port);
+
+    if (getaddrinfo(host, service, &hints, &result) != 0) {
+        /* AI_ADDRCONFIG hides loopback addresses on hosts without any configured address */
+        hints.ai_flags = 0;
+        if (getaddrinfo(host, service, &hints, &result) != 0)
+            return 0;
     }
-    ip[strlen(ip)-1] = 0;
-    
-    return true;
+
+    for (ai = result; ai != NULL; ai = ai->ai_next) {
+        if (ai->ai_family == AF_INET6 && n6 < NETW_MAX_ADDRESSES) {
+            memcpy(&v6[n6].addr, ai->ai_addr, ai->ai_addrlen);
+            v6[n6++].len = ai->ai_addrlen;
+        } else if (ai->ai_family == AF_INET && n4 < NETW_MAX_ADDRESSES) {
+            memcpy(&v4[n4].addr, ai->ai_addr, ai->ai_addrlen);
+            v4[n4++].len = ai->ai_addrlen;
+        }
+    }
+    freeaddrinfo(result);
+
+    for (int i = 0; n < NETW_MAX_ADDRESSES && (i < n6 || i < n4); i++) {
+        if (i < n6)
+            addrs[n++] = v6[i];
+        if (i < n4 && n < NETW_MAX_ADDRESSES)
+            addrs[n++] = v4[i];
+    }
+
+    return n;
 }
 
-/* Creates a socket and tries to connect to the server with TCP or UDP */
-void netw_connect(char* host, int port, bool useTCP)
+/* starts a non blocking connect to one address, for UDP the probe request is sent right away */
+int netw_startAttempt(struct netw_address* a, int sockType)
 {
-    char ip[16];
-    int sockType = SOCK_STREAM;
-    struct sockaddr_in serv_addr;
-        
-    if(netw_isValidIpAddress(host)) {
-        strcpy(ip, host);
-    } else {
-    	if(!netw_getIpAddress(ip, host)) {
-    	    ExitError("Could not find the IP address for given Hostname");
-    	}
+    int fd = socket(a->addr.ss_family, sockType, 0);
+
+    if (fd < 0)
+        return -1;
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    if (connect(fd, (struct sockaddr*)&a->addr, a->len) < 0 && errno != EINPROGRESS) {
+        close(fd);
+        return -1;
     }
-    
-    if(!useTCP) {
-    	sockType = SOCK_DGRAM;
+
+    if (sockType == SOCK_DGRAM && probe_length > 0 && send(fd, probe, probe_length, 0) < 0) {
+        close(fd);
+        return -1;
     }
-    
-    if ((client_fd = socket(AF_INET, sockType, 0)) < 0) {
-        ExitError("Socket creation error");
+
+    return fd;
+}
+
+/* 
+ * Happy eyeballs: starts a connection attempt to the next address every NETW_EYEBALLS_DELAY_MS (or as soon as
+ * the previous attempt failed) and keeps the first one that succeeds. A TCP attempt succeeds when the connection is
+ * established, a UDP attempt when the server answered the probe request. The last address still gets the whole
+ * timeout after its start, also when the timeout is shorter than the head start. Returns the winning socket or -1.
+ */
+int netw_race(struct netw_address* addrs, int n, int sockType, int* winner)
+{
+    int fds[NETW_MAX_ADDRESSES];
+    struct pollfd polls[NETW_MAX_ADDRESSES];
+    int started = 0, pending = 0, fd = -1;
+    uint32_t now, lastStart = 0, deadline = netw_millis() + (n - 1) * NETW_EYEBALLS_DELAY_MS
+        + (sockType == SOCK_STREAM ? NETW_CONNECT_TIMEOUT_MS : timeout_time);
+    uint8_t reply[16];
+
+    while (fd < 0) {
+        now = netw_millis();
+
+        /* start the next attempt */
+        if (started < n && (pending == 0 || now - lastStart >= NETW_EYEBALLS_DELAY_MS)) {
+            fds[started] = netw_startAttempt(&addrs[started], sockType);
+            if (fds[started] >= 0)
+                pending++;
+            /* without a probe there is nothing to wait for */
+            if (fds[started] >= 0 && sockType == SOCK_DGRAM && probe_length == 0) {
+                fd = fds[started];
+                *winner = started;
+            }
+            lastStart = now;
+            started++;
+            continue;
+        }
+
+        if (pending == 0 || (int32_t)(deadline - now) <= 0)
+            break;
+
+        /* wait for any attempt to finish, but not longer than the start of the next attempt */
+        int nfds = 0;
+        int wait = (int32_t)(deadline - now);
+        if (started < n && wait > NETW_EYEBALLS_DELAY_MS - (int)(now - lastStart))
+            wait = NETW_EYEBALLS_DELAY_MS - (int)(now - lastStart);
+        for (int i = 0; i < started; i++) {
+            polls[i].fd = fds[i];	// negative descriptors are ignored by poll()
+            polls[i].events = sockType == SOCK_STREAM ? POLLOUT : POLLIN;
+            polls[i].revents = 0;
+            nfds++;
+        }
+        if (poll(polls, nfds, wait) <= 0)
+            continue;
+
+        for (int i = 0; i < started && fd < 0; i++) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+
+            if (fds[i] < 0 || polls[i].revents == 0)
+                continue;
+
+            if (sockType == SOCK_STREAM)
+                getsockopt(fds[i], SOL_SOCKET, SO_ERROR, &err, &len);
+            else if (recv(fds[i], reply, sizeof(reply), 0) <= 0)
+                err = -1;	// typically ECONNREFUSED, nobody listens at this address
+
+            if (err == 0) {
+                fd = fds[i];
+                *winner = i;
+            } else {
+                close(fds[i]);
+                fds[i] = -1;
+                pending--;
+            }
+        }
     }
 
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(port);
+    /* UDP servers may ignore the probe: then fall back to the first address that didn't refuse it */
+    for (int i = 0; fd < 0 && sockType == SOCK_DGRAM && i < started; i++) {
+        if (fds[i] >= 0) {
+            fd = fds[i];
+            *winner = i;
+        }
+    }
 
-    // Convert IPv4 and IPv6 addresses from text to binary form
-    if (inet_pton(AF_INET, ip, &serv_addr.sin_addr) <= 0) {
-        ExitError("Invalid address/ Address not supported");
+    for (int i = 0; i < started; i++) {
+        if (fds[i] >= 0 && fds[i] != fd)
+            close(fds[i]);
     }
 
-    if ((connect(client_fd, (struct sockaddr*)&serv_addr, sizeof(serv_addr))) < 0) {
-        ExitError("Connection Failed");
+    if (fd >= 0)
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+
+    return fd;
+}
+
+/* sets a request that the server answers cheaply, used to find a reachable address when connecting with UDP */
+void netw_setProbe(const uint8_t* buffer, int length)
+{
+    if (length > (int)sizeof(probe))
+        length = sizeof(probe);
+    memcpy(probe, buffer, length);
+    probe_length = length;
+}
+
+/* returns the host of the address that won the last connection race and copies its details, NULL if there is none */
+const char* netw_getCachedAddress(int* port, bool* useTCP, struct netw_address* a)
+{
+    if (cached.len == 0)
+        return NULL;
+
+    *port = cached_port;
+    *useTCP = cached_tcp;
+    *a = cached;
+
+    return cached_host;
+}
+
+/* restores a cached address, for example from a warm-start cache, so the next connect to host doesn't need to resolve it */
+void netw_setCachedAddress(const char* host, int port, bool useTCP, struct netw_address* a)
+{
+    cached = *a;
+    cached_port = port;
+    cached_tcp = useTCP;
+    snprintf(cached_host, sizeof(cached_host), "%s", host);
+}
+
+/* Creates a socket and connects to the server with TCP or UDP trying all its addresses, returns 0 on success */
+int netw_connect(char* host, int port, bool useTCP)
+{
+    struct netw_address addrs[NETW_MAX_ADDRESSES];
+    int sockType = useTCP ? SOCK_STREAM : SOCK_DGRAM;
+    int n, winner = 0;
+    bool known = cached.len > 0 && cached_port == port && cached_tcp == useTCP && strcmp(cached_host, host) == 0;
+
+    /* a reconnect, for example from tnfs_recover(), replaces the socket of the lost session */
+    netw_disconnect();
+    stream = useTCP;
+
+    /* the address that won the previous race for this server is tried first, without resolving the host again */
+    if (known && (client_fd = netw_race(&cached, 1, sockType, &winner)) >= 0) {
+        pfds[0].events = POLLIN;
+        pfds[0].fd = client_fd;
+        netw_applyBusyPoll();
+        return 0;
     }
-    
+
+    n = netw_resolve(host, port, sockType, addrs);
+    if (n == 0) {
+        return netw_fail("Could not find the IP address for given Hostname");
+    }
+
+    if ((client_fd = netw_race(addrs, n, sockType, &winner)) < 0) {
+        return netw_fail("Connection Failed");
+    }
+
+    netw_setCachedAddress(host, port, useTCP, &addrs[winner]);
+
     /* Initialize polling data that we will use later in the netw_recv function */ 
     pfds[0].events = POLLIN;
     pfds[0].fd = client_fd;
+    netw_applyBusyPoll();
+
+    return 0;
 }
 
 /* disconnect from the server */
 void netw_disconnect()
 {
-    close(client_fd);
+    if(client_fd >= 0) {
+    	close(client_fd);
+    	client_fd = -1;
+    }
+}
+
+
+/* Copies the current connection to s */
+void netw_saveState(struct netw_state* s)
+{
+    s->fd = client_fd;
+    s->stream = stream;
+    s->timeout = timeout_time;
+}
+
+/* Makes the connection in s the current one, NULL for no connection yet. The connection it replaces stays open */
+void netw_loadState(const struct netw_state* s)
+{
+    client_fd = s != NULL ? s->fd : -1;
+    stream = s != NULL && s->stream;
+    timeout_time = s != NULL ? s->timeout : 1000;
+    pfds[0].fd = client_fd;
+    pfds[0].events = POLLIN;
 }
 
+/* the functions above as a transport, the default of tnfs_setTransport() */
+const struct netw_transport netw_sockets = {
+    netw_connect, netw_disconnect, netw_send, netw_recv, netw_sendBatch, netw_recvBatch, setTimeoutTime
+};
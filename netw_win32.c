@@ -11,13 +11,22 @@
 /* global variables */
 static int timeout_time = 1000;   // milliseconds
 static SOCKET client_fd = INVALID_SOCKET;
+static bool wsa_started = false;        // true when this connection called WSAStartup(), it calls WSACleanup() once
+static uint8_t probe[64];               // request sent to every address when connecting with UDP, see netw_setProbe()
+static int probe_length = 0;            // length of the probe request, zero to connect without probing
+static struct netw_address cached;      // address that won the last connection race
+static char cached_host[256];           // host, port and protocol of the cached address
+static int cached_port = 0;
+static bool cached_tcp = false;
+static bool stream = false;             // true when client_fd is a TCP socket
+static int busy_budget = 0;             // microseconds to spin on the socket before sleeping in select(), zero to never spin
 
-/* shows an error and quits */
-static void ExitError(const char* errMessage)
+/* shows an error, closes the socket and returns NETW_ERR_CONNECT */
+static int netw_fail(const char* errMessage)
 {
     fprintf(stderr, "\n%s\n", errMessage);
-    WSACleanup();
-    exit(-1);
+    netw_disconnect();
+    return NETW_ERR_CONNECT;
 }
 
 /* sets a new timeout time in milliseconds */
@@ -26,13 +35,38 @@ void setTimeoutTime(int t)
     timeout_time = t;
 }
 
+/* returns a monotonic clock in microseconds */
+uint32_t netw_micros()
+{
+    LARGE_INTEGER counter, frequency;
+
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    /* whole seconds and the rest apart, counter * 1000000 overflows after about ten days of uptime at 10 MHz */
+    return (uint32_t)(counter.QuadPart / frequency.QuadPart * 1000000 + counter.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart);
+}
+
+/* low-latency mode, see netw.c. Winsock has no SO_BUSY_POLL, only the spinning and the pinning apply */
+bool netw_setBusyPoll(int budget, int core)
+{
+    busy_budget = budget > 0 ? budget : 0;
+
+    if (core >= 0) {
+        return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core) != 0;
+    }
+
+    return true;
+}
+
 /* sends a packet */
-void netw_send(const uint8_t* buffer, int length)
+int netw_send(const uint8_t* buffer, int length)
 {
     int sent = send(client_fd, (const char*)buffer, length, 0);
     if (sent == SOCKET_ERROR) {
         fprintf(stderr, "netw_send failed: %d\n", WSAGetLastError());
+        return NETW_ERR_CLOSED;
     }
+    return sent;
 }
 
 /* Waits for a response from the server and reads the packet */
@@ -42,13 +76,28 @@ int netw_recv(uint8_t* buffer, int buffer_size)
     struct timeval tv;
     int ret;
 
-    FD_ZERO(&readfds);
-    FD_SET(client_fd, &readfds);
+    uint32_t start = netw_micros();
+
+    /* in low-latency mode spin first, select() with a zero timeout doesn't sleep */
+    do {
+        FD_ZERO(&readfds);
+        FD_SET(client_fd, &readfds);
+
+        tv.tv_sec  = 0;
+        tv.tv_usec = 0;
+
+        ret = busy_budget > 0 ? select(0, &readfds, NULL, NULL, &tv) : 0;
+    } while (ret == 0 && netw_micros() - start < (uint32_t)busy_budget);
+
+    if (ret == 0) {
+        FD_ZERO(&readfds);
+        FD_SET(client_fd, &readfds);
 
-    tv.tv_sec  = timeout_time / 1000;
-    tv.tv_usec = (timeout_time % 1000) * 1000;
+        tv.tv_sec  = timeout_time / 1000;
+        tv.tv_usec = (timeout_time % 1000) * 1000;
 
-    ret = select(0, &readfds, NULL, NULL, &tv);
+        ret = select(0, &readfds, NULL, NULL, &tv);
+    }
 
     /* timeout */
     if (ret == 0) {
@@ -58,93 +107,394 @@ int netw_recv(uint8_t* buffer, int buffer_size)
     /* error */
     if (ret == SOCKET_ERROR) {
         fprintf(stderr, "select failed: %d\n", WSAGetLastError());
-        return NETW_ERR_TIMEOUT;
+        return NETW_ERR_CLOSED;
     }
 
     /* socket ready */
     ret = recv(client_fd, (char*)buffer, buffer_size, 0);
     if (ret == SOCKET_ERROR) {
         fprintf(stderr, "recv failed: %d\n", WSAGetLastError());
-        return -1;
+        return NETW_ERR_CLOSED;
+    }
+
+    /* a stream socket reads zero bytes when the server has closed the connection */
+    if (ret == 0) {
+        return NETW_ERR_CLOSED;
     }
 
     return ret;
 }
 
-/* tries to distinguish an IP address from a domain name */
+/* sends a burst of datagrams, Winsock has no sendmmsg() so it's one send() each. Returns the amount sent */
+int netw_sendBatch(struct netw_datagram* d, int count)
+{
+    int sent = 0;
+
+    for (; sent < count; sent++) {
+        if (netw_send(d[sent].buffer, d[sent].length) < 0)
+            return sent > 0 ? sent : NETW_ERR_CLOSED;
+    }
+
+    return sent;
+}
+
+/* waits for a datagram and reads it together with all datagrams that are ready by then, see netw.c */
+int netw_recvBatch(struct netw_datagram* d, int count)
+{
+    fd_set readfds;
+    struct timeval tv = {0, 0};
+    int received = 1;
+    int length;
+
+    length = netw_recv(d[0].buffer, d[0].size);
+    if (length < 0)
+        return length;
+    d[0].length = length;
+
+    if (count > NETW_MAX_BATCH)
+        count = NETW_MAX_BATCH;
+
+    while (!stream && received < count) {
+        FD_ZERO(&readfds);
+        FD_SET(client_fd, &readfds);
+        if (select(0, &readfds, NULL, NULL, &tv) != 1)
+            break;
+
+        length = recv(client_fd, (char*)d[received].buffer, d[received].size, 0);
+        if (length == SOCKET_ERROR) {
+            /* a datagram larger than the buffer */
+            if (WSAGetLastError() == WSAEMSGSIZE)
+                length = d[received].size + 1;
+            else
+                break;
+        }
+        d[received++].length = length;
+    }
+
+    return received;
+}
+
+/* returns a monotonic clock in milliseconds */
+uint32_t netw_millis()
+{
+    return (uint32_t)GetTickCount();
+}
+
+/* tries to distinguish an IP address (IPv4 or IPv6) from a domain name */
 bool netw_isValidIpAddress(char* ipAddress)
 {
-    struct sockaddr_in sa;
-    return InetPtonA(AF_INET, ipAddress, &sa.sin_addr) == 1;
+    struct in6_addr addr;
+    return InetPtonA(AF_INET, ipAddress, &addr) == 1 || InetPtonA(AF_INET6, ipAddress, &addr) == 1;
 }
 
-/* finds an IP address from a given domain name */
+/* finds the first IP address of a given domain name, ip must hold NETW_MAX_IP_LEN characters */
 bool netw_getIpAddress(char* ip, char* hostname)
 {
     struct addrinfo hints;
     struct addrinfo* result = NULL;
+    bool found;
 
     ZeroMemory(&hints, sizeof(hints));
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_family = AF_UNSPEC;
 
     if (getaddrinfo(hostname, NULL, &hints, &result) != 0) {
         return false;
     }
 
-    struct sockaddr_in* addr = (struct sockaddr_in*)result->ai_addr;
-    InetNtopA(AF_INET, &addr->sin_addr, ip, 16);
+    found = getnameinfo(result->ai_addr, (socklen_t)result->ai_addrlen, ip, NETW_MAX_IP_LEN, NULL, 0, NI_NUMERICHOST) == 0;
+    freeaddrinfo(result);
+
+    return found;
+}
+
+/* resolves host into at most NETW_MAX_ADDRESSES addresses, alternating between IPv6 and IPv4 as recommended by RFC 8305 */
+static int netw_resolve(char* host, int port, int sockType, struct netw_address* addrs)
+{
+    struct addrinfo hints;
+    struct addrinfo* result = NULL;
+    struct addrinfo* ai;
+    struct netw_address v6[NETW_MAX_ADDRESSES];
+    struct netw_address v4[NETW_MAX_ADDRESSES];
+    char service[8];
+    int n6 = 0, n4 = 0, n = 0;
 
+    ZeroMemory(&hints, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = sockType;
+    sprintf(service, "%d", port);
+
+    if (getaddrinfo(host, service, &hints, &result) != 0) {
+        return 0;
+    }
+
+    for (ai = result; ai != NULL; ai = ai->ai_next) {
+        if (ai->ai_family == AF_INET6 && n6 < NETW_MAX_ADDRESSES) {
+            memcpy(&v6[n6].addr, ai->ai_addr, ai->ai_addrlen);
+            v6[n6++].len = (socklen_t)ai->ai_addrlen;
+        } else if (ai->ai_family == AF_INET && n4 < NETW_MAX_ADDRESSES) {
+            memcpy(&v4[n4].addr, ai->ai_addr, ai->ai_addrlen);
+            v4[n4++].len = (socklen_t)ai->ai_addrlen;
+        }
+    }
     freeaddrinfo(result);
-    return true;
+
+    for (int i = 0; n < NETW_MAX_ADDRESSES && (i < n6 || i < n4); i++) {
+        if (i < n6)
+            addrs[n++] = v6[i];
+        if (i < n4 && n < NETW_MAX_ADDRESSES)
+            addrs[n++] = v4[i];
+    }
+
+    return n;
 }
 
-/* Creates a socket and tries to connect to the server with TCP or UDP */
-void netw_connect(char* host, int port, bool useTCP)
+/* starts a non blocking connect to one address, for UDP the probe request is sent right away */
+static SOCKET netw_startAttempt(struct netw_address* a, int sockType)
+{
+    u_long nonblocking = 1;
+    SOCKET fd = socket(a->addr.ss_family, sockType, 0);
+
+    if (fd == INVALID_SOCKET) {
+        return INVALID_SOCKET;
+    }
+
+    ioctlsocket(fd, FIONBIO, &nonblocking);
+
+    if (connect(fd, (struct sockaddr*)&a->addr, a->len) == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK) {
+        closesocket(fd);
+        return INVALID_SOCKET;
+    }
+
+    if (sockType == SOCK_DGRAM && probe_length > 0 && send(fd, (const char*)probe, probe_length, 0) == SOCKET_ERROR) {
+        closesocket(fd);
+        return INVALID_SOCKET;
+    }
+
+    return fd;
+}
+
+/* 
+ * Happy eyeballs: starts a connection attempt to the next address every NETW_EYEBALLS_DELAY_MS (or as soon as
+ * the previous attempt failed) and keeps the first one that succeeds. A TCP attempt succeeds when the connection is
+ * established, a UDP attempt when the server answered the probe request. The last address still gets the whole
+ * timeout after its start, also when the timeout is shorter than the head start.
+ */
+static SOCKET netw_race(struct netw_address* addrs, int n, int sockType, int* winner)
+{
+    SOCKET fds[NETW_MAX_ADDRESSES];
+    SOCKET fd = INVALID_SOCKET;
+    fd_set readfds, writefds, exceptfds;
+    struct timeval tv;
+    int started = 0, pending = 0;
+    uint32_t now, lastStart = 0, deadline = netw_millis() + (n - 1) * NETW_EYEBALLS_DELAY_MS
+        + (sockType == SOCK_STREAM ? NETW_CONNECT_TIMEOUT_MS : timeout_time);
+    u_long blocking = 0;
+    char reply[16];
+
+    while (fd == INVALID_SOCKET) {
+        now = netw_millis();
+
+        /* start the next attempt */
+        if (started < n && (pending == 0 || now - lastStart >= NETW_EYEBALLS_DELAY_MS)) {
+            fds[started] = netw_startAttempt(&addrs[started], sockType);
+            if (fds[started] != INVALID_SOCKET) {
+                pending++;
+            }
+            /* without a probe there is nothing to wait for */
+            if (fds[started] != INVALID_SOCKET && sockType == SOCK_DGRAM && probe_length == 0) {
+                fd = fds[started];
+                *winner = started;
+            }
+            lastStart = now;
+            started++;
+            continue;
+        }
+
+        if (pending == 0 || (int32_t)(deadline - now) <= 0) {
+            break;
+        }
+
+        /* wait for any attempt to finish, but not longer than the start of the next attempt */
+        int wait = (int32_t)(deadline - now);
+        if (started < n && wait > NETW_EYEBALLS_DELAY_MS - (int)(now - lastStart)) {
+            wait = NETW_EYEBALLS_DELAY_MS - (int)(now - lastStart);
+        }
+        tv.tv_sec  = wait / 1000;
+        tv.tv_usec = (wait % 1000) * 1000;
+
+        FD_ZERO(&readfds);
+        FD_ZERO(&writefds);
+        FD_ZERO(&exceptfds);
+        for (int i = 0; i < started; i++) {
+            if (fds[i] != INVALID_SOCKET) {
+                FD_SET(fds[i], sockType == SOCK_STREAM ? &writefds : &readfds);
+                FD_SET(fds[i], &exceptfds);
+            }
+        }
+        if (select(0, &readfds, &writefds, &exceptfds, &tv) <= 0) {
+            continue;
+        }
+
+        for (int i = 0; i < started && fd == INVALID_SOCKET; i++) {
+            bool failed;
+
+            if (fds[i] == INVALID_SOCKET) {
+                continue;
+            }
+
+            /* a refused TCP connect is reported in exceptfds, a refused UDP probe as WSAECONNRESET */
+            if (FD_ISSET(fds[i], &exceptfds)) {
+                failed = true;
+            } else if (FD_ISSET(fds[i], &writefds)) {
+                failed = false;
+            } else if (FD_ISSET(fds[i], &readfds)) {
+                failed = recv(fds[i], reply, sizeof(reply), 0) <= 0;
+            } else {
+                continue;
+            }
+
+            if (!failed) {
+                fd = fds[i];
+                *winner = i;
+            } else {
+                closesocket(fds[i]);
+                fds[i] = INVALID_SOCKET;
+                pending--;
+            }
+        }
+    }
+
+    /* UDP servers may ignore the probe: then fall back to the first address that didn't refuse it */
+    for (int i = 0; fd == INVALID_SOCKET && sockType == SOCK_DGRAM && i < started; i++) {
+        if (fds[i] != INVALID_SOCKET) {
+            fd = fds[i];
+            *winner = i;
+        }
+    }
+
+    for (int i = 0; i < started; i++) {
+        if (fds[i] != INVALID_SOCKET && fds[i] != fd) {
+            closesocket(fds[i]);
+        }
+    }
+
+    if (fd != INVALID_SOCKET) {
+        ioctlsocket(fd, FIONBIO, &blocking);
+    }
+
+    return fd;
+}
+
+/* sets a request that the server answers cheaply, used to find a reachable address when connecting with UDP */
+void netw_setProbe(const uint8_t* buffer, int length)
+{
+    if (length > (int)sizeof(probe)) {
+        length = sizeof(probe);
+    }
+    memcpy(probe, buffer, length);
+    probe_length = length;
+}
+
+/* returns the host of the address that won the last connection race and copies its details, NULL if there is none */
+const char* netw_getCachedAddress(int* port, bool* useTCP, struct netw_address* a)
+{
+    if (cached.len == 0) {
+        return NULL;
+    }
+
+    *port = cached_port;
+    *useTCP = cached_tcp;
+    *a = cached;
+
+    return cached_host;
+}
+
+/* restores a cached address, for example from a warm-start cache, so the next connect to host doesn't need to resolve it */
+void netw_setCachedAddress(const char* host, int port, bool useTCP, struct netw_address* a)
+{
+    cached = *a;
+    cached_port = port;
+    cached_tcp = useTCP;
+    snprintf(cached_host, sizeof(cached_host), "%s", host);
+}
+
+/* Creates a socket and connects to the server with TCP or UDP trying all its addresses, returns 0 on success */
+int netw_connect(char* host, int port, bool useTCP)
 {
     WSADATA wsa;
-    struct sockaddr_in serv_addr;
-    char ip[16];
+    struct netw_address addrs[NETW_MAX_ADDRESSES];
     int sockType = useTCP ? SOCK_STREAM : SOCK_DGRAM;
+    int n, winner = 0;
+    bool known = cached.len > 0 && cached_port == port && cached_tcp == useTCP && strcmp(cached_host, host) == 0;
+
+    /* a reconnect, for example from tnfs_recover(), replaces the socket of the lost session */
+    if (client_fd != INVALID_SOCKET || wsa_started)
+        netw_disconnect();
+    stream = useTCP;
 
     if (WSAStartup(MAKEWORD(2,2), &wsa) != 0) {
-        ExitError("WSAStartup failed");
+        fprintf(stderr, "\nWSAStartup failed\n");
+        return NETW_ERR_CONNECT;
     }
+    wsa_started = true;
 
-    if (netw_isValidIpAddress(host)) {
-        strncpy(ip, host, sizeof(ip)-1);
-        ip[sizeof(ip)-1] = '\0';
-    } else {
-        if (!netw_getIpAddress(ip, host)) {
-            ExitError("Could not resolve hostname");
+    /* the address that won the previous race for this server is tried first, without resolving the host again */
+    if (known) {
+        client_fd = netw_race(&cached, 1, sockType, &winner);
+        if (client_fd != INVALID_SOCKET) {
+            return 0;
         }
     }
 
-    client_fd = socket(AF_INET, sockType, 0);
-    if (client_fd == INVALID_SOCKET) {
-        ExitError("Socket creation error");
+    n = netw_resolve(host, port, sockType, addrs);
+    if (n == 0) {
+        return netw_fail("Could not resolve hostname");
     }
 
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port   = htons((u_short)port);
-
-    if (InetPtonA(AF_INET, ip, &serv_addr.sin_addr) != 1) {
-        ExitError("Invalid IP address");
+    client_fd = netw_race(addrs, n, sockType, &winner);
+    if (client_fd == INVALID_SOCKET) {
+        return netw_fail("Connection failed");
     }
 
-    if (connect(client_fd, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) == SOCKET_ERROR) {
-        ExitError("Connection failed");
-    }
+    netw_setCachedAddress(host, port, useTCP, &addrs[winner]);
+
+    return 0;
 }
 
-/* disconnect from the server */
+/* disconnect from the server, Winsock is only cleaned up by the connection that started it */
 void netw_disconnect()
 {
     if (client_fd != INVALID_SOCKET) {
         closesocket(client_fd);
         client_fd = INVALID_SOCKET;
     }
-    WSACleanup();
+    if (wsa_started) {
+        WSACleanup();
+        wsa_started = false;
+    }
 }
 
+/* Copies the current connection to s */
+void netw_saveState(struct netw_state* s)
+{
+    s->fd = client_fd;
+    s->wsa = wsa_started;
+    s->stream = stream;
+    s->timeout = timeout_time;
+}
+
+/* Makes the connection in s the current one, NULL for no connection yet. The connection it replaces stays open */
+void netw_loadState(const struct netw_state* s)
+{
+    client_fd = s != NULL ? s->fd : INVALID_SOCKET;
+    wsa_started = s != NULL && s->wsa;
+    stream = s != NULL && s->stream;
+    timeout_time = s != NULL ? s->timeout : 1000;
+}
+
+/* the functions above as a transport, the default of tnfs_setTransport() */
+const struct netw_transport netw_sockets = {
+    netw_connect, netw_disconnect, netw_send, netw_recv, netw_sendBatch, netw_recvBatch, setTimeoutTime
+};
+
 #endif /* _WIN32 */
@@ -0,0 +1,174 @@
+#define _GNU_SOURCE	// struct mmsghdr
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include "tnfs_test.h"
+#include "../include/tnfs_pool.h"
+
+/*
+ * Datagrams per system call and client CPU per MB over loopback UDP: the same files are read with one tnfs_read()
+ * at a time and with bursts of tnfs_readv(). The system calls of netw.c are counted by wrapping the ones of glibc,
+ * the server runs in a process of its own and isn't counted.
+ */
+
+#define BENCH_FILES NETW_MAX_BATCH
+#define BENCH_SIZE (256 * 1024)
+#define BENCH_PASSES 8
+#define BENCH_CHUNK (TNFS_POOL_BUFSIZE - 7)	// what a READ of tnfs_readv() gets with the default pool
+
+/* datagrams and system calls in each direction */
+struct bench_count {
+    uint32_t sent, sends;
+    uint32_t received, receives;
+};
+
+struct bench_count bench_count;
+
+ssize_t send(int fd, const void* buffer, size_t length, int flags)
+{
+    ssize_t n = syscall(SYS_sendto, fd, buffer, length, flags, NULL, 0);
+
+    bench_count.sends++;
+    bench_count.sent += n > 0;
+    return n;
+}
+
+ssize_t recv(int fd, void* buffer, size_t length, int flags)
+{
+    ssize_t n = syscall(SYS_recvfrom, fd, buffer, length, flags, NULL, NULL);
+
+    bench_count.receives++;
+    bench_count.received += n > 0;
+    return n;
+}
+
+ssize_t read(int fd, void* buffer, size_t length)
+{
+    ssize_t n = syscall(SYS_read, fd, buffer, length);
+
+    bench_count.receives++;
+    bench_count.received += n > 0;
+    return n;
+}
+
+int sendmmsg(int fd, struct mmsghdr* msgs, unsigned int count, int flags)
+{
+    int n = syscall(SYS_sendmmsg, fd, msgs, count, flags);
+
+    bench_count.sends++;
+    bench_count.sent += n > 0 ? n : 0;
+    return n;
+}
+
+int recvmmsg(int fd, struct mmsghdr* msgs, unsigned int count, int flags, struct timespec* timeout)
+{
+    int n = syscall(SYS_recvmmsg, fd, msgs, count, flags, timeout);
+
+    bench_count.receives++;
+    bench_count.received += n > 0 ? n : 0;
+    return n;
+}
+
+/* user and system CPU time of this process in microseconds */
+uint64_t bench_cpu()
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/* reads every file to the end, one request at a time or in bursts, returns the amount of bytes */
+uint64_t bench_pass(uint8_t* handles, bool batched)
+{
+    char data[BENCH_FILES][BENCH_CHUNK];
+    char* buffers[BENCH_FILES];
+    int results[BENCH_FILES];
+    uint64_t total = 0;
+    int n, open = BENCH_FILES;
+
+    for (int i = 0; i < BENCH_FILES; i++) {
+        buffers[i] = data[i];
+        tnfs_lseek(handles[i], TNFS_SEEK_SET, 0);
+    }
+
+    if (!batched) {
+        for (int i = 0; i < BENCH_FILES; i++) {
+            while ((n = tnfs_read(data[i], handles[i], BENCH_CHUNK)) > 0)
+                total += n;
+        }
+        return total;
+    }
+
+    /* the files are of equal size, they all reach the end in the same burst */
+    while (open > 0 && tnfs_readv(handles, buffers, BENCH_CHUNK, results, BENCH_FILES) == 0) {
+        open = 0;
+        for (int i = 0; i < BENCH_FILES; i++) {
+            if (results[i] > 0) {
+                total += results[i];
+                open++;
+            }
+        }
+    }
+
+    return total;
+}
+
+/* reads the files BENCH_PASSES times and prints the counts */
+void bench_run(uint8_t* handles, bool batched)
+{
+    struct bench_count c;
+    uint64_t began, cpu, bytes = 0;
+    double mb;
+
+    bench_pass(handles, batched);	// warm up
+    memset(&bench_count, 0, sizeof(bench_count));
+    began = bench_cpu();
+    for (int i = 0; i < BENCH_PASSES; i++)
+        bytes += bench_pass(handles, batched);
+    cpu = bench_cpu() - began;
+    c = bench_count;
+    mb = bytes / 1048576.0;
+
+    printf("  %-8s %6.1f MB  send %5.2f datagrams/syscall  receive %5.2f datagrams/syscall  %7.0f syscalls/MB  %7.0f us CPU/MB\n",
+        batched ? "batched" : "single", mb, (double)c.sent / (c.sends ? c.sends : 1), (double)c.received / (c.receives ? c.receives : 1),
+        (c.sends + c.receives) / mb, cpu / mb);
+}
+
+int main()
+{
+    static char contents[BENCH_SIZE];
+    uint8_t handles[BENCH_FILES];
+    char name[16];
+    pid_t server;
+
+    for (int i = 0; i < BENCH_FILES; i++) {
+        snprintf(name, sizeof(name), "/f%d", i);
+        memset(contents, 'a' + i, sizeof(contents));
+        tnfs_memserver_put(name, contents, sizeof(contents), 0);
+    }
+    server = tnfs_test_serve(TNFS_TEST_HOST);
+    if (server < 0 || tnfs_connect(TNFS_TEST_HOST, false) != 0 || tnfs_mount("/", "", "") != 0)
+        return 1;
+    for (int i = 0; i < BENCH_FILES; i++) {
+        snprintf(name, sizeof(name), "/f%d", i);
+        handles[i] = tnfs_open(name, TNFS_O_RDONLY, 0);
+    }
+
+    printf("bench_batch: %d files of %d KiB read %d times in %d byte READs over loopback UDP\n",
+        BENCH_FILES, BENCH_SIZE / 1024, BENCH_PASSES, BENCH_CHUNK);
+    bench_run(handles, false);
+    bench_run(handles, true);
+
+    for (int i = 0; i < BENCH_FILES; i++)
+        tnfs_close(handles[i]);
+    tnfs_umount();
+    tnfs_disconnect();
+    tnfs_test_stop(server);
+
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "tnfs_test.h"
+#include "../include/tnfs_block.h"
+
+/*
+ * Sectors per second of an emulator-style trace over loopback UDP, through the block device layer and with a
+ * tnfs_lseek() plus tnfs_read() or tnfs_write() per access. The trace looks like a FAT disk of an emulated ST: FAT and
+ * directory sectors read over and over, files loaded sector by sector, clusters written back with their FAT sector.
+ */
+
+#define BENCH_IMAGE (8 * 1024 * 1024)
+#define BENCH_SECTORS (BENCH_IMAGE / TNFS_BLOCK_SECTOR)
+#define BENCH_FAT 40			// FAT and root directory sectors at the start of the image
+#define BENCH_OPS 20000
+
+/* one access of the trace */
+struct bench_op {
+    bool     write;
+    uint32_t sector;
+    uint16_t count;
+};
+
+struct bench_op bench_trace[BENCH_OPS];
+
+/* builds the trace, the same every run */
+int bench_build()
+{
+    uint32_t start;
+    int n = 0;
+
+    srand(1985);
+    while (n < BENCH_OPS) {
+        switch (rand() % 10) {
+            case 0: case 1: case 2: case 3:	// FAT and directory lookups
+                bench_trace[n++] = (struct bench_op){ false, 1 + rand() % BENCH_FAT, 1 };
+                break;
+            case 4: case 5: case 6:		// a file loaded one sector after the other
+                start = BENCH_FAT + rand() % (BENCH_SECTORS - BENCH_FAT - 64);
+                for (int i = 0; i < 32 && n < BENCH_OPS; i++)
+                    bench_trace[n++] = (struct bench_op){ false, start + i, 1 };
+                break;
+            case 7: case 8:			// a cluster written back, then its FAT sector
+                start = BENCH_FAT + rand() % (BENCH_SECTORS - BENCH_FAT - 2);
+                bench_trace[n++] = (struct bench_op){ true, start, 2 };
+                if (n < BENCH_OPS)
+                    bench_trace[n++] = (struct bench_op){ true, 1 + rand() % BENCH_FAT, 1 };
+                break;
+            default:				// a random sector
+                bench_trace[n++] = (struct bench_op){ false, rand() % BENCH_SECTORS, 1 };
+                break;
+        }
+    }
+
+    return n;
+}
+
+/* replays the trace through the block device layer, returns the sectors moved */
+uint32_t bench_block(uint32_t* requests)
+{
+    static char data[2 * TNFS_BLOCK_SECTOR];
+    struct tnfs_blockdev* b = tnfs_block_open("/disk.st", false);
+    uint32_t sectors = 0;
+
+    if (b == NULL)
+        return 0;
+
+    for (int i = 0; i < BENCH_OPS; i++) {
+        struct bench_op* op = &bench_trace[i];
+
+        if (op->write)
+            tnfs_block_write(b, op->sector, op->count, data);
+        else
+            tnfs_block_read(b, op->sector, op->count, data);
+        sectors += op->count;
+    }
+    tnfs_block_flush(b);
+    *requests = b->requests;
+    tnfs_block_close(b);
+
+    return sectors;
+}
+
+/* replays the trace with a seek and a read or write for every access, returns the sectors moved */
+uint32_t bench_plain(uint32_t* requests)
+{
+    static char data[2 * TNFS_BLOCK_SECTOR];
+    int fd = tnfs_open("/disk.st", TNFS_O_RDWR, 0);
+    uint32_t sectors = 0;
+
+    if (fd < 0)
+        return 0;
+
+    for (int i = 0; i < BENCH_OPS; i++) {
+        struct bench_op* op = &bench_trace[i];
+
+        tnfs_lseek(fd, TNFS_SEEK_SET, op->sector * TNFS_BLOCK_SECTOR);
+        if (op->write)
+            tnfs_write(data, fd, op->count * TNFS_BLOCK_SECTOR);
+        else
+            tnfs_read(data, fd, op->count * TNFS_BLOCK_SECTOR);
+        sectors += op->count;
+    }
+    *requests = 2 * BENCH_OPS;
+    tnfs_close(fd);
+
+    return sectors;
+}
+
+/* times one replay and prints sectors per second */
+void bench_run(const char* mode, uint32_t (*replay)(uint32_t*))
+{
+    uint32_t requests = 0;
+    uint32_t began = netw_micros();
+    uint32_t sectors = replay(&requests);
+    double seconds = (netw_micros() - began) / 1e6;
+
+    printf("  %-14s %8.0f sectors/s  %5.2f requests per sector\n", mode, sectors / seconds, (double)requests / sectors);
+}
+
+int main()
+{
+    static char image[BENCH_IMAGE];
+    pid_t server;
+
+    tnfs_memserver_put("/disk.st", image, sizeof(image), 0);
+    server = tnfs_test_serve(TNFS_TEST_HOST);
+    if (server < 0 || tnfs_connect(TNFS_TEST_HOST, false) != 0 || tnfs_mount("/", "", "") != 0)
+        return 1;
+
+    printf("bench_block: trace of %d sector reads and writes on a %d MiB image over loopback UDP\n",
+        bench_build(), BENCH_IMAGE / 1048576);
+    bench_run("seek and read", bench_plain);
+    bench_run("block device", bench_block);
+
+    tnfs_umount();
+    tnfs_disconnect();
+    tnfs_test_stop(server);
+
+    return 0;
+}
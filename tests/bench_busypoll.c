@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include "tnfs_test.h"
+
+/*
+ * Latency of small operations over loopback UDP, default against low-latency mode: a tnfs_stat() and a 64 byte
+ * tnfs_read() are timed one by one, with netw_recv() sleeping in poll() and with it spinning on the socket first.
+ */
+
+#define BENCH_OPS 20000
+#define BENCH_BUDGET 200	// microseconds to spin in low-latency mode
+
+uint32_t bench_stat[BENCH_OPS];
+uint32_t bench_read[BENCH_OPS];
+
+/* times BENCH_OPS stats and reads, then prints the percentiles */
+void bench_run(const char* mode, uint8_t handle)
+{
+    struct fstat st;
+    char data[64];
+    uint32_t began;
+
+    for (int i = 0; i < BENCH_OPS; i++) {
+        began = netw_micros();
+        tnfs_stat("/small.bin", &st);
+        bench_stat[i] = netw_micros() - began;
+
+        began = netw_micros();
+        if (tnfs_read(data, handle, sizeof(data)) != sizeof(data))
+            tnfs_lseek(handle, TNFS_SEEK_SET, 0);
+        bench_read[i] = netw_micros() - began;
+    }
+
+    printf("  %-12s stat p50 %4u us  p99 %4u us    read p50 %4u us  p99 %4u us\n", mode,
+        tnfs_test_percentile(bench_stat, BENCH_OPS, 50), tnfs_test_percentile(bench_stat, BENCH_OPS, 99),
+        tnfs_test_percentile(bench_read, BENCH_OPS, 50), tnfs_test_percentile(bench_read, BENCH_OPS, 99));
+}
+
+int main()
+{
+    char contents[4096] = "";
+    pid_t server;
+    int handle;
+
+    tnfs_memserver_put("/small.bin", contents, sizeof(contents), 0);
+    server = tnfs_test_serve(TNFS_TEST_HOST);
+    if (server < 0 || tnfs_connect(TNFS_TEST_HOST, false) != 0 || tnfs_mount("/", "", "") != 0)
+        return 1;
+    handle = tnfs_open("/small.bin", TNFS_O_RDONLY, 0);
+    if (handle < 0)
+        return 1;
+
+    printf("bench_busypoll: %d tnfs_stat() and 64 byte tnfs_read() calls over loopback UDP\n", BENCH_OPS);
+    bench_run("default", handle);
+    netw_setBusyPoll(BENCH_BUDGET, -1);
+    bench_run("low-latency", handle);
+    netw_setBusyPoll(0, -1);
+
+    tnfs_close(handle);
+    tnfs_umount();
+    tnfs_disconnect();
+    tnfs_test_stop(server);
+
+    return 0;
+}
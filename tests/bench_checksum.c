@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tnfs_test.h"
+#include "../include/tnfs_checksum.h"
+
+/*
+ * MB/s of CRC-32C with the CRC instructions of the processor and with the portable tables, and of xxHash64, over a
+ * buffer that stays in the cache like the data of a read does. Before timing, both CRC-32C paths have to give the
+ * check values of the algorithms and the same CRC over odd lengths and offsets.
+ */
+
+#define BENCH_SIZE (256 * 1024)
+#define BENCH_BYTES (512 * 1024 * 1024)
+
+uint8_t bench_data[BENCH_SIZE];
+volatile uint64_t bench_sink;	// keeps the results alive
+
+/* the check values of CRC-32C and xxHash64 with the CRC-32C path that is selected */
+void bench_known()
+{
+    TNFS_TEST_CHECK(tnfs_crc32c(0, "123456789", 9) == 0xE3069283);
+    TNFS_TEST_CHECK(tnfs_crc32c(tnfs_crc32c(0, "1234", 4), "56789", 5) == 0xE3069283);
+    TNFS_TEST_CHECK(tnfs_crc32c(0, "", 0) == 0);
+    TNFS_TEST_CHECK(tnfs_xxh64("", 0, 0) == 0xEF46DB3751D8E999ULL);
+    TNFS_TEST_CHECK(tnfs_xxh64("abc", 3, 0) == 0x44BC2CF5AD770999ULL);
+}
+
+/* returns the MB/s of one algorithm over the buffer */
+double bench_rate(bool crc)
+{
+    uint32_t began = netw_micros();
+    uint64_t sum = 0;
+
+    for (int i = 0; i < BENCH_BYTES / BENCH_SIZE; i++)
+        sum += crc ? tnfs_crc32c((uint32_t)sum, bench_data, BENCH_SIZE) : tnfs_xxh64(bench_data, BENCH_SIZE, sum);
+    bench_sink = sum;
+
+    return (double)BENCH_BYTES / (netw_micros() - began);
+}
+
+int main()
+{
+    uint32_t crc[2][64];
+    bool hardware;
+
+    srand(1985);
+    for (int i = 0; i < BENCH_SIZE; i++)
+        bench_data[i] = rand();
+
+    /* asks the processor, then the tables are forced for the second pass */
+    tnfs_crc32c(0, "", 0);
+    hardware = tnfs_crc32c_hardware == 1;
+    for (int path = 0; path < 2; path++) {
+        tnfs_crc32c_hardware = path == 0 && hardware ? 1 : 0;
+        bench_known();
+        for (int i = 0; i < 64; i++)
+            crc[path][i] = tnfs_crc32c(0, &bench_data[i], 1000 + i * 37);
+    }
+    TNFS_TEST_CHECK(memcmp(crc[0], crc[1], sizeof(crc[0])) == 0);
+
+    printf("bench_checksum: %d MiB through a %d KiB buffer\n", BENCH_BYTES >> 20, BENCH_SIZE >> 10);
+    if (hardware) {
+        tnfs_crc32c_hardware = 1;
+        printf("  %-18s %8.0f MB/s\n", "crc32c hardware", bench_rate(true));
+    } else {
+        printf("  %-18s %8s\n", "crc32c hardware", "n/a");
+    }
+    tnfs_crc32c_hardware = 0;
+    printf("  %-18s %8.0f MB/s\n", "crc32c portable", bench_rate(true));
+    printf("  %-18s %8.0f MB/s\n", "xxh64", bench_rate(false));
+
+    return tnfs_test_done("bench_checksum");
+}
@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tnfs_test.h"
+#include "../include/tnfs_listing.h"
+
+/*
+ * Milliseconds to sort a listing of 50000 entries again with tnfs_listing_sort(), by name, time and size, next to
+ * qsort() with strcasecmp() on the same names. The names look like those of a large collection of disk images: many
+ * share a prefix of more than four characters, which leaves ties after the first radix passes.
+ */
+
+#define BENCH_ENTRIES 50000
+#define BENCH_ROUNDS 5
+
+struct tnfs_listing bench_list;
+
+/* the order of two entries by name for qsort() */
+int bench_compare(const void* a, const void* b)
+{
+    return strcasecmp(&bench_list.names[bench_list.entries[*(const uint32_t*)a].name],
+                      &bench_list.names[bench_list.entries[*(const uint32_t*)b].name]);
+}
+
+/* returns the best of a few sorts in milliseconds, with qsort() when sortopts is 0xFF */
+double bench_sort(uint8_t sortopts)
+{
+    uint32_t best = 0xFFFFFFFF;
+    uint32_t began, took;
+
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        began = netw_micros();
+        if (sortopts == 0xFF) {
+            for (uint32_t i = 0; i < bench_list.count; i++)
+                bench_list.order[i] = i;
+            qsort(bench_list.order, bench_list.count, sizeof(uint32_t), bench_compare);
+        } else {
+            tnfs_listing_sort(&bench_list, "", 0, sortopts);
+        }
+        took = netw_micros() - began;
+        best = took < best ? took : best;
+    }
+
+    return best / 1000.0;
+}
+
+int main()
+{
+    const char* series[] = { "Gauntlet", "GameDisk", "Games_Pack", "Dungeon Master", "Demo", "Menu" };
+    char name[64];
+    struct dirx_item item;
+
+    srand(1985);
+    for (int i = 0; i < BENCH_ENTRIES; i++) {
+        snprintf(name, sizeof(name), "%s %05d.%s", series[rand() % 6], rand() % 100000, rand() % 2 ? "st" : "MSA");
+        item.name = name;
+        item.flags = i % 20 == 0 ? TNFS_DIRENTRY_DIR : 0;
+        item.size = 368640 + (rand() % 4) * 368640;
+        item.modified = 600000000 + rand();
+        item.created = 0;
+        if (!tnfs_listing_add(&bench_list, &item))
+            return 1;
+    }
+    tnfs_listing_sort(&bench_list, "", 0, TNFS_DIRSORT_NONE);
+
+    printf("bench_listing: %d entries sorted again, best of %d\n", BENCH_ENTRIES, BENCH_ROUNDS);
+    printf("  %-20s %7.2f milliseconds\n", "name", bench_sort(0));
+    printf("  %-20s %7.2f milliseconds\n", "name, descending", bench_sort(TNFS_DIRSORT_DESCENDING));
+    printf("  %-20s %7.2f milliseconds\n", "modified", bench_sort(TNFS_DIRSORT_MODIFIED));
+    printf("  %-20s %7.2f milliseconds\n", "size", bench_sort(TNFS_DIRSORT_SIZE));
+    printf("  %-20s %7.2f milliseconds\n", "qsort(), name", bench_sort(0xFF));
+
+    tnfs_listing_free(&bench_list);
+
+    return 0;
+}
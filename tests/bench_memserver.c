@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <time.h>
+#include "tnfs_test.h"
+
+/*
+ * CPU cost of the client per operation, without a kernel in the way: the operations go through the memory transport,
+ * and the time the stand-in server spends on each request is taken out by timing the send of the transport, which
+ * is where the server handles the request.
+ */
+
+#define BENCH_OPS 200000
+
+uint64_t bench_server = 0;	// nanoseconds spent in the server
+
+/* monotonic time in nanoseconds */
+uint64_t bench_nanos()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* the memory transport, with the server time counted */
+int bench_connect(char* host, int port, bool useTCP)
+{
+    return tnfs_memserver_transport.connect(host, port, useTCP);
+}
+
+void bench_disconnect()
+{
+    tnfs_memserver_transport.disconnect();
+}
+
+int bench_send(const uint8_t* buffer, int length)
+{
+    uint64_t began = bench_nanos();
+    int n = tnfs_memserver_transport.send(buffer, length);
+
+    bench_server += bench_nanos() - began;
+    return n;
+}
+
+int bench_recv(uint8_t* buffer, int buffer_size)
+{
+    return tnfs_memserver_transport.recv(buffer, buffer_size);
+}
+
+int bench_sendBatch(struct netw_datagram* d, int count)
+{
+    uint64_t began = bench_nanos();
+    int n = tnfs_memserver_transport.sendBatch(d, count);
+
+    bench_server += bench_nanos() - began;
+    return n;
+}
+
+int bench_recvBatch(struct netw_datagram* d, int count)
+{
+    return tnfs_memserver_transport.recvBatch(d, count);
+}
+
+void bench_setTimeout(int t)
+{
+    tnfs_memserver_transport.setTimeout(t);
+}
+
+const struct netw_transport bench_transport = {
+    bench_connect, bench_disconnect, bench_send, bench_recv, bench_sendBatch, bench_recvBatch, bench_setTimeout
+};
+
+/* operations to time, each one a single request */
+void bench_stat(int fd)
+{
+    struct fstat st;
+
+    (void)fd;
+    tnfs_stat("/games/game07.st", &st);
+}
+
+void bench_seek(int fd)
+{
+    tnfs_lseek(fd, TNFS_SEEK_SET, 0);
+}
+
+void bench_read(int fd)
+{
+    char data[512];
+
+    if (tnfs_read(data, fd, sizeof(data)) <= 0)
+        tnfs_lseek(fd, TNFS_SEEK_SET, 0);
+}
+
+void bench_open(int fd)
+{
+    (void)fd;
+    tnfs_close(tnfs_open("/games/game07.st", TNFS_O_RDONLY, 0));
+}
+
+/* runs one operation BENCH_OPS times and prints the time per operation with and without the server */
+void bench_run(const char* name, void (*op)(int), int fd, int requests)
+{
+    uint64_t began, total;
+
+    bench_server = 0;
+    began = bench_nanos();
+    for (int i = 0; i < BENCH_OPS; i++)
+        op(fd);
+    total = bench_nanos() - began;
+
+    printf("  %-16s client %6.0f ns/op  server %6.0f ns/op  %d request(s) per op\n", name,
+        (double)(total - bench_server) / BENCH_OPS, (double)bench_server / BENCH_OPS, requests);
+}
+
+int main()
+{
+    static char contents[64 * 1024];
+    char name[32];
+    int fd;
+
+    for (int i = 0; i < 40; i++) {
+        snprintf(name, sizeof(name), "/games/game%02d.st", i);
+        tnfs_memserver_put(name, contents, sizeof(contents), 0);
+    }
+    tnfs_setTransport(&bench_transport);
+    if (tnfs_connect("memory", false) != 0 || tnfs_mount("/", "", "") != 0)
+        return 1;
+    fd = tnfs_open("/games/game00.st", TNFS_O_RDONLY, 0);
+
+    printf("bench_memserver: client CPU per operation over the memory transport, %d operations each\n", BENCH_OPS);
+    bench_run("tnfs_stat()", bench_stat, fd, 1);
+    bench_run("tnfs_lseek()", bench_seek, fd, 1);
+    bench_run("tnfs_read() 512", bench_read, fd, 1);
+    bench_run("open and close", bench_open, fd, 2);
+
+    tnfs_close(fd);
+    tnfs_umount();
+    tnfs_disconnect();
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include "tnfs_test.h"
+#include "../include/tnfs_sched.h"
+
+/*
+ * Interactive latency while a bulk copy runs, over loopback UDP: one job keeps BENCH_BACKLOG reads of large files
+ * queued in the scheduler, another sends one tnfs_stat() after the other and times it from submit to completion.
+ * The stat is queued as TNFS_SCHED_INTERACTIVE, and for comparison in the bulk class, which is what a single FIFO
+ * of requests would do.
+ */
+
+#define BENCH_STATS 2000
+#define BENCH_FILES 4
+#define BENCH_SIZE (1024 * 1024)
+#define BENCH_BACKLOG (6 * TNFS_SCHED_SLOTS)	// bulk reads waiting in the scheduler
+#define BENCH_REQUESTS (BENCH_BACKLOG + 2 * TNFS_SCHED_SLOTS)
+
+struct tnfs_pool* bench_pool;
+uint8_t  bench_files[BENCH_FILES];
+int      bench_next = 0;	// file of the next bulk read
+bool     bench_statWaiting = false;
+uint32_t bench_submitted;	// netw_micros() when the stat was submitted
+uint32_t bench_samples[BENCH_STATS];
+int      bench_count = 0;
+uint64_t bench_bytes = 0;	// read by the bulk job
+char     bench_data[TNFS_POOL_BUFSIZE];
+
+/* collects a completed request: the stat is timed, a bulk read starts over at the end of its file */
+void bench_done(struct tnfs_request* req)
+{
+    uint8_t* file = req->user;
+    struct fstat st;
+    int n;
+
+    if (file == NULL) {
+        tnfs_takeStat(req, &st);
+        bench_samples[bench_count++] = netw_micros() - bench_submitted;
+        bench_statWaiting = false;
+    } else {
+        n = tnfs_takeRead(req, *file, bench_data);
+        if (n > 0)
+            bench_bytes += n;
+        else
+            tnfs_lseek(*file, TNFS_SEEK_SET, 0);
+    }
+
+    tnfs_pool_put(bench_pool, req);
+}
+
+/* runs until BENCH_STATS stats completed, with or without the bulk job */
+void bench_run(const char* mode, bool bulk, uint8_t cls)
+{
+    struct tnfs_request* req;
+    uint32_t began = netw_micros();
+    double seconds;
+
+    bench_count = 0;
+    bench_bytes = 0;
+    while (bench_count < BENCH_STATS) {
+        while (bulk && tnfs_sched_queued(TNFS_SCHED_BULK) < BENCH_BACKLOG && (req = tnfs_pool_get(bench_pool)) != NULL) {
+            req->user = &bench_files[bench_next];
+            tnfs_prepareRead(req, bench_files[bench_next], bench_pool->bufsize - 7);
+            tnfs_sched_submit(req, TNFS_SCHED_BULK);
+            bench_next = (bench_next + 1) % BENCH_FILES;
+        }
+        if (!bench_statWaiting && (req = tnfs_pool_get(bench_pool)) != NULL) {
+            req->user = NULL;
+            tnfs_prepareStat(req, "/meta.txt", bench_pool->bufsize);
+            bench_submitted = netw_micros();
+            tnfs_sched_submit(req, cls);
+            bench_statWaiting = true;
+        }
+        tnfs_sched_run(bench_done);
+    }
+
+    /* the rest of the backlog */
+    while (tnfs_sched_run(bench_done) > 0);
+
+    seconds = (netw_micros() - began) / 1e6;
+    printf("  %-24s stat p50 %5u us  p99 %5u us    bulk %6.1f MB/s\n", mode,
+        tnfs_test_percentile(bench_samples, BENCH_STATS, 50), tnfs_test_percentile(bench_samples, BENCH_STATS, 99),
+        bench_bytes / 1048576.0 / seconds);
+}
+
+int main()
+{
+    static char contents[BENCH_SIZE];
+    struct tnfs_context* context;
+    char name[16];
+    pid_t server;
+
+    tnfs_memserver_put("/meta.txt", "meta", 4, 0);
+    for (int i = 0; i < BENCH_FILES; i++) {
+        snprintf(name, sizeof(name), "/bulk%d.bin", i);
+        tnfs_memserver_put(name, contents, sizeof(contents), 0);
+    }
+    server = tnfs_test_serve(TNFS_TEST_HOST);
+
+    /* the backlog needs more request descriptors than the default pool has */
+    context = tnfs_context_createPool(BENCH_REQUESTS, TNFS_POOL_BUFSIZE);
+    if (server < 0 || context == NULL)
+        return 1;
+    tnfs_context_switch(context);
+    if (tnfs_connect(TNFS_TEST_HOST, false) != 0 || tnfs_mount("/", "", "") != 0)
+        return 1;
+    bench_pool = tnfs_pool_default();
+    for (int i = 0; i < BENCH_FILES; i++) {
+        snprintf(name, sizeof(name), "/bulk%d.bin", i);
+        bench_files[i] = tnfs_open(name, TNFS_O_RDONLY, 0);
+    }
+
+    printf("bench_sched: %d stats, alone and next to %d queued bulk reads of %d bytes, over loopback UDP\n",
+        BENCH_STATS, BENCH_BACKLOG, bench_pool->bufsize - 7);
+    bench_run("idle", false, TNFS_SCHED_INTERACTIVE);
+    bench_run("bulk, interactive class", true, TNFS_SCHED_INTERACTIVE);
+    bench_run("bulk, one FIFO", true, TNFS_SCHED_BULK);
+
+    for (int i = 0; i < BENCH_FILES; i++)
+        tnfs_close(bench_files[i]);
+    tnfs_umount();
+    tnfs_disconnect();
+    tnfs_test_stop(server);
+
+    return 0;
+}
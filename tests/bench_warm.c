@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "tnfs_test.h"
+#include "../include/tnfs_warm.h"
+
+/*
+ * Cold against warm start of a short-lived process over loopback: every run is a new process that connects, mounts
+ * and lists a directory of 40 files. A warm run first loads the cache file the previous run saved, and reads the
+ * listing from it instead of the server.
+ */
+
+#define BENCH_RUNS 25
+#define BENCH_CACHE "/tmp/tnfs_bench_warm.cache"
+
+/* one short-lived process, returns its time to the listing in microseconds */
+uint32_t bench_run(bool warm)
+{
+    struct tnfs_warm_dir cached;
+    struct dirx_data data;
+    struct dirx_item item;
+    uint32_t began, took;
+    int fds[2], entries = 0;
+    pid_t pid;
+
+    if (pipe(fds) != 0)
+        return 0;
+    pid = fork();
+    if (pid == 0) {
+        began = netw_micros();
+        if (warm)
+            tnfs_warm_open(BENCH_CACHE);
+        tnfs_connect(TNFS_TEST_HOST, false);
+        tnfs_mount("/", "", "");
+        if (warm && tnfs_warm_opendirx("/games", "", 0, 0, &cached) == 0) {
+            while (tnfs_warm_nextdirx(&cached, &item) == 0)
+                entries++;
+        } else if (tnfs_opendirx("/games", "", 0, 0, &data) == 0) {
+            while (tnfs_nextdirx(&data, &item) == 0)
+                entries++;
+            tnfs_closedir(data.handle);
+        }
+        took = entries == 40 ? netw_micros() - began : 0;
+        tnfs_umount();
+        tnfs_disconnect();
+        if (warm)
+            tnfs_warm_close();
+        if (write(fds[1], &took, 4) != 4)
+            _exit(1);
+        _exit(0);
+    }
+
+    close(fds[1]);
+    if (read(fds[0], &took, 4) != 4)
+        took = 0;
+    close(fds[0]);
+    waitpid(pid, NULL, 0);
+
+    return took;
+}
+
+int main()
+{
+    uint32_t cold[BENCH_RUNS], warm[BENCH_RUNS];
+    char name[32];
+    pid_t server;
+
+    for (int i = 0; i < 40; i++) {
+        snprintf(name, sizeof(name), "/games/game%02d.st", i);
+        tnfs_memserver_put(name, name, 1000 + i, 0);
+    }
+    server = tnfs_test_serve(TNFS_TEST_HOST);
+    if (server < 0)
+        return 1;
+
+    unlink(BENCH_CACHE);
+    bench_run(true);	// leaves the cache file for the warm runs
+    for (int i = 0; i < BENCH_RUNS; i++) {
+        cold[i] = bench_run(false);
+        warm[i] = bench_run(true);
+    }
+    unlink(BENCH_CACHE);
+    tnfs_test_stop(server);
+
+    printf("bench_warm: connect, mount and list 40 entries in a new process, %d runs\n", BENCH_RUNS);
+    printf("  cold  p50 %6u us  p99 %6u us\n", tnfs_test_percentile(cold, BENCH_RUNS, 50), tnfs_test_percentile(cold, BENCH_RUNS, 99));
+    printf("  warm  p50 %6u us  p99 %6u us\n", tnfs_test_percentile(warm, BENCH_RUNS, 50), tnfs_test_percentile(warm, BENCH_RUNS, 99));
+
+    return 0;
+}
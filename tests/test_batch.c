@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <string.h>
+#include "tnfs_test.h"
+#include "../include/tnfs_pool.h"
+
+/*
+ * batches over loopback UDP and TCP: every request of tnfs_statv() and tnfs_readv() gets its own response, also when a
+ * stream could join several of them in one read, and a name that can't be sent fails alone while the others get theirs
+ */
+
+char test_long[TNFS_BUFFERSIZE + 1];	// a name longer than a request buffer
+
+/* stats and reads NETW_MAX_BATCH files of different sizes over the protocol given */
+void test_session(bool useTCP)
+{
+    char names[NETW_MAX_BATCH][16];
+    char* list[NETW_MAX_BATCH];
+    char data[NETW_MAX_BATCH][64];
+    char* buffers[NETW_MAX_BATCH];
+    struct fstat st[NETW_MAX_BATCH];
+    int results[NETW_MAX_BATCH];
+    uint8_t handles[NETW_MAX_BATCH];
+    bool ok = true;
+
+    TNFS_TEST_CHECK(tnfs_connect(TNFS_TEST_HOST, useTCP) == 0);
+    TNFS_TEST_CHECK(tnfs_mount("/", "", "") == 0);
+
+    for (int i = 0; i < NETW_MAX_BATCH; i++) {
+        snprintf(names[i], sizeof(names[i]), "f%d", i);
+        list[i] = names[i];
+        buffers[i] = data[i];
+    }
+    TNFS_TEST_CHECK(tnfs_statv(list, st, results, NETW_MAX_BATCH) == 0);
+    for (int i = 0; i < NETW_MAX_BATCH; i++)
+        ok = ok && results[i] == 0 && st[i].size == (uint32_t)(10 + i);
+    TNFS_TEST_CHECK(ok);
+
+    /* the name that doesn't fit fails, a missing file gets the error of the server, every slot is written */
+    list[1] = test_long;
+    list[2] = "missing";
+    memset(results, 0x55, sizeof(results));
+    TNFS_TEST_CHECK(tnfs_statv(list, st, results, NETW_MAX_BATCH) == 0);
+    TNFS_TEST_CHECK(results[0] == 0 && results[1] == -TNFS_ENAMETOOLONG && results[2] == -TNFS_ENOENT);
+    for (int i = 3; i < NETW_MAX_BATCH; i++)
+        TNFS_TEST_CHECK(results[i] == 0 && st[i].size == (uint32_t)(10 + i));
+
+    for (int i = 0; i < NETW_MAX_BATCH; i++) {
+        list[i] = names[i];
+        handles[i] = tnfs_open(names[i], TNFS_O_RDONLY, 0);
+    }
+    TNFS_TEST_CHECK(tnfs_readv(handles, buffers, sizeof(data[0]), results, NETW_MAX_BATCH) == 0);
+    for (int i = 0; i < NETW_MAX_BATCH; i++) {
+        TNFS_TEST_CHECK(results[i] == 10 + i && data[i][0] == 'a' + i && data[i][9 + i] == 'a' + i);
+        tnfs_close(handles[i]);
+    }
+
+    /* a plain request after the batch gets its own response, not a late one of the batch */
+    TNFS_TEST_CHECK(tnfs_stat("f3", &st[0]) == 0 && st[0].size == 13);
+
+    TNFS_TEST_CHECK(tnfs_umount() == 0);
+    tnfs_disconnect();
+}
+
+int main()
+{
+    char contents[64];
+    char name[16];
+    pid_t server;
+
+    memset(test_long, 'x', TNFS_BUFFERSIZE);
+    for (int i = 0; i < NETW_MAX_BATCH; i++) {
+        snprintf(name, sizeof(name), "/f%d", i);
+        memset(contents, 'a' + i, sizeof(contents));
+        tnfs_memserver_put(name, contents, 10 + i, 0);
+    }
+
+    server = tnfs_test_serve(TNFS_TEST_HOST);
+    TNFS_TEST_CHECK(server > 0);
+    test_session(false);
+    tnfs_test_stop(server);
+
+    server = tnfs_test_serveTCP(TNFS_TEST_HOST);
+    TNFS_TEST_CHECK(server > 0);
+    test_session(true);
+    tnfs_test_stop(server);
+
+    return tnfs_test_done("test_batch");
+}
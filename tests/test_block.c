@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include <string.h>
+#include "tnfs_test.h"
+#include "../include/tnfs_block.h"
+
+/*
+ * block devices on the memory transport: random reads and writes of random length, some continuing where the last
+ * one ended and some crossing several runs, are compared with a shadow copy of the image. The cache evicts and flushes
+ * all along, and at the end the image on the server must equal the shadow copy
+ */
+
+#define TEST_SECTORS 200	// sectors in the image, a few times TNFS_BLOCK_CACHE
+#define TEST_LONGEST 20		// most sectors in one access, more than two runs
+#define TEST_OPS 3000
+
+char test_shadow[(TEST_SECTORS + 2) * TNFS_BLOCK_SECTOR];	// what the image should hold
+char test_data[TEST_LONGEST * TNFS_BLOCK_SECTOR];
+
+/* reads the whole file from the server without the block device, returns true when it equals the shadow copy */
+bool test_server(char* path, uint32_t size)
+{
+    static char image[sizeof(test_shadow)];
+    uint32_t done = 0;
+    int fd = tnfs_open(path, TNFS_O_RDONLY, 0);
+    int code = 0;
+
+    if (fd < 0)
+        return false;
+    while (done < sizeof(image) && (code = tnfs_read(&image[done], fd, TNFS_BLOCK_SECTOR)) > 0)
+        done += code;
+    tnfs_close(fd);
+
+    return done == size && memcmp(image, test_shadow, size) == 0;
+}
+
+int main()
+{
+    struct tnfs_blockdev* b;
+    uint32_t sector = 0;
+    uint16_t count;
+    bool same = true;
+
+    /* every WRITE of a whole run fits in the buffer */
+    TNFS_TEST_CHECK(TNFS_BLOCK_RUN >= 1 && TNFS_BLOCK_RUN * TNFS_BLOCK_SECTOR + 7 <= TNFS_BUFFERSIZE);
+
+    srand(1985);
+    for (uint32_t i = 0; i < TEST_SECTORS * TNFS_BLOCK_SECTOR; i++)
+        test_shadow[i] = rand();
+    tnfs_memserver_put("/disk.img", test_shadow, TEST_SECTORS * TNFS_BLOCK_SECTOR, 0);
+    tnfs_memserver_put("/short.img", test_shadow, 700, 0);
+
+    tnfs_setTransport(&tnfs_memserver_transport);
+    TNFS_TEST_CHECK(tnfs_connect("memory", false) == 0);
+    TNFS_TEST_CHECK(tnfs_mount("/", "", "") == 0);
+
+    /* read-only, the partial last sector reads as zeros beyond the end of the file */
+    b = tnfs_block_open("/short.img", true);
+    TNFS_TEST_CHECK(b != NULL && b->sectors == 2);
+    if (b != NULL) {
+        TNFS_TEST_CHECK(tnfs_block_read(b, 0, 2, test_data) == 0);
+        TNFS_TEST_CHECK(memcmp(test_data, test_shadow, 700) == 0 && test_data[700] == 0 && test_data[1023] == 0);
+        TNFS_TEST_CHECK(tnfs_block_write(b, 0, 1, test_data) == -TNFS_EROFS);
+        TNFS_TEST_CHECK(tnfs_block_read(b, 2, 1, test_data) == -TNFS_EINVAL);
+        TNFS_TEST_CHECK(tnfs_block_close(b) == 0);
+    }
+
+    b = tnfs_block_open("/disk.img", false);
+    TNFS_TEST_CHECK(b != NULL && b->sectors == TEST_SECTORS);
+    if (b == NULL)
+        return tnfs_test_done("test_block");
+
+    for (int i = 0; i < TEST_OPS; i++) {
+        /* a quarter of the accesses continue where the last one ended, which reads ahead */
+        if (rand() % 4 != 0 || sector >= TEST_SECTORS)
+            sector = rand() % TEST_SECTORS;
+        count = 1 + rand() % TEST_LONGEST;
+        if (count > TEST_SECTORS - sector)
+            count = TEST_SECTORS - sector;
+
+        if (rand() % 3 == 0) {
+            for (int j = 0; j < count * TNFS_BLOCK_SECTOR; j++)
+                test_data[j] = rand();
+            TNFS_TEST_CHECK(tnfs_block_write(b, sector, count, test_data) == 0);
+            memcpy(&test_shadow[sector * TNFS_BLOCK_SECTOR], test_data, count * TNFS_BLOCK_SECTOR);
+        } else {
+            TNFS_TEST_CHECK(tnfs_block_read(b, sector, count, test_data) == 0);
+            same = same && memcmp(test_data, &test_shadow[sector * TNFS_BLOCK_SECTOR], count * TNFS_BLOCK_SECTOR) == 0;
+        }
+        sector += count;
+
+        if (i % 500 == 499) {
+            TNFS_TEST_CHECK(tnfs_block_flush(b) == 0 && b->dirty == 0);
+            TNFS_TEST_CHECK(test_server("/disk.img", TEST_SECTORS * TNFS_BLOCK_SECTOR));
+        }
+    }
+    TNFS_TEST_CHECK(same);
+    TNFS_TEST_CHECK(b->hits > 0 && b->misses > 0);
+
+    /* a read past the end fails, a write past the end grows the image */
+    TNFS_TEST_CHECK(tnfs_block_read(b, TEST_SECTORS - 1, 2, test_data) == -TNFS_EINVAL);
+    memset(test_data, 0x5A, 3 * TNFS_BLOCK_SECTOR);
+    TNFS_TEST_CHECK(tnfs_block_write(b, TEST_SECTORS - 1, 3, test_data) == 0 && b->sectors == TEST_SECTORS + 2);
+    memcpy(&test_shadow[(TEST_SECTORS - 1) * TNFS_BLOCK_SECTOR], test_data, 3 * TNFS_BLOCK_SECTOR);
+
+    /* offsets beyond 4 GiB don't exist in TNFS: a write there must not wrap around to the start of the image */
+    TNFS_TEST_CHECK(tnfs_block_write(b, 0x800000, 1, test_data) == -TNFS_EINVAL);
+    TNFS_TEST_CHECK(tnfs_block_write(b, 0x7FFFFF, 2, test_data) == -TNFS_EINVAL);
+    TNFS_TEST_CHECK(tnfs_block_read(b, 0x800000, 1, test_data) == -TNFS_EINVAL);
+    TNFS_TEST_CHECK(b->sectors == TEST_SECTORS + 2);
+    TNFS_TEST_CHECK(tnfs_block_close(b) == 0);
+    TNFS_TEST_CHECK(test_server("/disk.img", sizeof(test_shadow)));
+
+    tnfs_umount();
+    tnfs_disconnect();
+
+    return tnfs_test_done("test_block");
+}
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <string.h>
+#include "tnfs_test.h"
+#include "../include/tnfs_checksum.h"
+
+/*
+ * known answers of CRC-32C and xxHash64, also with the digest built up over reads of odd sizes, and a checksum file
+ * is matched by the names on its lines, over the whole file, and a single digest applies to any file
+ */
+
+#define TEST_SPAM "Nobody inspects the spammish repetition"	// 39 bytes, more than one stripe of xxHash64
+
+bool test_empty = false;	// every READ is answered without data and without EOF
+
+/* empties the READ responses while test_empty is set */
+int test_recv(uint8_t* buffer, int length)
+{
+    if (test_empty && length >= 5 && buffer[3] == 0x21 && (buffer[4] == 0x00 || buffer[4] == TNFS_EOF)) {
+        buffer[4] = buffer[5] = buffer[6] = 0;
+        return 7;
+    }
+
+    return length;
+}
+
+/* reads a file with a CRC-32C running and compares it with a checksum file */
+int test_verify(char* path, char* sidecar)
+{
+    char data[64];
+    int fd = tnfs_open(path, TNFS_O_RDONLY, 0);
+
+    if (fd < 0)
+        return fd;
+    tnfs_checksum_start(fd, TNFS_CHECKSUM_CRC32C);
+    while (tnfs_read(data, fd, sizeof(data)) > 0);
+    tnfs_close(fd);
+
+    return tnfs_checksum_verify(fd, sidecar);
+}
+
+/* reads a file in pieces of the given sizes, over and over, with both digests running. Returns the handle */
+int test_pieces(char* path, const uint16_t* sizes, int count)
+{
+    char data[64];
+    int fd = tnfs_open(path, TNFS_O_RDONLY, 0);
+
+    if (fd < 0)
+        return fd;
+    tnfs_checksum_start(fd, TNFS_CHECKSUM_CRC32C | TNFS_CHECKSUM_XXH64);
+    for (int i = 0; tnfs_read(data, fd, sizes[i % count]) > 0; i++);
+    tnfs_close(fd);
+
+    return fd;
+}
+
+/* the published digests, with the CRC instructions and with the tables */
+void test_known()
+{
+    int hardware = tnfs_crc32c_hardware;
+
+    TNFS_TEST_CHECK(tnfs_crc32c(0, "123456789", 9) == 0xE3069283);
+    TNFS_TEST_CHECK(tnfs_crc32c(tnfs_crc32c(0, "1234", 4), "56789", 5) == 0xE3069283);
+    tnfs_crc32c_hardware = 0;
+    TNFS_TEST_CHECK(tnfs_crc32c(0, "123456789", 9) == 0xE3069283);
+    tnfs_crc32c_hardware = hardware;
+
+    TNFS_TEST_CHECK(tnfs_xxh64("", 0, 0) == 0xEF46DB3751D8E999ULL);
+    TNFS_TEST_CHECK(tnfs_xxh64("abc", 3, 0) == 0x44BC2CF5AD770999ULL);
+    TNFS_TEST_CHECK(tnfs_xxh64(TEST_SPAM, strlen(TEST_SPAM), 0) == 0xFBCEA83C8A378BF1ULL);
+}
+
+int main()
+{
+    static const uint16_t odd[] = { 5, 11, 1, 17, 2, 33 };	// read sizes
+    static const uint16_t whole[] = { 64 };
+    static char big[1000];
+    char list[4096] = "";
+    char line[64];
+    size_t others;
+    uint32_t crc;
+    uint64_t xxh;
+    int fd;
+
+    tnfs_memserver_put("/disks/image.st", "the disk image", 14, 0);
+    tnfs_test_recv = test_recv;
+    tnfs_setTransport(&tnfs_test_transport);
+    TNFS_TEST_CHECK(tnfs_connect("memory", false) == 0);
+    TNFS_TEST_CHECK(tnfs_mount("/", "", "") == 0);
+
+    test_known();
+
+    /* streaming: the digests of reads that split the stripes of xxHash64 at odd places equal the known ones */
+    tnfs_memserver_put("/spam.txt", TEST_SPAM, strlen(TEST_SPAM), 0);
+    fd = test_pieces("/spam.txt", odd, 6);
+    TNFS_TEST_CHECK(tnfs_checksum_result(fd, &crc, &xxh) == 0 && xxh == 0xFBCEA83C8A378BF1ULL);
+    fd = test_pieces("/spam.txt", whole, 1);
+    TNFS_TEST_CHECK(tnfs_checksum_result(fd, &crc, &xxh) == 0 && xxh == 0xFBCEA83C8A378BF1ULL);
+
+    /* and over many stripes they equal the digests of the whole block */
+    for (size_t i = 0; i < sizeof(big); i++)
+        big[i] = i * 7 + i / 13;
+    tnfs_memserver_put("/big.bin", big, sizeof(big), 0);
+    fd = test_pieces("/big.bin", odd, 6);
+    TNFS_TEST_CHECK(tnfs_checksum_result(fd, &crc, &xxh) == 0);
+    TNFS_TEST_CHECK(xxh == tnfs_xxh64(big, sizeof(big), 0) && crc == tnfs_crc32c(0, big, sizeof(big)));
+
+    /* the digest of the file, read once to learn it */
+    TNFS_TEST_CHECK(test_verify("/disks/image.st", "/disks/image.st") == -TNFS_ENODATA);
+    TNFS_TEST_CHECK(tnfs_checksum_result(0, &crc, NULL) == 0);
+
+    /* a list of many files, with this one far behind the first block and in binary mode */
+    for (int i = 0; i < 100; i++) {
+        snprintf(line, sizeof(line), "%08x  other%03d.st\n", i, i);
+        strcat(list, line);
+    }
+    others = strlen(list);
+    snprintf(line, sizeof(line), "%08x *disks/image.st\r\n", crc);
+    strcat(list, line);
+    tnfs_memserver_put("/disks/SUMS", list, strlen(list), 0);
+    TNFS_TEST_CHECK(test_verify("/disks/image.st", "/disks/SUMS") == 0);
+
+    /* a wrong digest for this file fails, a list without it has nothing to compare */
+    snprintf(line, sizeof(line), "%08x  image.st\n", crc ^ 1);
+    tnfs_memserver_put("/disks/bad.sum", line, strlen(line), 0);
+    TNFS_TEST_CHECK(test_verify("/disks/image.st", "/disks/bad.sum") == -TNFS_EIO);
+    tnfs_memserver_put("/disks/none.sum", list, others, 0);
+    TNFS_TEST_CHECK(test_verify("/disks/image.st", "/disks/none.sum") == -TNFS_ENODATA);
+
+    /* the BSD style and a file with only the digest */
+    snprintf(line, sizeof(line), "CRC32C (image.st) = %08x", crc);
+    tnfs_memserver_put("/disks/bsd.sum", line, strlen(line), 0);
+    TNFS_TEST_CHECK(test_verify("/disks/image.st", "/disks/bsd.sum") == 0);
+    snprintf(line, sizeof(line), "%08x\n", crc);
+    tnfs_memserver_put("/disks/image.st.crc", line, strlen(line), 0);
+    TNFS_TEST_CHECK(test_verify("/disks/image.st", "/disks/image.st.crc") == 0);
+
+    /* only the same name counts, not one that starts or ends like it */
+    snprintf(line, sizeof(line), "%08x  image.s\n%08x  image.st2\n%08x  IMAGE.ST\n", crc, crc, crc);
+    tnfs_memserver_put("/disks/near.sum", line, strlen(line), 0);
+    TNFS_TEST_CHECK(test_verify("/disks/image.st", "/disks/near.sum") == -TNFS_ENODATA);
+
+    /* a checksum file that never ends because each READ gets no data ends at the first empty one */
+    fd = tnfs_open("/disks/image.st", TNFS_O_RDONLY, 0);
+    tnfs_checksum_start(fd, TNFS_CHECKSUM_CRC32C);
+    TNFS_TEST_CHECK(tnfs_read(line, fd, sizeof(line)) == 14 && tnfs_close(fd) == 0);
+    test_empty = true;
+    TNFS_TEST_CHECK(tnfs_checksum_verify(fd, "/disks/image.st.crc") == -TNFS_ENODATA);
+    test_empty = false;
+
+    /* a handle out of range has no digest */
+    TNFS_TEST_CHECK(tnfs_checksum_result(TNFS_MAX_HANDLES, &crc, NULL) == -TNFS_EBADF);
+    TNFS_TEST_CHECK(tnfs_checksum_result(255, &crc, NULL) == -TNFS_EBADF);
+
+    tnfs_umount();
+    tnfs_disconnect();
+
+    return tnfs_test_done("test_checksum");
+}
@@ -0,0 +1,173 @@
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "tnfs_test.h"
+
+/*
+ * happy eyeballs on loopback: the resolved addresses alternate between IPv6 and IPv4, the race finds the family that
+ * answers when the other one refuses or stays silent, and the winner is tried first on the next connect without
+ * resolving the host again
+ */
+
+#define TEST_UNKNOWN "tnfs-test.invalid"	// a name that never resolves, reachable only through the cached address
+
+/* private functions of netw.c */
+int netw_resolve(char* host, int port, int sockType, struct netw_address* addrs);
+int netw_race(struct netw_address* addrs, int n, int sockType, int* winner);
+
+/* fills a with a loopback address and TNFS_PORT */
+void test_address(struct netw_address* a, const char* host)
+{
+    struct sockaddr_in* v4 = (struct sockaddr_in*)&a->addr;
+    struct sockaddr_in6* v6 = (struct sockaddr_in6*)&a->addr;
+
+    memset(a, 0, sizeof(struct netw_address));
+    if (inet_pton(AF_INET, host, &v4->sin_addr) == 1) {
+        v4->sin_family = AF_INET;
+        v4->sin_port = htons(TNFS_PORT);
+        a->len = sizeof(struct sockaddr_in);
+    } else {
+        inet_pton(AF_INET6, host, &v6->sin6_addr);
+        v6->sin6_family = AF_INET6;
+        v6->sin6_port = htons(TNFS_PORT);
+        a->len = sizeof(struct sockaddr_in6);
+    }
+}
+
+/* a socket on ::1 that takes requests and never answers them, like a server behind a broken IPv6 route */
+int test_silent()
+{
+    struct netw_address a;
+    int on = 1;
+    int fd = socket(AF_INET6, SOCK_DGRAM, 0);
+
+    test_address(&a, TNFS_TEST_HOST6);
+    setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on));
+    if (fd >= 0 && bind(fd, (struct sockaddr*)&a.addr, a.len) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* races the IPv6 and the IPv4 address, returns the family that won or -1, elapsed gets the milliseconds it took */
+int test_race(struct netw_address* addrs, uint32_t* elapsed)
+{
+    uint32_t start = netw_millis();
+    int winner = -1;
+    int fd = netw_race(addrs, 2, SOCK_DGRAM, &winner);
+
+    *elapsed = netw_millis() - start;
+    if (fd < 0)
+        return -1;
+    close(fd);
+
+    return addrs[winner].addr.ss_family;
+}
+
+/* the order of netw_resolve(): IPv6 first, and never twice the same family while the other one has addresses left */
+void test_order(char* host)
+{
+    struct netw_address addrs[NETW_MAX_ADDRESSES];
+    int n = netw_resolve(host, TNFS_PORT, SOCK_DGRAM, addrs);
+    int v6 = 0, v4 = 0;
+
+    for (int i = 0; i < n; i++)
+        addrs[i].addr.ss_family == AF_INET6 ? v6++ : v4++;
+    TNFS_TEST_CHECK(n > 0);
+    TNFS_TEST_CHECK(v6 == 0 || addrs[0].addr.ss_family == AF_INET6);
+    for (int i = 1; i < n; i++) {
+        bool same = addrs[i].addr.ss_family == addrs[i - 1].addr.ss_family;
+        int left = 0;
+
+        for (int j = i; j < n; j++)
+            left += addrs[j].addr.ss_family != addrs[i].addr.ss_family;
+        TNFS_TEST_CHECK(!same || left == 0);
+    }
+}
+
+int main()
+{
+    struct netw_address addrs[2];
+    struct netw_address cached;
+    struct fstat st;
+    uint32_t elapsed;
+    bool useTCP;
+    int port, silent, saved, quiet;
+    pid_t server4, server6;
+
+    /* localhost has both families on most systems */
+    tnfs_memserver_put("/file.txt", "0123456789", 10, 0);
+    test_order("localhost");
+    test_order("127.0.0.1");
+    test_order("::1");
+
+    /* a host with an IPv6 and an IPv4 address, in the order netw_resolve() gives them */
+    test_address(&addrs[0], TNFS_TEST_HOST6);
+    test_address(&addrs[1], TNFS_TEST_HOST);
+    netw_setProbe((const uint8_t*)"\x00\x00\xFF\x01", 4);
+
+    /* nothing listens at all */
+    TNFS_TEST_CHECK(test_race(addrs, &elapsed) == -1);
+
+    /* IPv6 refuses: IPv4 starts at once instead of after the head start */
+    server4 = tnfs_test_serve(TNFS_TEST_HOST);
+    TNFS_TEST_CHECK(server4 > 0);
+    TNFS_TEST_CHECK(test_race(addrs, &elapsed) == AF_INET && elapsed < NETW_EYEBALLS_DELAY_MS);
+
+    /* IPv6 stays silent: IPv4 wins once the head start is over */
+    silent = test_silent();
+    TNFS_TEST_CHECK(silent >= 0);
+    TNFS_TEST_CHECK(test_race(addrs, &elapsed) == AF_INET && elapsed >= NETW_EYEBALLS_DELAY_MS);
+
+    /* also with a timeout shorter than the head start */
+    setTimeoutTime(100);
+    TNFS_TEST_CHECK(test_race(addrs, &elapsed) == AF_INET && elapsed >= NETW_EYEBALLS_DELAY_MS);
+    setTimeoutTime(1000);
+    close(silent);
+
+    /* both answer: IPv6 wins with its head start */
+    server6 = tnfs_test_serve(TNFS_TEST_HOST6);
+    TNFS_TEST_CHECK(server6 > 0);
+    TNFS_TEST_CHECK(test_race(addrs, &elapsed) == AF_INET6 && elapsed < NETW_EYEBALLS_DELAY_MS);
+
+    /* IPv4 is gone: IPv6 still wins */
+    tnfs_test_stop(server4);
+    TNFS_TEST_CHECK(test_race(addrs, &elapsed) == AF_INET6);
+
+    /* a session over IPv6, the winner is cached for the host */
+    TNFS_TEST_CHECK(tnfs_connect(TNFS_TEST_HOST6, false) == 0);
+    TNFS_TEST_CHECK(tnfs_mount("/", "", "") == 0 && tnfs_stat("file.txt", &st) == 0 && st.size == 10);
+    TNFS_TEST_CHECK(tnfs_umount() == 0);
+    tnfs_disconnect();
+    TNFS_TEST_CHECK(netw_getCachedAddress(&port, &useTCP, &cached) != NULL);
+    TNFS_TEST_CHECK(cached.addr.ss_family == AF_INET6 && port == TNFS_PORT && !useTCP);
+
+    /* the cached address is tried first: a host that doesn't resolve connects through it */
+    netw_setCachedAddress(TEST_UNKNOWN, TNFS_PORT, false, &addrs[0]);
+    TNFS_TEST_CHECK(tnfs_connect(TEST_UNKNOWN, false) == 0);
+    TNFS_TEST_CHECK(tnfs_mount("/", "", "") == 0 && tnfs_stat("file.txt", &st) == 0);
+    TNFS_TEST_CHECK(tnfs_umount() == 0);
+    tnfs_disconnect();
+
+    /* once the cached address is dead the host is resolved again, which fails for this one (quietly here) */
+    netw_setCachedAddress(TEST_UNKNOWN, TNFS_PORT, false, &addrs[1]);
+    fflush(stderr);
+    saved = dup(STDERR_FILENO);
+    quiet = open("/dev/null", O_WRONLY);
+    dup2(quiet, STDERR_FILENO);
+    TNFS_TEST_CHECK(tnfs_connect(TEST_UNKNOWN, false) != 0);
+    fflush(stderr);
+    dup2(saved, STDERR_FILENO);
+    close(quiet);
+    close(saved);
+
+    tnfs_test_stop(server6);
+
+    return tnfs_test_done("test_eyeballs");
+}
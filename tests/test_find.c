@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <string.h>
+#include "tnfs_test.h"
+#include "../include/tnfs_find.h"
+
+/*
+ * tnfs_find() over a small tree on the memory transport: every matching file is reported once with its path and size,
+ * directories are searched whatever the pattern says, hidden files only with TNFS_DIROPT_NO_SKIPHIDDEN, and the counts
+ * and bytes of the result are those of the listings the server sent
+ */
+
+/* the tree, with the files that "*.st" finds */
+struct test_file {
+    const char* path;
+    uint32_t size;
+    bool matches;
+    bool hidden;
+} test_files[] = {
+    { "/games/a.st", 10, true, false },
+    { "/games/b.txt", 11, false, false },
+    { "/games/.c.st", 12, true, true },
+    { "/games/sub/d.st", 13, true, false },
+    { "/games/sub/e.txt", 14, false, false },
+    { "/games/sub/deep/F.ST", 15, true, false },
+    { "/games/other.txt/g.st", 16, true, false },	// a directory that doesn't match the pattern
+    { "/outside.st", 17, false, false },
+};
+
+#define TEST_FILES (int)(sizeof(test_files) / sizeof(test_files[0]))
+#define TEST_MANY (2 * TNFS_DIRX_BATCH + 1)	// files in /many, three READDIRX responses
+
+int  test_found[TEST_FILES];	// reports per file
+int  test_limit = -1;		// reports until the callback stops the search, -1 never
+bool test_sized = true;		// every report had the size of its file
+
+/* counts a match by its path */
+bool test_found_file(const char* path, struct dirx_item* item, void* user)
+{
+    int* reports = (int*)user;
+
+    (*reports)++;
+    for (int i = 0; i < TEST_FILES; i++) {
+        if (strcmp(path, test_files[i].path) == 0) {
+            test_found[i]++;
+            test_sized = test_sized && item->size == test_files[i].size;
+        }
+    }
+
+    return test_limit < 0 || *reports < test_limit;
+}
+
+/* the bytes of one READDIRX response with these names */
+uint32_t test_bytes(const char** names, int count)
+{
+    uint32_t bytes = 9;
+
+    for (int i = 0; i < count; i++)
+        bytes += strlen(names[i]) + 14;
+
+    return bytes;
+}
+
+int main()
+{
+    const char* games[] = { "a.st", "other.txt", "sub" };
+    const char* hidden[] = { ".c.st", "a.st", "other.txt", "sub" };
+    const char* sub[] = { "d.st", "deep" };
+    const char* deep[] = { "F.ST" };
+    const char* other[] = { "g.st" };
+    const char* dirs[] = { "other.txt", "sub" };
+    char path[32];
+    struct tnfs_find_result r;
+    uint32_t bytes;
+    int reports = 0;
+    bool ok = true;
+
+    for (int i = 0; i < TEST_FILES; i++)
+        tnfs_memserver_put(test_files[i].path, "0123456789abcdefghij", test_files[i].size, 0);
+    for (int i = 0; i < TEST_MANY; i++) {
+        snprintf(path, sizeof(path), "/many/f%03d.st", i);
+        tnfs_memserver_put(path, "", 0, 0);
+    }
+    tnfs_setTransport(&tnfs_memserver_transport);
+    TNFS_TEST_CHECK(tnfs_connect("memory", false) == 0);
+    TNFS_TEST_CHECK(tnfs_mount("/", "", "") == 0);
+
+    /* hidden files are left out by default */
+    TNFS_TEST_CHECK(tnfs_find("/games", "*.st", 0, test_found_file, &reports, &r) == 0);
+    for (int i = 0; i < TEST_FILES; i++)
+        ok = ok && test_found[i] == (test_files[i].matches && !test_files[i].hidden);
+    TNFS_TEST_CHECK(ok && test_sized && reports == 4);
+    bytes = test_bytes(games, 3) + test_bytes(sub, 2) + test_bytes(deep, 1) + test_bytes(other, 1);
+    TNFS_TEST_CHECK(r.matches == 4 && r.dirs == 4 && r.entries == 7 && r.bytes == bytes && r.failed == 0);
+
+    /* and found with TNFS_DIROPT_NO_SKIPHIDDEN */
+    memset(test_found, 0, sizeof(test_found));
+    reports = 0;
+    TNFS_TEST_CHECK(tnfs_find("/games/", "*.st", TNFS_DIROPT_NO_SKIPHIDDEN, test_found_file, &reports, &r) == 0);
+    for (int i = 0; i < TEST_FILES; i++)
+        ok = ok && test_found[i] == test_files[i].matches;
+    TNFS_TEST_CHECK(ok && test_sized && reports == 5);
+    bytes = test_bytes(hidden, 4) + test_bytes(sub, 2) + test_bytes(deep, 1) + test_bytes(other, 1);
+    TNFS_TEST_CHECK(r.matches == 5 && r.dirs == 4 && r.entries == 8 && r.bytes == bytes);
+
+    /* a pattern that matches nothing still walks the whole tree */
+    reports = 0;
+    TNFS_TEST_CHECK(tnfs_find("/games", "*.zip", 0, test_found_file, &reports, &r) == 0);
+    TNFS_TEST_CHECK(reports == 0 && r.matches == 0 && r.dirs == 4 && r.entries == 3);
+    bytes = test_bytes(dirs, 2) + test_bytes(&sub[1], 1) + 2 * 5;	// two listings that are only the end
+    TNFS_TEST_CHECK(r.bytes == bytes);
+
+    /* a listing of several responses counts the header of each */
+    TNFS_TEST_CHECK(tnfs_find("/many", "*", 0, test_found_file, &reports, &r) == 0);
+    TNFS_TEST_CHECK(r.matches == TEST_MANY && r.bytes == 3 * 9 + TEST_MANY * (strlen("f000.st") + 14));
+
+    /* the callback stops the search */
+    reports = 0;
+    test_limit = 2;
+    TNFS_TEST_CHECK(tnfs_find("/games", "*", 0, test_found_file, &reports, &r) == 0);
+    TNFS_TEST_CHECK(reports == 2 && r.matches == 2);
+    test_limit = -1;
+
+    /* a root that isn't there fails */
+    TNFS_TEST_CHECK(tnfs_find("/missing", "*", 0, test_found_file, &reports, &r) == -TNFS_ENOENT);
+    TNFS_TEST_CHECK(r.dirs == 0 && r.failed == 1);
+
+    tnfs_umount();
+    tnfs_disconnect();
+
+    return tnfs_test_done("test_find");
+}
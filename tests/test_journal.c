@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "tnfs_test.h"
+#include "../include/tnfs_journal.h"
+
+/*
+ * the journal keeps a file readable and writable while the server is away, detects changes by others made after
+ * our own writes, and leaves no overlay copies behind once it has been replayed. Opening a file for writing doesn't
+ * download it and only the first write after the open asks the modification time again
+ */
+
+#define TEST_JOURNAL "/tmp/tnfs_test.journal"
+#define TEST_OVERLAY "/tmp/tnfs_test_overlay"
+#define TEST_TWIN1 "/7aii0oki"	// two paths with the same tnfs_journal_hash()
+#define TEST_TWIN2 "/rkhpg1y3"
+
+bool test_offline = false;	// true while the server "can't be reached"
+bool test_dropAfterWrite = false;	// the server goes away right after it answered a WRITE
+
+/* requests and responses get lost while test_offline is set */
+int test_send(const uint8_t* buffer, int length)
+{
+    return test_offline ? length : tnfs_test_inner->send(buffer, length);
+}
+
+int test_recv(uint8_t* buffer, int length)
+{
+    if (test_offline)
+        return NETW_ERR_TIMEOUT;
+    if (test_dropAfterWrite && length >= 4 && buffer[3] == 0x22) {
+        test_dropAfterWrite = false;
+        test_offline = true;
+    }
+
+    return length;
+}
+
+/* reads a whole file of the server into data */
+int test_fetch(char* path, char* data, uint16_t size)
+{
+    int fd = tnfs_open(path, TNFS_O_RDONLY, 0);
+    int length = fd >= 0 ? tnfs_read(data, fd, size) : fd;
+
+    if (fd >= 0)
+        tnfs_close(fd);
+
+    return length;
+}
+
+int main()
+{
+    struct tnfs_journal_result r;
+    char data[32];
+    int doc, other, twin1, twin2;
+
+    unlink(TEST_JOURNAL);
+    tnfs_memserver_put("/doc.txt", "0123456789", 10, 1000);
+    tnfs_memserver_put("/other.txt", "abcdefghij", 10, 1000);
+    tnfs_test_send = test_send;
+    tnfs_test_recv = test_recv;
+    tnfs_setTransport(&tnfs_test_transport);
+    TNFS_TEST_CHECK(tnfs_connect("memory", false) == 0);
+    TNFS_TEST_CHECK(tnfs_mount("/", "", "") == 0);
+    TNFS_TEST_CHECK(tnfs_journal_open(TEST_JOURNAL, TEST_OVERLAY) == 0);
+
+    /* both files are opened and written while the server is there, without downloading them */
+    doc = tnfs_open("/doc.txt", TNFS_O_RDWR, 0);
+    other = tnfs_open("/other.txt", TNFS_O_RDWR, 0);
+    TNFS_TEST_CHECK(doc >= 0 && other >= 0);
+    TNFS_TEST_CHECK(tnfs_test_sent[0x21] == 0 && tnfs_test_sent[0x24] == 2);
+    TNFS_TEST_CHECK(tnfs_write("AB", doc, 2) == 0);
+    TNFS_TEST_CHECK(tnfs_write("ab", other, 2) == 0);
+    TNFS_TEST_CHECK(tnfs_test_sent[0x22] == 2 && tnfs_test_sent[0x24] == 4);
+
+    /* a file that was only read and written online leaves no copy in the overlay when it is closed */
+    TNFS_TEST_CHECK(tnfs_close(doc) == 0 && access(TEST_OVERLAY "/doc.txt", F_OK) != 0);
+
+    /* reopened, what is read now can be read back offline; the next writes continue without asking the mtime again */
+    doc = tnfs_open("/doc.txt", TNFS_O_RDWR, 0);
+    TNFS_TEST_CHECK(doc >= 0 && tnfs_read(data, doc, sizeof(data)) == 10 && tnfs_lseek(doc, TNFS_SEEK_SET, 2) == 0);
+    sleep(1);	// so our writes give the file a new modification time
+    TNFS_TEST_CHECK(tnfs_write("CD", doc, 2) == 0 && tnfs_test_sent[0x24] == 6);
+    TNFS_TEST_CHECK(tnfs_write("EF", doc, 2) == 0 && tnfs_test_sent[0x24] == 6);
+
+    /* someone else changes the second file after our write */
+    tnfs_memserver_put("/other.txt", "changed", 7, 5000);
+
+    /* the server goes away, the writes continue in the journal and read back with what the server had */
+    test_offline = true;
+    TNFS_TEST_CHECK(tnfs_write("GH", doc, 2) == 0);
+    TNFS_TEST_CHECK(tnfs_write("cd", other, 2) == 0);
+    TNFS_TEST_CHECK(!tnfs_isOnline() && tnfs_journal_pending() > 0);
+    TNFS_TEST_CHECK(tnfs_lseek(doc, TNFS_SEEK_SET, 0) == 0);
+    memset(data, 0, sizeof(data));
+    TNFS_TEST_CHECK(tnfs_read(data, doc, sizeof(data)) == 10 && memcmp(data, "ABCDEFGH89", 10) == 0);
+
+    /* what was never read while the server was there can't be read back */
+    TNFS_TEST_CHECK(tnfs_lseek(other, TNFS_SEEK_SET, 0) == 0 && tnfs_read(data, other, 4) == 4 && memcmp(data, "abcd", 4) == 0);
+    TNFS_TEST_CHECK(tnfs_read(data, other, 4) == -TNFS_EIO);
+
+    /* back online: our own online writes aren't a conflict, the change by someone else is */
+    test_offline = false;
+    TNFS_TEST_CHECK(tnfs_journal_replay(&r) == 0);
+    TNFS_TEST_CHECK(r.conflicts == 1 && r.failed == 0 && r.remaining == 0);
+    TNFS_TEST_CHECK(test_fetch("/doc.txt", data, sizeof(data)) == 10 && memcmp(data, "ABCDEFGH89", 10) == 0);
+    TNFS_TEST_CHECK(test_fetch("/other.txt", data, sizeof(data)) == 7 && memcmp(data, "changed", 7) == 0);
+
+    /* the overlay is empty again, a later offline period can't read stale copies */
+    TNFS_TEST_CHECK(access(TEST_OVERLAY "/doc.txt", F_OK) != 0 && access(TEST_OVERLAY "/other.txt", F_OK) != 0);
+
+    tnfs_close(doc);
+    tnfs_close(other);
+
+    /* two paths with the same hash have an overlay copy and a conflict check each */
+    tnfs_memserver_put(TEST_TWIN1, "0123456789", 10, 1000);
+    tnfs_memserver_put(TEST_TWIN2, "abcd", 4, 1000);
+    twin1 = tnfs_open(TEST_TWIN1, TNFS_O_RDWR, 0);
+    TNFS_TEST_CHECK(twin1 >= 0 && tnfs_read(data, twin1, sizeof(data)) == 10 && tnfs_lseek(twin1, TNFS_SEEK_SET, 0) == 0);
+    twin2 = tnfs_open(TEST_TWIN2, TNFS_O_RDWR, 0);
+    TNFS_TEST_CHECK(twin2 >= 0);
+    test_offline = true;
+    TNFS_TEST_CHECK(tnfs_write("x", twin1, 1) == 0 && tnfs_write("y", twin2, 1) == 0);
+    TNFS_TEST_CHECK(tnfs_lseek(twin1, TNFS_SEEK_SET, 4) == 0 && tnfs_read(data, twin1, 6) == 6 && memcmp(data, "456789", 6) == 0);
+    tnfs_memserver_put(TEST_TWIN2, "changed", 7, 5000);
+    test_offline = false;
+    TNFS_TEST_CHECK(tnfs_journal_replay(&r) == 0 && r.conflicts == 1 && r.failed == 0);
+    TNFS_TEST_CHECK(test_fetch(TEST_TWIN1, data, sizeof(data)) == 10 && memcmp(data, "x123456789", 10) == 0);
+    TNFS_TEST_CHECK(test_fetch(TEST_TWIN2, data, sizeof(data)) == 7 && memcmp(data, "changed", 7) == 0);
+    tnfs_close(twin1);
+    tnfs_close(twin2);
+
+    /* the server goes away right after it appended: the append is done and isn't sent again by the next replay */
+    tnfs_memserver_put("/log.txt", "start", 5, 1000);
+    twin1 = tnfs_open("/log.txt", TNFS_O_WRONLY | TNFS_O_APPEND, 0);
+    TNFS_TEST_CHECK(twin1 >= 0);
+    test_offline = true;
+    TNFS_TEST_CHECK(tnfs_write("one", twin1, 3) == 0 && tnfs_close(twin1) == 0);
+    TNFS_TEST_CHECK(tnfs_unlink("/doc.txt") == 0 && tnfs_journal_pending() == 2);
+    test_offline = false;
+    test_dropAfterWrite = true;
+    TNFS_TEST_CHECK(tnfs_journal_replay(&r) == -TNFS_EAGAIN && r.applied == 1 && r.remaining == 1);
+    test_offline = false;
+    TNFS_TEST_CHECK(tnfs_journal_replay(&r) == 0 && r.applied == 1 && r.remaining == 0);
+    memset(data, 0, sizeof(data));
+    TNFS_TEST_CHECK(test_fetch("/log.txt", data, sizeof(data)) == 8 && memcmp(data, "startone", 8) == 0);
+    TNFS_TEST_CHECK(test_fetch("/doc.txt", data, sizeof(data)) < 0);
+
+    tnfs_journal_close();
+    tnfs_umount();
+    tnfs_disconnect();
+
+    unlink(TEST_JOURNAL);
+    rmdir(TEST_OVERLAY);
+
+    return tnfs_test_done("test_journal");
+}
@@ -0,0 +1,141 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tnfs_test.h"
+#include "../include/tnfs_listing.h"
+
+/*
+ * tnfs_listing_sort() against qsort() with a plain comparison of the options, for every combination of the
+ * TNFS_DIRSORT_* flags with and without folders first. The names share long prefixes and differ only in case, and
+ * many sizes and times are equal, so most of the order comes from the ties after the radix passes.
+ */
+
+#define TEST_ENTRIES 3000
+
+struct tnfs_listing test_list;
+uint8_t test_diropts;
+uint8_t test_sortopts;
+
+/* compares names like the documentation says: without case unless TNFS_DIRSORT_CASE, then in strcmp() order */
+int test_names(const char* a, const char* b)
+{
+    int i = 0;
+
+    if (!(test_sortopts & TNFS_DIRSORT_CASE)) {
+        while (a[i] && tolower((unsigned char)a[i]) == tolower((unsigned char)b[i]))
+            i++;
+        if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i]))
+            return tolower((unsigned char)a[i]) < tolower((unsigned char)b[i]) ? -1 : 1;
+    }
+
+    return strcmp(a, b) < 0 ? -1 : strcmp(a, b) > 0;
+}
+
+/* the order of two entries of test_list for qsort() */
+int test_compare(const void* x, const void* y)
+{
+    struct tnfs_listing_entry* a = &test_list.entries[*(const uint32_t*)x];
+    struct tnfs_listing_entry* b = &test_list.entries[*(const uint32_t*)y];
+    bool descending = test_sortopts & TNFS_DIRSORT_DESCENDING;
+    int diff = 0;
+
+    if (!(test_diropts & TNFS_DIROPT_NO_FOLDERSFIRST) && (a->flags & TNFS_DIRENTRY_DIR) != (b->flags & TNFS_DIRENTRY_DIR))
+        return (a->flags & TNFS_DIRENTRY_DIR) ? -1 : 1;
+
+    if (test_sortopts & TNFS_DIRSORT_MODIFIED)
+        diff = a->modified < b->modified ? -1 : a->modified > b->modified;
+    else if (test_sortopts & TNFS_DIRSORT_SIZE)
+        diff = a->size < b->size ? -1 : a->size > b->size;
+    if (diff != 0)
+        return descending ? -diff : diff;
+
+    /* equal times and sizes are ordered by ascending names */
+    diff = test_names(&test_list.names[a->name], &test_list.names[b->name]);
+
+    return descending && !(test_sortopts & (TNFS_DIRSORT_MODIFIED | TNFS_DIRSORT_SIZE)) ? -diff : diff;
+}
+
+/* fills the listing with names that share prefixes of 0 to 9 characters and differ in case */
+void test_fill()
+{
+    const char* prefixes[] = { "", "a", "ab", "GAME", "gamedisk", "GameDisk_", "zz", "Z" };
+    const char* ends[] = { "", ".st", ".ST", ".msa", "1", "10", "2" };
+    char name[64];
+    struct dirx_item item;
+
+    srand(1985);
+    for (int i = 0; i < TEST_ENTRIES; i++) {
+        snprintf(name, sizeof(name), "%s%c%s%d", prefixes[rand() % 8], "aAbB_~"[rand() % 6], ends[rand() % 7], i);
+        /* every fifth name is the one before with the case turned around */
+        if (i % 5 == 0 && i > 0) {
+            strcpy(name, &test_list.names[test_list.entries[i - 1].name]);
+            for (char* p = name; *p; p++)
+                *p = isupper((unsigned char)*p) ? tolower((unsigned char)*p) : toupper((unsigned char)*p);
+        }
+        item.name = name;
+        item.flags = rand() % 4 == 0 ? TNFS_DIRENTRY_DIR : 0;
+        item.size = rand() % 8 * 1000;
+        item.modified = 1000000 + rand() % 16;
+        item.created = 0;
+        TNFS_TEST_CHECK(tnfs_listing_add(&test_list, &item));
+    }
+}
+
+/* sorts with tnfs_listing_sort() and with qsort(), true when the orders are the same */
+bool test_sort(const char* pattern, uint8_t diropts, uint8_t sortopts)
+{
+    static uint32_t expected[TEST_ENTRIES];
+    int n = 0;
+    int visible = tnfs_listing_sort(&test_list, pattern, diropts, sortopts);
+
+    for (uint32_t i = 0; i < test_list.count; i++) {
+        struct tnfs_listing_entry* e = &test_list.entries[i];
+        if (pattern[0] == 0 || ((e->flags & TNFS_DIRENTRY_DIR) && !(diropts & TNFS_DIROPT_DIR_PATTERN))
+         || tnfs_listing_match(&test_list.names[e->name], pattern, sortopts & TNFS_DIRSORT_CASE))
+            expected[n++] = i;
+    }
+    test_diropts = diropts;
+    test_sortopts = sortopts;
+    if (!(sortopts & TNFS_DIRSORT_NONE))
+        qsort(expected, n, sizeof(uint32_t), test_compare);
+
+    return visible == n && memcmp(test_list.order, expected, n * sizeof(uint32_t)) == 0;
+}
+
+int main()
+{
+    const uint8_t flags[] = { TNFS_DIRSORT_CASE, TNFS_DIRSORT_DESCENDING, TNFS_DIRSORT_MODIFIED, TNFS_DIRSORT_SIZE };
+    struct dirx_item item;
+    bool ok;
+
+    test_fill();
+
+    /* every combination of the flags, with and without folders first */
+    for (int combo = 0; combo < 16; combo++) {
+        uint8_t sortopts = 0;
+
+        for (int f = 0; f < 4; f++)
+            sortopts |= (combo & (1 << f)) ? flags[f] : 0;
+        for (int folders = 0; folders < 2; folders++) {
+            ok = test_sort("", folders ? 0 : TNFS_DIROPT_NO_FOLDERSFIRST, sortopts);
+            if (!TNFS_TEST_CHECK(ok))
+                fprintf(stderr, "  sortopts %02x %s\n", sortopts, folders ? "folders first" : "mixed");
+        }
+    }
+
+    /* the pattern, for files only or also for directories, and the order of the server */
+    TNFS_TEST_CHECK(test_sort("*.st*", 0, TNFS_DIRSORT_DESCENDING));
+    TNFS_TEST_CHECK(test_sort("*.st*", 0, TNFS_DIRSORT_CASE));
+    TNFS_TEST_CHECK(test_sort("game*", TNFS_DIROPT_DIR_PATTERN, TNFS_DIRSORT_SIZE | TNFS_DIRSORT_DESCENDING));
+    TNFS_TEST_CHECK(test_sort("*", 0, TNFS_DIRSORT_NONE));
+
+    /* the items are those of the order */
+    tnfs_listing_sort(&test_list, "", 0, 0);
+    TNFS_TEST_CHECK(tnfs_listing_item(&test_list, 0, &item) && strcmp(item.name, &test_list.names[test_list.entries[test_list.order[0]].name]) == 0);
+    TNFS_TEST_CHECK(!tnfs_listing_item(&test_list, test_list.visible, &item));
+
+    tnfs_listing_free(&test_list);
+
+    return tnfs_test_done("test_listing");
+}
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "tnfs_test.h"
+#include "../include/tnfs_pool.h"
+
+/*
+ * Pipelined requests take their descriptors and buffers from a pool: once running, an operation must not allocate.
+ * malloc() and friends are counted by wrapping the ones of glibc, the server is the memory transport.
+ */
+
+#define TEST_ROUNDS 1000
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* p, size_t size);
+
+uint32_t test_allocations = 0;	// calls of malloc(), calloc() and realloc()
+
+void* malloc(size_t size)
+{
+    test_allocations++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+    test_allocations++;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* p, size_t size)
+{
+    test_allocations++;
+    return __libc_realloc(p, size);
+}
+
+/* one round of pipelined and plain operations, returns false when one failed */
+bool test_round(uint8_t* handles, char** names)
+{
+    char data[NETW_MAX_BATCH][512];
+    char* buffers[NETW_MAX_BATCH];
+    struct fstat st[NETW_MAX_BATCH];
+    int results[NETW_MAX_BATCH];
+    bool ok = true;
+
+    for (int i = 0; i < NETW_MAX_BATCH; i++) {
+        buffers[i] = data[i];
+        ok = ok && tnfs_lseek(handles[i], TNFS_SEEK_SET, 0) == 0;
+    }
+    ok = ok && tnfs_statv(names, st, results, NETW_MAX_BATCH) == 0;
+    ok = ok && tnfs_readv(handles, buffers, 512, results, NETW_MAX_BATCH) == 0;
+    for (int i = 0; i < NETW_MAX_BATCH; i++)
+        ok = ok && results[i] == 512 && data[i][0] == 'A' + i;
+    ok = ok && tnfs_stat(names[0], &st[0]) == 0 && st[0].size == 4096;
+
+    return ok;
+}
+
+int main()
+{
+    struct tnfs_context* first = tnfs_context_current();
+    struct tnfs_context* other;
+    struct tnfs_pool* pool;
+    char contents[4096];
+    char names[NETW_MAX_BATCH][16];
+    char* list[NETW_MAX_BATCH];
+    uint8_t handles[NETW_MAX_BATCH];
+    uint32_t allocations, gets;
+    bool ok = true;
+
+    for (int i = 0; i < NETW_MAX_BATCH; i++) {
+        snprintf(names[i], sizeof(names[i]), "/f%d", i);
+        memset(contents, 'A' + i, sizeof(contents));
+        tnfs_memserver_put(names[i], contents, sizeof(contents), 0);
+        list[i] = names[i];
+    }
+
+    tnfs_setTransport(&tnfs_memserver_transport);
+    TNFS_TEST_CHECK(tnfs_connect("memory", false) == 0);
+    TNFS_TEST_CHECK(tnfs_mount("/", "", "") == 0);
+    for (int i = 0; i < NETW_MAX_BATCH; i++)
+        handles[i] = tnfs_open(names[i], TNFS_O_RDONLY, 0);
+
+    /* warm up, then count */
+    pool = tnfs_pool_default();
+    for (int i = 0; i < 10; i++)
+        test_round(handles, list);
+    allocations = test_allocations;
+    gets = pool->gets;
+    for (int i = 0; i < TEST_ROUNDS; i++)
+        ok = test_round(handles, list) && ok;
+
+    TNFS_TEST_CHECK(ok);
+    TNFS_TEST_CHECK(test_allocations - allocations == 0);
+    TNFS_TEST_CHECK(pool->gets - gets == 2 * NETW_MAX_BATCH * TEST_ROUNDS);
+    TNFS_TEST_CHECK(pool->used == 0 && pool->misses == 0);
+    printf("test_pool: %.3f allocations and %.1f pool gets per round of seeks, tnfs_statv(), tnfs_readv() and tnfs_stat()\n",
+        (double)(test_allocations - allocations) / TEST_ROUNDS, (double)(pool->gets - gets) / TEST_ROUNDS);
+
+    /* a context with a pool of its own uses it, the first context keeps the default pool */
+    allocations = test_allocations;
+    other = tnfs_context_createPool(2 * NETW_MAX_BATCH, 1024);
+    TNFS_TEST_CHECK(other != NULL);
+    TNFS_TEST_CHECK(test_allocations > allocations);	// the counting works
+    tnfs_context_switch(other);
+    TNFS_TEST_CHECK(tnfs_pool_default() != &tnfs_default_pool);
+    TNFS_TEST_CHECK(tnfs_pool_default()->count == 2 * NETW_MAX_BATCH && tnfs_pool_default()->bufsize == 1024);
+    tnfs_context_switch(first);
+    TNFS_TEST_CHECK(tnfs_pool_default() == &tnfs_default_pool);
+    tnfs_context_free(other);
+
+    for (int i = 0; i < NETW_MAX_BATCH; i++)
+        tnfs_close(handles[i]);
+    tnfs_umount();
+    tnfs_disconnect();
+
+    return tnfs_test_done("test_pool");
+}
@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <string.h>
+#include "tnfs_test.h"
+
+/*
+ * directory prefetch on the memory transport: while the caller walks a batch of tnfs_nextdirx() the READDIRX for the
+ * next one is on its way, the names of the current batch stay valid meanwhile, another request in between first takes
+ * the pending response off the wire, and nothing is sent anymore once the listing reached its end
+ */
+
+#define TEST_FILES (3 * TNFS_DIRX_BATCH + 5)
+
+/* READDIRX requests without a response yet */
+int test_pending()
+{
+    return tnfs_test_sent[0x18] - tnfs_test_received[0x18];
+}
+
+int main()
+{
+    static char buffers[2 * TNFS_BUFFERSIZE];
+    struct dirx_data dir;
+    struct dirx_item item;
+    struct fstat st;
+    char path[32];
+    char first[32];
+    char* name = NULL;
+    bool seen[TEST_FILES];
+    bool valid = true;
+    bool ahead = true;
+    int entries = 0;
+    int batches = 0;
+    int code, n;
+
+    memset(seen, 0, sizeof(seen));
+    for (int i = 0; i < TEST_FILES; i++) {
+        snprintf(path, sizeof(path), "/dir/file%03d", i);
+        tnfs_memserver_put(path, path, i, 0);
+    }
+    tnfs_setTransport(&tnfs_test_transport);
+    TNFS_TEST_CHECK(tnfs_connect("memory", false) == 0);
+    TNFS_TEST_CHECK(tnfs_mount("/", "", "") == 0);
+
+    TNFS_TEST_CHECK(tnfs_opendirx("dir", "", 0, 0, &dir) == 0);
+    TNFS_TEST_CHECK(tnfs_prefetchdirx(&dir, buffers, TNFS_BUFFERSIZE) == 0);
+
+    while ((code = tnfs_nextdirx(&dir, &item)) == 0) {
+        /* the first entry of a batch: the READDIRX of the next one was sent at once */
+        if (dir.entry == 1) {
+            batches++;
+            name = item.name;
+            strcpy(first, name);
+            ahead = ahead && (test_pending() == 1 || (dir.status & TNFS_DIRSTATUS_EOF));
+        }
+        valid = valid && strcmp(name, first) == 0;
+
+        if (sscanf(item.name, "file%d", &n) == 1 && n >= 0 && n < TEST_FILES && !seen[n] && item.size == (uint32_t)n)
+            seen[n] = true;
+        entries++;
+
+        /* a request in between drains the READDIRX on its way, the current batch isn't touched */
+        if (entries == TNFS_DIRX_BATCH + 3) {
+            TNFS_TEST_CHECK(test_pending() == 1);
+            TNFS_TEST_CHECK(tnfs_stat("dir/file007", &st) == 0 && st.size == 7);
+            TNFS_TEST_CHECK(test_pending() == 0 && strcmp(name, first) == 0);
+        }
+    }
+    TNFS_TEST_CHECK(valid && ahead);
+
+    /* every file once, and nothing is sent after the end */
+    TNFS_TEST_CHECK(code == TNFS_EOF && entries == TEST_FILES && batches == (TEST_FILES + TNFS_DIRX_BATCH - 1) / TNFS_DIRX_BATCH);
+    for (int i = 0; i < TEST_FILES; i++)
+        TNFS_TEST_CHECK(seen[i]);
+    TNFS_TEST_CHECK(test_pending() == 0 && tnfs_test_sent[0x18] == batches);
+    TNFS_TEST_CHECK(tnfs_nextdirx(&dir, &item) == TNFS_EOF && tnfs_test_sent[0x18] == batches);
+
+    TNFS_TEST_CHECK(tnfs_closedir(dir.handle) == 0);
+    tnfs_umount();
+    tnfs_disconnect();
+
+    return tnfs_test_done("test_prefetch");
+}
@@ -0,0 +1,193 @@
+#define _GNU_SOURCE	// preadv2()
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include "tnfs_test.h"
+#include "../include/tnfs_preload.h"
+
+/*
+ * The LD_PRELOAD shim over loopback UDP: the test starts itself again with build/libtnfs_preload.so loaded, and that
+ * process reads a file of the server through dup(), fcntl(), readv() and preadv(), a fork() and an execv(). Then cat
+ * is run through sh, once with the file as its argument and once redirected, which goes through dup2() and execve().
+ */
+
+#define TEST_SIZE 100000
+#define TEST_SHIM "build/libtnfs_preload.so"
+#define TEST_FILE "/tnfs/data.bin"
+#define TEST_OUT "build/test_preload.out"
+
+char test_data[TEST_SIZE];
+
+/* the contents of the file, every offset has its own byte */
+void test_fill()
+{
+    for (int i = 0; i < TEST_SIZE; i++)
+        test_data[i] = (char)(i * 31 + i / 256);
+}
+
+/* reads length bytes from fd and compares them with the file at offset */
+bool test_read(int fd, uint32_t offset, size_t length)
+{
+    char data[256];
+
+    return read(fd, data, length) == (ssize_t)length && memcmp(data, &test_data[offset], length) == 0;
+}
+
+/* runs the test program again with the shim loaded, returns its exit code */
+int test_spawn(const char* self, char* const argv[])
+{
+    int status;
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        setenv("LD_PRELOAD", TEST_SHIM, 1);
+        setenv(TNFS_PRELOAD_ENV_HOST, TNFS_TEST_HOST, 1);
+        execv(self, argv);
+        _exit(127);
+    }
+
+    return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/* checks that the output of a shell command is the file */
+void test_cat(const char* command)
+{
+    static char data[TEST_SIZE + 1];
+    char line[512];
+    FILE* out;
+    size_t n = 0;
+
+    snprintf(line, sizeof(line), "LD_PRELOAD=%s %s=%s sh -c '%s' > %s", TEST_SHIM, TNFS_PRELOAD_ENV_HOST, TNFS_TEST_HOST,
+        command, TEST_OUT);
+    TNFS_TEST_CHECK(system(line) == 0);
+    out = fopen(TEST_OUT, "rb");
+    if (TNFS_TEST_CHECK(out != NULL)) {
+        n = fread(data, 1, sizeof(data), out);
+        fclose(out);
+    }
+    TNFS_TEST_CHECK(n == TEST_SIZE && memcmp(data, test_data, TEST_SIZE) == 0);
+    unlink(TEST_OUT);
+}
+
+/* the process with the shim loaded */
+int test_shim(const char* self)
+{
+    char a[10], b[20], c[64], d[64];
+    struct iovec iov[2];
+    struct stat st;
+    char offset[16];
+    char* argv[5];
+    FILE* stream;
+    int fd, copy, high, status;
+    pid_t pid;
+
+    fd = open(TEST_FILE, O_RDONLY);
+    if (!TNFS_TEST_CHECK(fd >= 0))
+        return 1;
+    TNFS_TEST_CHECK(test_read(fd, 0, 100));
+
+    /* duplicates share the offset, and stay open when the original is closed */
+    copy = dup(fd);
+    TNFS_TEST_CHECK(copy >= 0 && test_read(copy, 100, 100));
+    high = fcntl(fd, F_DUPFD_CLOEXEC, 40);
+    TNFS_TEST_CHECK(high >= 40 && lseek(high, 1000, SEEK_SET) == 1000);
+    TNFS_TEST_CHECK(test_read(fd, 1000, 10));
+    TNFS_TEST_CHECK(dup2(fd, 50) == 50 && close(fd) == 0 && close(copy) == 0 && close(high) == 0);
+    TNFS_TEST_CHECK(test_read(50, 1010, 10));
+
+    /* vectors, at the offset of the file and at their own */
+    iov[0] = (struct iovec){ a, sizeof(a) };
+    iov[1] = (struct iovec){ b, sizeof(b) };
+    TNFS_TEST_CHECK(readv(50, iov, 2) == 30 && memcmp(a, &test_data[1020], 10) == 0 && memcmp(b, &test_data[1030], 20) == 0);
+    iov[0] = (struct iovec){ c, sizeof(c) };
+    iov[1] = (struct iovec){ d, sizeof(d) };
+    TNFS_TEST_CHECK(preadv(50, iov, 2, 5000) == 128 && memcmp(c, &test_data[5000], 64) == 0 && memcmp(d, &test_data[5064], 64) == 0);
+    TNFS_TEST_CHECK(preadv2(50, iov, 1, -1, 0) == 64 && memcmp(c, &test_data[1050], 64) == 0);
+    TNFS_TEST_CHECK(preadv(50, iov, 1, TEST_SIZE - 4) == 4 && memcmp(c, &test_data[TEST_SIZE - 4], 4) == 0);
+
+    /* what the shim doesn't take fails instead of reading nothing */
+    TNFS_TEST_CHECK(mmap(NULL, 4096, PROT_READ, MAP_PRIVATE, 50, 0) == MAP_FAILED);
+    stream = fdopen(dup(50), "r");
+    TNFS_TEST_CHECK(stream != NULL && fgetc(stream) == (uint8_t)test_data[1114]);
+    if (stream != NULL)
+        fclose(stream);
+
+    /* a child of fork() has a session of its own and a copy of the offset */
+    lseek(50, 2000, SEEK_SET);
+    pid = fork();
+    if (pid == 0)
+        _exit(test_read(50, 2000, 100) && test_read(50, 2100, 100) ? 0 : 1);
+    TNFS_TEST_CHECK(pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    TNFS_TEST_CHECK(test_read(50, 2000, 100));
+
+    /* a program started with execv() inherits the descriptor and its offset */
+    pid = fork();
+    if (pid == 0) {
+        snprintf(offset, sizeof(offset), "%d", 2100);
+        argv[0] = (char*)self;
+        argv[1] = "inherit";
+        argv[2] = offset;
+        argv[3] = NULL;
+        execv(self, argv);
+        _exit(127);
+    }
+    TNFS_TEST_CHECK(pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    TNFS_TEST_CHECK(close(50) == 0 && read(50, a, 1) == -1);
+    TNFS_TEST_CHECK(fstat(50, &st) == -1);
+
+    /* close_range() and closefrom() forget the file, the next descriptor with the same number is a real one again */
+    fd = open(TEST_FILE, O_RDONLY);
+    TNFS_TEST_CHECK(fd >= 0 && close_range(fd, fd, 0) == 0);
+    TNFS_TEST_CHECK(open("/dev/zero", O_RDONLY) == fd && fstat(fd, &st) == 0 && S_ISCHR(st.st_mode) && close(fd) == 0);
+    fd = open(TEST_FILE, O_RDONLY);
+    TNFS_TEST_CHECK(fd >= 0);
+    closefrom(fd);
+    TNFS_TEST_CHECK(open("/dev/zero", O_RDONLY) == fd && fstat(fd, &st) == 0 && S_ISCHR(st.st_mode) && close(fd) == 0);
+
+    return tnfs_test_done("test_preload shim");
+}
+
+/* the program started by test_shim(), descriptor 50 is the file */
+int test_inherit(uint32_t offset)
+{
+    struct stat st;
+
+    TNFS_TEST_CHECK(getenv(TNFS_PRELOAD_ENV_FDS) == NULL);
+    TNFS_TEST_CHECK(fstat(50, &st) == 0 && st.st_size == TEST_SIZE);
+    TNFS_TEST_CHECK(test_read(50, offset, 100));
+    TNFS_TEST_CHECK(lseek(50, 0, SEEK_CUR) == offset + 100);
+
+    return tnfs_test_done("test_preload exec");
+}
+
+int main(int argc, char** argv)
+{
+    char* shim[] = { argv[0], "shim", NULL };
+    pid_t server;
+
+    test_fill();
+    if (argc > 1 && strcmp(argv[1], "shim") == 0)
+        return test_shim(argv[0]);
+    if (argc > 2 && strcmp(argv[1], "inherit") == 0)
+        return test_inherit(atoi(argv[2]));
+
+    tnfs_memserver_put("/data.bin", test_data, TEST_SIZE, 0);
+    server = tnfs_test_serve(TNFS_TEST_HOST);
+    TNFS_TEST_CHECK(server > 0);
+
+    TNFS_TEST_CHECK(test_spawn(argv[0], shim) == 0);
+    test_cat("cat " TEST_FILE);
+    test_cat("cat < " TEST_FILE);
+    test_cat("exec 3< " TEST_FILE "; exec cat <&3");
+
+    tnfs_test_stop(server);
+
+    return tnfs_test_done("test_preload");
+}
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <string.h>
+#include "tnfs_test.h"
+
+/*
+ * the stand-in server forgets our session: the client mounts again, reopens its handles at the position they had and
+ * sends the request once more with the new handle, but a request that may have been executed already and can't be
+ * repeated safely fails instead of being sent a second time
+ */
+
+bool test_forget = false;	// the server forgets the session before it handles the next request
+bool test_deaf = false;		// responses are lost until the client mounts again
+bool test_stale = false;	// reads are sent without a session, so the server answers each of them with ESTALE
+uint8_t test_last[256][8];	// the start of the last request of each command
+int test_probed = 0;		// requests sent with the request id of the probe
+
+/* the probe of tnfs.c that netw_connect() sends */
+extern uint8_t tnfs_probe[];
+
+/* makes the server start a session of its own, which closes every handle of ours */
+void test_restart()
+{
+    const uint8_t mount[] = { 0x00, 0x00, 0x00, 0x00, 0x02, 0x01, '/', 0x00, 0x00, 0x00 };
+    uint8_t response[TNFS_BUFFERSIZE];
+
+    tnfs_memserver_handle(mount, sizeof(mount), response);
+}
+
+/* sends a request to a server that restarts or whose responses get lost on demand */
+int test_send(const uint8_t* buffer, int length)
+{
+    uint8_t response[TNFS_BUFFERSIZE];
+
+    if (buffer[3] == 0x00) {
+        test_deaf = false;
+        memset(tnfs_test_sent, 0, sizeof(tnfs_test_sent));
+    }
+    memcpy(test_last[buffer[3]], buffer, length < 8 ? length : 8);
+    if (buffer[2] == tnfs_probe[2])
+        test_probed++;
+
+    if (test_forget) {
+        test_forget = false;
+        test_restart();
+    }
+    if (test_deaf) {
+        tnfs_memserver_handle(buffer, length, response);
+        return length;
+    }
+    if (test_stale && buffer[3] == 0x21) {
+        uint8_t request[TNFS_BUFFERSIZE];
+
+        memcpy(request, buffer, length);
+        memset(request, 0, 2);
+        return tnfs_test_inner->send(request, length);
+    }
+
+    return tnfs_test_inner->send(buffer, length);
+}
+
+int main()
+{
+    struct tnfs_session session;
+    struct fstat st;
+    char data[16];
+    uint8_t before;
+    int a, b;
+
+    tnfs_memserver_put("/a.txt", "aaaaaaaaaa", 10, 0);
+    tnfs_memserver_put("/b.txt", "0123456789ABCDEFGHIJ", 20, 0);
+    tnfs_memserver_put("/gone.txt", "x", 1, 0);
+    tnfs_test_send = test_send;
+    tnfs_setTransport(&tnfs_test_transport);
+    TNFS_TEST_CHECK(tnfs_connect("memory", false) == 0);
+    TNFS_TEST_CHECK(tnfs_mount("/", "", "") == 0);
+
+    /* b gets the second handle of the server, after the restart it is reopened as the first */
+    a = tnfs_open("a.txt", TNFS_O_RDONLY, 0);
+    b = tnfs_open("b.txt", TNFS_O_RDONLY, 0);
+    TNFS_TEST_CHECK(a >= 0 && b >= 0 && tnfs_close(a) == 0);
+    TNFS_TEST_CHECK(tnfs_read(data, b, 5) == 5 && memcmp(data, "01234", 5) == 0);
+    before = test_last[0x21][4];
+
+    /* a read is replayed with the reopened handle and goes on where the previous one ended */
+    test_forget = true;
+    TNFS_TEST_CHECK(tnfs_read(data, b, 5) == 5 && memcmp(data, "56789", 5) == 0);
+    TNFS_TEST_CHECK(tnfs_test_sent[0x00] == 1 && tnfs_test_sent[0x29] == 1 && tnfs_test_sent[0x25] == 1 && tnfs_test_sent[0x21] == 1);
+    TNFS_TEST_CHECK(test_last[0x21][4] != before && test_last[0x21][4] == test_last[0x25][4]);
+    TNFS_TEST_CHECK(tnfs_getSession(&session) == TNFS_SESSION_MOUNTED && session.recoveries == 1);
+
+    /* also when the response was lost together with the session */
+    test_forget = test_deaf = true;
+    TNFS_TEST_CHECK(tnfs_read(data, b, 5) == 5 && memcmp(data, "ABCDE", 5) == 0);
+    TNFS_TEST_CHECK(tnfs_stat("b.txt", &st) == 0 && st.size == 20);
+
+    /* an unlink the server refused because of the session was not executed, it may be sent again */
+    test_forget = true;
+    TNFS_TEST_CHECK(tnfs_unlink("gone.txt") == 0);
+    TNFS_TEST_CHECK(tnfs_stat("gone.txt", &st) == -TNFS_ENOENT);
+
+    /* a mkdir without a response may have been executed, it fails instead of being sent again */
+    test_deaf = true;
+    TNFS_TEST_CHECK(tnfs_mkdir("new") != 0);
+    TNFS_TEST_CHECK(tnfs_test_sent[0x00] == 1 && tnfs_test_sent[0x13] == 0);
+    TNFS_TEST_CHECK(tnfs_stat("new", &st) == 0 && (st.mode & 0170000) == 0040000);
+    TNFS_TEST_CHECK(tnfs_getSession(&session) == TNFS_SESSION_MOUNTED && session.recoveries == 4);
+
+    /* the handle still works after all this */
+    TNFS_TEST_CHECK(tnfs_read(data, b, 5) == 5 && memcmp(data, "FGHIJ", 5) == 0);
+
+    /* a bad handle is an error of the request, not a lost session */
+    TNFS_TEST_CHECK(tnfs_write("x", b, 1) == -TNFS_EBADF);
+    TNFS_TEST_CHECK(tnfs_getSession(&session) == TNFS_SESSION_MOUNTED && session.recoveries == 4);
+
+    /* the server still has the session when only the response was lost, it is ended before the new one */
+    memset(test_last[0x01], 0, 8);
+    test_deaf = true;
+    TNFS_TEST_CHECK(tnfs_stat("b.txt", &st) == 0 && st.size == 20);
+    TNFS_TEST_CHECK(tnfs_test_sent[0x00] == 1 && test_last[0x01][3] == 0x01 && (test_last[0x01][0] | test_last[0x01][1]) != 0);
+    TNFS_TEST_CHECK(tnfs_getSession(&session) == TNFS_SESSION_MOUNTED && session.recoveries == 5);
+
+    /* a request that is stale in the new session as well fails after one recovery */
+    test_stale = true;
+    TNFS_TEST_CHECK(tnfs_read(data, b, 5) == -TNFS_ESTALE);
+    TNFS_TEST_CHECK(tnfs_test_sent[0x00] == 1 && tnfs_test_sent[0x21] == 1);
+    TNFS_TEST_CHECK(tnfs_getSession(&session) == TNFS_SESSION_MOUNTED && session.recoveries == 6);
+    test_stale = false;
+
+    /* a late answer to the probe of a connect can't be taken for the answer to a request: the next 255 don't use its id */
+    tnfs_close(b);
+    tnfs_umount();
+    TNFS_TEST_CHECK(tnfs_connect("memory", false) == 0 && tnfs_mount("/", "", "") == 0);
+    test_probed = 0;
+    for (int i = 0; i < 253; i++)
+        tnfs_stat("a.txt", &st);
+    TNFS_TEST_CHECK(test_probed == 0 && tnfs_umount() == 0 && test_probed == 0);
+
+    tnfs_umount();
+    tnfs_disconnect();
+
+    return tnfs_test_done("test_recover");
+}
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tnfs_test.h"
+#include "../include/tnfs_relay.h"
+
+/*
+ * tnfs_relay_copy() and tnfs_relay_tree() between two contexts: the source is the stand-in server in the process on
+ * the memory transport, the destination a copy of it served over loopback UDP that already has the destination
+ * directories and an older, longer file in the way. A file of several segments and a tree are copied, read back from
+ * the destination byte for byte, and the context that was current before is current again after every call.
+ */
+
+#define TEST_BIG (5 * TNFS_RELAY_SEGMENT + 1234)	// copied through five lanes at once
+
+/* a file of the source tree */
+struct test_file {
+    const char* from;
+    const char* to;
+    uint32_t size;
+} test_files[] = {
+    { "/src/tree/a.bin", "/dst/tree/a.bin", 1000 },
+    { "/src/tree/empty", "/dst/tree/empty", 0 },
+    { "/src/tree/.hidden", "/dst/tree/.hidden", 17 },
+    { "/src/tree/sub/b.bin", "/dst/tree/sub/b.bin", 3 * TNFS_RELAY_SEGMENT },
+    { "/src/tree/sub/deep/c.txt", "/dst/tree/sub/deep/c.txt", TNFS_RELAY_CHUNK + 1 },
+};
+
+#define TEST_FILES (int)(sizeof(test_files) / sizeof(test_files[0]))
+
+uint8_t test_data[TEST_BIG];	// contents of every file from its first byte on
+
+/* true when the file on the mount of context has the first size bytes of test_data, and no more */
+bool test_same(struct tnfs_context* context, const char* path, uint32_t size)
+{
+    char buffer[512];
+    uint32_t offset = 0;
+    int handle, n;
+    bool same = true;
+
+    tnfs_context_switch(context);
+    handle = tnfs_open((char*)path, TNFS_O_RDONLY, 0);
+    if (handle < 0)
+        return false;
+    while (same && (n = tnfs_read(buffer, handle, sizeof(buffer))) > 0) {
+        same = offset + n <= size && memcmp(buffer, &test_data[offset], n) == 0;
+        offset += n;
+    }
+    tnfs_close(handle);
+
+    return same && offset == size;
+}
+
+int main()
+{
+    struct tnfs_context* current = tnfs_context_current();
+    struct tnfs_context* src = tnfs_context_create();
+    struct tnfs_context* dst = tnfs_context_create();
+    struct tnfs_relay_result r;
+    uint64_t bytes = 0;
+    bool ok = true;
+    pid_t server;
+
+    srand(1985);
+    for (int i = 0; i < TEST_BIG; i++)
+        test_data[i] = rand();
+
+    /* the destination: the directories are there and a longer file is in the way */
+    memset(test_data, 'x', 5000);
+    tnfs_memserver_put("/dst/tree/a.bin", test_data, 5000, 0);
+    tnfs_memserver_put("/dst/tree/sub/old.txt", "old", 3, 0);
+    server = tnfs_test_serve(TNFS_TEST_HOST);
+    TNFS_TEST_CHECK(server > 0);
+    for (int i = 0; i < 5000; i++)
+        test_data[i] = rand();
+
+    /* the source */
+    tnfs_memserver_reset();
+    tnfs_memserver_put("/src/big.bin", test_data, TEST_BIG, 0);
+    for (int i = 0; i < TEST_FILES; i++) {
+        tnfs_memserver_put(test_files[i].from, test_data, test_files[i].size, 0);
+        bytes += test_files[i].size;
+    }
+
+    TNFS_TEST_CHECK(src != NULL && dst != NULL);
+    tnfs_context_switch(src);
+    tnfs_setTransport(&tnfs_memserver_transport);
+    TNFS_TEST_CHECK(tnfs_connect("memory", false) == 0 && tnfs_mount("/", "", "") == 0);
+    tnfs_context_switch(dst);
+    TNFS_TEST_CHECK(tnfs_connect(TNFS_TEST_HOST, false) == 0 && tnfs_mount("/", "", "") == 0);
+    tnfs_context_switch(current);
+
+    /* one file of several segments into an existing directory */
+    TNFS_TEST_CHECK(tnfs_relay_copy(src, "/src/big.bin", dst, "/dst/big.bin", &r) == 0);
+    TNFS_TEST_CHECK(tnfs_context_current() == current);
+    TNFS_TEST_CHECK(r.files == 1 && r.failed == 0 && r.bytes == TEST_BIG);
+    TNFS_TEST_CHECK(test_same(dst, "/dst/big.bin", TEST_BIG));
+    tnfs_context_switch(current);
+
+    /* the tree onto the directories that are there, the longer file is overwritten and the other one stays */
+    TNFS_TEST_CHECK(tnfs_relay_tree(src, "/src/tree", dst, "/dst/tree/", &r) == 0);
+    TNFS_TEST_CHECK(tnfs_context_current() == current);
+    TNFS_TEST_CHECK(r.files == TEST_FILES && r.dirs == 3 && r.failed == 0 && r.bytes == bytes);
+    for (int i = 0; i < TEST_FILES; i++) {
+        ok = test_same(dst, test_files[i].to, test_files[i].size);
+        if (!TNFS_TEST_CHECK(ok))
+            fprintf(stderr, "  %s\n", test_files[i].to);
+    }
+    TNFS_TEST_CHECK(test_same(src, "/src/tree/sub/b.bin", 3 * TNFS_RELAY_SEGMENT));
+    memcpy(test_data, "old", 3);	// what test_same() compares with
+    TNFS_TEST_CHECK(test_same(dst, "/dst/tree/sub/old.txt", 3));
+    tnfs_context_switch(current);
+
+    /* what can't be copied, the current context stays as well */
+    TNFS_TEST_CHECK(tnfs_relay_copy(src, "/src/missing", dst, "/dst/missing", &r) == -TNFS_ENOENT);
+    TNFS_TEST_CHECK(tnfs_context_current() == current);
+    TNFS_TEST_CHECK(tnfs_relay_copy(src, "/src/tree", dst, "/dst/copy", &r) == -TNFS_EISDIR);
+    TNFS_TEST_CHECK(tnfs_context_current() == current);
+    TNFS_TEST_CHECK(tnfs_relay_tree(src, "/src/missing", dst, "/dst/missing", &r) == -TNFS_ENOENT);
+    TNFS_TEST_CHECK(tnfs_context_current() == current && r.failed == 1);
+
+    tnfs_context_switch(src);
+    tnfs_umount();
+    tnfs_disconnect();
+    tnfs_context_switch(dst);
+    tnfs_umount();
+    tnfs_disconnect();
+    tnfs_context_switch(current);
+    tnfs_context_free(src);
+    tnfs_context_free(dst);
+    tnfs_test_stop(server);
+
+    return tnfs_test_done("test_relay");
+}
@@ -0,0 +1,181 @@
+#include <string.h>
+#include "tnfs_test.h"
+#include "../include/tnfs_sched.h"
+
+/*
+ * the request scheduler on the memory transport with a clock of its own: the order in which weighted fair queuing
+ * serves the classes, the share of each class while all of them stay backlogged, and the rate and burst of the token
+ * buckets of a class and of the server connection
+ */
+
+#define TEST_BACKLOG 16		// requests each class keeps queued while the shares are measured
+#define TEST_ROUNDS 70
+
+struct tnfs_pool* test_pool;
+uint32_t test_now = 1000;			// the clock of the token buckets
+uint8_t  test_classes[TNFS_SCHED_CLASSES] = { TNFS_SCHED_INTERACTIVE, TNFS_SCHED_FOREGROUND, TNFS_SCHED_BULK };
+char     test_order[TNFS_SCHED_SLOTS + 1];	// classes of the requests served, as '0', '1' or '2'
+int      test_served[TNFS_SCHED_CLASSES];	// requests served per class
+bool     test_again = false;			// a served request is queued once more in its class
+
+uint32_t test_clock()
+{
+    return test_now;
+}
+
+/* queues count STAT requests in a class, returns the amount queued */
+int test_submit(uint8_t cls, int count)
+{
+    struct tnfs_request* req;
+
+    for (int i = 0; i < count; i++) {
+        req = tnfs_pool_get(test_pool);
+        if (req == NULL)
+            return i;
+        req->user = &test_classes[cls];
+        tnfs_prepareStat(req, "/meta.txt", test_pool->bufsize);
+        tnfs_sched_submit(req, cls);
+    }
+
+    return count;
+}
+
+/* counts a served request, and queues it again or gives it back to the pool */
+void test_done(struct tnfs_request* req)
+{
+    uint8_t cls = *(uint8_t*)req->user;
+    int served = test_served[0] + test_served[1] + test_served[2];
+    struct fstat st;
+
+    TNFS_TEST_CHECK(tnfs_takeStat(req, &st) == 0 && st.size == 4);
+    if (served < TNFS_SCHED_SLOTS)
+        test_order[served] = '0' + cls;
+    test_served[cls]++;
+
+    if (test_again) {
+        tnfs_prepareStat(req, "/meta.txt", test_pool->bufsize);
+        tnfs_sched_submit(req, cls);
+    } else
+        tnfs_pool_put(test_pool, req);
+}
+
+/* forgets what was served so far */
+void test_reset()
+{
+    memset(test_order, 0, sizeof(test_order));
+    memset(test_served, 0, sizeof(test_served));
+}
+
+/* serves everything that is queued */
+void test_drain()
+{
+    test_again = false;
+    while (tnfs_sched_run(test_done) > 0);
+}
+
+int main()
+{
+    struct tnfs_context* context;
+    int served;
+
+    tnfs_memserver_put("/meta.txt", "meta", 4, 0);
+    context = tnfs_context_createPool(3 * TEST_BACKLOG, TNFS_POOL_BUFSIZE);
+    TNFS_TEST_CHECK(context != NULL);
+    if (context == NULL)
+        return tnfs_test_done("test_sched");
+    tnfs_context_switch(context);
+    tnfs_setTransport(&tnfs_memserver_transport);
+    TNFS_TEST_CHECK(tnfs_connect("memory", false) == 0 && tnfs_mount("/", "", "") == 0);
+    test_pool = tnfs_pool_default();
+    tnfs_sched_clock = test_clock;
+
+    /*
+     * the order of one round: with weights 3 and 1 the bulk requests finish at 1, 2, 3 and 4 times 16384 virtual time
+     * units and the interactive ones at a third of that, the first bulk request goes between the third and the fourth
+     * interactive one although the bulk requests were queued first
+     */
+    tnfs_sched_weight(TNFS_SCHED_INTERACTIVE, 3);
+    tnfs_sched_weight(TNFS_SCHED_BULK, 1);
+    test_reset();
+    TNFS_TEST_CHECK(test_submit(TNFS_SCHED_BULK, 4) == 4 && test_submit(TNFS_SCHED_INTERACTIVE, 4) == 4);
+    TNFS_TEST_CHECK(tnfs_sched_run(test_done) == 8);
+    TNFS_TEST_CHECK(strcmp(test_order, "00020222") == 0);
+    TNFS_TEST_CHECK(tnfs_sched_queued(TNFS_SCHED_BULK) == 0 && tnfs_sched_run(test_done) == 0);
+
+    /* all three classes backlogged: each gets its weight's share of the requests, within one request */
+    tnfs_sched_weight(TNFS_SCHED_INTERACTIVE, 4);
+    tnfs_sched_weight(TNFS_SCHED_FOREGROUND, 2);
+    tnfs_sched_weight(TNFS_SCHED_BULK, 1);
+    for (int i = 0; i < TNFS_SCHED_CLASSES; i++)
+        TNFS_TEST_CHECK(test_submit(i, TEST_BACKLOG) == TEST_BACKLOG);
+    test_reset();
+    test_again = true;
+    for (int i = 0; i < TEST_ROUNDS; i++)
+        tnfs_sched_run(test_done);
+    served = TEST_ROUNDS * TNFS_SCHED_SLOTS;
+    TNFS_TEST_CHECK(test_served[0] + test_served[1] + test_served[2] == served);
+    TNFS_TEST_CHECK(test_served[TNFS_SCHED_INTERACTIVE] >= served * 4 / 7 - 1 && test_served[TNFS_SCHED_INTERACTIVE] <= served * 4 / 7 + 1);
+    TNFS_TEST_CHECK(test_served[TNFS_SCHED_FOREGROUND] >= served * 2 / 7 - 1 && test_served[TNFS_SCHED_FOREGROUND] <= served * 2 / 7 + 1);
+    TNFS_TEST_CHECK(test_served[TNFS_SCHED_BULK] >= served / 7 - 1 && test_served[TNFS_SCHED_BULK] <= served / 7 + 1);
+    test_drain();
+
+    /*
+     * a class limited to 6400 bytes per second with a burst of 320 bytes: five STATs of 64 bytes at once, then a STAT
+     * goes out as soon as a token is left, which is every 10 ms on average
+     */
+    tnfs_sched_limit(TNFS_SCHED_BULK, 100 * TNFS_SCHED_METADATA, 5 * TNFS_SCHED_METADATA);
+    test_reset();
+    TNFS_TEST_CHECK(test_submit(TNFS_SCHED_BULK, 13) == 13);
+    TNFS_TEST_CHECK(tnfs_sched_run(test_done) == 5);
+    TNFS_TEST_CHECK(tnfs_sched_run(test_done) == 0 && tnfs_sched_delay() == 1);
+    test_now += 1;
+    TNFS_TEST_CHECK(tnfs_sched_run(test_done) == 1 && tnfs_sched_delay() == 10);
+    test_now += 9;
+    TNFS_TEST_CHECK(tnfs_sched_run(test_done) == 0);
+    test_now += 1;
+    TNFS_TEST_CHECK(tnfs_sched_run(test_done) == 1);
+
+    /* idle for a second: the tokens don't pile up beyond the burst */
+    test_now += 1000;
+    TNFS_TEST_CHECK(tnfs_sched_run(test_done) == 5 && tnfs_sched_queued(TNFS_SCHED_BULK) == 1);
+
+    /* other classes pass while the bulk class waits for tokens */
+    TNFS_TEST_CHECK(test_submit(TNFS_SCHED_INTERACTIVE, 3) == 3);
+    test_reset();
+    TNFS_TEST_CHECK(tnfs_sched_run(test_done) == 3 && test_served[TNFS_SCHED_INTERACTIVE] == 3);
+
+    /* kept backlogged for a second the class gets its rate: 100 STATs, one every 10 ms */
+    test_reset();
+    test_again = true;
+    for (int i = 0; i < 200; i++) {
+        test_now += 5;
+        tnfs_sched_run(test_done);
+    }
+    TNFS_TEST_CHECK(test_served[TNFS_SCHED_BULK] == 100);
+    tnfs_sched_limit(TNFS_SCHED_BULK, 0, 0);
+    test_drain();
+
+    /* the largest rate, whose burst doesn't fit in 32 bit signed tokens, is as good as no limit */
+    tnfs_sched_limit(TNFS_SCHED_BULK, UINT32_MAX, 0);
+    test_reset();
+    TNFS_TEST_CHECK(test_submit(TNFS_SCHED_BULK, 3) == 3);
+    TNFS_TEST_CHECK(tnfs_sched_run(test_done) == 3 && tnfs_sched_delay() == 0);
+    tnfs_sched_limit(TNFS_SCHED_BULK, 0, 0);
+
+    /* the limit of the server holds back all classes together */
+    tnfs_sched_limit(TNFS_SCHED_SERVER, 10 * TNFS_SCHED_METADATA, 2 * TNFS_SCHED_METADATA);
+    test_reset();
+    TNFS_TEST_CHECK(test_submit(TNFS_SCHED_INTERACTIVE, 2) == 2 && test_submit(TNFS_SCHED_BULK, 2) == 2);
+    TNFS_TEST_CHECK(tnfs_sched_run(test_done) == 2 && tnfs_sched_delay() == 2);
+    test_now += 2;
+    TNFS_TEST_CHECK(tnfs_sched_run(test_done) == 1 && tnfs_sched_delay() == 100);
+    tnfs_sched_limit(TNFS_SCHED_SERVER, 0, 0);
+    TNFS_TEST_CHECK(tnfs_sched_run(test_done) == 1 && tnfs_sched_delay() == 0);
+    TNFS_TEST_CHECK(test_served[TNFS_SCHED_INTERACTIVE] == 2 && test_served[TNFS_SCHED_BULK] == 2);
+
+    tnfs_sched_clock = netw_millis;
+    tnfs_umount();
+    tnfs_disconnect();
+
+    return tnfs_test_done("test_sched");
+}
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "tnfs_test.h"
+
+/*
+ * tnfs_lazyMount(), tnfs_keepalive() and tnfs_getSession() on the memory transport: nothing is connected or sent until
+ * the first request, the keepalive waits for the interval since the last response and then sends one STAT, a session
+ * the server forgot is mounted again by the keepalive, and the state goes through TNFS_SESSION_LAZY, MOUNTED, OFFLINE
+ * and NONE on the way.
+ */
+
+#define TEST_INTERVAL 100	// keepalive interval in milliseconds
+
+int  test_total = 0;		// requests of every command
+bool test_down = false;		// the server doesn't answer
+
+/* makes the server start a session of its own */
+void test_restart()
+{
+    const uint8_t mount[] = { 0x00, 0x00, 0x00, 0x00, 0x02, 0x01, '/', 0x00, 0x00, 0x00 };
+    uint8_t response[TNFS_BUFFERSIZE];
+
+    tnfs_memserver_handle(mount, sizeof(mount), response);
+}
+
+/* counts the requests, the server is down on demand */
+int test_send(const uint8_t* buffer, int length)
+{
+    test_total++;
+    if (test_down)
+        return length;
+
+    return tnfs_test_inner->send(buffer, length);
+}
+
+/* true when tnfs_keepalive() sends nothing for most of the interval after the last response */
+bool test_quiet()
+{
+    uint32_t start = netw_millis();
+    int total = test_total;
+    bool quiet = true;
+
+    while (netw_millis() - start < TEST_INTERVAL * 8 / 10) {
+        quiet = quiet && tnfs_keepalive() == 0;
+        usleep(5000);
+    }
+
+    return quiet && test_total == total;
+}
+
+/* waits past the interval */
+void test_idle()
+{
+    usleep((TEST_INTERVAL + 20) * 1000);
+}
+
+int main()
+{
+    struct tnfs_session session;
+    struct fstat st;
+    uint16_t id;
+
+    tnfs_memserver_put("/a.txt", "alpha", 5, 0);
+    tnfs_test_send = test_send;
+    tnfs_setTransport(&tnfs_test_transport);
+    tnfs_setKeepalive(TEST_INTERVAL);
+    TNFS_TEST_CHECK(tnfs_getSession(&session) == TNFS_SESSION_NONE && session.id == 0);
+
+    /* the lazy mount: nothing happens until the first request, which connects, mounts and is sent */
+    TNFS_TEST_CHECK(tnfs_lazyMount("memory", false, "/", "", "") == 0);
+    usleep(20000);
+    TNFS_TEST_CHECK(tnfs_test_connects == 0 && test_total == 0);
+    TNFS_TEST_CHECK(tnfs_getSession(&session) == TNFS_SESSION_LAZY && session.id == 0);
+    TNFS_TEST_CHECK(tnfs_stat("/a.txt", &st) == 0 && st.size == 5);
+    TNFS_TEST_CHECK(tnfs_test_connects == 1 && tnfs_test_sent[0x00] == 1 && tnfs_test_sent[0x24] == 1 && test_total == 2);
+    TNFS_TEST_CHECK(tnfs_getSession(&session) == TNFS_SESSION_MOUNTED && session.id != 0 && session.keepalives == 0);
+
+    /* the keepalive: not before the interval, then one STAT, and a request of the application starts it over */
+    TNFS_TEST_CHECK(test_quiet());
+    test_idle();
+    TNFS_TEST_CHECK(tnfs_keepalive() == 1 && tnfs_test_sent[0x24] == 2 && test_total == 3);
+    TNFS_TEST_CHECK(tnfs_getSession(&session) == TNFS_SESSION_MOUNTED && session.keepalives == 1 && session.idle < TEST_INTERVAL);
+    TNFS_TEST_CHECK(test_quiet());
+    TNFS_TEST_CHECK(tnfs_stat("/a.txt", &st) == 0);
+    TNFS_TEST_CHECK(test_quiet());
+
+    /* a session the server forgot is mounted again by the keepalive, not by the next request */
+    id = session.id;
+    test_restart();
+    test_idle();
+    TNFS_TEST_CHECK(tnfs_keepalive() == 1 && tnfs_test_sent[0x00] == 2);
+    TNFS_TEST_CHECK(tnfs_getSession(&session) == TNFS_SESSION_MOUNTED && session.id != id && session.recoveries == 1);
+    TNFS_TEST_CHECK(tnfs_stat("/a.txt", &st) == 0 && tnfs_test_sent[0x00] == 2);
+
+    /* a server that is down makes the session offline, the keepalive tries again after another interval */
+    test_down = true;
+    test_idle();
+    TNFS_TEST_CHECK(tnfs_keepalive() < 0);
+    TNFS_TEST_CHECK(tnfs_getSession(&session) == TNFS_SESSION_OFFLINE && session.recoveries == 1);
+    TNFS_TEST_CHECK(tnfs_keepalive() == 0);
+    test_down = false;
+    test_idle();
+    TNFS_TEST_CHECK(tnfs_keepalive() == 1);
+    TNFS_TEST_CHECK(tnfs_getSession(&session) == TNFS_SESSION_MOUNTED);
+
+    /* unmounted */
+    tnfs_umount();
+    TNFS_TEST_CHECK(tnfs_getSession(&session) == TNFS_SESSION_NONE && session.id == 0);
+    TNFS_TEST_CHECK(tnfs_keepalive() == 0);
+    tnfs_disconnect();
+
+    /* a lazy mount whose server is down stays lazy, the keepalive makes the session once it is back */
+    TNFS_TEST_CHECK(tnfs_lazyMount("memory", false, "/", "", "") == 0);
+    test_down = true;
+    TNFS_TEST_CHECK(tnfs_stat("/a.txt", &st) < 0);
+    TNFS_TEST_CHECK(tnfs_getSession(&session) == TNFS_SESSION_LAZY);
+    test_down = false;
+    test_idle();
+    TNFS_TEST_CHECK(tnfs_keepalive() == 1);
+    TNFS_TEST_CHECK(tnfs_getSession(&session) == TNFS_SESSION_MOUNTED && session.id != 0);
+    tnfs_umount();
+    tnfs_disconnect();
+
+    /* a lazy mount that was never used ends without a word to the server */
+    test_total = 0;
+    TNFS_TEST_CHECK(tnfs_lazyMount("memory", false, "/", "", "") == 0);
+    tnfs_umount();
+    TNFS_TEST_CHECK(test_total == 0 && tnfs_getSession(&session) == TNFS_SESSION_NONE);
+
+    return tnfs_test_done("test_session");
+}
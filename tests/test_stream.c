@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <string.h>
+#include "tnfs_test.h"
+#include "../include/tnfs_stream.h"
+
+/*
+ * buffered streams on the memory transport: the modes of tnfs_fopen(), small writes and reads that reach the server in
+ * requests of TNFS_STREAM_BUFSIZE bytes, seeks across the read ahead data, and an "a" stream whose position is the end
+ * of the file
+ */
+
+/* returns the size of a file on the server */
+uint32_t test_size(char* path)
+{
+    struct fstat st;
+
+    return tnfs_stat(path, &st) == 0 ? st.size : 0xFFFFFFFF;
+}
+
+/* the modes and what they do to the file */
+void test_modes()
+{
+    struct tnfs_stream* s;
+    char data[16];
+
+    TNFS_TEST_CHECK(tnfs_fopen("missing.txt", "r") == NULL);
+    TNFS_TEST_CHECK(tnfs_fopen("missing.txt", "r+") == NULL);
+    TNFS_TEST_CHECK(tnfs_fopen("modes.txt", "x") == NULL);
+    TNFS_TEST_CHECK(tnfs_fopen("modes.txt", "") == NULL);
+
+    /* "w" creates and truncates, "r" can't write */
+    s = tnfs_fopen("modes.txt", "w");
+    TNFS_TEST_CHECK(s != NULL && tnfs_fputs("0123456789", s) == 10 && tnfs_fclose(s) == 0);
+    s = tnfs_fopen("modes.txt", "r");
+    TNFS_TEST_CHECK(s != NULL && tnfs_fputs("x", s) == 1 && tnfs_fclose(s) != 0);
+    TNFS_TEST_CHECK(test_size("modes.txt") == 10);
+    s = tnfs_fopen("modes.txt", "w");
+    TNFS_TEST_CHECK(s != NULL && tnfs_ftell(s) == 0 && tnfs_fclose(s) == 0);
+    TNFS_TEST_CHECK(test_size("modes.txt") == 0);
+
+    /* "w+" reads back what it wrote */
+    s = tnfs_fopen("modes.txt", "w+");
+    TNFS_TEST_CHECK(s != NULL && tnfs_fputs("abcdef", s) == 6 && tnfs_fseek(s, TNFS_SEEK_SET, 2) == 0);
+    TNFS_TEST_CHECK(tnfs_fread(data, 3, s) == 3 && memcmp(data, "cde", 3) == 0);
+    TNFS_TEST_CHECK(tnfs_fclose(s) == 0);
+
+    /* "r+" overwrites in place */
+    s = tnfs_fopen("modes.txt", "r+");
+    TNFS_TEST_CHECK(s != NULL && tnfs_fseek(s, TNFS_SEEK_SET, 1) == 0 && tnfs_fputs("XY", s) == 2);
+    TNFS_TEST_CHECK(tnfs_fseek(s, TNFS_SEEK_SET, 0) == 0 && tnfs_fread(data, 16, s) == 6 && memcmp(data, "aXYdef", 6) == 0);
+    TNFS_TEST_CHECK(tnfs_feof(s) && tnfs_fclose(s) == 0);
+}
+
+/* small writes and reads go to the server in whole buffers */
+void test_buffered()
+{
+    struct tnfs_stream* s;
+    char line[64];
+    char expected[64];
+    int lines = 0;
+    bool ok = true;
+
+    s = tnfs_fopen("lines.txt", "w");
+    memset(tnfs_test_sent, 0, sizeof(tnfs_test_sent));
+    for (int i = 0; s != NULL && i < 200; i++)
+        ok = ok && tnfs_fprintf(s, "line %d\n", i) > 0;
+    TNFS_TEST_CHECK(ok && tnfs_ftell(s) == test_size("lines.txt") + s->wlen);
+    TNFS_TEST_CHECK(tnfs_test_sent[0x22] == (int)(tnfs_ftell(s) / TNFS_STREAM_BUFSIZE));
+    TNFS_TEST_CHECK(tnfs_fclose(s) == 0);
+    TNFS_TEST_CHECK(tnfs_test_sent[0x22] == (int)((test_size("lines.txt") + TNFS_STREAM_BUFSIZE - 1) / TNFS_STREAM_BUFSIZE));
+
+    s = tnfs_fopen("lines.txt", "r");
+    memset(tnfs_test_sent, 0, sizeof(tnfs_test_sent));
+    while (s != NULL && tnfs_fgets(line, sizeof(line), s) != NULL) {
+        snprintf(expected, sizeof(expected), "line %d\n", lines++);
+        ok = ok && strcmp(line, expected) == 0;
+    }
+    TNFS_TEST_CHECK(ok && lines == 200 && tnfs_feof(s));
+    TNFS_TEST_CHECK(tnfs_ftell(s) == test_size("lines.txt"));
+    TNFS_TEST_CHECK(tnfs_test_sent[0x21] == (int)(tnfs_ftell(s) / TNFS_STREAM_BUFSIZE) + 2);
+
+    /* seeks within and behind the read ahead data */
+    TNFS_TEST_CHECK(tnfs_fseek(s, TNFS_SEEK_SET, 7) == 0 && tnfs_fgets(line, sizeof(line), s) != NULL);
+    TNFS_TEST_CHECK(strcmp(line, "line 1\n") == 0 && tnfs_ftell(s) == 14);
+    TNFS_TEST_CHECK(tnfs_fseek(s, TNFS_SEEK_CUR, 7) == 0 && tnfs_fgetc(s) == 'l' && tnfs_ftell(s) == 22);
+    TNFS_TEST_CHECK(tnfs_fseek(s, TNFS_SEEK_END, -8) == 0 && tnfs_fgets(line, sizeof(line), s) != NULL);
+    TNFS_TEST_CHECK(strcmp(line, "ine 199\n") == 0 && tnfs_ftell(s) == test_size("lines.txt"));
+    TNFS_TEST_CHECK(tnfs_fgetc(s) == -TNFS_EOF && tnfs_feof(s));
+    TNFS_TEST_CHECK(tnfs_fclose(s) == 0);
+}
+
+/* an "a" stream starts at the end and stays there whatever was read or seeked in between */
+void test_append()
+{
+    struct tnfs_stream* s;
+    char data[16];
+
+    s = tnfs_fopen("log.txt", "a");
+    TNFS_TEST_CHECK(s != NULL && tnfs_ftell(s) == 0 && tnfs_fputs("first\n", s) == 6 && tnfs_fclose(s) == 0);
+
+    s = tnfs_fopen("log.txt", "a");
+    TNFS_TEST_CHECK(s != NULL && tnfs_ftell(s) == 6);
+    TNFS_TEST_CHECK(tnfs_fputs("second\n", s) == 7 && tnfs_ftell(s) == 13 && tnfs_fclose(s) == 0);
+
+    s = tnfs_fopen("log.txt", "a+");
+    TNFS_TEST_CHECK(s != NULL && tnfs_ftell(s) == 13);
+    TNFS_TEST_CHECK(tnfs_fseek(s, TNFS_SEEK_SET, 0) == 0 && tnfs_fread(data, 5, s) == 5 && memcmp(data, "first", 5) == 0);
+    TNFS_TEST_CHECK(tnfs_fputs("third\n", s) == 6 && tnfs_ftell(s) == 19);
+    TNFS_TEST_CHECK(tnfs_fseek(s, TNFS_SEEK_SET, 13) == 0 && tnfs_fread(data, 6, s) == 6 && memcmp(data, "third\n", 6) == 0);
+    TNFS_TEST_CHECK(tnfs_fclose(s) == 0 && test_size("log.txt") == 19);
+}
+
+int main()
+{
+    tnfs_memserver_put("/placeholder", "", 0, 0);
+    tnfs_setTransport(&tnfs_test_transport);
+    TNFS_TEST_CHECK(tnfs_connect("memory", false) == 0);
+    TNFS_TEST_CHECK(tnfs_mount("/", "", "") == 0);
+
+    test_modes();
+    test_buffered();
+    test_append();
+
+    tnfs_umount();
+    tnfs_disconnect();
+
+    return tnfs_test_done("test_stream");
+}
@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "tnfs_test.h"
+#include "../include/tnfs_sync.h"
+
+/*
+ * tnfs_sync() against the stand-in server over loopback UDP: the first run downloads the tree, later runs only the
+ * new and changed files and delete what is gone, with the manifest or with the local files to compare against, and
+ * with TNFS_SYNC_TRUST_DIRS. A listing that fails, or runs out of memory, must not delete anything.
+ */
+
+#define TEST_LOCAL "build/test_sync"
+#define TEST_MANIFEST "build/test_sync.manifest"
+#define TEST_BIG 70	// files in /big, more than the first allocation of a list
+
+uint8_t test_fail = 0;		// responses to this command report an error, zero for none
+int  test_reallocs = -1;	// realloc() calls until one fails, -1 never
+
+void* __libc_realloc(void* p, size_t size);
+
+void* realloc(void* p, size_t size)
+{
+    if (test_reallocs >= 0 && test_reallocs-- == 0)
+        return NULL;
+
+    return __libc_realloc(p, size);
+}
+
+/* responses to test_fail report an error */
+int test_recv(uint8_t* buffer, int length)
+{
+    if (test_fail != 0 && length >= 5 && buffer[3] == test_fail)
+        buffer[4] = TNFS_EIO;
+
+    return length;
+}
+
+/* serves the files put so far, the previous server is stopped */
+void test_serve(pid_t* server)
+{
+    tnfs_test_stop(*server);
+    *server = tnfs_test_serve(TNFS_TEST_HOST);
+    TNFS_TEST_CHECK(*server > 0);
+    TNFS_TEST_CHECK(tnfs_connect(TNFS_TEST_HOST, false) == 0 && tnfs_mount("/", "", "") == 0);
+}
+
+/* ends the session with the current server */
+void test_leave()
+{
+    tnfs_umount();
+    tnfs_disconnect();
+}
+
+/* true when the local file has exactly the given contents */
+bool test_local(const char* path, const char* contents)
+{
+    char name[256];
+    char data[256];
+    size_t n = 0;
+    FILE* f;
+
+    snprintf(name, sizeof(name), "%s/%s", TEST_LOCAL, path);
+    f = fopen(name, "rb");
+    if (f == NULL)
+        return false;
+    n = fread(data, 1, sizeof(data), f);
+    fclose(f);
+
+    return n == strlen(contents) && memcmp(data, contents, n) == 0;
+}
+
+/* true when a local file or directory exists */
+bool test_exists(const char* path)
+{
+    char name[256];
+    struct stat st;
+
+    snprintf(name, sizeof(name), "%s/%s", TEST_LOCAL, path);
+
+    return stat(name, &st) == 0;
+}
+
+/* creates a local file that isn't on the server */
+void test_stray(const char* path)
+{
+    char name[256];
+    FILE* f;
+
+    snprintf(name, sizeof(name), "%s/%s", TEST_LOCAL, path);
+    f = fopen(name, "wb");
+    if (TNFS_TEST_CHECK(f != NULL)) {
+        fputs("stray", f);
+        fclose(f);
+    }
+}
+
+/* the tree of the first run */
+void test_tree()
+{
+    tnfs_memserver_reset();
+    tnfs_memserver_put("/tree/a.txt", "alpha", 5, 1000000);
+    tnfs_memserver_put("/tree/b.txt", "bravo", 5, 1000000);
+    tnfs_memserver_put("/tree/sub/c.txt", "charlie", 7, 1000000);
+    tnfs_memserver_put("/tree/sub/deep/d.txt", "delta", 5, 1000000);
+}
+
+int main()
+{
+    struct tnfs_sync_result r;
+    char path[32];
+    pid_t server = 0;
+    bool ok = true;
+
+    mkdir("build", 0755);
+    system("rm -rf " TEST_LOCAL " " TEST_MANIFEST);
+    tnfs_test_inner = &netw_sockets;
+    tnfs_test_recv = test_recv;
+    tnfs_setTransport(&tnfs_test_transport);
+
+    /* the first run downloads everything */
+    test_tree();
+    test_serve(&server);
+    TNFS_TEST_CHECK(tnfs_sync("tree", TEST_LOCAL, TEST_MANIFEST, 0, &r) == 0);
+    TNFS_TEST_CHECK(r.dirs == 3 && r.listed == 3 && r.files == 4 && r.downloaded == 4 && r.deleted == 0 && r.failed == 0);
+    TNFS_TEST_CHECK(r.bytes == 22);
+    TNFS_TEST_CHECK(test_local("a.txt", "alpha") && test_local("sub/c.txt", "charlie") && test_local("sub/deep/d.txt", "delta"));
+
+    /* unchanged: nothing is downloaded, a local file that the server doesn't have is deleted */
+    test_stray("stray.txt");
+    TNFS_TEST_CHECK(tnfs_sync("tree", TEST_LOCAL, TEST_MANIFEST, 0, &r) == 0);
+    TNFS_TEST_CHECK(r.listed == 3 && r.files == 4 && r.downloaded == 0 && r.deleted == 1 && !test_exists("stray.txt"));
+
+    /* without a manifest the local files tell what changed */
+    TNFS_TEST_CHECK(tnfs_sync("tree", TEST_LOCAL, NULL, 0, &r) == 0);
+    TNFS_TEST_CHECK(r.files == 4 && r.downloaded == 0 && r.deleted == 0);
+
+    /* the manifest trusts unchanged directories: only the subdirectories are asked for their time */
+    TNFS_TEST_CHECK(tnfs_sync("tree", TEST_LOCAL, TEST_MANIFEST, TNFS_SYNC_TRUST_DIRS, &r) == 0);
+    TNFS_TEST_CHECK(r.dirs == 3 && r.listed == 0 && r.files == 4 && r.downloaded == 0);
+    test_leave();
+
+    /* changed, new and deleted files, in directories with a new time */
+    sleep(1);
+    tnfs_memserver_reset();
+    tnfs_memserver_put("/tree/b.txt", "bravo two", 9, 2000000);
+    tnfs_memserver_put("/tree/sub/c.txt", "charlie", 7, 1000000);
+    tnfs_memserver_put("/tree/sub/deep/d.txt", "delta", 5, 1000000);
+    tnfs_memserver_put("/tree/sub/e.txt", "echo", 4, 1000000);
+    test_serve(&server);
+    TNFS_TEST_CHECK(tnfs_sync("tree", TEST_LOCAL, TEST_MANIFEST, TNFS_SYNC_TRUST_DIRS, &r) == 0);
+    TNFS_TEST_CHECK(r.listed == 3 && r.files == 4 && r.downloaded == 2 && r.deleted == 1 && r.failed == 0);
+    TNFS_TEST_CHECK(test_local("b.txt", "bravo two") && test_local("sub/e.txt", "echo") && !test_exists("a.txt"));
+
+    /* no listing: nothing is deleted and the next run lists again although the directories didn't change */
+    test_stray("stray.txt");
+    test_fail = 0x18;
+    TNFS_TEST_CHECK(tnfs_sync("tree", TEST_LOCAL, TEST_MANIFEST, 0, &r) == 0);
+    TNFS_TEST_CHECK(r.listed == 0 && r.failed == 1 && r.deleted == 0 && r.downloaded == 0);
+    TNFS_TEST_CHECK(test_exists("stray.txt") && test_local("sub/c.txt", "charlie") && test_local("sub/deep/d.txt", "delta"));
+    test_fail = 0;
+    TNFS_TEST_CHECK(tnfs_sync("tree", TEST_LOCAL, TEST_MANIFEST, TNFS_SYNC_TRUST_DIRS, &r) == 0);
+    TNFS_TEST_CHECK(r.listed == 3 && r.deleted == 1 && r.downloaded == 0 && !test_exists("stray.txt"));
+    test_leave();
+
+    /* a download that fails is tried again by the next run, although its directory didn't change */
+    sleep(1);
+    tnfs_memserver_reset();
+    tnfs_memserver_put("/tree/b.txt", "bravo two", 9, 2000000);
+    tnfs_memserver_put("/tree/sub/c.txt", "charlie", 7, 1000000);
+    tnfs_memserver_put("/tree/sub/deep/d.txt", "delta", 5, 1000000);
+    tnfs_memserver_put("/tree/sub/e.txt", "echo", 4, 1000000);
+    tnfs_memserver_put("/tree/sub/f.txt", "foxtrot", 7, 1000000);
+    test_serve(&server);
+    test_fail = 0x29;
+    TNFS_TEST_CHECK(tnfs_sync("tree", TEST_LOCAL, TEST_MANIFEST, TNFS_SYNC_TRUST_DIRS, &r) == 0);
+    TNFS_TEST_CHECK(r.downloaded == 0 && r.failed == 1 && !test_exists("sub/f.txt"));
+    test_fail = 0;
+    TNFS_TEST_CHECK(tnfs_sync("tree", TEST_LOCAL, TEST_MANIFEST, TNFS_SYNC_TRUST_DIRS, &r) == 0);
+    TNFS_TEST_CHECK(r.files == 5 && r.downloaded == 1 && r.failed == 0 && test_local("sub/f.txt", "foxtrot"));
+    TNFS_TEST_CHECK(tnfs_sync("tree", TEST_LOCAL, TEST_MANIFEST, TNFS_SYNC_TRUST_DIRS, &r) == 0);
+    TNFS_TEST_CHECK(r.listed == 0 && r.files == 5 && r.downloaded == 0);
+    test_leave();
+
+    /* out of memory while listing: the run fails and deletes nothing */
+    for (int i = 0; i < TEST_BIG; i++) {
+        snprintf(path, sizeof(path), "/big/f%03d", i);
+        tnfs_memserver_put(path, path, strlen(path), 1000000);
+    }
+    test_serve(&server);
+    system("rm -rf " TEST_LOCAL);
+    TNFS_TEST_CHECK(tnfs_sync("big", TEST_LOCAL, NULL, 0, &r) == 0 && r.downloaded == TEST_BIG);
+    test_reallocs = 2;	// the list of entries and the names of the synced directory, then its listing grows the list
+    TNFS_TEST_CHECK(tnfs_sync("big", TEST_LOCAL, NULL, 0, &r) == -TNFS_ENOMEM);
+    test_reallocs = -1;
+    TNFS_TEST_CHECK(r.deleted == 0 && r.listed == 0);
+    for (int i = 0; i < TEST_BIG; i++) {
+        snprintf(path, sizeof(path), "f%03d", i);
+        ok = ok && test_exists(path);
+    }
+    TNFS_TEST_CHECK(ok);
+    test_leave();
+
+    tnfs_test_stop(server);
+    system("rm -rf " TEST_LOCAL " " TEST_MANIFEST);
+
+    return tnfs_test_done("test_sync");
+}
@@ -0,0 +1,307 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "tnfs_test.h"
+#include "../include/tnfs_sched.h"
+#include "../include/tnfs_timeline.h"
+
+/*
+ * tnfs_timeline_export() on the memory transport: the file has to be valid JSON in the Chrome trace event format, the
+ * blocking path records its request, send, wait and decode spans, a burst of tnfs_statv() its burst and one span per
+ * request in flight, and every queued request of the scheduler is a "b" event with an "e" event of the same id, name
+ * and lane that doesn't end before it starts.
+ */
+
+#define TEST_TIMELINE "build/test_timeline.json"
+#define TEST_EVENTS 256
+
+/* the fields of one trace event that the checks look at, -1 when it doesn't have the field */
+struct test_event {
+    char name[32];
+    char ph[32];
+    long tid;
+    long ts;
+    long dur;
+    long id;
+} test_events[TEST_EVENTS];
+
+int test_count = 0;		// events in test_events
+uint32_t test_stats = 0;	// tnfs_sched_run() completions
+
+bool test_value(const char** p, int depth, struct test_event* e, const char* key);
+
+/* skips white space */
+void test_space(const char** p)
+{
+    while (isspace((unsigned char)**p))
+        (*p)++;
+}
+
+/* reads a string without escapes into out, false when it isn't one */
+bool test_string(const char** p, char* out, size_t size)
+{
+    size_t n = 0;
+
+    if (**p != '"')
+        return false;
+    for ((*p)++; **p != '"'; (*p)++) {
+        if (**p == 0 || **p == '\\' || (unsigned char)**p < 0x20)
+            return false;
+        if (n + 1 < size)
+            out[n++] = **p;
+    }
+    (*p)++;
+    out[n] = 0;
+
+    return true;
+}
+
+/* reads an object, the members of a trace event (depth 2) go to a new entry of test_events */
+bool test_object(const char** p, int depth)
+{
+    struct test_event* e = NULL;
+    char key[32];
+
+    if (depth == 2) {
+        if (test_count == TEST_EVENTS)
+            return false;
+        e = &test_events[test_count++];
+        memset(e, 0, sizeof(struct test_event));
+        e->tid = e->ts = e->dur = e->id = -1;
+    }
+
+    (*p)++;
+    test_space(p);
+    if (**p == '}') {
+        (*p)++;
+        return true;
+    }
+    for (;;) {
+        test_space(p);
+        if (!test_string(p, key, sizeof(key)))
+            return false;
+        test_space(p);
+        if (*(*p)++ != ':' || !test_value(p, depth + 1, e, key))
+            return false;
+        test_space(p);
+        if (**p == '}') {
+            (*p)++;
+            return true;
+        }
+        if (*(*p)++ != ',')
+            return false;
+    }
+}
+
+/* reads an array */
+bool test_array(const char** p, int depth)
+{
+    (*p)++;
+    test_space(p);
+    if (**p == ']') {
+        (*p)++;
+        return true;
+    }
+    for (;;) {
+        if (!test_value(p, depth + 1, NULL, NULL))
+            return false;
+        test_space(p);
+        if (**p == ']') {
+            (*p)++;
+            return true;
+        }
+        if (*(*p)++ != ',')
+            return false;
+    }
+}
+
+/* reads any JSON value, with e the value of key is kept when it is a field of struct test_event */
+bool test_value(const char** p, int depth, struct test_event* e, const char* key)
+{
+    char text[32];
+    char* end;
+    long n;
+
+    test_space(p);
+    if (**p == '{')
+        return test_object(p, depth);
+    if (**p == '[')
+        return test_array(p, depth);
+    if (**p == '"') {
+        if (!test_string(p, text, sizeof(text)))
+            return false;
+        if (e != NULL && strcmp(key, "name") == 0)
+            strcpy(e->name, text);
+        if (e != NULL && strcmp(key, "ph") == 0)
+            strcpy(e->ph, text);
+        return true;
+    }
+    if (strncmp(*p, "true", 4) == 0 || strncmp(*p, "null", 4) == 0) {
+        *p += 4;
+        return true;
+    }
+    if (strncmp(*p, "false", 5) == 0) {
+        *p += 5;
+        return true;
+    }
+
+    n = strtol(*p, &end, 10);
+    if (end == *p || *end == '.')
+        return false;
+    *p = end;
+    if (e != NULL && strcmp(key, "tid") == 0)
+        e->tid = n;
+    if (e != NULL && strcmp(key, "ts") == 0)
+        e->ts = n;
+    if (e != NULL && strcmp(key, "dur") == 0)
+        e->dur = n;
+    if (e != NULL && strcmp(key, "id") == 0)
+        e->id = n;
+
+    return true;
+}
+
+/* exports the timeline and reads it back into test_events, false when it isn't valid JSON */
+bool test_export()
+{
+    static char json[256 * 1024];
+    const char* p = json;
+    size_t length;
+    FILE* f;
+
+    test_count = 0;
+    if (tnfs_timeline_export(TEST_TIMELINE) != 0 || (f = fopen(TEST_TIMELINE, "r")) == NULL)
+        return false;
+    length = fread(json, 1, sizeof(json) - 1, f);
+    fclose(f);
+    json[length] = 0;
+
+    test_space(&p);
+    if (*p != '{' || !test_object(&p, 0))
+        return false;
+    test_space(&p);
+
+    return *p == 0;
+}
+
+/* returns the number of complete events with this name on a lane, any lane when lane is -1 */
+int test_spans(const char* name, long lane)
+{
+    int n = 0;
+
+    for (int i = 0; i < test_count; i++) {
+        struct test_event* e = &test_events[i];
+        if (strcmp(e->ph, "X") == 0 && strcmp(e->name, name) == 0 && (lane < 0 || e->tid == lane) && e->ts >= 0 && e->dur >= 0)
+            n++;
+    }
+
+    return n;
+}
+
+/* returns the number of "b" events that have a matching "e" event, -1 when one doesn't */
+int test_pairs()
+{
+    int pairs = 0;
+
+    for (int i = 0; i < test_count; i++) {
+        struct test_event* b = &test_events[i];
+        bool found = false;
+
+        if (strcmp(b->ph, "b") != 0)
+            continue;
+        for (int j = 0; j < test_count && !found; j++) {
+            struct test_event* e = &test_events[j];
+            found = strcmp(e->ph, "e") == 0 && e->id == b->id && e->tid == b->tid && strcmp(e->name, b->name) == 0
+                 && e->ts >= b->ts;
+        }
+        if (!found)
+            return -1;
+        pairs++;
+    }
+
+    return pairs;
+}
+
+/* counts a completed stat of the scheduler */
+void test_done(struct tnfs_request* req)
+{
+    struct fstat st;
+
+    if (tnfs_takeStat(req, &st) == 0)
+        test_stats++;
+    tnfs_pool_put(tnfs_pool_default(), req);
+}
+
+int main()
+{
+    char* paths[] = { "/a.txt", "/b.txt", "/a.txt" };
+    const uint8_t classes[] = { TNFS_SCHED_INTERACTIVE, TNFS_SCHED_INTERACTIVE, TNFS_SCHED_BULK, TNFS_SCHED_FOREGROUND };
+    struct fstat st[3];
+    struct tnfs_request* req;
+    int results[3];
+
+    mkdir("build", 0755);
+    tnfs_memserver_put("/a.txt", "alpha", 5, 0);
+    tnfs_memserver_put("/b.txt", "bravo", 5, 0);
+    tnfs_setTransport(&tnfs_memserver_transport);
+    TNFS_TEST_CHECK(tnfs_connect("memory", false) == 0 && tnfs_mount("/", "", "") == 0);
+
+    /* nothing recorded yet is still a valid file */
+    TNFS_TEST_CHECK(tnfs_timeline_start(1000) == 0);
+    TNFS_TEST_CHECK(test_export() && test_spans("STAT", -1) == 0 && test_pairs() == 0);
+
+    /* the blocking path */
+    TNFS_TEST_CHECK(tnfs_stat("/a.txt", &st[0]) == 0);
+    TNFS_TEST_CHECK(test_export());
+    TNFS_TEST_CHECK(test_spans("STAT", TNFS_LANE_BLOCKING) == 1 && test_spans("encode", TNFS_LANE_BLOCKING) == 1);
+    TNFS_TEST_CHECK(test_spans("send", TNFS_LANE_BLOCKING) == 1 && test_spans("wait", TNFS_LANE_BLOCKING) == 1);
+    TNFS_TEST_CHECK(test_spans("decode", TNFS_LANE_BLOCKING) == 1);
+
+    /* a burst: its send, wait and burst spans, and one span in flight per request on lanes of their own */
+    TNFS_TEST_CHECK(tnfs_timeline_start(1000) == 0);
+    TNFS_TEST_CHECK(tnfs_statv(paths, st, results, 3) == 0 && results[0] == 0 && results[1] == 0 && results[2] == 0);
+    TNFS_TEST_CHECK(test_export());
+    TNFS_TEST_CHECK(test_spans("burst", TNFS_LANE_BATCH) == 1 && test_spans("send", TNFS_LANE_BATCH) == 1);
+    TNFS_TEST_CHECK(test_spans("wait", TNFS_LANE_BATCH) >= 1 && test_spans("in flight", -1) == 3);
+    TNFS_TEST_CHECK(test_spans("in flight", TNFS_LANE_FLIGHT) == 1 && test_spans("in flight", TNFS_LANE_FLIGHT + 2) == 1);
+    TNFS_TEST_CHECK(test_spans("decode", TNFS_LANE_BATCH) == 3 && test_spans("STAT", -1) == 0);
+
+    /* requests of the scheduler: a "b" and an "e" event for each on the lane of its class */
+    TNFS_TEST_CHECK(tnfs_timeline_start(1000) == 0);
+    for (int i = 0; i < 4; i++) {
+        req = tnfs_pool_get(tnfs_pool_default());
+        if (TNFS_TEST_CHECK(req != NULL)) {
+            tnfs_prepareStat(req, paths[i % 2], tnfs_pool_default()->bufsize);
+            TNFS_TEST_CHECK(tnfs_sched_submit(req, classes[i]) == 0);
+        }
+    }
+    while (tnfs_sched_run(test_done) > 0);
+    TNFS_TEST_CHECK(test_stats == 4);
+    TNFS_TEST_CHECK(test_export() && test_pairs() == 4);
+    for (int i = 0; i < test_count; i++) {
+        struct test_event* e = &test_events[i];
+        if (strcmp(e->ph, "b") == 0)
+            TNFS_TEST_CHECK(strcmp(e->name, "queued") == 0 && e->tid >= TNFS_LANE_QUEUED && e->tid < TNFS_LANE_QUEUED + TNFS_SCHED_CLASSES);
+    }
+
+    /* a full timeline drops spans and stays valid */
+    TNFS_TEST_CHECK(tnfs_timeline_start(2) == 0);
+    TNFS_TEST_CHECK(tnfs_stat("/b.txt", &st[0]) == 0);
+    TNFS_TEST_CHECK(tnfs_timeline_dropped() > 0 && test_export() && test_spans("STAT", -1) == 0);
+
+    /* stopped, nothing more is recorded */
+    TNFS_TEST_CHECK(tnfs_timeline_start(1000) == 0);
+    tnfs_timeline_stop();
+    TNFS_TEST_CHECK(tnfs_stat("/b.txt", &st[0]) == 0);
+    TNFS_TEST_CHECK(test_export() && test_spans("STAT", -1) == 0 && test_spans("send", -1) == 0);
+
+    tnfs_timeline_free();
+    tnfs_umount();
+    tnfs_disconnect();
+    unlink(TEST_TIMELINE);
+
+    return tnfs_test_done("test_timeline");
+}
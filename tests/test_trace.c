@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "tnfs_test.h"
+#include "../include/tnfs_trace.h"
+
+/*
+ * Traces on the memory transport: the variable length numbers and the records of the file read back as they were
+ * written, with and without TNFS_TRACE_NO_DATA, and a recorded workload replays with the same statuses. A mount and a
+ * retransmission are skipped, and against a changed tree the requests for a file that no longer opens are skipped and
+ * the open differs.
+ */
+
+#define TEST_TRACE "build/test_trace.trc"
+
+/* private functions of tnfs_trace.c */
+extern FILE* tnfs_trace_file;
+void tnfs_trace_putNumber(uint64_t n);
+const uint8_t* tnfs_trace_getNumber(const uint8_t* p, const uint8_t* end, uint64_t* n);
+
+uint8_t test_last[TNFS_BUFFERSIZE];	// the last request sent
+int     test_lastLength = 0;
+int     test_sent = 0;			// requests sent
+
+/* keeps the last request */
+int test_send(const uint8_t* buffer, int length)
+{
+    memcpy(test_last, buffer, length);
+    test_lastLength = length;
+    test_sent++;
+
+    return tnfs_test_inner->send(buffer, length);
+}
+
+/* reads the whole trace file into buffer, returns its length */
+long test_read(uint8_t* buffer, long size)
+{
+    FILE* f = fopen(TEST_TRACE, "rb");
+    long length;
+
+    if (f == NULL)
+        return 0;
+    length = fread(buffer, 1, size, f);
+    fclose(f);
+
+    return length;
+}
+
+/* numbers that take one to ten bytes, written and read back */
+void test_numbers()
+{
+    const uint64_t numbers[] = { 0, 1, 127, 128, 16383, 16384, 0xFFFFFFFF, 0x8000000000000000ULL, 0xFFFFFFFFFFFFFFFFULL };
+    const int bytes[] = { 1, 1, 1, 2, 2, 3, 5, 10, 10 };
+    uint8_t data[128];
+    const uint8_t* p = data;
+    const uint8_t* end;
+    uint64_t n;
+
+    tnfs_trace_file = tmpfile();
+    if (!TNFS_TEST_CHECK(tnfs_trace_file != NULL))
+        return;
+    for (int i = 0; i < 9; i++)
+        tnfs_trace_putNumber(numbers[i]);
+    rewind(tnfs_trace_file);
+    end = &data[fread(data, 1, sizeof(data), tnfs_trace_file)];
+    fclose(tnfs_trace_file);
+    tnfs_trace_file = NULL;
+
+    for (int i = 0; i < 9; i++) {
+        const uint8_t* next = tnfs_trace_getNumber(p, end, &n);
+        if (!TNFS_TEST_CHECK(next != NULL && n == numbers[i] && next - p == bytes[i]))
+            fprintf(stderr, "  number %d\n", i);
+        p = next != NULL ? next : end;
+    }
+    TNFS_TEST_CHECK(p == end);
+
+    /* a number that the file ends in the middle of */
+    data[0] = 0x80;
+    TNFS_TEST_CHECK(tnfs_trace_getNumber(data, &data[1], &n) == NULL);
+}
+
+/* checks the next record at *p, moves *p past it */
+bool test_record(const uint8_t** p, const uint8_t* end, uint8_t kind, const uint8_t* data, int stored, int length)
+{
+    uint64_t delta, n, original;
+    const uint8_t* q = *p;
+
+    if (q >= end || *q++ != kind || (q = tnfs_trace_getNumber(q, end, &delta)) == NULL
+     || (q = tnfs_trace_getNumber(q, end, &n)) == NULL || n != (uint64_t)stored)
+        return false;
+    if ((kind & TNFS_TRACE_TRUNCATED) && ((q = tnfs_trace_getNumber(q, end, &original)) == NULL || original != (uint64_t)length))
+        return false;
+    if (end - q < stored || memcmp(q, data, stored) != 0)
+        return false;
+    *p = q + stored;
+
+    return true;
+}
+
+/* the records of a READ and a WRITE, with and without their data */
+void test_records()
+{
+    uint8_t write[300], read[200], request[7] = { 0, 0, 9, 0x21, 1, 200, 0 };
+    uint8_t file[1024];
+    const uint8_t* p;
+    const uint8_t* end;
+
+    for (int i = 0; i < 300; i++)
+        write[i] = i;
+    memcpy(read, write, 200);
+    write[3] = 0x22;
+    read[3] = 0x21;
+
+    for (int options = 0; options <= TNFS_TRACE_NO_DATA; options++) {
+        bool cut = options & TNFS_TRACE_NO_DATA;
+
+        TNFS_TEST_CHECK(tnfs_trace_start(TEST_TRACE, options) == 0 && tnfs_trace_used);
+        tnfs_trace_record(0, write, 300);
+        tnfs_trace_record(0, request, 7);
+        tnfs_trace_record(TNFS_TRACE_RECEIVED, read, 200);
+        tnfs_trace_record(TNFS_TRACE_RECEIVED, read, TNFS_TRACE_KEPT);	// a short read is kept whole
+        tnfs_trace_record(TNFS_TRACE_RECEIVED, write, 300);		// only READ responses lose their data
+        TNFS_TEST_CHECK(tnfs_trace_stop() == 0 && !tnfs_trace_used);
+
+        end = &file[test_read(file, sizeof(file))];
+        TNFS_TEST_CHECK(end - file >= 16 && memcmp(file, TNFS_TRACE_MAGIC, 8) == 0 && file[12] == options);
+        p = &file[16];
+        TNFS_TEST_CHECK(test_record(&p, end, cut ? TNFS_TRACE_TRUNCATED : 0, write, cut ? TNFS_TRACE_KEPT : 300, 300));
+        TNFS_TEST_CHECK(test_record(&p, end, 0, request, 7, 7));
+        TNFS_TEST_CHECK(test_record(&p, end, TNFS_TRACE_RECEIVED | (cut ? TNFS_TRACE_TRUNCATED : 0), read,
+                                    cut ? TNFS_TRACE_KEPT : 200, 200));
+        TNFS_TEST_CHECK(test_record(&p, end, TNFS_TRACE_RECEIVED, read, TNFS_TRACE_KEPT, TNFS_TRACE_KEPT));
+        TNFS_TEST_CHECK(test_record(&p, end, TNFS_TRACE_RECEIVED, write, 300, 300));
+        TNFS_TEST_CHECK(p == end);
+    }
+}
+
+/* the workload: a listing, reads, a missing file, a pause, a retransmission, and a file that is written and removed */
+void test_workload(uint8_t options)
+{
+    char data[512];
+    struct fstat st;
+    int handle;
+
+    memset(data, 'w', sizeof(data));
+    tnfs_test_send = test_send;
+    tnfs_setTransport(&tnfs_test_transport);
+    TNFS_TEST_CHECK(tnfs_connect("memory", false) == 0);
+    TNFS_TEST_CHECK(tnfs_trace_start(TEST_TRACE, options) == 0);
+    test_sent = 0;
+    TNFS_TEST_CHECK(tnfs_mount("/", "", "") == 0);
+
+    handle = tnfs_opendir("/data");
+    TNFS_TEST_CHECK(handle >= 0);
+    while (tnfs_readdir(handle, data) == 0);
+    TNFS_TEST_CHECK(tnfs_closedir(handle) == 0);
+
+    handle = tnfs_open("/data/a.bin", TNFS_O_RDONLY, 0);
+    TNFS_TEST_CHECK(handle >= 0);
+    TNFS_TEST_CHECK(tnfs_read(data, handle, 512) == 512 && tnfs_read(data, handle, 512) == 488);
+    TNFS_TEST_CHECK(tnfs_lseek(handle, TNFS_SEEK_SET, 100) == 0 && tnfs_close(handle) == 0);
+
+    TNFS_TEST_CHECK(tnfs_stat("/data/b.txt", &st) == 0 && tnfs_stat("/data/missing", &st) == -TNFS_ENOENT);
+    usleep(30000);
+    tnfs_trace_record(0, test_last, test_lastLength);	// the stat again with the same sequence number
+
+    handle = tnfs_open("/data/new.txt", TNFS_O_WRONLY | TNFS_O_CREAT | TNFS_O_TRUNC, 0644);
+    TNFS_TEST_CHECK(handle >= 0 && tnfs_write(data, handle, 300) == 0 && tnfs_close(handle) == 0);
+    TNFS_TEST_CHECK(tnfs_unlink("/data/new.txt") == 0);
+
+    TNFS_TEST_CHECK(tnfs_trace_stop() == 0);
+}
+
+/* a replay that is done */
+bool test_replay(uint16_t pace, uint32_t replayed, uint32_t skipped, uint32_t differed, struct tnfs_trace_result* r)
+{
+    return tnfs_trace_replay(TEST_TRACE, pace, r) == 0 && r->replayed == replayed && r->skipped == skipped
+        && r->differed == differed;
+}
+
+int main()
+{
+    char data[1000];
+    struct tnfs_trace_result r;
+    int requests;
+
+    mkdir("build", 0755);
+
+    test_numbers();
+    test_records();
+
+    for (int i = 0; i < 1000; i++)
+        data[i] = i;
+    tnfs_memserver_put("/data/a.bin", data, 1000, 0);
+    tnfs_memserver_put("/data/b.txt", "bravo", 5, 0);
+
+    for (int options = 0; options <= TNFS_TRACE_NO_DATA; options++) {
+        test_workload(options);
+        requests = test_sent - 1;	// without the mount
+
+        /* the same tree: every status is the recorded one, the mount and the stat sent again are skipped, and the pause
+         * is kept with pace 100 and left out with 0 */
+        TNFS_TEST_CHECK(test_replay(100, requests, 2, 0, &r));
+        TNFS_TEST_CHECK(r.elapsed_ms >= 30 && r.recorded_ms >= 30);
+        TNFS_TEST_CHECK(r.commands[0x21].count == 2 && r.commands[0x22].count == 1 && r.commands[0x24].count == 2);
+        TNFS_TEST_CHECK(test_replay(0, requests, 2, 0, &r) && r.elapsed_ms < 30);
+
+        /* a.bin renamed: the open differs, and its reads, seek and close are skipped */
+        TNFS_TEST_CHECK(tnfs_rename("/data/a.bin", "/data/c.bin") == 0);
+        TNFS_TEST_CHECK(test_replay(0, requests - 4, 6, 1, &r));
+        TNFS_TEST_CHECK(tnfs_rename("/data/c.bin", "/data/a.bin") == 0);
+
+        tnfs_umount();
+        tnfs_disconnect();
+    }
+
+    /* no trace */
+    TNFS_TEST_CHECK(tnfs_trace_replay("build/test_trace.missing", 0, &r) == -TNFS_ENOENT);
+    TNFS_TEST_CHECK(tnfs_trace_replay("tests/test_trace.c", 0, &r) == -TNFS_EINVAL);
+
+    unlink(TEST_TRACE);
+
+    return tnfs_test_done("test_trace");
+}
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <unistd.h>
+#include "tnfs_test.h"
+#include "../include/tnfs_warm.h"
+
+/* the warm-start cache keeps listings and timing per server and mount, one cache file serves several servers */
+
+#define TEST_CACHE "/tmp/tnfs_test_warm.cache"
+#define TEST_OTHER "127.0.0.78"
+#define TEST_MANY 100	// files in /a and /b, more than one READDIRX response holds
+
+/* lists /games of the current mount so the cache records it */
+void test_list()
+{
+    struct dirx_data data;
+    struct dirx_item item;
+
+    if (tnfs_opendirx("/games", "", 0, 0, &data) == 0) {
+        while (tnfs_nextdirx(&data, &item) == 0);
+        tnfs_closedir(data.handle);
+    }
+}
+
+/* reads /a and /b at the same time, returns true when the cache doesn't mix up their entries */
+bool test_interleaved()
+{
+    struct dirx_data a, b;
+    struct dirx_item item;
+    struct tnfs_warm_dir cached;
+    bool more = true;
+    bool ok = true;
+    int n = 0;
+
+    if (tnfs_opendirx("/a", "", 0, 0, &a) != 0 || tnfs_opendirx("/b", "", 0, 0, &b) != 0)
+        return false;
+    while (more) {
+        more = tnfs_nextdirx(&a, &item) == 0;
+        more = tnfs_nextdirx(&b, &item) == 0 || more;
+    }
+    tnfs_closedir(a.handle);
+    tnfs_closedir(b.handle);
+
+    for (const char* dir = "ab"; *dir != 0; dir++) {
+        char path[] = { '/', *dir, 0 };
+
+        if (tnfs_warm_opendirx(path, "", 0, 0, &cached) != 0)
+            continue;
+        for (n = 0; tnfs_warm_nextdirx(&cached, &item) == 0; n++)
+            ok = ok && item.name[0] == *dir;
+        ok = ok && n == TEST_MANY && cached.entries == TEST_MANY;
+    }
+
+    /* the directory that was started last is complete */
+    return ok && tnfs_warm_opendirx("/b", "", 0, 0, &cached) == 0;
+}
+
+/* overwrites the last byte of the cache file, the zero that ends the name of the last entry, returns true when done */
+bool test_damage()
+{
+    FILE* f = fopen(TEST_CACHE, "r+b");
+    bool ok;
+
+    if (f == NULL)
+        return false;
+    ok = fseek(f, -1, SEEK_END) == 0 && fgetc(f) == 0 && fseek(f, -1, SEEK_END) == 0 && fputc('x', f) == 'x';
+    fclose(f);
+
+    return ok;
+}
+
+int main()
+{
+    struct tnfs_warm_dir cached;
+    uint16_t srtt, rttvar, retry;
+    pid_t first, second;
+
+    tnfs_memserver_put("/games/a.st", "a", 1, 0);
+    tnfs_memserver_put("/other/b.st", "b", 1, 0);
+    for (int i = 0; i < TEST_MANY; i++) {
+        char path[32];
+
+        snprintf(path, sizeof(path), "/a/a%03d.st", i);
+        tnfs_memserver_put(path, "a", 1, 0);
+        path[1] = path[3] = 'b';
+        tnfs_memserver_put(path, "b", 1, 0);
+    }
+    first = tnfs_test_serve(TNFS_TEST_HOST);
+    second = tnfs_test_serve(TEST_OTHER);
+    TNFS_TEST_CHECK(first > 0 && second > 0);
+
+    /* a process that used the first server */
+    unlink(TEST_CACHE);
+    tnfs_warm_open(TEST_CACHE);
+    tnfs_connect(TNFS_TEST_HOST, false);
+    tnfs_mount("/", "", "");
+    test_list();
+    TNFS_TEST_CHECK(tnfs_warm_opendirx("/games", "", 0, 0, &cached) == 0);
+    TNFS_TEST_CHECK(test_interleaved());
+    tnfs_umount();
+    tnfs_disconnect();
+    tnfs_warm_close();
+
+    /* the next process mounts another directory of the same server: no listing */
+    tnfs_setTiming(0, 0, 0);
+    tnfs_warm_open(TEST_CACHE);
+    tnfs_connect(TNFS_TEST_HOST, false);
+    TNFS_TEST_CHECK(tnfs_getTiming(&srtt, &rttvar, &retry) && retry == 1000);
+    tnfs_mount("/other", "", "");
+    TNFS_TEST_CHECK(tnfs_warm_opendirx("/games", "", 0, 0, &cached) == -TNFS_ENOENT);
+    tnfs_umount();
+    tnfs_disconnect();
+    tnfs_warm_close();
+
+    /* and one on the other server gets neither the timing nor the listings of the first */
+    tnfs_setTiming(0, 0, 0);
+    tnfs_warm_open(TEST_CACHE);
+    tnfs_lazyMount(TEST_OTHER, false, "/", "", "");
+    TNFS_TEST_CHECK(tnfs_getTiming(&srtt, &rttvar, &retry) && retry == 0);
+    TNFS_TEST_CHECK(tnfs_warm_opendirx("/games", "", 0, 0, &cached) == -TNFS_ENOENT);
+    tnfs_umount();
+    tnfs_disconnect();
+    tnfs_warm_close();
+
+    /* the same server and mount find the listing again */
+    tnfs_warm_open(TEST_CACHE);
+    tnfs_connect(TNFS_TEST_HOST, false);
+    tnfs_mount("/", "", "");
+    TNFS_TEST_CHECK(tnfs_warm_opendirx("/games", "", 0, 0, &cached) == 0 && cached.entries == 1);
+    tnfs_umount();
+    tnfs_disconnect();
+    tnfs_warm_close();
+
+    /* a cache file whose last entry lost its terminating zero: the listing is dropped, not read beyond its end */
+    unlink(TEST_CACHE);
+    tnfs_warm_open(TEST_CACHE);
+    tnfs_connect(TNFS_TEST_HOST, false);
+    tnfs_mount("/", "", "");
+    test_list();
+    tnfs_umount();
+    tnfs_disconnect();
+    tnfs_warm_close();
+    TNFS_TEST_CHECK(test_damage());
+    tnfs_warm_open(TEST_CACHE);
+    tnfs_connect(TNFS_TEST_HOST, false);
+    tnfs_mount("/", "", "");
+    TNFS_TEST_CHECK(tnfs_warm_opendirx("/games", "", 0, 0, &cached) == -TNFS_ENOENT);
+    test_list();
+    TNFS_TEST_CHECK(tnfs_warm_opendirx("/games", "", 0, 0, &cached) == 0 && cached.entries == 1);
+    tnfs_umount();
+    tnfs_disconnect();
+    tnfs_warm_close();
+
+    unlink(TEST_CACHE);
+    tnfs_test_stop(first);
+    tnfs_test_stop(second);
+
+    return tnfs_test_done("test_warm");
+}
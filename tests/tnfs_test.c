@@ -0,0 +1,277 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "tnfs_test.h"
+
+int tnfs_test_failures = 0;	// failed checks of the running test
+const struct netw_transport* tnfs_test_inner = &tnfs_memserver_transport;	// transport under tnfs_test_transport
+int  (*tnfs_test_send)(const uint8_t* buffer, int length) = NULL;	// sends instead of tnfs_test_inner, NULL for none
+int  (*tnfs_test_recv)(uint8_t* buffer, int length) = NULL;		// sees each received datagram, NULL for none
+int  tnfs_test_connects = 0;	// calls of connect() of tnfs_test_transport
+int  tnfs_test_sent[256];	// requests sent per command
+int  tnfs_test_received[256];	// responses received per command
+
+
+/* counts a failed check and shows where it is */
+bool tnfs_test_check(bool ok, const char* what, const char* file, int line)
+{
+    if (!ok) {
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+        tnfs_test_failures++;
+    }
+
+    return ok;
+}
+
+/* shows the result of a test, returns the exit code of the test program */
+int tnfs_test_done(const char* name)
+{
+    printf("%-24s %s\n", name, tnfs_test_failures == 0 ? "ok" : "FAILED");
+
+    return tnfs_test_failures == 0 ? 0 : 1;
+}
+
+/* makes a socket of the given type bound to host and TNFS_PORT, host is an IPv4 or IPv6 address. Returns it or -1 */
+int tnfs_test_bind(const char* host, int type)
+{
+    struct sockaddr_storage addr;
+    struct sockaddr_in* v4 = (struct sockaddr_in*)&addr;
+    struct sockaddr_in6* v6 = (struct sockaddr_in6*)&addr;
+    socklen_t addrlen;
+    int fd;
+    int on = 1;
+
+    memset(&addr, 0, sizeof(addr));
+    if (inet_pton(AF_INET, host, &v4->sin_addr) == 1) {
+        v4->sin_family = AF_INET;
+        v4->sin_port = htons(TNFS_PORT);
+        addrlen = sizeof(struct sockaddr_in);
+    } else if (inet_pton(AF_INET6, host, &v6->sin6_addr) == 1) {
+        v6->sin6_family = AF_INET6;
+        v6->sin6_port = htons(TNFS_PORT);
+        addrlen = sizeof(struct sockaddr_in6);
+    } else {
+        return -1;
+    }
+
+    fd = socket(addr.ss_family, type, 0);
+    if (fd < 0)
+        return -1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (addr.ss_family == AF_INET6)
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on));
+    if (bind(fd, (struct sockaddr*)&addr, addrlen) != 0 || (type == SOCK_STREAM && listen(fd, 4) != 0)) {
+        perror("tnfs_test_bind");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/*
+ * starts the stand-in server in a child process that answers UDP requests on host and TNFS_PORT, with the files that
+ * tnfs_memserver_put() added so far. host is an IPv4 or IPv6 address. Returns the process id of the server or -1
+ */
+pid_t tnfs_test_serve(const char* host)
+{
+    struct sockaddr_storage client;
+    socklen_t clientlen;
+    uint8_t* request;
+    uint8_t* response;
+    pid_t pid;
+    int length;
+
+    /* bound before the fork, so the client can't send before the server listens */
+    int fd = tnfs_test_bind(host, SOCK_DGRAM);
+    if (fd < 0)
+        return -1;
+
+    fflush(stdout);
+    pid = fork();
+    if (pid != 0) {
+        close(fd);
+        return pid;
+    }
+
+    request = malloc(TNFS_BUFFERSIZE);
+    response = malloc(TNFS_BUFFERSIZE);
+    tnfs_memserver_transport.connect("", 0, false);
+    while (request != NULL && response != NULL) {
+        clientlen = sizeof(client);
+        length = recvfrom(fd, request, TNFS_BUFFERSIZE, 0, (struct sockaddr*)&client, &clientlen);
+        if (length <= 0)
+            continue;
+        length = tnfs_memserver_handle(request, length, response);
+        if (length > 0)
+            sendto(fd, response, length, 0, (struct sockaddr*)&client, clientlen);
+    }
+    _exit(1);
+}
+
+/*
+ * like tnfs_test_serve() over TCP, one connection at a time. Like a real server it takes what one read of the stream
+ * gets for one request, so a client has to wait for each response before it sends the next request
+ */
+pid_t tnfs_test_serveTCP(const char* host)
+{
+    uint8_t* request;
+    uint8_t* response;
+    pid_t pid;
+    int client, length;
+
+    int fd = tnfs_test_bind(host, SOCK_STREAM);
+    if (fd < 0)
+        return -1;
+
+    fflush(stdout);
+    pid = fork();
+    if (pid != 0) {
+        close(fd);
+        return pid;
+    }
+
+    request = malloc(TNFS_BUFFERSIZE);
+    response = malloc(TNFS_BUFFERSIZE);
+    tnfs_memserver_transport.connect("", 0, true);
+    while (request != NULL && response != NULL) {
+        client = accept(fd, NULL, NULL);
+        if (client < 0)
+            continue;
+        while ((length = recv(client, request, TNFS_BUFFERSIZE, 0)) > 0) {
+            length = tnfs_memserver_handle(request, length, response);
+            if (length > 0 && send(client, response, length, MSG_NOSIGNAL) != length)
+                break;
+        }
+        close(client);
+    }
+    _exit(1);
+}
+
+/* ends the server of tnfs_test_serve() or tnfs_test_serveTCP() */
+void tnfs_test_stop(pid_t server)
+{
+    if (server <= 0)
+        return;
+
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+}
+
+/* compares two samples for qsort() */
+int tnfs_test_compare(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* sorts the samples and returns the given percentile of them */
+uint32_t tnfs_test_percentile(uint32_t* samples, int count, int percent)
+{
+    int i;
+
+    if (count <= 0)
+        return 0;
+
+    qsort(samples, count, sizeof(uint32_t), tnfs_test_compare);
+    i = (count * percent + 99) / 100 - 1;
+
+    return samples[i < 0 ? 0 : i];
+}
+
+/* transport: connects tnfs_test_inner */
+int tnfs_test_connect(char* host, int port, bool useTCP)
+{
+    tnfs_test_connects++;
+
+    return tnfs_test_inner->connect(host, port, useTCP);
+}
+
+/* transport: disconnects tnfs_test_inner */
+void tnfs_test_disconnect()
+{
+    tnfs_test_inner->disconnect();
+}
+
+/* transport: sends a request through the send hook or tnfs_test_inner */
+int tnfs_test_sendOne(const uint8_t* buffer, int length)
+{
+    int code = tnfs_test_send != NULL ? tnfs_test_send(buffer, length) : tnfs_test_inner->send(buffer, length);
+
+    if (length >= 4)
+        tnfs_test_sent[buffer[3]]++;
+
+    return code;
+}
+
+/* transport: receives a response, the recv hook may change it or make it get lost */
+int tnfs_test_recvOne(uint8_t* buffer, int buffer_size)
+{
+    int length = tnfs_test_inner->recv(buffer, buffer_size);
+
+    if (length >= 0 && tnfs_test_recv != NULL)
+        length = tnfs_test_recv(buffer, length);
+    if (length >= 4)
+        tnfs_test_received[buffer[3]]++;
+
+    return length;
+}
+
+/* transport: sends a burst, one request at a time when there is a send hook */
+int tnfs_test_sendBatch(struct netw_datagram* d, int count)
+{
+    if (tnfs_test_send == NULL) {
+        for (int i = 0; i < count; i++)
+            tnfs_test_sent[d[i].buffer[3]]++;
+        return tnfs_test_inner->sendBatch(d, count);
+    }
+
+    for (int i = 0; i < count; i++)
+        tnfs_test_sendOne(d[i].buffer, d[i].length);
+
+    return count;
+}
+
+/* transport: receives a burst, the responses that the recv hook loses are left out */
+int tnfs_test_recvBatch(struct netw_datagram* d, int count)
+{
+    struct netw_datagram swap;
+    int n = tnfs_test_inner->recvBatch(d, count);
+    int kept = 0;
+
+    for (int i = 0; i < n; i++) {
+        if (tnfs_test_recv != NULL)
+            d[i].length = tnfs_test_recv(d[i].buffer, d[i].length);
+        if (d[i].length < 0)
+            continue;
+        if (d[i].length >= 4)
+            tnfs_test_received[d[i].buffer[3]]++;
+
+        /* swapped rather than copied, so every buffer stays in exactly one datagram */
+        swap = d[kept];
+        d[kept++] = d[i];
+        d[i] = swap;
+    }
+
+    return n > 0 && kept == 0 ? NETW_ERR_TIMEOUT : n > 0 ? kept : n;
+}
+
+/* transport: sets the timeout of tnfs_test_inner */
+void tnfs_test_setTimeout(int t)
+{
+    tnfs_test_inner->setTimeout(t);
+}
+
+/* the transport of the tests that count, change or lose datagrams, see tnfs_test.h */
+const struct netw_transport tnfs_test_transport = {
+    tnfs_test_connect, tnfs_test_disconnect, tnfs_test_sendOne, tnfs_test_recvOne, tnfs_test_sendBatch,
+    tnfs_test_recvBatch, tnfs_test_setTimeout
+};
@@ -0,0 +1,52 @@
+#ifndef __tnfs_test_h__
+#define __tnfs_test_h__
+
+#include <sys/types.h>
+#include "../include/tnfs.h"
+#include "../include/tnfs_memserver.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Helpers of the tests and benchmarks in this directory, built and run by "./build.sh test" and "./build.sh bench".
+ * A test returns 0 when every check passed, a benchmark prints its numbers. Both talk to the stand-in server of
+ * tnfs_memserver.c, either in the process through the memory transport or over UDP or TCP on a loopback address with
+ * tnfs_test_serve() or tnfs_test_serveTCP(), which gives real system calls and a real network stack without anything
+ * outside the tree.
+ */
+
+#define TNFS_TEST_HOST "127.0.0.77"	// loopback address of tnfs_test_serve(), the port is TNFS_PORT
+#define TNFS_TEST_HOST6 "::1"		// IPv6 loopback address of tnfs_test_serve()
+
+/* fails the test with the file and line when cond is false, the test goes on */
+#define TNFS_TEST_CHECK(cond) tnfs_test_check((cond), #cond, __FILE__, __LINE__)
+
+/*
+ * tnfs_test_transport passes every call on to tnfs_test_inner, the memory transport unless the test sets another, and
+ * counts connects, requests and responses. A test that loses, changes or refuses datagrams sets tnfs_test_send, which
+ * sends with tnfs_test_inner itself (or doesn't), or tnfs_test_recv, which gets each received datagram and returns
+ * its length or a negative code to lose it. Bursts go through the send hook one request at a time.
+ */
+extern const struct netw_transport tnfs_test_transport;
+extern const struct netw_transport* tnfs_test_inner;
+extern int (*tnfs_test_send)(const uint8_t* buffer, int length);
+extern int (*tnfs_test_recv)(uint8_t* buffer, int length);
+extern int tnfs_test_connects;
+extern int tnfs_test_sent[256];
+extern int tnfs_test_received[256];
+
+/* public functions */
+bool  tnfs_test_check(bool ok, const char* what, const char* file, int line);
+int   tnfs_test_done(const char* name);
+pid_t tnfs_test_serve(const char* host);
+pid_t tnfs_test_serveTCP(const char* host);
+void  tnfs_test_stop(pid_t server);
+uint32_t tnfs_test_percentile(uint32_t* samples, int count, int percent);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __tnfs_test_h__ */
@@ -1,27 +1,301 @@
 #include "include/tnfs.h"
+#include "include/tnfs_warm.h"
+#include "include/tnfs_journal.h"
+#include "include/tnfs_pool.h"
+#include "include/tnfs_checksum.h"
+#include "include/tnfs_trace.h"
+#include "include/tnfs_timeline.h"
 
 /* 
- * TNFS_MAX_RESULTS must be in contrast with the total tnfs_buffer size and max_path length !!!
- * for example is TNFS_MAX_PATH_LEN is 256 and TNFS_MAX_RESULTS = 50 then TNFS_BUFFERSIZE must be: 10 bytes + (13 bytes + 256) * 50 = 13460 bytes 
+ * TNFS_DIRX_BATCH must be in contrast with the total tnfs_buffer size and max_path length !!!
+ * for example is TNFS_MAX_PATH_LEN is 256 and TNFS_DIRX_BATCH = 50 then TNFS_BUFFERSIZE must be: 10 bytes + (13 bytes + 256) * 50 = 13460 bytes 
+ * the footprint profiles in tnfs_config.h choose them together
  */
-const uint8_t TNFS_MAX_RESULTS = 58;
 const char    TNFS_PROTOCOL_VERSION[] = {0x02, 0x01};
 
+/* kinds of entries in the handle table */
+#define TNFS_HANDLE_FREE 0x00
+#define TNFS_HANDLE_FILE 0x01	// opened with tnfs_open()
+#define TNFS_HANDLE_DIR  0x02	// opened with tnfs_opendir()
+#define TNFS_HANDLE_DIRX 0x03	// opened with tnfs_opendirx()
+#define TNFS_HANDLE_KIND 0x0F	// mask for the kinds above
+#define TNFS_HANDLE_STATED 0x10	// flag: mtime was asked after a write of ours, see tnfs_trackMtime()
+#define TNFS_HANDLE_SEEDED 0x20	// flag: what is read from and written to this file goes to its overlay copy too
+#define TNFS_HANDLE_JOURNAL 0x40	// flag: writes to this file go to the journal until it has been replayed
+#define TNFS_HANDLE_LOST 0x80	// flag: the file or directory could not be reopened after a session recovery
+#define TNFS_NO_HANDLE 0xFF	// server handle of a file that was opened while the server couldn't be reached
+
+/* everything we need to know to reopen a file or directory when the server has lost our session */
+struct tnfs_handle {
+    uint8_t  type;		// TNFS_HANDLE_FILE, TNFS_HANDLE_DIR or TNFS_HANDLE_DIRX, optionally with the flags above
+    uint8_t  server;		// handle as given by the server in the current session
+    uint8_t  previous;		// handle as given by the server in the session before the last recovery
+    uint8_t  whence;		// TNFS_SEEK_SET or TNFS_SEEK_END, the base of position for files
+    uint16_t flags;		// flags given to open(), or diropts and sortopts (high byte) given to opendirx()
+    uint16_t mode;		// mode given to open()
+    uint32_t position;		// file offset, or directory position as given by TELLDIR
+    uint32_t mtime;		// modification time of the file at open or after our writes, only known while the journal is enabled
+    uint32_t stated;		// netw_millis() when mtime was asked after a write of ours
+    uint16_t slack;		// seconds after mtime that our writes since then may have moved it to
+    char     path[TNFS_MAX_PATH_LEN]; // path of the file or directory, for opendirx() followed by the match pattern
+};
+
+#if TNFS_USE_CONTEXTS
+/* everything that belongs to one connection and mount, see tnfs_context_switch() */
+struct tnfs_context {
+    const struct netw_transport* transport;
+    uint16_t session_id;
+    uint8_t  request_id;
+    struct tnfs_handle handles[TNFS_MAX_HANDLES];
+    char     host[TNFS_MAX_HOST_LEN];
+    bool     useTCP;
+    char     mount_dir[TNFS_MAX_PATH_LEN];
+    char     mount_user[TNFS_MAX_CRED_LEN];
+    char     mount_pass[TNFS_MAX_CRED_LEN];
+    bool     mounted;
+    bool     online;
+    uint16_t retry_time;
+    uint16_t srtt;
+    uint16_t rttvar;
+    bool     rtt_measured;
+    char     prefetch_request[6];
+    struct dirx_data* prefetch_data;
+    uint32_t prefetch_sent;
+    bool     lazy;
+    uint32_t last_response;
+    uint32_t keepalive_sent;
+    uint32_t keepalive_ms;
+    uint32_t keepalives;
+    uint32_t recoveries;
+#if TNFS_USE_PIPELINE
+    struct tnfs_pool* pool;	// pool of tnfs_context_createPool(), NULL for the default pool
+#endif
+    struct netw_state netw;
+};
+#endif
+
 /* tnfs global variables */
 char 	 tnfs_buffer[TNFS_BUFFERSIZE];	// send and receive buffer
+const struct netw_transport* tnfs_transport = &netw_sockets;	// network backend, see tnfs_setTransport()
 uint16_t tnfs_session_id = 0;		// stores current session id received from the server
 uint8_t  tnfs_request_id = 0;		// request id increases each new request
+uint8_t  tnfs_probe[] = {0x00, 0x00, 0x00, 0x01};	// an UMOUNT without a session, see tnfs_setProbe()
+
+/* session recovery global variables */
+char     tnfs_replay[TNFS_BUFFERSIZE];			// copy of the current request, sent again after a timeout or a recovery
+char     tnfs_resend[TNFS_RECOVER_REQUEST_LEN];		// copy of a request of tnfs_recover() while the current one waits in tnfs_replay
+struct tnfs_handle tnfs_handles[TNFS_MAX_HANDLES];	// open files and directories, the index is the handle given to the caller
+char     tnfs_host[TNFS_MAX_HOST_LEN];			// server given to tnfs_connect(), empty when netw_connect() was used directly
+bool     tnfs_useTCP = false;				// protocol given to tnfs_connect()
+char     tnfs_mount_dir[TNFS_MAX_PATH_LEN];		// directory given to tnfs_mount()
+char     tnfs_mount_user[TNFS_MAX_CRED_LEN];		// username given to tnfs_mount()
+char     tnfs_mount_pass[TNFS_MAX_CRED_LEN];		// password given to tnfs_mount()
+bool     tnfs_mounted = false;				// true between a successful tnfs_mount() and tnfs_umount()
+bool     tnfs_recovering = false;			// true while tnfs_recover() is busy, prevents a recovery within a recovery
+bool     tnfs_online = true;				// false when the last request got no response from the server
+
+/* timing global variables */
+uint16_t tnfs_retry_time = 0;		// minimal retry time in milliseconds as given by the server at mount
+uint16_t tnfs_srtt = 0;			// smoothed round trip time in milliseconds
+uint16_t tnfs_rttvar = 0;		// variation of the round trip time in milliseconds
+bool     tnfs_rtt_measured = false;	// true once tnfs_srtt and tnfs_rttvar hold a measurement
+
+/* prefetch global variables */
+char     tnfs_prefetch_request[6];		// READDIRX sent ahead by tnfs_sendPrefetch(), kept to send it again
+struct dirx_data* tnfs_prefetch_data = NULL;	// directory whose READDIRX response is still on its way, NULL if none
+uint32_t tnfs_prefetch_sent = 0;		// netw_micros() when the READDIRX was sent ahead, for the timeline
+
+/* session manager global variables */
+bool     tnfs_lazy = false;			// connect and mount wait for the first request, see tnfs_lazyMount()
+uint32_t tnfs_last_response = 0;		// netw_millis() of the last response of the server
+uint32_t tnfs_keepalive_sent = 0;		// netw_millis() of the last attempt of tnfs_keepalive()
+uint32_t tnfs_keepalive_ms = TNFS_KEEPALIVE_MS;	// idle time after which tnfs_keepalive() sends a request, zero for never
+uint32_t tnfs_keepalives = 0;			// keepalive requests sent
+uint32_t tnfs_recoveries = 0;			// times the session was lost and mounted again
+
+/* context global variables */
+#if TNFS_USE_CONTEXTS
+struct tnfs_context tnfs_first_context;			// holds the globals above while another context is current
+struct tnfs_context* tnfs_context = &tnfs_first_context;	// the context the globals above belong to
+#endif
 
+/* batch global variables */
+#if TNFS_USE_PIPELINE
+uint8_t  tnfs_batch_buffer[NETW_MAX_BATCH * TNFS_BATCH_SLICE];	// receives the responses of tnfs_batch()
+uint32_t tnfs_batch_started = 0;	// netw_micros() at the first burst of the running tnfs_batch(), for the timeline
+#endif
 
-/* sends the allready buffered data to the server and waits for a response */
-int tnfs_sendReceive(int length)
+
+/* returns the network timeout from the round trip time, but never shorter than the retry time the server asked for */
+uint32_t tnfs_timeout()
+{
+    uint32_t timeout = tnfs_rtt_measured ? tnfs_srtt + 4 * tnfs_rttvar : TNFS_NET_TIMEOUT_MS;
+
+    if (timeout < tnfs_retry_time)
+        timeout = tnfs_retry_time;
+    if (timeout < TNFS_MIN_TIMEOUT_MS)
+        timeout = TNFS_MIN_TIMEOUT_MS;
+    if (timeout > TNFS_NET_TIMEOUT_MS)
+        timeout = TNFS_NET_TIMEOUT_MS;
+
+    return timeout;
+}
+
+/* sets the network timeout from the round trip time */
+void tnfs_tuneTimeout()
+{
+    tnfs_transport->setTimeout(tnfs_timeout());
+}
+
+/* doubles the network timeout for every attempt that got no response, up to TNFS_NET_TIMEOUT_MS */
+void tnfs_backoff(int attempts)
+{
+    uint32_t timeout = tnfs_timeout();
+
+    while (attempts-- > 0 && timeout < TNFS_NET_TIMEOUT_MS)
+        timeout *= 2;
+    if (timeout > TNFS_NET_TIMEOUT_MS)
+        timeout = TNFS_NET_TIMEOUT_MS;
+
+    tnfs_transport->setTimeout(timeout);
+}
+
+/* adds a round trip time sample in milliseconds to the smoothed values, like TCP does (RFC 6298) */
+void tnfs_measureRtt(uint32_t sample)
+{
+    if (sample > 0xFFFF)
+        sample = 0xFFFF;
+
+    if (!tnfs_rtt_measured) {
+        tnfs_srtt = sample;
+        tnfs_rttvar = sample / 2;
+        tnfs_rtt_measured = true;
+    } else {
+        tnfs_rttvar = (3 * tnfs_rttvar + (tnfs_srtt > sample ? tnfs_srtt - sample : sample - tnfs_srtt)) / 4;
+        tnfs_srtt = (7 * tnfs_srtt + sample) / 8;
+    }
+
+    tnfs_tuneTimeout();
+}
+
+/* returns false when nothing was measured yet, otherwise the round trip time and the retry time of the server */
+bool tnfs_getTiming(uint16_t* srtt, uint16_t* rttvar, uint16_t* retry_time)
+{
+    *srtt = tnfs_srtt;
+    *rttvar = tnfs_rttvar;
+    *retry_time = tnfs_retry_time;
+
+    return tnfs_rtt_measured;
+}
+
+/* returns the server given to tnfs_connect() or tnfs_lazyMount(), an empty host when there is none, and the mounted directory */
+void tnfs_getServer(const char** host, uint16_t* port, const char** dir)
+{
+    *host = tnfs_host;
+    *port = TNFS_PORT;
+    *dir = tnfs_mount_dir;
+}
+
+/* starts with timing measured by an earlier process, see tnfs_warm_open() */
+void tnfs_setTiming(uint16_t srtt, uint16_t rttvar, uint16_t retry_time)
+{
+    tnfs_srtt = srtt;
+    tnfs_rttvar = rttvar;
+    tnfs_retry_time = retry_time;
+    tnfs_rtt_measured = true;
+
+    tnfs_tuneTimeout();
+}
+
+/* receives the response of the READDIRX that was sent ahead into the spare buffer of its directory */
+void tnfs_collectPrefetch()
+{
+    struct dirx_data* data = tnfs_prefetch_data;
+    int retry = 0;
+    int length;
+    uint32_t began;
+
+    if (data == NULL) {
+        return;
+    }
+    tnfs_prefetch_data = NULL;
+    began = tnfs_timeline_used ? netw_micros() : 0;
+
+    while (true) {
+        length = tnfs_transport->recv((uint8_t*)data->spare, data->batchsize);
+        if (tnfs_trace_used)
+            tnfs_trace_record(TNFS_TRACE_RECEIVED, (uint8_t*)data->spare, length < data->batchsize ? length : data->batchsize);
+        /* skip late responses to earlier requests */
+        if (length > 0 && (length < 5 || data->spare[2] != tnfs_prefetch_request[2] || data->spare[3] != 0x18)) {
+            continue;
+        }
+        if (length != NETW_ERR_TIMEOUT || ++retry >= TNFS_SEND_RETRIES) {
+            break;
+        }
+        if (tnfs_transport->send((const uint8_t*)tnfs_prefetch_request, 6) < 0) {
+            length = NETW_ERR_CLOSED;
+            break;
+        }
+        if (tnfs_trace_used)
+            tnfs_trace_record(0, (uint8_t*)tnfs_prefetch_request, 6);
+    }
+
+    /* a response that filled the buffer may have been truncated */
+    if (length >= data->batchsize) {
+        length = -TNFS_ENOBUFS;
+    }
+
+    data->fetched = length > 0 ? length : -TNFS_EPROTO;
+
+    if (tnfs_timeline_used) {
+        tnfs_timeline_span(TNFS_SPAN_WAIT, TNFS_LANE_PREFETCH, began, tnfs_prefetch_request[2], 0x18, retry + 1);
+        tnfs_timeline_span(TNFS_SPAN_REQUEST, TNFS_LANE_PREFETCH, tnfs_prefetch_sent, tnfs_prefetch_request[2], 0x18, 0);
+    }
+}
+
+/* sends the allready buffered data until the server responds or the retries run out */
+int tnfs_transmit(int length)
 {
     int retry   = 0;
     int rlength = 0;
+    uint32_t sent = 0;
+    uint32_t began = tnfs_timeline_used ? netw_micros() : 0;
+    uint8_t  seq = tnfs_buffer[2];
+    uint8_t  cmd = tnfs_buffer[3];
+    char*    copy;
+
+    /* a response that is still on its way would be taken for the response to this request */
+    if (tnfs_prefetch_data != NULL) {
+        tnfs_collectPrefetch();
+        if (tnfs_timeline_used)
+            tnfs_timeline_span(TNFS_SPAN_DRAIN, TNFS_LANE_BLOCKING, began, seq, cmd, 0);
+    }
+
+    /* a late response to an earlier request overwrites the buffer, the copy is sent again after a timeout */
+    copy = tnfs_recovering ? tnfs_resend : tnfs_replay;
+    if (copy == tnfs_resend && length > (int)sizeof(tnfs_resend))
+        return -TNFS_ENOBUFS;
+    memcpy(copy, tnfs_buffer, length);
 
     do {
+        if (retry > 0) {
+            tnfs_backoff(retry);
+            memcpy(tnfs_buffer, copy, length);
+        }
+
         /* send request */
-        netw_send((const uint8_t*)tnfs_buffer, length);
+        sent = netw_millis();
+        if (tnfs_timeline_used)
+            began = netw_micros();
+        if (tnfs_transport->send((const uint8_t*)tnfs_buffer, length) < 0) {
+            return NETW_ERR_CLOSED;
+        }
+        if (tnfs_timeline_used) {
+            tnfs_timeline_span(retry == 0 ? TNFS_SPAN_SEND : TNFS_SPAN_RESEND, TNFS_LANE_BLOCKING, began, seq, cmd, retry + 1);
+            began = netw_micros();
+        }
+        if (tnfs_trace_used)
+            tnfs_trace_record(0, (uint8_t*)tnfs_buffer, length);
 
 #ifdef DEBUG
         printf("sent: ");
@@ -31,12 +305,185 @@ int tnfs_sendReceive(int length)
         printf("\n");
 #endif
 
-        /* wait for response */
-        rlength = netw_recv((uint8_t*)tnfs_buffer, TNFS_BUFFERSIZE);
+        /* wait for response, skipping late responses to earlier requests or earlier attempts */
+        do {
+            rlength = tnfs_transport->recv((uint8_t*)tnfs_buffer, TNFS_BUFFERSIZE);
+            if (tnfs_trace_used)
+                tnfs_trace_record(TNFS_TRACE_RECEIVED, (uint8_t*)tnfs_buffer, rlength < TNFS_BUFFERSIZE ? rlength : TNFS_BUFFERSIZE);
+        } while (rlength > 0 && (rlength < 5 || (uint8_t)tnfs_buffer[2] != seq || (uint8_t)tnfs_buffer[3] != cmd));
+        if (tnfs_timeline_used)
+            tnfs_timeline_span(TNFS_SPAN_WAIT, TNFS_LANE_BLOCKING, began, seq, cmd, retry + 1);
 
         retry++;
 
-    } while (rlength <= 0 && retry < TNFS_SEND_RETRIES);
+    } while (rlength == NETW_ERR_TIMEOUT && retry < TNFS_SEND_RETRIES);
+
+    if (retry > 1) {
+        tnfs_tuneTimeout();
+    }
+
+    if (rlength > 0) {
+        tnfs_last_response = netw_millis();
+    }
+
+    /* only a response to the first attempt is an unambiguous sample (Karn's algorithm) */
+    if (rlength > 0 && retry == 1) {
+        tnfs_measureRtt(netw_millis() - sent);
+    }
+
+    return rlength;
+}
+
+/*
+ * returns true when the server doesn't know our session anymore or can't be reached. EBADF is not one of them, a
+ * server reports an unknown session with ESTALE and EBADF only for a handle it doesn't have
+ */
+bool tnfs_isSessionLost(int rlength)
+{
+    if (rlength <= 0) {
+        return true;
+    }
+
+    return rlength >= 5 && tnfs_buffer[4] == TNFS_ESTALE;
+}
+
+/* returns true for commands that carry a file handle in byte 4 */
+bool tnfs_isFileCommand(uint8_t cmd)
+{
+    return cmd == 0x21 || cmd == 0x22 || cmd == 0x23 || cmd == 0x25;
+}
+
+/* returns true for commands that carry a directory handle in byte 4 */
+bool tnfs_isDirCommand(uint8_t cmd)
+{
+    return cmd == 0x11 || cmd == 0x12 || cmd == 0x15 || cmd == 0x16 || cmd == 0x18;
+}
+
+/* finds the entry in the handle table that had the given server handle before the last recovery */
+struct tnfs_handle* tnfs_findPrevious(uint8_t cmd, uint8_t server)
+{
+    for (int i = 0; i < TNFS_MAX_HANDLES; i++) {
+        struct tnfs_handle* h = &tnfs_handles[i];
+
+        if (h->type == TNFS_HANDLE_FREE || h->previous != server) {
+            continue;
+        }
+        if (((h->type & TNFS_HANDLE_KIND) == TNFS_HANDLE_FILE) == tnfs_isFileCommand(cmd)) {
+            return h;
+        }
+    }
+
+    return NULL;
+}
+
+/* 
+ * returns true if the request in tnfs_replay may be sent again when we don't know if the server executed it.
+ * Reads, writes and seeks qualify because the file offset is restored by tnfs_recover() before the replay.
+ */
+bool tnfs_isIdempotent()
+{
+    uint8_t cmd = tnfs_replay[3];
+    uint16_t flags;
+    struct tnfs_handle* h;
+
+    switch (cmd) {
+        case 0x10: case 0x11: case 0x12: case 0x15: case 0x16: case 0x17: case 0x18:
+        case 0x21: case 0x23: case 0x24: case 0x25: case 0x27: case 0x30: case 0x31:
+            return true;
+        case 0x22: /* writes to a file opened with TNFS_O_APPEND would be appended twice */
+            h = tnfs_findPrevious(cmd, tnfs_replay[4]);
+            return h != NULL && !(h->flags & TNFS_O_APPEND);
+        case 0x29: /* an exclusive create fails the second time */
+            memcpy(&flags, &tnfs_replay[4], 2);
+            return !(flags & TNFS_O_EXCL);
+        default:   /* mount, mkdir, rmdir, unlink and rename */
+            return false;
+    }
+}
+
+/* points the request in tnfs_replay to the new session and the reopened handle */
+bool tnfs_patchReplay()
+{
+    uint8_t cmd = tnfs_replay[3];
+    struct tnfs_handle* h;
+
+    memcpy(&tnfs_replay[0], &tnfs_session_id, 2);
+    tnfs_replay[2] = tnfs_request_id++;
+
+    if (tnfs_isFileCommand(cmd) || tnfs_isDirCommand(cmd)) {
+        h = tnfs_findPrevious(cmd, tnfs_replay[4]);
+        if (h == NULL || (h->type & TNFS_HANDLE_LOST)) {
+            return false;
+        }
+        tnfs_replay[4] = h->server;
+    }
+
+    return true;
+}
+
+/* sends the allready buffered data to the server and waits for a response */
+int tnfs_sendReceive(int length)
+{
+    int rlength = 0;
+    int attempt = 0;
+    bool recoverable;
+    uint32_t began = 0;
+    uint8_t  seq = tnfs_buffer[2];
+    uint8_t  cmd = tnfs_buffer[3];
+
+    /* the session of tnfs_lazyMount() is made now, the request waits in tnfs_replay meanwhile */
+    if (tnfs_lazy && !tnfs_recovering) {
+        memcpy(tnfs_replay, tnfs_buffer, length);
+        rlength = tnfs_wake();
+        if (rlength != 0) {
+            tnfs_buffer[4] = -rlength;
+            return rlength;
+        }
+        memcpy(tnfs_buffer, tnfs_replay, length);
+        memcpy(&tnfs_buffer[0], &tnfs_session_id, 2);
+    }
+    recoverable = tnfs_mounted && !tnfs_recovering;
+
+    if (tnfs_timeline_used) {
+        tnfs_timeline_span(TNFS_SPAN_ENCODE, TNFS_LANE_BLOCKING, tnfs_timeline_encode, seq, cmd, 0);
+        began = netw_micros();
+    }
+
+    /* tnfs_transmit() leaves the request in tnfs_replay */
+    rlength = tnfs_transmit(length);
+
+    /* the server lost our session or went away: mount again, reopen our handles and repeat the request */
+    while (recoverable && tnfs_isSessionLost(rlength) && attempt < TNFS_RECOVER_ATTEMPTS) {
+        uint8_t lost = rlength > 0 ? tnfs_buffer[4] : 0;
+        attempt++;
+        uint32_t recovering = tnfs_timeline_used ? netw_micros() : 0;
+        int code = tnfs_recover(rlength <= 0);
+        if (tnfs_timeline_used)
+            tnfs_timeline_span(TNFS_SPAN_RECOVER, TNFS_LANE_BLOCKING, recovering, seq, cmd, attempt);
+        if (code != 0) {
+            continue;
+        }
+        tnfs_recoveries++;
+        /* without a response we can't know if the server executed the request */
+        if (rlength <= 0 && !tnfs_isIdempotent()) {
+            break;
+        }
+        if (!tnfs_patchReplay()) {
+            tnfs_buffer[4] = TNFS_ESTALE;
+            return -TNFS_ESTALE;
+        }
+        memcpy(tnfs_buffer, tnfs_replay, length);
+        rlength = tnfs_transmit(length);
+        /* a new session didn't help, another one won't either */
+        if (lost != 0 && rlength > 0 && tnfs_buffer[4] == lost) {
+            break;
+        }
+    }
+
+    tnfs_online = rlength > 0;
+
+    if (tnfs_timeline_used)
+        tnfs_timeline_span(TNFS_SPAN_REQUEST, TNFS_LANE_BLOCKING, began, seq, cmd, 0);
 
     /* no response after retries */
     if (rlength <= 0) {
@@ -67,86 +514,999 @@ int tnfs_sendReceive(int length)
     return rlength;
 }
 
-/* buffers a new command header */
-void tnfs_prepareCommand(uint8_t cmd)
+#if TNFS_USE_PIPELINE
+/* fills the header of a request taken from a pool, the caller appends the payload at req->length */
+void tnfs_prepareRequest(struct tnfs_request* req, uint8_t cmd)
+{
+    memcpy(&req->buffer[0], &tnfs_session_id, 2);
+    req->id = tnfs_request_id++;
+    req->cmd = cmd;
+    req->buffer[2] = req->id;
+    req->buffer[3] = cmd;
+    req->length = 4;
+}
+
+/* copies the response into the request and marks it TNFS_REQ_DONE, lane is the timeline lane of its flight */
+void tnfs_complete(struct tnfs_pool* pool, struct tnfs_request* req, int lane, struct netw_datagram* d)
+{
+    if (d->length > d->size || d->length > pool->bufsize) {
+        req->length = 0;
+        req->status = -TNFS_ENOBUFS;
+    } else {
+        memcpy(req->buffer, d->buffer, d->length);
+        req->length = d->length;
+        req->status = d->buffer[4] == 0x00 ? 0 : -d->buffer[4];
+    }
+    req->state = TNFS_REQ_DONE;
+
+    if (tnfs_timeline_used)
+        tnfs_timeline_span(TNFS_SPAN_FLIGHT, lane, tnfs_batch_started, req->id, req->cmd, req->retries + 1);
+}
+
+/* hands a response to the request in flight with the same request id and command, returns false for strays */
+bool tnfs_dispatch(struct tnfs_pool* pool, struct tnfs_request** reqs, int count, struct netw_datagram* d)
+{
+    for (int i = 0; i < count; i++) {
+        struct tnfs_request* req = reqs[i];
+
+        if (req->state != TNFS_REQ_SENT || d->length < 5 || d->buffer[2] != req->id || d->buffer[3] != req->cmd) {
+            continue;
+        }
+
+        /* only a response to the first attempt is an unambiguous sample (Karn's algorithm) */
+        if (req->retries == 0) {
+            tnfs_measureRtt(netw_millis() - req->sent);
+        }
+        tnfs_complete(pool, req, TNFS_LANE_FLIGHT + i, d);
+
+        return true;
+    }
+
+    return false;
+}
+
+/*
+ * the requests of a batch over TCP, one at a time: the responses have no length of their own, so several of them that
+ * arrive in one read of the stream could not be told apart. The requests after the first one without a response stay
+ * TNFS_REQ_SENT
+ */
+void tnfs_waitStream(struct tnfs_pool* pool, struct tnfs_request** reqs, int count)
+{
+    struct netw_datagram d;
+    int length;
+
+    d.buffer = (uint8_t*)tnfs_buffer;
+    d.size = TNFS_BUFFERSIZE;
+    for (int i = 0; i < count; i++) {
+        if (reqs[i]->state != TNFS_REQ_SENT) {
+            continue;
+        }
+
+        memcpy(tnfs_buffer, reqs[i]->buffer, reqs[i]->length);
+        length = tnfs_transmit(reqs[i]->length);
+        if (length < 5) {
+            break;
+        }
+        d.length = length;
+        tnfs_complete(pool, reqs[i], TNFS_LANE_FLIGHT + i, &d);
+    }
+}
+
+/* sends the requests that have no response yet in one burst, returns false when the transport failed */
+bool tnfs_burst(struct tnfs_request** reqs, int count, int attempt)
+{
+    struct netw_datagram out[NETW_MAX_BATCH];
+    uint32_t began = 0;
+    int n = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (reqs[i]->state != TNFS_REQ_SENT) {
+            continue;
+        }
+        if (attempt > 0) {
+            reqs[i]->retries++;
+        }
+        reqs[i]->sent = netw_millis();
+        out[n].buffer = reqs[i]->buffer;
+        out[n].length = reqs[i]->length;
+        n++;
+    }
+    if (tnfs_timeline_used) {
+        tnfs_batch_started = attempt == 0 ? netw_micros() : tnfs_batch_started;
+        began = netw_micros();
+    }
+    if (tnfs_transport->sendBatch(out, n) < n) {
+        return false;
+    }
+    for (int i = 0; tnfs_trace_used && i < n; i++)
+        tnfs_trace_record(0, out[i].buffer, out[i].length);
+    if (tnfs_timeline_used)
+        tnfs_timeline_span(attempt == 0 ? TNFS_SPAN_SEND : TNFS_SPAN_RESEND, TNFS_LANE_BATCH, began, 0, 0xFF, attempt + 1);
+
+    return true;
+}
+
+/*
+ * sends up to NETW_MAX_BATCH requests in one burst without waiting for the responses, tnfs_waitBatch() collects them.
+ * In between other work can be done, like a burst to another context. Returns 0, -TNFS_E2BIG, or -TNFS_EPROTO when
+ * the burst could not be sent, tnfs_waitBatch() then fails too
+ */
+int tnfs_sendBatch(struct tnfs_request** reqs, int count)
+{
+    if (count > NETW_MAX_BATCH) {
+        return -TNFS_E2BIG;
+    }
+
+    /* the requests were built before the session of tnfs_lazyMount() existed */
+    if (tnfs_lazy) {
+        if (tnfs_wake() != 0)
+            return -TNFS_EPROTO;
+        for (int i = 0; i < count; i++)
+            memcpy(&reqs[i]->buffer[0], &tnfs_session_id, 2);
+    }
+
+    tnfs_collectPrefetch();
+
+    for (int i = 0; i < count; i++) {
+        reqs[i]->state = TNFS_REQ_SENT;
+        reqs[i]->retries = 0;
+    }
+
+    /* a stream sends them one by one in tnfs_waitBatch() */
+    if (tnfs_useTCP) {
+        if (tnfs_timeline_used)
+            tnfs_batch_started = netw_micros();
+        return 0;
+    }
+
+    if (!tnfs_burst(reqs, count, 0)) {
+        for (int i = 0; i < count; i++)
+            reqs[i]->state = TNFS_REQ_READY;
+        return -TNFS_EPROTO;
+    }
+
+    return 0;
+}
+
+/*
+ * dispatches the responses to a burst of tnfs_sendBatch() in whatever order they arrive, requests without a response
+ * are sent again. Returns 0 when every request is TNFS_REQ_DONE with the result in its status and buffer, otherwise
+ * -TNFS_EPROTO
+ */
+int tnfs_waitBatch(struct tnfs_pool* pool, struct tnfs_request** reqs, int count)
+{
+    struct netw_datagram in[NETW_MAX_BATCH];
+    int pending = 0;
+    int done = 0;
+    int n = 0;
+    uint32_t began = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (reqs[i]->state == TNFS_REQ_SENT) {
+            pending++;
+        }
+    }
+    if (tnfs_useTCP) {
+        pending = 0;
+        tnfs_waitStream(pool, reqs, count);
+    }
+    for (int i = 0; i < NETW_MAX_BATCH; i++) {
+        in[i].buffer = &tnfs_batch_buffer[i * TNFS_BATCH_SLICE];
+        in[i].size = TNFS_BATCH_SLICE;
+    }
+
+    for (int attempt = 0; pending > 0 && attempt < TNFS_SEND_RETRIES && n != NETW_ERR_CLOSED; attempt++) {
+        /* one burst with every request that has no response yet, the first one was sent by tnfs_sendBatch() */
+        if (attempt > 0) {
+            tnfs_backoff(attempt);
+            if (!tnfs_burst(reqs, count, attempt))
+                break;
+        }
+
+        /* drain the responses until all arrived or the server stays silent */
+        while (pending > 0) {
+            if (tnfs_timeline_used)
+                began = netw_micros();
+            n = tnfs_transport->recvBatch(in, pending);
+            if (tnfs_timeline_used)
+                tnfs_timeline_span(TNFS_SPAN_WAIT, TNFS_LANE_BATCH, began, 0, 0xFF, attempt + 1);
+            if (n < 0) {
+                break;
+            }
+            for (int i = 0; i < n; i++) {
+                if (tnfs_trace_used)
+                    tnfs_trace_record(TNFS_TRACE_RECEIVED, in[i].buffer, in[i].length < in[i].size ? in[i].length : in[i].size);
+                if (tnfs_dispatch(pool, reqs, count, &in[i])) {
+                    pending--;
+                }
+            }
+        }
+    }
+
+    tnfs_tuneTimeout();
+    for (int i = 0; i < count; i++) {
+        if (reqs[i]->state == TNFS_REQ_DONE) {
+            done++;
+        }
+    }
+    if (done > 0) {
+        tnfs_online = true;
+        tnfs_last_response = netw_millis();
+    } else if (count > 0) {
+        tnfs_online = false;
+    }
+
+    if (tnfs_timeline_used)
+        tnfs_timeline_span(TNFS_SPAN_BATCH, TNFS_LANE_BATCH, tnfs_batch_started, 0, 0xFF, count);
+
+#ifdef DEBUG
+    printf("batch: %d requests, %d without response\n\n", count, count - done);
+#endif
+
+    return done == count ? 0 : -TNFS_EPROTO;
+}
+
+/*
+ * sends up to NETW_MAX_BATCH requests from a pool in one burst and dispatches the responses in whatever order they
+ * arrive, requests without a response are sent again. Returns 0 when every request is TNFS_REQ_DONE with the result
+ * in its status and buffer, otherwise -TNFS_EPROTO. Batched requests are not replayed by a session recovery.
+ */
+int tnfs_batch(struct tnfs_pool* pool, struct tnfs_request** reqs, int count)
+{
+    int code = tnfs_sendBatch(reqs, count);
+
+    if (code == -TNFS_E2BIG) {
+        return code;
+    }
+
+    return tnfs_waitBatch(pool, reqs, count);
+}
+#endif
+
+/* buffers a new command header */
+void tnfs_prepareCommand(uint8_t cmd)
+{
+    if (tnfs_timeline_used)
+        tnfs_timeline_encode = netw_micros();
+    memset(tnfs_buffer, 0, sizeof(tnfs_buffer));
+    memcpy(&tnfs_buffer[0], &tnfs_session_id, 2);
+    tnfs_buffer[2] = tnfs_request_id++;
+    tnfs_buffer[3] = cmd;
+}
+
+/* finds a free entry in the handle table, returns -TNFS_EMFILE when all are in use */
+int tnfs_allocHandle()
+{
+    for (int i = 0; i < TNFS_MAX_HANDLES; i++) {
+        if (tnfs_handles[i].type == TNFS_HANDLE_FREE) {
+            return i;
+        }
+    }
+
+    return -TNFS_EMFILE;
+}
+
+/* looks up a handle given to the caller, returns 0 or -TNFS_EBADF / -TNFS_ESTALE */
+int tnfs_getHandle(uint8_t handle, bool isDir, struct tnfs_handle** h)
+{
+    if (handle >= TNFS_MAX_HANDLES || tnfs_handles[handle].type == TNFS_HANDLE_FREE) {
+        return -TNFS_EBADF;
+    }
+
+    *h = &tnfs_handles[handle];
+    if (((*h)->type & TNFS_HANDLE_KIND) == TNFS_HANDLE_FILE ? isDir : !isDir) {
+        return -TNFS_EBADF;
+    }
+    if ((*h)->type & TNFS_HANDLE_LOST) {
+        return -TNFS_ESTALE;
+    }
+
+    return 0;
+}
+
+/* sends the MOUNT command with the credentials remembered by tnfs_mount() */
+int tnfs_sendMount()
+{
+    size_t length = 6;
+    uint16_t retry_time = 0;
+
+    tnfs_prepareCommand(0x00); /* TNFS_CMD_MOUNT */
+    memcpy(&tnfs_buffer[4], TNFS_PROTOCOL_VERSION, 2);
+
+    strcpy(&tnfs_buffer[length], tnfs_mount_dir);
+    length += strlen(tnfs_mount_dir) + 1;
+
+    strcpy(&tnfs_buffer[length], tnfs_mount_user);
+    length += strlen(tnfs_mount_user) + 1;
+
+    strcpy(&tnfs_buffer[length], tnfs_mount_pass);
+    length += strlen(tnfs_mount_pass) + 1;
+
+    length = tnfs_sendReceive((int)length);
+    if (tnfs_buffer[4] == 0x00) {
+        /* session id */
+        memcpy(&tnfs_session_id, &tnfs_buffer[0], 2);
+
+        /* retry time (uint16 little endian) */
+        memcpy(&retry_time, &tnfs_buffer[7], 2);
+        tnfs_retry_time = retry_time;
+        tnfs_tuneTimeout();
+
+#ifdef DEBUG
+        printf("session id: %u\n", tnfs_session_id);
+        printf("server minimal retry time: %u\n\n", retry_time);
+#endif
+    }
+
+    return -tnfs_buffer[4];
+}
+
+/* sends the OPEN command, returns the server handle or a negative error code */
+int tnfs_sendOpen(const char* filename, uint16_t flags, uint16_t mode)
+{
+    int length = 8;
+
+    tnfs_prepareCommand(0x29);
+    memcpy(&tnfs_buffer[4], &flags, 2);
+    memcpy(&tnfs_buffer[6], &mode, 2);
+    strcpy(&tnfs_buffer[length], filename);
+    length += strlen(filename)+1;
+
+    length = tnfs_sendReceive(length);
+    if(tnfs_buffer[4] != 0x00)
+    	return tnfs_buffer[4] * -1;
+    
+    return (uint8_t)tnfs_buffer[5]; // server handle
+}
+
+/* sends the OPENDIR command, returns the server handle or a negative error code */
+int tnfs_sendOpendir(const char* path)
+{
+    int length = 4;
+
+    tnfs_prepareCommand(0x10);
+    strcpy(&tnfs_buffer[length], path);
+    length += strlen(path)+1;
+    
+    length = tnfs_sendReceive(length);
+    if(length == 6 && tnfs_buffer[4] == 0x00)
+    	return (uint8_t)tnfs_buffer[5]; // server handle
+    
+    return tnfs_buffer[4] * -1; // return code
+}
+
+/* sends the OPENDIRX command, returns the server handle or a negative error code */
+int tnfs_sendOpendirx(const char* path, const char* pattern, uint8_t diropts, uint8_t sortopts, uint16_t* entries)
+{
+    int length = 8;
+
+    tnfs_prepareCommand(0x17);
+    tnfs_buffer[4] = diropts;			// directory options
+    tnfs_buffer[5] = sortopts;			// sort options
+    // leave tnfs_buffer[6] and [7] to zero  because we want the total files found
+    strcpy(&tnfs_buffer[length], pattern);		// search pattern
+    length += strlen(pattern)+1;
+    strcpy(&tnfs_buffer[length], path);		// directory path
+    length += strlen(path)+1;
+    
+    length = tnfs_sendReceive(length);
+    
+    if(length == 8 && tnfs_buffer[4] == 0x00) {
+    	memcpy(entries, &tnfs_buffer[6], 2); // copy the number of matching directory entries found
+    	return (uint8_t)tnfs_buffer[5]; // server handle
+    }
+    
+    return tnfs_buffer[4] == 0x00 ? -TNFS_EPROTO : tnfs_buffer[4] * -1; // Return code
+}
+
+/* sends the LSEEK command for a server handle */
+int tnfs_sendLseek(uint8_t server, uint8_t seektype, uint32_t position)
+{
+    int length = 10;
+
+    tnfs_prepareCommand(0x25);
+    tnfs_buffer[4] = server;
+    tnfs_buffer[5] = seektype;
+    memcpy(&tnfs_buffer[6], &position, 4);
+
+    return tnfs_sendReceive(length);
+}
+
+/* sends the SEEKDIR command for a server handle */
+int tnfs_sendSeekdir(uint8_t server, uint32_t position)
+{
+    int length = 9;
+
+    tnfs_prepareCommand(0x16);
+    tnfs_buffer[4] = server;
+    memcpy(&tnfs_buffer[5], &position, 4);
+
+    return tnfs_sendReceive(length);
+}
+
+/* opens a file or directory again in a new session and restores its position */
+void tnfs_reopen(struct tnfs_handle* h)
+{
+    uint16_t entries;
+    int code = 0;
+
+    /* files in journal mode are reopened by tnfs_resumeHandles() once the journal has been replayed */
+    if (h->type == TNFS_HANDLE_FREE || (h->type & (TNFS_HANDLE_LOST | TNFS_HANDLE_JOURNAL))) {
+        return;
+    }
+
+    h->previous = h->server;
+
+    switch (h->type & TNFS_HANDLE_KIND) {
+        case TNFS_HANDLE_FILE:
+            /* the file exists by now, never create or truncate it a second time */
+            code = tnfs_sendOpen(h->path, h->flags & ~(TNFS_O_CREAT | TNFS_O_EXCL | TNFS_O_TRUNC), h->mode);
+            break;
+        case TNFS_HANDLE_DIR:
+            code = tnfs_sendOpendir(h->path);
+            break;
+        case TNFS_HANDLE_DIRX:
+            code = tnfs_sendOpendirx(h->path, &h->path[strlen(h->path) + 1], h->flags & 0xFF, h->flags >> 8, &entries);
+            break;
+    }
+
+    if (code >= 0) {
+        h->server = code;
+        if ((h->type & TNFS_HANDLE_KIND) == TNFS_HANDLE_FILE && (h->position != 0 || h->whence != TNFS_SEEK_SET)) {
+            code = tnfs_sendLseek(h->server, h->whence, h->position);
+        } else if ((h->type & TNFS_HANDLE_KIND) != TNFS_HANDLE_FILE && h->position != 0) {
+            code = tnfs_sendSeekdir(h->server, h->position);
+        }
+    }
+
+    if (code < 0) {
+#ifdef DEBUG
+        printf("Could not reopen \"%s\" after recovery: %s\n\n", h->path, tnfs_error_string(code));
+#endif
+        h->type |= TNFS_HANDLE_LOST;
+    }
+}
+
+/*
+ * an UMOUNT without a session is answered without side effects, netw_connect() sends it to find a live UDP address.
+ * It takes a request id of its own, so a late answer to it is skipped like any stray instead of being taken for the
+ * answer to a real UMOUNT
+ */
+void tnfs_setProbe()
+{
+    tnfs_probe[2] = tnfs_request_id++;
+    netw_setProbe(tnfs_probe, sizeof(tnfs_probe));
+}
+
+/* re-establishes a lost session: reconnects when asked, mounts again and reopens all files and directories */
+int tnfs_recover(bool reconnect)
+{
+    int code = 0;
+
+#ifdef DEBUG
+    printf("Session lost, recovering...\n\n");
+#endif
+
+    tnfs_recovering = true;
+
+    /* only possible when the connection was made with tnfs_connect() */
+    if (reconnect && tnfs_host[0] != 0) {
+        tnfs_transport->disconnect();
+        tnfs_setProbe();
+        if (tnfs_transport->connect(tnfs_host, TNFS_PORT, tnfs_useTCP) != 0) {
+            code = -TNFS_EIO;
+        }
+    }
+
+    /* the server may still have the old session with all its handles, end it when it does (best effort) */
+    if (code == 0 && tnfs_session_id != 0) {
+        tnfs_prepareCommand(0x01);
+        tnfs_transmit(4);
+    }
+
+    if (code == 0) {
+        tnfs_session_id = 0;
+        code = tnfs_sendMount();
+    }
+
+    if (code == 0) {
+        for (int i = 0; i < TNFS_MAX_HANDLES; i++) {
+            tnfs_reopen(&tnfs_handles[i]);
+        }
+    }
+
+    tnfs_recovering = false;
+
+    return code;
+}
+
+/* returns true when the last request got a response from the server */
+bool tnfs_isOnline()
+{
+    return tnfs_online;
+}
+
+/* connects and mounts the session of tnfs_lazyMount(), returns 0 or a negative error code and tries again next time */
+int tnfs_wake()
+{
+    int code;
+
+    tnfs_lazy = false;
+
+    code = tnfs_recover(true);
+    if (code != 0) {
+        tnfs_lazy = true;
+        tnfs_online = false;
+        return code;
+    }
+
+    tnfs_mounted = true;
+
+    return 0;
+}
+
+/*
+ * Remembers the server and the credentials without any network traffic, the first request connects and mounts. Use
+ * it instead of tnfs_connect() and tnfs_mount() so the start of the application doesn't wait for the server. Returns
+ * 0 or -TNFS_ENAMETOOLONG
+ */
+int tnfs_lazyMount(char* host, bool useTCP, const char* dir, const char* username, const char* password)
+{
+    if (strlen(host) >= TNFS_MAX_HOST_LEN || strlen(dir) >= TNFS_MAX_PATH_LEN || strlen(username) >= TNFS_MAX_CRED_LEN
+        || strlen(password) >= TNFS_MAX_CRED_LEN) {
+        return -TNFS_ENAMETOOLONG;
+    }
+
+    tnfs_transport->disconnect();
+    strcpy(tnfs_host, host);
+    tnfs_useTCP = useTCP;
+    strcpy(tnfs_mount_dir, dir);
+    strcpy(tnfs_mount_user, username);
+    strcpy(tnfs_mount_pass, password);
+
+    tnfs_mounted = false;
+    tnfs_session_id = 0;
+    memset(tnfs_handles, 0, sizeof(tnfs_handles));
+    tnfs_online = true;
+    tnfs_lazy = true;
+#if TNFS_USE_WARM
+    tnfs_warm_connected(host, TNFS_PORT);
+#endif
+
+    return 0;
+}
+
+/* Sets the idle time in milliseconds after which tnfs_keepalive() sends a request, zero turns the keepalive off */
+void tnfs_setKeepalive(uint32_t interval)
+{
+    tnfs_keepalive_ms = interval;
+}
+
+/*
+ * Call it from the idle loop of the application, as often as it likes. It makes the session of tnfs_lazyMount() if
+ * that didn't happen yet, and sends a STAT of the mount root when nothing was received for the keepalive interval: the
+ * server doesn't expire an idle session, and a session that was lost anyway is recovered now instead of by the next
+ * real request. After a failure it waits another interval. Returns 1 when a request was sent, 0 when none was due, or
+ * a negative error code
+ */
+int tnfs_keepalive()
+{
+    uint32_t now = netw_millis();
+    bool due = now - tnfs_keepalive_sent >= tnfs_keepalive_ms;
+    int code;
+
+    if (tnfs_lazy) {
+        if (!tnfs_online && !due)
+            return 0;
+        tnfs_keepalive_sent = now;
+        code = tnfs_wake();
+        return code != 0 ? code : 1;
+    }
+
+    if (!tnfs_mounted || tnfs_keepalive_ms == 0 || !due || now - tnfs_last_response < tnfs_keepalive_ms)
+        return 0;
+
+    tnfs_keepalive_sent = now;
+    tnfs_keepalives++;
+    tnfs_prepareCommand(0x24); /* TNFS_CMD_STAT */
+    strcpy(&tnfs_buffer[4], "/");
+    code = tnfs_sendReceive(6);
+
+    return code < 0 ? code : 1;
+}
+
+/* Returns the state of the session as one of TNFS_SESSION_*, and fills session with the details when it isn't NULL */
+uint8_t tnfs_getSession(struct tnfs_session* session)
+{
+    uint8_t state;
+
+    if (tnfs_lazy)
+        state = TNFS_SESSION_LAZY;
+    else if (!tnfs_mounted)
+        state = TNFS_SESSION_NONE;
+    else
+        state = tnfs_online ? TNFS_SESSION_MOUNTED : TNFS_SESSION_OFFLINE;
+
+    if (session != NULL) {
+        session->state = state;
+        session->id = state == TNFS_SESSION_MOUNTED || state == TNFS_SESSION_OFFLINE ? tnfs_session_id : 0;
+        session->idle = tnfs_last_response != 0 ? netw_millis() - tnfs_last_response : 0;
+        session->keepalives = tnfs_keepalives;
+        session->recoveries = tnfs_recoveries;
+    }
+
+    return state;
+}
+
+#if TNFS_USE_JOURNAL
+/* reopens the files that were written in journal mode, the journal has been replayed by now */
+void tnfs_resumeHandles()
+{
+    struct fstat st;
+
+    for (int i = 0; i < TNFS_MAX_HANDLES; i++) {
+        struct tnfs_handle* h = &tnfs_handles[i];
+
+        if (!(h->type & TNFS_HANDLE_JOURNAL)) {
+            continue;
+        }
+        h->type &= ~(TNFS_HANDLE_JOURNAL | TNFS_HANDLE_STATED);
+        h->mtime = tnfs_stat(h->path, &st) == 0 ? st.mtime : 0;
+        h->slack = 0;
+        tnfs_reopen(h);
+    }
+}
+
+/*
+ * returns true when a mutation has to go to the journal: the server can't be reached or older mutations are still
+ * waiting. Every TNFS_JOURNAL_PROBE_MS the server is tried again, when it responds the journal is replayed first.
+ */
+bool tnfs_useJournal()
+{
+    if (!tnfs_journal_active()) {
+        return false;
+    }
+
+    if (tnfs_journal_pending() > 0 && (tnfs_online || tnfs_journal_due())) {
+        if (tnfs_journal_replay(NULL) == 0) {
+            tnfs_resumeHandles();
+        }
+    } else if (!tnfs_online && tnfs_journal_due()) {
+        tnfs_online = true; // nothing waiting, let this request find out if the server is back
+    }
+
+    return tnfs_journal_pending() > 0 || !tnfs_online;
+}
+
+/* journals a write to a file, the handle keeps writing to the journal until the journal has been replayed */
+int tnfs_journalWrite(struct tnfs_handle* h, const char* data, uint16_t length)
+{
+    struct tnfs_journal_entry e;
+    int code;
+
+    /* the offset from the end of the file is only known by the server */
+    if (h->whence != TNFS_SEEK_SET && !(h->flags & TNFS_O_APPEND)) {
+        return -TNFS_ESPIPE;
+    }
+
+    memset(&e, 0, sizeof(e));
+    e.op = TNFS_JOURNAL_WRITE;
+    e.length = length;
+    e.offset = (h->flags & TNFS_O_APPEND) ? TNFS_JOURNAL_APPEND : h->position;
+    e.mtime = h->mtime;
+    e.mode = h->slack;
+    strcpy(e.path, h->path);
+
+    code = tnfs_journal_add(&e, data);
+    if (code != 0) {
+        return code;
+    }
+
+    h->type |= TNFS_HANDLE_JOURNAL;
+    if (tnfs_checksum_used) {
+        tnfs_checksum_update(h - tnfs_handles, h->position, data, length);
+    }
+    h->position += length;
+
+    return 0;
+}
+
+/* journals an open, mkdir, rmdir, unlink or rename */
+int tnfs_journalPath(uint8_t op, const char* path, const char* path2, uint16_t flags, uint16_t mode)
+{
+    struct tnfs_journal_entry e;
+
+    if (strlen(path) >= TNFS_MAX_PATH_LEN || strlen(path2) >= TNFS_MAX_PATH_LEN) {
+        return -TNFS_ENAMETOOLONG;
+    }
+
+    memset(&e, 0, sizeof(e));
+    e.op = op;
+    e.flags = flags;
+    e.mode = mode;
+    strcpy(e.path, path);
+    strcpy(e.path2, path2);
+
+    return tnfs_journal_add(&e, "");
+}
+#else
+/* without the journal every mutation goes to the server */
+bool tnfs_useJournal()
+{
+    return false;
+}
+
+/* never called without the journal, files don't get into journal mode */
+int tnfs_journalWrite(struct tnfs_handle* h, const char* data, uint16_t length)
+{
+    (void)h;
+    (void)data;
+    (void)length;
+
+    return -TNFS_ENOSYS;
+}
+
+/* never called without the journal, tnfs_useJournal() is always false */
+int tnfs_journalPath(uint8_t op, const char* path, const char* path2, uint16_t flags, uint16_t mode)
+{
+    (void)op;
+    (void)path;
+    (void)path2;
+    (void)flags;
+    (void)mode;
+
+    return -TNFS_ENOSYS;
+}
+#endif
+
+/* connects to a TNFS server and remembers it to be able to reconnect after the connection was lost */
+int tnfs_connect(char* host, bool useTCP)
+{
+    if (strlen(host) >= TNFS_MAX_HOST_LEN) {
+        return NETW_ERR_CONNECT;
+    }
+
+    tnfs_setProbe();
+
+    strcpy(tnfs_host, host);
+    tnfs_useTCP = useTCP;
+    tnfs_lazy = false;
+#if TNFS_USE_WARM
+    tnfs_warm_connected(host, TNFS_PORT);
+#endif
+
+    return tnfs_transport->connect(host, TNFS_PORT, useTCP);
+}
+
+/* disconnects from the TNFS server */
+void tnfs_disconnect()
+{
+    tnfs_transport->disconnect();
+    tnfs_host[0] = 0;
+    tnfs_lazy = false;
+}
+
+/* chooses the network backend for the next tnfs_connect(), NULL for the sockets of netw.c or netw_win32.c */
+void tnfs_setTransport(const struct netw_transport* transport)
+{
+    tnfs_transport = transport != NULL ? transport : &netw_sockets;
+}
+
+#if TNFS_USE_CONTEXTS
+/* copies the globals of the current connection and mount to a context, or back from it */
+void tnfs_context_copy(struct tnfs_context* c, bool save)
+{
+#define TNFS_CONTEXT_COPY(field, global) \
+    if (save) memcpy(&c->field, &global, sizeof(global)); else memcpy(&global, &c->field, sizeof(global))
+
+    TNFS_CONTEXT_COPY(transport, tnfs_transport);
+    TNFS_CONTEXT_COPY(session_id, tnfs_session_id);
+    TNFS_CONTEXT_COPY(request_id, tnfs_request_id);
+    TNFS_CONTEXT_COPY(handles, tnfs_handles);
+    TNFS_CONTEXT_COPY(host, tnfs_host);
+    TNFS_CONTEXT_COPY(useTCP, tnfs_useTCP);
+    TNFS_CONTEXT_COPY(mount_dir, tnfs_mount_dir);
+    TNFS_CONTEXT_COPY(mount_user, tnfs_mount_user);
+    TNFS_CONTEXT_COPY(mount_pass, tnfs_mount_pass);
+    TNFS_CONTEXT_COPY(mounted, tnfs_mounted);
+    TNFS_CONTEXT_COPY(online, tnfs_online);
+    TNFS_CONTEXT_COPY(retry_time, tnfs_retry_time);
+    TNFS_CONTEXT_COPY(srtt, tnfs_srtt);
+    TNFS_CONTEXT_COPY(rttvar, tnfs_rttvar);
+    TNFS_CONTEXT_COPY(rtt_measured, tnfs_rtt_measured);
+    TNFS_CONTEXT_COPY(prefetch_request, tnfs_prefetch_request);
+    TNFS_CONTEXT_COPY(prefetch_data, tnfs_prefetch_data);
+    TNFS_CONTEXT_COPY(prefetch_sent, tnfs_prefetch_sent);
+    TNFS_CONTEXT_COPY(lazy, tnfs_lazy);
+    TNFS_CONTEXT_COPY(last_response, tnfs_last_response);
+    TNFS_CONTEXT_COPY(keepalive_sent, tnfs_keepalive_sent);
+    TNFS_CONTEXT_COPY(keepalive_ms, tnfs_keepalive_ms);
+    TNFS_CONTEXT_COPY(keepalives, tnfs_keepalives);
+    TNFS_CONTEXT_COPY(recoveries, tnfs_recoveries);
+#if TNFS_USE_PIPELINE
+    TNFS_CONTEXT_COPY(pool, tnfs_current_pool);
+#endif
+
+#undef TNFS_CONTEXT_COPY
+
+    if (save)
+        netw_saveState(&c->netw);
+    else
+        netw_loadState(&c->netw);
+}
+
+/*
+ * Creates a context for another connection and mount, not connected yet. Switch to it with tnfs_context_switch()
+ * before tnfs_connect(). Returns NULL when out of memory
+ */
+struct tnfs_context* tnfs_context_create()
+{
+    struct tnfs_context* c = calloc(1, sizeof(struct tnfs_context));
+    struct netw_state current;
+
+    if (c == NULL)
+        return NULL;
+
+    c->transport = &netw_sockets;
+    c->online = true;
+    c->keepalive_ms = TNFS_KEEPALIVE_MS;
+
+    /* the sockets backend tells what a connection that isn't there yet looks like */
+    netw_saveState(&current);
+    netw_loadState(NULL);
+    netw_saveState(&c->netw);
+    netw_loadState(&current);
+
+    return c;
+}
+
+#if TNFS_USE_PIPELINE
+/*
+ * Creates a context like tnfs_context_create() whose pipelined requests (tnfs_statv(), tnfs_readv(), the scheduler,
+ * ...) come from a pool of its own, with request descriptors of bufsize bytes. Returns NULL when out of memory
+ */
+struct tnfs_context* tnfs_context_createPool(uint16_t requests, uint16_t bufsize)
+{
+    struct tnfs_context* c = tnfs_context_create();
+
+    if (c == NULL)
+        return NULL;
+
+    c->pool = tnfs_pool_create(requests, bufsize);
+    if (c->pool == NULL) {
+        free(c);
+        return NULL;
+    }
+
+    return c;
+}
+#endif
+
+/* Returns the current context, the first one exists from the start */
+struct tnfs_context* tnfs_context_current()
 {
-    memset(tnfs_buffer, 0, sizeof(tnfs_buffer));
-    memcpy(&tnfs_buffer[0], &tnfs_session_id, 2);
-    tnfs_buffer[2] = tnfs_request_id++;
-    tnfs_buffer[3] = cmd;
+    return tnfs_context;
 }
 
-//* Establish a new session */
-int tnfs_mount(const char* dir, const char* username, const char* password)
+/*
+ * Makes another context current: the following calls use its connection, mount and handles. Handles, directories and
+ * streams belong to the context that was current when they were opened
+ */
+void tnfs_context_switch(struct tnfs_context* context)
 {
-    size_t length = 6;
-    uint16_t retry_time = 0;
+    if (context == NULL || context == tnfs_context)
+        return;
 
-    tnfs_prepareCommand(0x00); /* TNFS_CMD_MOUNT */
-    memcpy(&tnfs_buffer[4], TNFS_PROTOCOL_VERSION, 2);
+    tnfs_context_copy(tnfs_context, true);
+    tnfs_context_copy(context, false);
+    tnfs_context = context;
+}
 
-    strcpy(&tnfs_buffer[length], dir);
-    length += strlen(dir) + 1;
+/* Disconnects and frees a context from tnfs_context_create(), unmount it first. The current context can't be freed */
+void tnfs_context_free(struct tnfs_context* context)
+{
+    struct tnfs_context* current = tnfs_context;
 
-    strcpy(&tnfs_buffer[length], username);
-    length += strlen(username) + 1;
+    if (context == NULL || context == tnfs_context || context == &tnfs_first_context)
+        return;
 
-    strcpy(&tnfs_buffer[length], password);
-    length += strlen(password) + 1;
+    tnfs_context_switch(context);
+    tnfs_disconnect();
+    tnfs_context_switch(current);
+#if TNFS_USE_PIPELINE
+    free(context->pool);
+#endif
+    free(context);
+}
+#endif
 
-    length = tnfs_sendReceive((int)length);
-    if (tnfs_buffer[4] == 0x00) {
-        /* session id */
-        memcpy(&tnfs_session_id, &tnfs_buffer[0], 2);
+//* Establish a new session */
+int tnfs_mount(const char* dir, const char* username, const char* password)
+{
+    if (strlen(dir) >= TNFS_MAX_PATH_LEN || strlen(username) >= TNFS_MAX_CRED_LEN || strlen(password) >= TNFS_MAX_CRED_LEN) {
+        return -TNFS_ENAMETOOLONG;
+    }
 
-        /* retry time (uint16 little endian) */
-        memcpy(&retry_time, &tnfs_buffer[7], 2);
+    /* remember the credentials, tnfs_recover() needs them to mount again */
+    strcpy(tnfs_mount_dir, dir);
+    strcpy(tnfs_mount_user, username);
+    strcpy(tnfs_mount_pass, password);
 
-#ifdef DEBUG
-        printf("session id: %u\n", tnfs_session_id);
-        printf("server minimal retry time: %u\n\n", retry_time);
-#endif
+    tnfs_mounted = false;
+    tnfs_lazy = false;
+    tnfs_session_id = 0;
+    memset(tnfs_handles, 0, sizeof(tnfs_handles));
+
+    if (tnfs_sendMount() != 0) {
+        return -tnfs_buffer[4];
     }
 
-    return -tnfs_buffer[4];
+    tnfs_mounted = true;
+
+    return 0;
 }
 
 /* Ends the session */
 int tnfs_umount()
 {
+    /* a session of tnfs_lazyMount() that was never used isn't made just to end it */
+    if (tnfs_lazy) {
+        tnfs_lazy = false;
+        memset(tnfs_mount_pass, 0, sizeof(tnfs_mount_pass));
+        return 0;
+    }
+
     tnfs_prepareCommand(0x01);
     tnfs_sendReceive(4);
 
+    /* forget the session, there is nothing to recover anymore */
+    tnfs_mounted = false;
+    memset(tnfs_handles, 0, sizeof(tnfs_handles));
+    memset(tnfs_mount_pass, 0, sizeof(tnfs_mount_pass));
+
     return tnfs_buffer[4] * -1; // return code
 }
 
 /* Open a directory */
 int tnfs_opendir(const char* path)
 {
-    int length = 4;
+    int slot = tnfs_allocHandle();
+    int code;
 
-    tnfs_prepareCommand(0x10);
-    strcpy(&tnfs_buffer[length], path);
-    length += strlen(path)+1;
-    
-    length = tnfs_sendReceive(length);
-    if(length == 6 && tnfs_buffer[4] == 0x00)
-    	return tnfs_buffer[5]; // tnfs file handle
+    if(slot < 0)
+    	return slot;
+    if(strlen(path) >= TNFS_MAX_PATH_LEN)
+    	return -TNFS_ENAMETOOLONG;
+
+    code = tnfs_sendOpendir(path);
+    if(code < 0)
+    	return code;
+
+    tnfs_handles[slot].type = TNFS_HANDLE_DIR;
+    tnfs_handles[slot].server = code;
+    tnfs_handles[slot].position = 0;
+    strcpy(tnfs_handles[slot].path, path);
     
-    return tnfs_buffer[4] * -1; // return code
+    return slot; // tnfs file handle
 }
 
 /* reads one entry from the open directory */
 int tnfs_readdir(char handle, char* dest)
 {
     int length = 5;
+    struct tnfs_handle* h;
+    int code = tnfs_getHandle(handle, true, &h);
+
+    if(code != 0)
+    	return code;
 
     tnfs_prepareCommand(0x11);
-    tnfs_buffer[4] = handle;
+    tnfs_buffer[4] = h->server;
     
     length = tnfs_sendReceive(length);
     if(tnfs_buffer[4] == 0x00) {
     	strcpy(dest, &tnfs_buffer[5]);
+    	h->position++;
     }
     
     return tnfs_buffer[4] * -1; // return code
@@ -155,83 +1515,304 @@ int tnfs_readdir(char handle, char* dest)
 /* Open a directory (with a lot of options) */
 int tnfs_opendirx(char* path, char* pattern, uint8_t diropts, uint8_t sortopts, struct dirx_data* data)
 {
-    int length = 8;
+    int slot = tnfs_allocHandle();
+    int code;
+    uint16_t entries = 0;
 
-    tnfs_prepareCommand(0x17);
-    tnfs_buffer[4] = diropts;			// directory options
-    tnfs_buffer[5] = sortopts;			// sort options
-    // leave tnfs_buffer[6] and [7] to zero  because we want the total files found
-    strcpy(&tnfs_buffer[length], pattern);		// search pattern
-    length += strlen(pattern)+1;
-    strcpy(&tnfs_buffer[length], path);		// directory path
-    length += strlen(path)+1;
-    
-    length = tnfs_sendReceive(length);
-    
     memset(data, 0, sizeof(struct dirx_data)); // set whole structure to zeros
-    if(length == 8 && tnfs_buffer[4] == 0x00) {
-    	data->handle = tnfs_buffer[5];
-    	memcpy(&data->entries, &tnfs_buffer[6], 2); // copy the number of matching directory entries found in odirx.entries.
-    }
+
+    if(slot < 0)
+    	return slot;
+    if(strlen(path) + strlen(pattern) + 2 > TNFS_MAX_PATH_LEN)
+    	return -TNFS_ENAMETOOLONG;
+
+    code = tnfs_sendOpendirx(path, pattern, diropts, sortopts, &entries);
+    if(code < 0)
+    	return code;
+
+    tnfs_handles[slot].type = TNFS_HANDLE_DIRX;
+    tnfs_handles[slot].server = code;
+    tnfs_handles[slot].flags = diropts | (sortopts << 8);
+    tnfs_handles[slot].position = 0;
+    strcpy(tnfs_handles[slot].path, path);
+    strcpy(&tnfs_handles[slot].path[strlen(path) + 1], pattern);
+
+    data->handle = slot;
+    data->entries = entries; // the number of matching directory entries found
     
-    return tnfs_buffer[4] * -1; // Return code
+    return 0; // Return code
+}
+
+#if TNFS_USE_PIPELINE
+/* Opens up to NETW_MAX_BATCH directories for tnfs_nextdirx() with one burst of OPENDIRX requests */
+int tnfs_opendirxv(char** paths, char* pattern, uint8_t diropts, uint8_t sortopts, struct dirx_data* data, int* results, int count)
+{
+    struct tnfs_pool* pool = tnfs_pool_default();
+    struct tnfs_request* reqs[NETW_MAX_BATCH];
+    uint8_t slot[NETW_MAX_BATCH];
+    uint8_t which[NETW_MAX_BATCH];
+    uint16_t entries;
+    int code = 0;
+    int n = 0;
+    int spare = 0;
+
+    if(count > NETW_MAX_BATCH)
+    	return -TNFS_E2BIG;
+
+    for(int i = 0; i < count; i++) {
+    	memset(&data[i], 0, sizeof(struct dirx_data));
+    	results[i] = -TNFS_EMFILE;
+
+    	/* a handle is only taken once its directory is open, so look for distinct free handles here */
+    	while(spare < TNFS_MAX_HANDLES && tnfs_handles[spare].type != TNFS_HANDLE_FREE)
+    	    spare++;
+    	if(spare == TNFS_MAX_HANDLES)
+    	    continue;
+    	if(strlen(paths[i]) + strlen(pattern) + 2 > TNFS_MAX_PATH_LEN) {
+    	    results[i] = -TNFS_ENAMETOOLONG;
+    	    continue;
+    	}
+
+    	reqs[n] = tnfs_pool_get(pool);
+    	if(reqs[n] == NULL) {
+    	    results[i] = -TNFS_ENOMEM;
+    	    continue;
+    	}
+    	tnfs_prepareRequest(reqs[n], 0x17);
+    	reqs[n]->buffer[4] = diropts;
+    	reqs[n]->buffer[5] = sortopts;
+    	reqs[n]->buffer[6] = 0;
+    	reqs[n]->buffer[7] = 0;
+    	strcpy((char*)&reqs[n]->buffer[8], pattern);
+    	strcpy((char*)&reqs[n]->buffer[9 + strlen(pattern)], paths[i]);
+    	reqs[n]->length = 10 + strlen(pattern) + strlen(paths[i]);
+    	slot[n] = spare++;
+    	which[n++] = i;
+    }
+
+    if(n > 0)
+    	code = tnfs_batch(pool, reqs, n);
+
+    for(int j = 0; j < n; j++) {
+    	int i = which[j];
+    	struct tnfs_handle* h = &tnfs_handles[slot[j]];
+
+    	results[i] = reqs[j]->state == TNFS_REQ_DONE ? reqs[j]->status : -TNFS_EPROTO;
+    	if(results[i] == 0 && reqs[j]->length != 8)
+    	    results[i] = -TNFS_EPROTO;
+    	if(results[i] == 0) {
+    	    memcpy(&entries, &reqs[j]->buffer[6], 2);
+    	    h->type = TNFS_HANDLE_DIRX;
+    	    h->server = reqs[j]->buffer[5];
+    	    h->flags = diropts | (sortopts << 8);
+    	    h->position = 0;
+    	    strcpy(h->path, paths[i]);
+    	    strcpy(&h->path[strlen(paths[i]) + 1], pattern);
+    	    data[i].handle = slot[j];
+    	    data[i].entries = entries;
+    	}
+    	tnfs_pool_put(pool, reqs[j]);
+    }
+
+    return code;
 }
+#endif
 
 /* Closes a directory */
 int tnfs_closedir(char handle)
 {
     int length = 5;
+    struct tnfs_handle* h;
+    int code = tnfs_getHandle(handle, true, &h);
+
+    if(code == -TNFS_ESTALE) {
+    	h->type = TNFS_HANDLE_FREE; // the server doesn't know this directory anymore
+    	return 0;
+    }
+    if(code != 0)
+    	return code;
 
     tnfs_prepareCommand(0x12);
-    tnfs_buffer[4] = handle;
+    tnfs_buffer[4] = h->server;
     
     tnfs_sendReceive(length);
+    h->type = TNFS_HANDLE_FREE;
     
     return tnfs_buffer[4] * -1;
 }
 
+/* takes the header of a READDIRX response and remembers the directory position */
+void tnfs_takeDirx(struct dirx_data* data, struct tnfs_handle* h, const char* response, int length)
+{
+    uint32_t began = tnfs_timeline_used ? netw_micros() : 0;
+
+    data->count  = response[5];
+    data->status = response[6];
+    memcpy(&data->dirpos, &response[7], 2); // copy the position of first entry as given by TELLDIR
+    h->position = data->dirpos + data->count;
+#if TNFS_USE_WARM
+    if(h->type == TNFS_HANDLE_DIRX)
+        tnfs_warm_record(h->path, &h->path[strlen(h->path) + 1], h->flags, data->dirpos, data->count, data->status, &response[9], length - 9);
+#else
+    (void)length;
+#endif
+    if(tnfs_timeline_used)
+    	tnfs_timeline_span(TNFS_SPAN_DECODE, TNFS_LANE_BLOCKING, began, response[2], response[3], 0);
+}
+
 /* fills the buffer with multiple entries from the open directory with extra stat information for each entry */
 int tnfs_readdirx(struct dirx_data* data)
 {
     int length = 6;
+    struct tnfs_handle* h;
+    int code = tnfs_getHandle(data->handle, true, &h);
+
+    if(code != 0)
+    	return code;
 
     tnfs_prepareCommand(0x18);
-    tnfs_buffer[4] = data->handle;
-    tnfs_buffer[5] = TNFS_MAX_RESULTS;
+    tnfs_buffer[4] = h->server;
+    tnfs_buffer[5] = TNFS_DIRX_BATCH;
     
     length = tnfs_sendReceive(length);
     
-    if(length > 8 && tnfs_buffer[4] == 0x00) {
-    	data->count  = tnfs_buffer[5];
-    	data->status = tnfs_buffer[6];
-    	memcpy(&data->dirpos, &tnfs_buffer[7], 2); // copy the position of first entry as given by TELLDIR
-    }
+    if(length > 8 && tnfs_buffer[4] == 0x00)
+    	tnfs_takeDirx(data, h, tnfs_buffer, length);
     
     return tnfs_buffer[4] * -1;
 }
 
+/* sends a READDIRX without waiting for the response, tnfs_collectPrefetch() receives it later */
+void tnfs_sendPrefetch(struct dirx_data* data, struct tnfs_handle* h)
+{
+    tnfs_collectPrefetch(); // only one request can be ahead
+
+    memcpy(&tnfs_prefetch_request[0], &tnfs_session_id, 2);
+    tnfs_prefetch_request[2] = tnfs_request_id++;
+    tnfs_prefetch_request[3] = 0x18;
+    tnfs_prefetch_request[4] = h->server;
+    tnfs_prefetch_request[5] = TNFS_DIRX_BATCH;
+
+    data->ahead = true;
+    data->fetched = -TNFS_EPROTO;
+    if (tnfs_timeline_used)
+        tnfs_prefetch_sent = netw_micros();
+    if (tnfs_transport->send((const uint8_t*)tnfs_prefetch_request, 6) >= 0) {
+        if (tnfs_trace_used)
+            tnfs_trace_record(0, (uint8_t*)tnfs_prefetch_request, 6);
+        data->fetched = 0;
+        tnfs_prefetch_data = data;
+    }
+}
+
+/* returns the length of a READDIRX response by walking its entries */
+int tnfs_dirxLength(const char* response)
+{
+    int length = 9;
+
+    for (int i = 0; i < (uint8_t)response[5]; i++) {
+        length += strlen(&response[length + 13]) + 14;
+    }
+
+    return length;
+}
+
+/* makes the next batch of a directory in prefetch mode current and sends the READDIRX for the batch after it */
+int tnfs_nextBatch(struct dirx_data* data)
+{
+    struct tnfs_handle* h;
+    char* spare;
+    int code = tnfs_getHandle(data->handle, true, &h);
+
+    if(code != 0)
+    	return code;
+
+    if(!data->ahead)
+    	tnfs_sendPrefetch(data, h);
+    tnfs_collectPrefetch();
+    data->ahead = false;
+
+    if(data->fetched >= 5 && data->spare[4] == TNFS_EOF) {
+    	data->count = 0;
+    	data->status = TNFS_DIRSTATUS_EOF;
+    	return -TNFS_EOF;
+    }
+
+    /* 
+     * the response went missing, reports an error or was sent before a seekdir(): seek to where we are and read
+     * the batch synchronously, which also recovers a lost session
+     */
+    if(data->fetched < 9 || data->spare[4] != 0x00 || memcmp(&data->spare[7], &h->position, 2) != 0) {
+    	code = tnfs_sendSeekdir(h->server, h->position);
+    	if(code >= 0)
+    	    code = tnfs_readdirx(data);
+    	if(code != 0)
+    	    return code;
+    	code = tnfs_dirxLength(tnfs_buffer);
+    	if(code > data->batchsize)
+    	    return -TNFS_ENOBUFS;
+    	memcpy(data->spare, tnfs_buffer, code);
+    } else {
+    	tnfs_takeDirx(data, h, data->spare, data->fetched);
+    }
+
+    spare = data->batch;
+    data->batch = data->spare;
+    data->spare = spare;
+
+    if(!(data->status & TNFS_DIRSTATUS_EOF))
+    	tnfs_sendPrefetch(data, h);
+
+    return 0;
+}
+
+/* 
+ * switches a directory opened with opendirx() to prefetch mode, call it before the first nextdirx(). The next READDIRX
+ * is sent as soon as a batch arrives so it travels while the caller walks the current batch. buffers must hold
+ * 2 * size bytes (size larger than any READDIRX response) and stay valid until the directory is closed.
+ */
+int tnfs_prefetchdirx(struct dirx_data* data, char* buffers, uint16_t size)
+{
+    struct tnfs_handle* h;
+    int code = tnfs_getHandle(data->handle, true, &h);
+
+    if(code != 0)
+    	return code;
+    if(data->count != 0 || size < 9)
+    	return -TNFS_EINVAL;
+
+    data->batch = buffers;
+    data->spare = buffers + size;
+    data->batchsize = size;
+    data->ahead = false;
+
+    return 0;
+}
+
 /* reads one entry from the open directory with extra stat information */
 int tnfs_nextdirx(struct dirx_data* data, struct dirx_item* xitem)
 {
     int code;
+    const char* buffer = data->batchsize > 0 ? data->batch : tnfs_buffer;
     
     if(data->entry >= data->count) {
     	if(data->status == TNFS_DIRSTATUS_EOF) {
     	    return TNFS_EOF;
     	}
-	code = tnfs_readdirx(data);
+	code = data->batchsize > 0 ? tnfs_nextBatch(data) : tnfs_readdirx(data);
 	if(code != 0) {
 	    return code * -1; // error
 	}
     	data->needle = 9;
     	data->entry = 0;
+    	buffer = data->batchsize > 0 ? data->batch : tnfs_buffer;
     }
     /* fill dirx_item structure */
-    xitem->flags = tnfs_buffer[data->needle];
-    memcpy(&xitem->size, &tnfs_buffer[data->needle + 1], 4); 
-    memcpy(&xitem->modified, &tnfs_buffer[data->needle + 5], 4); 
-    memcpy(&xitem->created, &tnfs_buffer[data->needle + 9], 4); 
-    xitem->name = &tnfs_buffer[data->needle + 13];
+    xitem->flags = buffer[data->needle];
+    memcpy(&xitem->size, &buffer[data->needle + 1], 4); 
+    memcpy(&xitem->modified, &buffer[data->needle + 5], 4); 
+    memcpy(&xitem->created, &buffer[data->needle + 9], 4); 
+    xitem->name = (char*)&buffer[data->needle + 13];
     
     /* increase counters */
     data->needle += strlen(xitem->name) + 14;
@@ -244,9 +1825,14 @@ int tnfs_nextdirx(struct dirx_data* data, struct dirx_item* xitem)
 int tnfs_telldir(char handle, uint32_t* position) 
 {
     int length = 5;
+    struct tnfs_handle* h;
+    int code = tnfs_getHandle(handle, true, &h);
+
+    if(code != 0)
+    	return code * -1;
 
     tnfs_prepareCommand(0x15);
-    tnfs_buffer[4] = handle;
+    tnfs_buffer[4] = h->server;
     
     length = tnfs_sendReceive(length);
     
@@ -260,13 +1846,14 @@ int tnfs_telldir(char handle, uint32_t* position)
 /* Moves current directory results position to new value */
 int tnfs_seekdir(char handle, uint32_t position) 
 {
-    int length = 9;
+    struct tnfs_handle* h;
+    int code = tnfs_getHandle(handle, true, &h);
 
-    tnfs_prepareCommand(0x16);
-    tnfs_buffer[4] = handle;
-    memcpy(&tnfs_buffer[5], &position, 4);
-    
-    tnfs_sendReceive(length);
+    if(code != 0)
+    	return code * -1;
+
+    if(tnfs_sendSeekdir(h->server, position) >= 0)
+    	h->position = position;
     
     return tnfs_buffer[4];
 }
@@ -276,11 +1863,16 @@ int tnfs_mkdir(char* dir)
 {
     int length = 4;
 
+    if(tnfs_useJournal())
+    	return -tnfs_journalPath(TNFS_JOURNAL_MKDIR, dir, "", 0, 0);
+
     tnfs_prepareCommand(0x13);
     strcpy(&tnfs_buffer[length], dir);
     length += strlen(dir)+1;
     
     tnfs_sendReceive(length);
+    if(!tnfs_online && tnfs_journal_active())
+    	return -tnfs_journalPath(TNFS_JOURNAL_MKDIR, dir, "", 0, 0);
 
     return tnfs_buffer[4];
 }
@@ -290,40 +1882,158 @@ int tnfs_rmdir(char* dir)
 {
     int length = 4;
 
+    if(tnfs_useJournal())
+    	return -tnfs_journalPath(TNFS_JOURNAL_RMDIR, dir, "", 0, 0);
+
     tnfs_prepareCommand(0x14);
     strcpy(&tnfs_buffer[length], dir);
     length += strlen(dir)+1;
     
     tnfs_sendReceive(length);
+    if(!tnfs_online && tnfs_journal_active())
+    	return -tnfs_journalPath(TNFS_JOURNAL_RMDIR, dir, "", 0, 0);
 
     return tnfs_buffer[4];
 }
 
+/*
+ * data of a file opened for reading and writing went to or came from the server, its overlay copy gets it too so it
+ * can be read back when the file continues offline
+ */
+void tnfs_mirrorFile(struct tnfs_handle* h, uint32_t position, const char* data, uint16_t length)
+{
+#if TNFS_USE_JOURNAL
+    if((h->type & TNFS_HANDLE_SEEDED) && data != NULL && tnfs_journal_active())
+    	tnfs_journal_mirror(h->path, position, data, length);
+#else
+    (void)h;
+    (void)position;
+    (void)data;
+    (void)length;
+#endif
+}
+
+/* a file was written on the server, which moved its modification time past the one we know */
+void tnfs_wroteFile(struct tnfs_handle* h, uint32_t position, const char* data, uint16_t length)
+{
+    tnfs_mirrorFile(h, (h->flags & TNFS_O_APPEND) ? TNFS_JOURNAL_APPEND : position, data, length);
+#if TNFS_USE_JOURNAL
+    /* the server second of this write is at most this far after the one of the write that mtime was asked after */
+    if(h->type & TNFS_HANDLE_STATED) {
+    	uint32_t slack = (netw_millis() - h->stated) / 1000 + 2;
+    	h->slack = slack < 0xFFFF ? slack : 0xFFFF;
+    }
+#endif
+}
+
+#if TNFS_USE_JOURNAL
+/*
+ * keeps the modification time of a file that is written online up to date, so its writes aren't taken for changes by
+ * others when the file continues in the journal. Only the first write and then one write every TNFS_JOURNAL_STAT_MS
+ * cost a STAT, the writes in between are covered by the slack of tnfs_wroteFile()
+ */
+void tnfs_trackMtime(struct tnfs_handle* h)
+{
+    struct fstat st;
+
+    if(h->mtime == 0 || !tnfs_journal_active()
+     || ((h->type & TNFS_HANDLE_STATED) && netw_millis() - h->stated < TNFS_JOURNAL_STAT_MS))
+    	return;
+
+    if(tnfs_stat(h->path, &st) == 0) {
+    	h->mtime = st.mtime;
+    	h->stated = netw_millis();
+    	h->slack = 0;
+    	h->type |= TNFS_HANDLE_STATED;
+    }
+}
+#endif
+
 /* Open a file */
 int tnfs_open(char* filename, uint16_t flags, uint16_t mode)
 {
-    int length = 8;
-
-    tnfs_prepareCommand(0x29);
-    memcpy(&tnfs_buffer[4], &flags, 2);
-    memcpy(&tnfs_buffer[6], &mode, 2);
-    strcpy(&tnfs_buffer[length], filename);
-    length += strlen(filename)+1;
+    int slot = tnfs_allocHandle();
+    bool journal = tnfs_useJournal();
+    uint32_t mtime = 0;
+    struct fstat st;
+    int code = -TNFS_EIO;
+
+    if(slot < 0)
+    	return slot;
+    if(strlen(filename) >= TNFS_MAX_PATH_LEN)
+    	return -TNFS_ENAMETOOLONG;
+
+    /* the modification time detects changes by others when writes have to be replayed from the journal */
+    if(!journal && tnfs_journal_active() && (flags & TNFS_O_WRONLY) && tnfs_stat(filename, &st) == 0)
+    	mtime = st.mtime;
+
+    if(!journal)
+    	code = tnfs_sendOpen(filename, flags, mode);
+
+    /* without a server a file opened for writing continues in the journal */
+    if((journal || (!tnfs_online && tnfs_journal_active())) && (flags & TNFS_O_WRONLY)) {
+    	code = tnfs_journalPath(TNFS_JOURNAL_OPEN, filename, "", flags, mode);
+    	if(code != 0)
+    	    return code;
+    	code = TNFS_NO_HANDLE;
+    	tnfs_handles[slot].type = TNFS_HANDLE_FILE | TNFS_HANDLE_JOURNAL;
+    } else {
+    	tnfs_handles[slot].type = TNFS_HANDLE_FILE;
+    }
+    if(code < 0) {
+    	tnfs_handles[slot].type = TNFS_HANDLE_FREE;
+    	return code;
+    }
 
-    length = tnfs_sendReceive(length);
-    if(tnfs_buffer[4] != 0x00)
-    	return tnfs_buffer[4] * -1;
+    tnfs_handles[slot].server = code;
+    tnfs_handles[slot].mtime = mtime;
+    tnfs_handles[slot].slack = 0;
+    tnfs_handles[slot].flags = flags;
+    tnfs_handles[slot].mode = mode;
+    tnfs_handles[slot].whence = TNFS_SEEK_SET;
+    tnfs_handles[slot].position = 0;
+    strcpy(tnfs_handles[slot].path, filename);
+
+#if TNFS_USE_JOURNAL
+    /* a file that is read back may continue offline, its overlay copy fills with what is read and written from now on */
+    if(tnfs_handles[slot].type & TNFS_HANDLE_JOURNAL) {
+    	tnfs_journal_seed(filename, (flags & TNFS_O_TRUNC) ? 0 : TNFS_JOURNAL_UNKNOWN);
+    	tnfs_handles[slot].type |= TNFS_HANDLE_SEEDED;
+    } else if(tnfs_journal_active() && (flags & TNFS_O_RDWR) == TNFS_O_RDWR) {
+    	tnfs_journal_seed(filename, (flags & TNFS_O_TRUNC) ? 0 : mtime != 0 ? st.size : TNFS_JOURNAL_UNKNOWN);
+    	tnfs_handles[slot].type |= TNFS_HANDLE_SEEDED;
+    }
+#endif
     
-    return tnfs_buffer[5]; // filehandle
+    return slot; // filehandle
 }
 
 /* read data from a file */
 int tnfs_read(char* data, uint8_t handle, uint16_t maxlen)
 {
     int length = 7;
+    struct tnfs_handle* h;
+    int code = tnfs_getHandle(handle, false, &h);
+
+    if(code != 0)
+    	return code;
+    if(maxlen > TNFS_BUFFERSIZE - 7)
+    	maxlen = TNFS_BUFFERSIZE - 7; // the response has to fit in tnfs_buffer
+
+#if TNFS_USE_JOURNAL
+    /* data written while offline is read back from the overlay */
+    if(h->type & TNFS_HANDLE_JOURNAL) {
+    	code = tnfs_journal_read(h->path, h->position, data, maxlen);
+    	if(code > 0 && tnfs_checksum_used)
+    	    tnfs_checksum_update(handle, h->position, data, code);
+    	if(code > 0)
+    	    h->position += code;
+    	return code;
+    }
+#endif
 
     tnfs_prepareCommand(0x21);
-    tnfs_buffer[4] = handle;
+    tnfs_buffer[4] = h->server;
     memcpy(&tnfs_buffer[5], &maxlen, 2);
 
     length = tnfs_sendReceive(length);
@@ -332,40 +2042,248 @@ int tnfs_read(char* data, uint8_t handle, uint16_t maxlen)
         return tnfs_buffer[4] * -1; // return code
     }
     
+    uint32_t began = tnfs_timeline_used ? netw_micros() : 0;
     memcpy(&maxlen, &tnfs_buffer[5], 2);
     memcpy(data, &tnfs_buffer[7], maxlen);
+    if(tnfs_checksum_used)
+    	tnfs_checksum_update(handle, h->position, data, maxlen);
+    tnfs_mirrorFile(h, h->position, data, maxlen);
+    if(tnfs_timeline_used)
+    	tnfs_timeline_span(TNFS_SPAN_COPY, TNFS_LANE_BLOCKING, began, tnfs_buffer[2], 0x21, 0);
+    h->position += maxlen;
     
     return maxlen; // actual length of data
 }
 
+#if TNFS_USE_PIPELINE
+/* builds a READ request for a file in a request descriptor, returns 0 or a negative error code */
+int tnfs_prepareRead(struct tnfs_request* req, uint8_t handle, uint16_t maxlen)
+{
+    struct tnfs_handle* h;
+    int code = tnfs_getHandle(handle, false, &h);
+
+    if(code != 0)
+    	return code;
+    if(h->type & TNFS_HANDLE_JOURNAL)
+    	return -TNFS_EBADF;	// reads from the overlay can't be sent as a request
+
+    tnfs_prepareRequest(req, 0x21);
+    req->buffer[4] = h->server;
+    memcpy(&req->buffer[5], &maxlen, 2);
+    req->length = 7;
+
+    return 0;
+}
+
+/* copies the data of a completed READ request and moves the file position, returns the length or a negative error code */
+int tnfs_takeRead(struct tnfs_request* req, uint8_t handle, char* data)
+{
+    struct tnfs_handle* h;
+    uint16_t length;
+    int code = req->state == TNFS_REQ_DONE ? req->status : -TNFS_EPROTO;
+
+    if(code == 0)
+    	code = tnfs_getHandle(handle, false, &h);
+    if(code != 0)
+    	return code;
+
+    uint32_t began = tnfs_timeline_used ? netw_micros() : 0;
+    memcpy(&length, &req->buffer[5], 2);
+    if(length > req->length - 7)
+    	length = req->length - 7;
+    memcpy(data, &req->buffer[7], length);
+    if(tnfs_checksum_used)
+    	tnfs_checksum_update(handle, h->position, data, length);
+    tnfs_mirrorFile(h, h->position, data, length);
+    if(tnfs_timeline_used)
+    	tnfs_timeline_span(TNFS_SPAN_COPY, TNFS_LANE_BATCH, began, req->id, req->cmd, 0);
+    h->position += length;
+
+    return length;
+}
+
+/*
+ * builds a WRITE request for a file in a request descriptor of bufsize bytes, data may already be in place at
+ * req->buffer + 7. Returns 0 or a negative error code
+ */
+int tnfs_prepareWrite(struct tnfs_request* req, uint8_t handle, const char* data, uint16_t length, uint16_t bufsize)
+{
+    struct tnfs_handle* h;
+    int code = tnfs_getHandle(handle, false, &h);
+
+    if(code != 0)
+    	return code;
+    if(h->type & TNFS_HANDLE_JOURNAL)
+    	return -TNFS_EBADF;	// writes to the journal can't be sent as a request
+    if(length + 7 > bufsize)
+    	return -TNFS_ENOBUFS;
+
+    tnfs_prepareRequest(req, 0x22);
+    req->buffer[4] = h->server;
+    memcpy(&req->buffer[5], &length, 2);
+    memmove(&req->buffer[7], data, length);
+    req->length = 7 + length;
+
+    return 0;
+}
+
+/*
+ * moves the file position by what a completed WRITE request wrote, returns that length or a negative error code. data
+ * is what was written, only needed for the checksums, NULL leaves them out
+ */
+int tnfs_takeWrite(struct tnfs_request* req, uint8_t handle, const char* data)
+{
+    struct tnfs_handle* h;
+    uint16_t length = 0;
+    int code = req->state == TNFS_REQ_DONE ? req->status : -TNFS_EPROTO;
+
+    if(code == 0)
+    	code = tnfs_getHandle(handle, false, &h);
+    if(code != 0)
+    	return code;
+
+    if(req->length >= 7)
+    	memcpy(&length, &req->buffer[5], 2);
+    if(tnfs_checksum_used && data != NULL)
+    	tnfs_checksum_update(handle, h->position, data, length);
+    tnfs_wroteFile(h, h->position, data, length);
+    h->position += length;
+
+    return length;
+}
+
+/* read data from up to NETW_MAX_BATCH different files with one burst of requests */
+int tnfs_readv(uint8_t* handles, char** data, uint16_t maxlen, int* results, int count)
+{
+    struct tnfs_pool* pool = tnfs_pool_default();
+    struct tnfs_request* reqs[NETW_MAX_BATCH];
+    uint8_t slot[NETW_MAX_BATCH];
+    int code = 0;
+    int n = 0;
+
+    if(count > NETW_MAX_BATCH)
+    	return -TNFS_E2BIG;
+    if(maxlen + 7 > pool->bufsize)
+    	maxlen = pool->bufsize - 7;
+    if(maxlen + 7 > TNFS_BATCH_SLICE)
+    	maxlen = TNFS_BATCH_SLICE - 7;	// the response has to fit in its slice of tnfs_batch_buffer
+
+    for(int i = 0; i < count; i++) {
+    	reqs[n] = tnfs_pool_get(pool);
+    	if(reqs[n] == NULL) {
+    	    results[i] = -TNFS_ENOMEM;
+    	    continue;
+    	}
+    	results[i] = tnfs_prepareRead(reqs[n], handles[i], maxlen);
+    	if(results[i] != 0) {
+    	    tnfs_pool_put(pool, reqs[n]);
+    	    continue;
+    	}
+    	slot[n++] = i;
+    }
+
+    if(n > 0)
+    	code = tnfs_batch(pool, reqs, n);
+
+    for(int j = 0; j < n; j++) {
+    	results[slot[j]] = tnfs_takeRead(reqs[j], handles[slot[j]], data[slot[j]]);
+    	tnfs_pool_put(pool, reqs[j]);
+    }
+
+    return code;
+}
+#endif
+
 /* write data to a file */
 int tnfs_write(char* data, uint8_t handle, uint16_t maxlen)
 {
     int length = 7;
+    bool journal = tnfs_useJournal();
+    struct tnfs_handle* h;
+    int code = tnfs_getHandle(handle, false, &h);
+
+    if(code != 0)
+    	return code;
+    if(maxlen > TNFS_BUFFERSIZE - 7)
+    	return -TNFS_ENOBUFS; // the request has to fit in tnfs_buffer
+    if(journal || (h->type & TNFS_HANDLE_JOURNAL))
+    	return tnfs_journalWrite(h, data, maxlen);
 
     tnfs_prepareCommand(0x22);
-    tnfs_buffer[4] = handle;
+    tnfs_buffer[4] = h->server;
     memcpy(&tnfs_buffer[5], &maxlen, 2);
     memcpy(&tnfs_buffer[7], data, maxlen);
     length += maxlen;
 
     tnfs_sendReceive(length);
+    if(!tnfs_online && tnfs_journal_active())
+    	return tnfs_journalWrite(h, data, maxlen);
+
+    code = tnfs_buffer[4] * -1;
+    if(code == 0) {
+    	if(tnfs_checksum_used)
+    	    tnfs_checksum_update(handle, h->position, data, maxlen);
+    	tnfs_wroteFile(h, h->position, data, maxlen);
+    	h->position += maxlen;
+#if TNFS_USE_JOURNAL
+    	tnfs_trackMtime(h);
+#endif
+    }
     
-    return tnfs_buffer[4] * -1; // return code
+    return code; // return code
 }
 
 /* close a file */
 int tnfs_close(uint8_t handle)
 {
     int length = 5;
+    struct tnfs_handle* h;
+    int code = tnfs_getHandle(handle, false, &h);
+
+    if(tnfs_checksum_used)
+    	tnfs_checksum_close(handle);
+#if TNFS_USE_JOURNAL
+    /* the overlay copy isn't needed anymore unless the journal refers to it */
+    if((code == 0 || code == -TNFS_ESTALE) && (h->type & TNFS_HANDLE_SEEDED))
+    	tnfs_journal_release(h->path);
+#endif
+    if(code == -TNFS_ESTALE) {
+    	h->type = TNFS_HANDLE_FREE; // the server doesn't know this file anymore
+    	return 0;
+    }
+    if(code != 0)
+    	return code;
+
+    /* the server handle of a file in journal mode is only closed when the server is there */
+    if((h->type & TNFS_HANDLE_JOURNAL) && (h->server == TNFS_NO_HANDLE || !tnfs_online)) {
+    	h->type = TNFS_HANDLE_FREE;
+    	return 0;
+    }
 
     tnfs_prepareCommand(0x23);
-    tnfs_buffer[4] = handle;
+    tnfs_buffer[4] = h->server;
     tnfs_sendReceive(length);
+    if(h->type & TNFS_HANDLE_JOURNAL)
+    	tnfs_buffer[4] = 0x00;	// the data is safe in the journal
+    h->type = TNFS_HANDLE_FREE;
     
     return tnfs_buffer[4] * -1; // Return code
 }
 
+/* copies the stat information from a STAT response */
+void tnfs_parseStat(const char* response, struct fstat* st)
+{
+    memcpy(&st->mode, &response[5], 2);
+    memcpy(&st->uid, &response[7], 2);
+    memcpy(&st->gid, &response[9], 2);
+    memcpy(&st->size, &response[11], 4);
+    memcpy(&st->atime, &response[15], 4);
+    memcpy(&st->mtime, &response[19], 4);
+    memcpy(&st->ctime, &response[23], 4);
+    snprintf(st->uidstring, TNFS_STAT_NAME_LEN, "%s", &response[27]);
+    snprintf(st->gidstring, TNFS_STAT_NAME_LEN, "%s", &response[28 + strlen(&response[27])]);
+}
+
 /* Get stat information from a file */
 int tnfs_stat(char* filename, struct fstat* st)
 {
@@ -376,34 +2294,151 @@ int tnfs_stat(char* filename, struct fstat* st)
     length += strlen(filename)+1;
 
     tnfs_sendReceive(length);
-    if(tnfs_buffer[4] == 0x00) {
-    	memcpy(&st->mode, &tnfs_buffer[5], 2);
-    	memcpy(&st->uid, &tnfs_buffer[7], 2);
-    	memcpy(&st->gid, &tnfs_buffer[9], 2);
-    	memcpy(&st->size, &tnfs_buffer[11], 4);
-    	memcpy(&st->atime, &tnfs_buffer[15], 4);
-    	memcpy(&st->mtime, &tnfs_buffer[19], 4);
-    	memcpy(&st->ctime, &tnfs_buffer[23], 4);
-    	strcpy(st->uidstring, &tnfs_buffer[27]);
-    	strcpy(st->gidstring, &tnfs_buffer[28+strlen(st->uidstring)]);
-    }
+    uint32_t began = tnfs_timeline_used ? netw_micros() : 0;
+    if(tnfs_buffer[4] == 0x00)
+    	tnfs_parseStat(tnfs_buffer, st);
+    if(tnfs_timeline_used)
+    	tnfs_timeline_span(TNFS_SPAN_DECODE, TNFS_LANE_BLOCKING, began, tnfs_buffer[2], 0x24, 0);
     
     return tnfs_buffer[4] * -1; // Return code
 }
 
+#if TNFS_USE_PIPELINE
+/* builds a STAT request in a request descriptor, returns 0 or -TNFS_ENAMETOOLONG */
+int tnfs_prepareStat(struct tnfs_request* req, const char* filename, uint16_t bufsize)
+{
+    tnfs_prepareRequest(req, 0x24);
+    if(strlen(filename) + 5 > bufsize)
+    	return -TNFS_ENAMETOOLONG;
+
+    strcpy((char*)&req->buffer[4], filename);
+    req->length += strlen(filename) + 1;
+
+    return 0;
+}
+
+/* copies the stat information of a completed STAT request, returns 0 or a negative error code */
+int tnfs_takeStat(struct tnfs_request* req, struct fstat* st)
+{
+    int code = req->state == TNFS_REQ_DONE ? req->status : -TNFS_EPROTO;
+    uint32_t began = tnfs_timeline_used ? netw_micros() : 0;
+
+    if(code == 0)
+    	tnfs_parseStat((char*)req->buffer, st);
+    if(tnfs_timeline_used)
+    	tnfs_timeline_span(TNFS_SPAN_DECODE, TNFS_LANE_BATCH, began, req->id, req->cmd, 0);
+
+    return code;
+}
+
+/* Get stat information from up to NETW_MAX_BATCH files with one burst of requests */
+int tnfs_statv(char** filenames, struct fstat* st, int* results, int count)
+{
+    struct tnfs_pool* pool = tnfs_pool_default();
+    struct tnfs_request* reqs[NETW_MAX_BATCH];
+    uint8_t slot[NETW_MAX_BATCH];
+    int code = 0;
+    int n = 0;
+
+    if(count > NETW_MAX_BATCH)
+    	return -TNFS_E2BIG;
+
+    /* a name that can't be sent gets its error, the others go out anyway */
+    for(int i = 0; i < count; i++) {
+    	reqs[n] = tnfs_pool_get(pool);
+    	if(reqs[n] == NULL) {
+    	    results[i] = -TNFS_ENOMEM;
+    	    continue;
+    	}
+    	results[i] = tnfs_prepareStat(reqs[n], filenames[i], pool->bufsize);
+    	if(results[i] != 0) {
+    	    tnfs_pool_put(pool, reqs[n]);
+    	    continue;
+    	}
+    	slot[n++] = i;
+    }
+
+    if(n > 0)
+    	code = tnfs_batch(pool, reqs, n);
+
+    for(int j = 0; j < n; j++) {
+    	results[slot[j]] = tnfs_takeStat(reqs[j], &st[slot[j]]);
+    	tnfs_pool_put(pool, reqs[j]);
+    }
+
+    return code;
+}
+#endif
+
 /* Seeks to a new position in a file */
 int tnfs_lseek(uint8_t handle, uint8_t seektype, uint32_t position)
 {
-    int length = 10;
-
-    tnfs_prepareCommand(0x25);
-    tnfs_buffer[4] = handle;
-    tnfs_buffer[5] = seektype;
-    memcpy(&tnfs_buffer[6], &position, 4);
+    int length;
+    struct tnfs_handle* h;
+    int code = tnfs_getHandle(handle, false, &h);
+
+    if(code != 0)
+    	return code;
+
+    /* a file in journal mode seeks locally, the end of the file is only known by the server */
+    if(h->type & TNFS_HANDLE_JOURNAL) {
+    	if(seektype == TNFS_SEEK_END)
+    	    return -TNFS_EINVAL;
+    	h->position = seektype == TNFS_SEEK_CUR ? h->position + position : position;
+    	return 0;
+    }
 
-    tnfs_sendReceive(length);
+    length = tnfs_sendLseek(h->server, seektype, position);
+    if(tnfs_buffer[4] != 0x00)
+    	return tnfs_buffer[4] * -1; // Return code
+
+    /* remember the offset to restore it after a recovery, newer servers return the absolute position */
+    if(length >= 9) {
+    	memcpy(&h->position, &tnfs_buffer[5], 4);
+    	h->whence = TNFS_SEEK_SET;
+    } else if(seektype == TNFS_SEEK_CUR) {
+    	h->position += position;
+    } else {
+    	h->position = position;
+    	h->whence = seektype;
+    }
    
-    return tnfs_buffer[4] * -1; // Return code
+    return 0; // Return code
+}
+
+/*
+ * returns the position in a file as far as the library knows it. An older server doesn't return the position after a
+ * seek from the end, then the size of the file is asked with a STAT.
+ */
+int tnfs_tell(uint8_t handle, uint32_t* position)
+{
+    struct tnfs_handle* h;
+    struct fstat st;
+    int code = tnfs_getHandle(handle, false, &h);
+
+    if(code != 0)
+    	return code;
+    if(h->whence != TNFS_SEEK_SET) {
+    	code = tnfs_stat(h->path, &st);
+    	if(code != 0)
+    	    return code;
+    	if((int32_t)h->position < 0 && (uint32_t)-(int32_t)h->position > st.size)
+    	    return -TNFS_EINVAL;
+    	h->position += st.size;
+    	h->whence = TNFS_SEEK_SET;
+    }
+
+    *position = h->position;
+
+    return 0;
+}
+
+/* returns the path an open file was opened with, NULL when the handle is not an open file */
+const char* tnfs_getPath(uint8_t handle)
+{
+    struct tnfs_handle* h;
+
+    return tnfs_getHandle(handle, false, &h) == 0 ? h->path : NULL;
 }
 
 /* Delete a file */
@@ -411,11 +2446,16 @@ int tnfs_unlink(char* filename)
 {
     int length = 4;
 
+    if(tnfs_useJournal())
+    	return tnfs_journalPath(TNFS_JOURNAL_UNLINK, filename, "", 0, 0);
+
     tnfs_prepareCommand(0x26);
     strcpy(&tnfs_buffer[length], filename);
     length += strlen(filename)+1;
 
     tnfs_sendReceive(length);
+    if(!tnfs_online && tnfs_journal_active())
+    	return tnfs_journalPath(TNFS_JOURNAL_UNLINK, filename, "", 0, 0);
    
     return tnfs_buffer[4] * -1; // Return code
 }
@@ -440,6 +2480,9 @@ int tnfs_rename(char* source, char* destination)
 {
     int length = 4;
 
+    if(tnfs_useJournal())
+    	return tnfs_journalPath(TNFS_JOURNAL_RENAME, source, destination, 0, 0);
+
     tnfs_prepareCommand(0x28);
     strcpy(&tnfs_buffer[length], source);
     length += strlen(source)+1;
@@ -447,6 +2490,8 @@ int tnfs_rename(char* source, char* destination)
     length += strlen(destination)+1;
 
     tnfs_sendReceive(length);
+    if(!tnfs_online && tnfs_journal_active())
+    	return tnfs_journalPath(TNFS_JOURNAL_RENAME, source, destination, 0, 0);
    
     return tnfs_buffer[4] * -1; // Return code
 }
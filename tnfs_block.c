@@ -0,0 +1,311 @@
+#include "include/tnfs_block.h"
+
+/*
+ * Block devices: an emulated disk reads and writes single sectors at random places in an image, which would cost an
+ * LSEEK and a READ or WRITE for every sector. A block device keeps TNFS_BLOCK_CACHE sectors in a write-back cache.
+ * Dirty sectors are only written on tnfs_block_flush(), on tnfs_block_close() or when their line is needed for another
+ * sector, and then adjacent dirty sectors go out as one WRITE of up to TNFS_BLOCK_RUN sectors. A read that continues
+ * where the previous one ended also fetches the next TNFS_BLOCK_READAHEAD sectors with the same READ.
+ */
+
+#define TNFS_BLOCK_UNKNOWN 0xFFFFFFFF	// position of the file on the server after a failed request
+
+/* block device global variables */
+struct tnfs_blockdev tnfs_blockdevs[TNFS_MAX_BLOCKDEVS];	// open block devices, handle is -1 for a free one
+bool     tnfs_blockdevs_initialized = false;
+char     tnfs_block_run[TNFS_BLOCK_RUN * TNFS_BLOCK_SECTOR];	// data of one READ or WRITE of several sectors
+
+
+/* returns the cache line of a sector, -1 when the sector isn't cached */
+int tnfs_block_find(struct tnfs_blockdev* b, uint32_t sector)
+{
+    for (int i = 0; i < TNFS_BLOCK_CACHE; i++) {
+        if ((b->lines[i].flags & TNFS_BLOCK_VALID) && b->lines[i].sector == sector)
+            return i;
+    }
+
+    return -1;
+}
+
+/* true when count sectors from sector lie within the 32 bit file offsets of TNFS */
+bool tnfs_block_fits(uint32_t sector, uint16_t count)
+{
+    return ((uint64_t)sector + count) * TNFS_BLOCK_SECTOR <= UINT32_MAX;
+}
+
+/* moves the file on the server to a sector unless it is there already */
+int tnfs_block_seek(struct tnfs_blockdev* b, uint32_t sector)
+{
+    uint64_t offset = (uint64_t)sector * TNFS_BLOCK_SECTOR;
+    int code;
+
+    if (offset > UINT32_MAX)
+        return -TNFS_EINVAL;
+    if (b->position == offset)
+        return 0;
+
+    code = tnfs_lseek(b->handle, TNFS_SEEK_SET, (uint32_t)offset);
+    b->position = code == 0 ? (uint32_t)offset : TNFS_BLOCK_UNKNOWN;
+
+    return code;
+}
+
+/* writes count sectors from tnfs_block_run to the server with one request */
+int tnfs_block_send(struct tnfs_blockdev* b, uint32_t sector, uint16_t count)
+{
+    int code = tnfs_block_seek(b, sector);
+
+    if (code != 0)
+        return code;
+
+    b->requests++;
+    code = tnfs_write(tnfs_block_run, b->handle, count * TNFS_BLOCK_SECTOR);
+    b->position = code == 0 ? b->position + count * TNFS_BLOCK_SECTOR : TNFS_BLOCK_UNKNOWN;
+
+    return code;
+}
+
+/* reads count sectors from the server into tnfs_block_run, a part beyond the end of the image reads as zeros */
+int tnfs_block_fetch(struct tnfs_blockdev* b, uint32_t sector, uint16_t count)
+{
+    uint16_t size = count * TNFS_BLOCK_SECTOR;
+    uint16_t done = 0;
+    int code = tnfs_block_seek(b, sector);
+
+    if (code != 0)
+        return code;
+
+    /* a server may return less than asked for, then ask for the rest */
+    while (done < size) {
+        b->requests++;
+        code = tnfs_read(&tnfs_block_run[done], b->handle, size - done);
+        if (code == -TNFS_EOF || code == 0)
+            break;
+        if (code < 0) {
+            b->position = TNFS_BLOCK_UNKNOWN;
+            return code;
+        }
+        done += code;
+        b->position += code;
+    }
+
+    memset(&tnfs_block_run[done], 0, size - done);
+
+    return 0;
+}
+
+/* Writes all dirty sectors to the server, adjacent sectors are combined into one request */
+int tnfs_block_flush(struct tnfs_blockdev* b)
+{
+    uint8_t order[TNFS_BLOCK_CACHE];
+    uint16_t count = 0;
+    uint16_t run;
+    uint8_t line;
+    int code = 0;
+
+    if (b->dirty == 0)
+        return 0;
+
+    /* the dirty lines sorted on sector number */
+    for (int i = 0; i < TNFS_BLOCK_CACHE; i++) {
+        if (!(b->lines[i].flags & TNFS_BLOCK_DIRTY))
+            continue;
+
+        int j = count++;
+        while (j > 0 && b->lines[order[j - 1]].sector > b->lines[i].sector) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    for (uint16_t i = 0; i < count && code == 0; i += run) {
+        for (run = 0; run < TNFS_BLOCK_RUN && i + run < count; run++) {
+            line = order[i + run];
+            if (run > 0 && b->lines[line].sector != b->lines[order[i]].sector + run)
+                break;
+            memcpy(&tnfs_block_run[run * TNFS_BLOCK_SECTOR], b->data[line], TNFS_BLOCK_SECTOR);
+        }
+
+        code = tnfs_block_send(b, b->lines[order[i]].sector, run);
+        if (code != 0)
+            break;
+
+        for (uint16_t j = i; j < i + run; j++)
+            b->lines[order[j]].flags &= ~TNFS_BLOCK_DIRTY;
+        b->dirty -= run;
+    }
+
+#ifdef DEBUG
+    printf("block flush: %u dirty sectors, %u left\n\n", count, b->dirty);
+#endif
+
+    return code;
+}
+
+/* returns a line for a sector that isn't cached, the least recently used one. Returns -1 if a dirty line can't be written */
+int tnfs_block_claim(struct tnfs_blockdev* b, uint32_t sector)
+{
+    int victim = 0;
+
+    for (int i = 0; i < TNFS_BLOCK_CACHE; i++) {
+        if (!(b->lines[i].flags & TNFS_BLOCK_VALID)) {
+            victim = i;
+            break;
+        }
+        if (b->lines[i].used < b->lines[victim].used)
+            victim = i;
+    }
+
+    /* when a dirty sector has to go, write all of them so they can be combined */
+    if ((b->lines[victim].flags & TNFS_BLOCK_DIRTY) && tnfs_block_flush(b) != 0)
+        return -1;
+
+    b->lines[victim].sector = sector;
+    b->lines[victim].flags = TNFS_BLOCK_VALID;
+    b->lines[victim].used = ++b->clock;
+
+    return victim;
+}
+
+/* Opens a disk image as block device, NULL on failure */
+struct tnfs_blockdev* tnfs_block_open(char* filename, bool readonly)
+{
+    struct tnfs_blockdev* b = NULL;
+    struct fstat st;
+    int handle;
+
+    if (!tnfs_blockdevs_initialized) {
+        for (int i = 0; i < TNFS_MAX_BLOCKDEVS; i++)
+            tnfs_blockdevs[i].handle = -1;
+        tnfs_blockdevs_initialized = true;
+    }
+
+    for (int i = 0; b == NULL && i < TNFS_MAX_BLOCKDEVS; i++) {
+        if (tnfs_blockdevs[i].handle < 0)
+            b = &tnfs_blockdevs[i];
+    }
+    if (b == NULL || tnfs_stat(filename, &st) != 0)
+        return NULL;
+
+    handle = tnfs_open(filename, readonly ? TNFS_O_RDONLY : TNFS_O_RDWR, 0);
+    if (handle < 0)
+        return NULL;
+
+    memset(b, 0, sizeof(struct tnfs_blockdev));
+    b->handle = handle;
+    b->readonly = readonly;
+    b->size = st.size;
+    b->sectors = st.size / TNFS_BLOCK_SECTOR;
+
+    /* the end of a file that isn't a whole disk image can be read, past the end it reads as zeros */
+    if (readonly && st.size % TNFS_BLOCK_SECTOR != 0)
+        b->sectors++;
+    b->next = TNFS_BLOCK_UNKNOWN;
+
+    return b;
+}
+
+/* Writes the dirty sectors and closes the block device */
+int tnfs_block_close(struct tnfs_blockdev* b)
+{
+    int code = tnfs_block_flush(b);
+    int closed = tnfs_close(b->handle);
+
+    b->handle = -1;
+
+    return code != 0 ? code : closed;
+}
+
+/* Reads count sectors, returns 0 or a negative error code */
+int tnfs_block_read(struct tnfs_blockdev* b, uint32_t sector, uint16_t count, char* data)
+{
+    int lines[TNFS_BLOCK_RUN];
+    uint16_t run;
+    int line;
+    int code = 0;
+
+    if (!tnfs_block_fits(sector, count) || sector + count > b->sectors)
+        return -TNFS_EINVAL;
+
+    for (uint16_t i = 0; i < count; i += run) {
+        line = tnfs_block_find(b, sector + i);
+        if (line >= 0) {
+            b->lines[line].used = ++b->clock;
+            memcpy(&data[i * TNFS_BLOCK_SECTOR], b->data[line], TNFS_BLOCK_SECTOR);
+            b->hits++;
+            run = 1;
+            continue;
+        }
+
+        /* the sectors that are missing, continued with read-ahead when the access is sequential */
+        uint32_t limit = b->next == sector ? count - i + TNFS_BLOCK_READAHEAD : count - i;
+        if (limit > TNFS_BLOCK_RUN)
+            limit = TNFS_BLOCK_RUN;
+        if (limit > b->sectors - sector - i)
+            limit = b->sectors - sector - i;
+        for (run = 1; run < limit && tnfs_block_find(b, sector + i + run) < 0; run++);
+
+        /* claim the lines first, a dirty line that has to go is written with the same buffer that the read uses */
+        for (uint16_t j = 0; j < run; j++) {
+            lines[j] = tnfs_block_claim(b, sector + i + j);
+            if (lines[j] < 0)
+                code = -TNFS_EIO;
+        }
+
+        if (code == 0)
+            code = tnfs_block_fetch(b, sector + i, run);
+        if (code != 0) {
+            for (uint16_t j = 0; j < run; j++) {
+                if (lines[j] >= 0)
+                    b->lines[lines[j]].flags = 0;
+            }
+            return code;
+        }
+
+        for (uint16_t j = 0; j < run; j++)
+            memcpy(b->data[lines[j]], &tnfs_block_run[j * TNFS_BLOCK_SECTOR], TNFS_BLOCK_SECTOR);
+        b->misses += run;
+
+        /* only the asked sectors go to the caller, the rest stays in the cache */
+        if (run > count - i)
+            run = count - i;
+        memcpy(&data[i * TNFS_BLOCK_SECTOR], tnfs_block_run, run * TNFS_BLOCK_SECTOR);
+    }
+
+    b->next = sector + count;
+
+    return 0;
+}
+
+/* Writes count sectors into the cache, they reach the server later. Returns 0 or a negative error code */
+int tnfs_block_write(struct tnfs_blockdev* b, uint32_t sector, uint16_t count, const char* data)
+{
+    int line;
+
+    if (b->readonly)
+        return -TNFS_EROFS;
+    if (!tnfs_block_fits(sector, count))
+        return -TNFS_EINVAL;
+
+    for (uint16_t i = 0; i < count; i++) {
+        line = tnfs_block_find(b, sector + i);
+        if (line < 0)
+            line = tnfs_block_claim(b, sector + i);
+        if (line < 0)
+            return -TNFS_EIO;
+
+        memcpy(b->data[line], &data[i * TNFS_BLOCK_SECTOR], TNFS_BLOCK_SECTOR);
+        b->lines[line].used = ++b->clock;
+        if (!(b->lines[line].flags & TNFS_BLOCK_DIRTY)) {
+            b->lines[line].flags |= TNFS_BLOCK_DIRTY;
+            b->dirty++;
+        }
+    }
+
+    /* writing past the end grows the image */
+    if (sector + count > b->sectors)
+        b->sectors = sector + count;
+
+    return 0;
+}
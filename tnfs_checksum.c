@@ -0,0 +1,471 @@
+#include "include/tnfs_checksum.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <nmmintrin.h>
+#define TNFS_CRC32C_SSE42
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define TNFS_CRC32C_ARMV8
+#endif
+
+#if TNFS_USE_METRICS	// left out by the footprint profile, see tnfs_config.h
+
+/*
+ * Checksums: after tnfs_checksum_start() every tnfs_read() and tnfs_write() on the handle adds its data to a CRC-32C
+ * and/or xxHash64 digest while the data is still in the cache, so verifying a transfer needs no second pass over the
+ * file. The digest is only valid when the data went through in one sequential pass, a seek in between is noticed
+ * from the file position. tnfs_checksum_verify() compares the digest with a checksum file on the server.
+ */
+
+#define TNFS_XXH_P1 11400714785074694791ULL
+#define TNFS_XXH_P2 14029467366897019727ULL
+#define TNFS_XXH_P3 1609587929392839161ULL
+#define TNFS_XXH_P4 9650029242287828579ULL
+#define TNFS_XXH_P5 2870177450012600261ULL
+
+/* checksum global variables */
+struct tnfs_checksum tnfs_checksums[TNFS_MAX_HANDLES];	// digest of each file handle
+bool     tnfs_checksum_used = false;			// true once a checksum was started, until then the hooks cost one test
+uint32_t tnfs_crc32c_table[8][256];			// tables of the portable CRC-32C, slicing by 8
+bool     tnfs_crc32c_ready = false;			// true once the tables are filled
+int      tnfs_crc32c_hardware = -1;			// 1 with the CRC instructions, 0 with the tables, -1 until asked
+
+
+/* builds the tables of the portable CRC-32C */
+void tnfs_crc32c_init()
+{
+    uint32_t crc;
+
+    for (int i = 0; i < 256; i++) {
+        crc = i;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0x82F63B78 & -(crc & 1));
+        tnfs_crc32c_table[0][i] = crc;
+    }
+    for (int i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++)
+            tnfs_crc32c_table[t][i] = (tnfs_crc32c_table[t - 1][i] >> 8) ^ tnfs_crc32c_table[0][tnfs_crc32c_table[t - 1][i] & 0xFF];
+    }
+
+    tnfs_crc32c_ready = true;
+}
+
+/* portable CRC-32C over the inverted crc, eight bytes per step */
+uint32_t tnfs_crc32c_portable(uint32_t crc, const uint8_t* p, size_t length)
+{
+    uint32_t lo, hi;
+
+    if (!tnfs_crc32c_ready)
+        tnfs_crc32c_init();
+
+    while (length >= 8) {
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = tnfs_crc32c_table[7][lo & 0xFF] ^ tnfs_crc32c_table[6][(lo >> 8) & 0xFF]
+            ^ tnfs_crc32c_table[5][(lo >> 16) & 0xFF] ^ tnfs_crc32c_table[4][lo >> 24]
+            ^ tnfs_crc32c_table[3][hi & 0xFF] ^ tnfs_crc32c_table[2][(hi >> 8) & 0xFF]
+            ^ tnfs_crc32c_table[1][(hi >> 16) & 0xFF] ^ tnfs_crc32c_table[0][hi >> 24];
+        p += 8;
+        length -= 8;
+    }
+    while (length-- > 0)
+        crc = (crc >> 8) ^ tnfs_crc32c_table[0][(crc ^ *p++) & 0xFF];
+
+    return crc;
+}
+
+#ifdef TNFS_CRC32C_SSE42
+/* CRC-32C over the inverted crc with the crc32 instruction of SSE4.2 */
+__attribute__((target("sse4.2")))
+uint32_t tnfs_crc32c_sse42(uint32_t crc, const uint8_t* p, size_t length)
+{
+#ifdef __x86_64__
+    uint64_t crc64 = crc;
+    uint64_t word;
+
+    while (length >= 8) {
+        memcpy(&word, p, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        p += 8;
+        length -= 8;
+    }
+    crc = (uint32_t)crc64;
+#endif
+    while (length-- > 0)
+        crc = _mm_crc32_u8(crc, *p++);
+
+    return crc;
+}
+#endif
+
+#ifdef TNFS_CRC32C_ARMV8
+/* CRC-32C over the inverted crc with the CRC32 instructions of ARMv8 */
+uint32_t tnfs_crc32c_armv8(uint32_t crc, const uint8_t* p, size_t length)
+{
+    uint64_t word;
+
+    while (length >= 8) {
+        memcpy(&word, p, 8);
+        crc = __crc32cd(crc, word);
+        p += 8;
+        length -= 8;
+    }
+    while (length-- > 0)
+        crc = __crc32cb(crc, *p++);
+
+    return crc;
+}
+#endif
+
+/* Continues a CRC-32C, start with crc 0. Uses the CRC instructions of the processor when it has them */
+uint32_t tnfs_crc32c(uint32_t crc, const void* data, size_t length)
+{
+#if defined(TNFS_CRC32C_SSE42)
+    if (tnfs_crc32c_hardware < 0)
+        tnfs_crc32c_hardware = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+    if (tnfs_crc32c_hardware)
+        return ~tnfs_crc32c_sse42(~crc, data, length);
+#elif defined(TNFS_CRC32C_ARMV8)
+    if (tnfs_crc32c_hardware != 0)
+        return ~tnfs_crc32c_armv8(~crc, data, length);
+#endif
+
+    return ~tnfs_crc32c_portable(~crc, data, length);
+}
+
+/* xxHash64 round of one accumulator */
+uint64_t tnfs_xxh64_round(uint64_t acc, uint64_t input)
+{
+    acc += input * TNFS_XXH_P2;
+    acc = (acc << 31) | (acc >> 33);
+
+    return acc * TNFS_XXH_P1;
+}
+
+/* xxHash64 merge of an accumulator into the hash */
+uint64_t tnfs_xxh64_merge(uint64_t hash, uint64_t acc)
+{
+    hash ^= tnfs_xxh64_round(0, acc);
+
+    return hash * TNFS_XXH_P1 + TNFS_XXH_P4;
+}
+
+/* starts an xxHash64 */
+void tnfs_xxh64_reset(struct tnfs_checksum* c, uint64_t seed)
+{
+    c->acc[0] = seed + TNFS_XXH_P1 + TNFS_XXH_P2;
+    c->acc[1] = seed + TNFS_XXH_P2;
+    c->acc[2] = seed;
+    c->acc[3] = seed - TNFS_XXH_P1;
+    c->total = 0;
+    c->buffered = 0;
+}
+
+/* adds 32 byte stripes to an xxHash64 */
+void tnfs_xxh64_stripes(struct tnfs_checksum* c, const uint8_t* p, size_t count)
+{
+    uint64_t lane[4];
+
+    while (count-- > 0) {
+        memcpy(lane, p, 32);
+        c->acc[0] = tnfs_xxh64_round(c->acc[0], lane[0]);
+        c->acc[1] = tnfs_xxh64_round(c->acc[1], lane[1]);
+        c->acc[2] = tnfs_xxh64_round(c->acc[2], lane[2]);
+        c->acc[3] = tnfs_xxh64_round(c->acc[3], lane[3]);
+        p += 32;
+    }
+}
+
+/* adds data to an xxHash64 */
+void tnfs_xxh64_update(struct tnfs_checksum* c, const uint8_t* p, size_t length)
+{
+    size_t n;
+
+    c->total += length;
+
+    if (c->buffered > 0) {
+        n = 32 - c->buffered;
+        if (n > length)
+            n = length;
+        memcpy(&c->stripe[c->buffered], p, n);
+        c->buffered += n;
+        p += n;
+        length -= n;
+        if (c->buffered < 32)
+            return;
+        tnfs_xxh64_stripes(c, c->stripe, 1);
+        c->buffered = 0;
+    }
+
+    tnfs_xxh64_stripes(c, p, length / 32);
+    p += length & ~(size_t)31;
+    length &= 31;
+
+    memcpy(c->stripe, p, length);
+    c->buffered = length;
+}
+
+/* returns the xxHash64 of the data so far */
+uint64_t tnfs_xxh64_digest(struct tnfs_checksum* c)
+{
+    const uint8_t* p = c->stripe;
+    uint8_t left = c->buffered;
+    uint64_t hash, k;
+    uint32_t k32;
+
+    if (c->total >= 32) {
+        hash = ((c->acc[0] << 1) | (c->acc[0] >> 63)) + ((c->acc[1] << 7) | (c->acc[1] >> 57))
+             + ((c->acc[2] << 12) | (c->acc[2] >> 52)) + ((c->acc[3] << 18) | (c->acc[3] >> 46));
+        for (int i = 0; i < 4; i++)
+            hash = tnfs_xxh64_merge(hash, c->acc[i]);
+    } else {
+        hash = c->acc[2] + TNFS_XXH_P5;
+    }
+    hash += c->total;
+
+    for (; left >= 8; left -= 8, p += 8) {
+        memcpy(&k, p, 8);
+        hash ^= tnfs_xxh64_round(0, k);
+        hash = ((hash << 27) | (hash >> 37)) * TNFS_XXH_P1 + TNFS_XXH_P4;
+    }
+    if (left >= 4) {
+        memcpy(&k32, p, 4);
+        hash ^= (uint64_t)k32 * TNFS_XXH_P1;
+        hash = ((hash << 23) | (hash >> 41)) * TNFS_XXH_P2 + TNFS_XXH_P3;
+        left -= 4;
+        p += 4;
+    }
+    for (; left > 0; left--, p++) {
+        hash ^= *p * TNFS_XXH_P5;
+        hash = ((hash << 11) | (hash >> 53)) * TNFS_XXH_P1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= TNFS_XXH_P2;
+    hash ^= hash >> 29;
+    hash *= TNFS_XXH_P3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+/* Returns the xxHash64 of a block of data */
+uint64_t tnfs_xxh64(const void* data, size_t length, uint64_t seed)
+{
+    struct tnfs_checksum c;
+
+    tnfs_xxh64_reset(&c, seed);
+    tnfs_xxh64_update(&c, data, length);
+
+    return tnfs_xxh64_digest(&c);
+}
+
+/* adds the data that was read from or written to a file at position, called by tnfs_read() and tnfs_write() */
+void tnfs_checksum_update(uint8_t handle, uint32_t position, const char* data, uint16_t length)
+{
+    struct tnfs_checksum* c;
+
+    if (handle >= TNFS_MAX_HANDLES)
+        return;
+    c = &tnfs_checksums[handle];
+    if (!c->active || !c->sequential)
+        return;
+
+    if (position != c->position) {
+        c->sequential = false;
+        return;
+    }
+
+    if (c->algorithms & TNFS_CHECKSUM_CRC32C)
+        c->crc = tnfs_crc32c(c->crc, data, length);
+    if (c->algorithms & TNFS_CHECKSUM_XXH64)
+        tnfs_xxh64_update(c, (const uint8_t*)data, length);
+    c->position += length;
+}
+
+/* returns where the file name starts in a path of length bytes, behind its directories */
+size_t tnfs_checksum_base(const char* path, size_t length)
+{
+    size_t start = length;
+
+    while (start > 0 && path[start - 1] != '/' && path[start - 1] != '\\')
+        start--;
+
+    return start;
+}
+
+/* stops adding data when the file is closed, the result stays available */
+void tnfs_checksum_close(uint8_t handle)
+{
+    if (handle < TNFS_MAX_HANDLES)
+        tnfs_checksums[handle].active = false;
+}
+
+/* Starts a digest of everything that is read from or written to an open file from its current position on */
+int tnfs_checksum_start(uint8_t handle, uint8_t algorithms)
+{
+    struct tnfs_checksum* c;
+    const char* path;
+    uint32_t position;
+    int code = tnfs_tell(handle, &position);
+
+    if (code != 0)
+        return code;
+    if (algorithms == 0 || (algorithms & ~(TNFS_CHECKSUM_CRC32C | TNFS_CHECKSUM_XXH64)))
+        return -TNFS_EINVAL;
+
+    c = &tnfs_checksums[handle];
+    memset(c, 0, sizeof(struct tnfs_checksum));
+    c->algorithms = algorithms;
+    c->active = true;
+    c->sequential = true;
+    c->position = position;
+    path = tnfs_getPath(handle);
+    strcpy(c->name, &path[tnfs_checksum_base(path, strlen(path))]);
+    tnfs_xxh64_reset(c, 0);
+    tnfs_checksum_used = true;
+
+    return 0;
+}
+
+/* Returns the digests so far, also after the file was closed. -TNFS_ESPIPE when a seek broke the sequence */
+int tnfs_checksum_result(uint8_t handle, uint32_t* crc32c, uint64_t* xxh64)
+{
+    struct tnfs_checksum* c;
+
+    if (handle >= TNFS_MAX_HANDLES || tnfs_checksums[handle].algorithms == 0)
+        return -TNFS_EBADF;
+    c = &tnfs_checksums[handle];
+    if (!c->sequential)
+        return -TNFS_ESPIPE;
+
+    if (crc32c != NULL)
+        *crc32c = c->crc;
+    if (xxh64 != NULL)
+        *xxh64 = tnfs_xxh64_digest(c);
+
+    return 0;
+}
+
+/* returns the length of a digest word of 8 or 16 hexadecimal digits at p, otherwise 0 */
+int tnfs_checksum_digits(const char* p, int length)
+{
+    int digits = strspn(p, "0123456789abcdefABCDEF");
+
+    return (digits == 8 || digits == 16) && digits == length ? digits : 0;
+}
+
+/*
+ * compares the digests on one line of a checksum file when the line names this file, or no file at all like a file
+ * that only holds a digest. Returns the amount of digests compared or -TNFS_EIO when one differs
+ */
+int tnfs_checksum_line(struct tnfs_checksum* c, const char* line, uint32_t crc, uint64_t xxh)
+{
+    bool named = false;
+    bool matched = false;
+    int compared = 0;
+    int length, digits, start, end;
+    uint64_t value;
+
+    /* the names, like "image.st", "*image.st" in binary mode or "(image.st)" of the BSD style */
+    for (const char* p = line; *(p += strspn(p, " \t\r")) != 0; p += length) {
+        length = strcspn(p, " \t\r");
+        if (tnfs_checksum_digits(p, length) == 0) {
+            start = strspn(p, "*(");
+            start = start < length ? start : length;
+            end = length - (p[length - 1] == ')' && start < length);
+            start += tnfs_checksum_base(p + start, end - start);
+            named = true;
+            matched = matched || ((size_t)(end - start) == strlen(c->name) && memcmp(p + start, c->name, end - start) == 0);
+        }
+    }
+    if (named && !matched)
+        return 0;
+
+    for (const char* p = line; *(p += strspn(p, " \t\r")) != 0; p += length) {
+        length = strcspn(p, " \t\r");
+        digits = tnfs_checksum_digits(p, length);
+        value = strtoull(p, NULL, 16);
+        if (digits == 8 && (c->algorithms & TNFS_CHECKSUM_CRC32C)) {
+            if (value != crc)
+                return -TNFS_EIO;
+            compared++;
+        }
+        if (digits == 16 && (c->algorithms & TNFS_CHECKSUM_XXH64)) {
+            if (value != xxh)
+                return -TNFS_EIO;
+            compared++;
+        }
+    }
+
+    return compared;
+}
+
+/*
+ * Compares the digests with a checksum file on the server that holds them as hexadecimal text, 8 digits for a
+ * CRC-32C and 16 digits for an xxHash64. Each line gives the digests of the file it names (like "e3069283  image.st"),
+ * or of any file when it names none. Returns 0 when every digest of this file that was computed matches, -TNFS_EIO
+ * when one differs and -TNFS_ENODATA when the checksum file has none of them.
+ */
+int tnfs_checksum_verify(uint8_t handle, char* sidecar)
+{
+    char text[TNFS_BLOCKSIZE + 1];
+    char* line;
+    char* newline;
+    uint32_t crc;
+    uint64_t xxh;
+    int compared = 0;
+    int kept = 0;
+    int length;
+    int result = 0;
+    bool eof = false;
+    int code = tnfs_checksum_result(handle, &crc, &xxh);
+    int file;
+
+    if (code != 0)
+        return code;
+
+    file = tnfs_open(sidecar, TNFS_O_RDONLY, 0);
+    if (file < 0)
+        return file;
+
+    /* the file is read in blocks, a line that continues in the next block is moved to the front */
+    while (!eof && result >= 0) {
+        code = tnfs_read(&text[kept], file, TNFS_BLOCKSIZE - kept);
+        if (code < 0 && code != -TNFS_EOF) {
+            result = code;
+            break;
+        }
+        eof = code <= 0;	// a server that answers with no data and no EOF would be asked forever
+        length = kept + (code > 0 ? code : 0);
+        text[length] = 0;
+
+        for (line = text; result >= 0 && (newline = strchr(line, '\n')) != NULL; line = newline + 1) {
+            *newline = 0;
+            result = tnfs_checksum_line(&tnfs_checksums[handle], line, crc, xxh);
+            compared += result;
+        }
+
+        /* the last line without a newline, and a line longer than the block that is cut */
+        kept = length - (line - text);
+        if (result >= 0 && kept > 0 && (eof || kept == TNFS_BLOCKSIZE)) {
+            result = tnfs_checksum_line(&tnfs_checksums[handle], line, crc, xxh);
+            compared += result;
+            kept = 0;
+        }
+        memmove(text, line, kept);
+    }
+    tnfs_close(file);
+
+#ifdef DEBUG
+    printf("checksum: crc32c %08x xxh64 %016llx, %d compared with %s\n\n", crc, (unsigned long long)xxh, compared, sidecar);
+#endif
+
+    if (result < 0)
+        return result;
+
+    return compared > 0 ? 0 : -TNFS_ENODATA;
+}
+
+#endif /* TNFS_USE_METRICS */
@@ -0,0 +1,167 @@
+#include "include/tnfs_find.h"
+
+#if TNFS_USE_PIPELINE	// left out by the footprint profile, see tnfs_config.h
+
+/*
+ * Recursive find: every directory is listed with OPENDIRX and the pattern, so the server leaves out the files that
+ * don't match. Without TNFS_DIROPT_DIR_PATTERN the pattern doesn't apply to directories, which means the same
+ * listing also names every subdirectory to descend into and no second pass is needed. The directories that are
+ * waiting are opened TNFS_FIND_PARALLEL at a time with one burst of requests, and each listing sends its next READDIRX
+ * ahead while the entries of the current one are handled.
+ */
+
+/* directories that still have to be searched, first in first out */
+struct tnfs_find_queue {
+    char**   paths;
+    uint32_t head;	// next directory to search
+    uint32_t count;	// directories added
+    uint32_t capacity;
+};
+
+
+/* adds a directory to the queue, returns false when out of memory */
+bool tnfs_find_push(struct tnfs_find_queue* q, const char* path)
+{
+    char** grown;
+
+    if (q->count == q->capacity) {
+        grown = realloc(q->paths, (q->capacity * 2 + 16) * sizeof(char*));
+        if (grown == NULL)
+            return false;
+        q->paths = grown;
+        q->capacity = q->capacity * 2 + 16;
+    }
+
+    q->paths[q->count] = malloc(strlen(path) + 1);
+    if (q->paths[q->count] == NULL)
+        return false;
+    strcpy(q->paths[q->count++], path);
+
+    return true;
+}
+
+/* builds the path of an entry in a directory, returns false when it is too long */
+bool tnfs_find_join(char* dest, const char* dir, const char* name)
+{
+    size_t length = strlen(dir);
+    bool slash = length > 0 && dir[length - 1] == '/';
+
+    if (length + strlen(name) + (slash ? 1 : 2) > TNFS_MAX_PATH_LEN)
+        return false;
+
+    sprintf(dest, slash ? "%s%s" : "%s/%s", dir, name);
+
+    return true;
+}
+
+/* lists one open directory: reports the matching files and queues the subdirectories. Returns false to stop */
+bool tnfs_find_list(struct dirx_data* data, const char* dir, tnfs_find_callback found, void* user,
+                    struct tnfs_find_queue* q, char* batches, struct tnfs_find_result* result, int* code)
+{
+    char path[TNFS_MAX_PATH_LEN];
+    struct dirx_item item;
+    bool fetch;
+    int next;
+
+    tnfs_prefetchdirx(data, batches, TNFS_BUFFERSIZE);
+
+    while (true) {
+        /* the next response is fetched once the entries of the current one are used up */
+        fetch = data->entry >= data->count && data->status != TNFS_DIRSTATUS_EOF;
+        next = tnfs_nextdirx(data, &item);
+        if (fetch && next == 0)
+            result->bytes += 9;	// header of a READDIRX response
+        else if (fetch && next == TNFS_EOF)
+            result->bytes += 5;	// a response that only says the listing ended
+        if (next != 0)
+            break;
+
+        result->bytes += strlen(item.name) + 14;
+        result->entries++;
+
+        if (strcmp(item.name, ".") == 0 || strcmp(item.name, "..") == 0)
+            continue;
+        if (!tnfs_find_join(path, dir, item.name)) {
+            result->failed++;
+            continue;
+        }
+
+        if (item.flags & TNFS_DIRENTRY_DIR) {
+            if (!tnfs_find_push(q, path)) {
+                *code = -TNFS_ENOMEM;
+                return false;
+            }
+        } else {
+            result->matches++;
+            if (!found(path, &item, user))
+                return false;
+        }
+    }
+
+    if (next != TNFS_EOF)
+        result->failed++;
+
+    return true;
+}
+
+/*
+ * Finds the files that match a pattern, like "*.ST", in root and all directories below it. diropts can add
+ * TNFS_DIROPT_NO_SKIPHIDDEN and TNFS_DIROPT_NO_SKIPSPECIAL. Returns 0, also when the callback stopped the search, or a
+ * negative error code when root could not be searched. Directories below root that failed are counted in the result.
+ */
+int tnfs_find(char* root, char* pattern, uint8_t diropts, tnfs_find_callback found, void* user, struct tnfs_find_result* result)
+{
+    struct tnfs_find_queue q;
+    struct dirx_data data[TNFS_FIND_PARALLEL];
+    int results[TNFS_FIND_PARALLEL];
+    char* batches = malloc(2 * TNFS_BUFFERSIZE);
+    bool searching = true;
+    int code = 0;
+    int n;
+
+    memset(&q, 0, sizeof(q));
+    memset(result, 0, sizeof(struct tnfs_find_result));
+
+    /* the pattern must not hide the directories to descend into */
+    diropts = (diropts & ~TNFS_DIROPT_DIR_PATTERN) | TNFS_DIROPT_NO_FOLDERSFIRST;
+
+    if (batches == NULL || !tnfs_find_push(&q, root))
+        code = -TNFS_ENOMEM;
+
+    while (code == 0 && searching && q.head < q.count) {
+        n = q.count - q.head < TNFS_FIND_PARALLEL ? q.count - q.head : TNFS_FIND_PARALLEL;
+        tnfs_opendirxv(&q.paths[q.head], pattern, diropts, TNFS_DIRSORT_NONE, data, results, n);
+
+        for (int i = 0; i < n; i++) {
+            if (results[i] != 0) {
+                if (q.head + i == 0)
+                    code = results[i];
+                result->failed++;
+                continue;
+            }
+            result->dirs++;
+
+            if (searching)
+                searching = tnfs_find_list(&data[i], q.paths[q.head + i], found, user, &q, batches, result, &code);
+            tnfs_closedir(data[i].handle);
+        }
+
+        for (int i = 0; i < n; i++)
+            free(q.paths[q.head + i]);
+        q.head += n;
+    }
+
+#ifdef DEBUG
+    printf("find: %u matches in %u dirs, %u entries (%u bytes) received, %u failed\n\n",
+           result->matches, result->dirs, result->entries, result->bytes, result->failed);
+#endif
+
+    while (q.head < q.count)
+        free(q.paths[q.head++]);
+    free(q.paths);
+    free(batches);
+
+    return code;
+}
+
+#endif /* TNFS_USE_PIPELINE */
@@ -0,0 +1,738 @@
+#include "include/tnfs_journal.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#define tnfs_local_mkdir(path) _mkdir(path)
+#define tnfs_local_rmdir(path) _rmdir(path)
+#define tnfs_local_truncate(f, size) _chsize(_fileno(f), size)
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#define tnfs_local_mkdir(path) mkdir(path, 0755)
+#define tnfs_local_rmdir(path) rmdir(path)
+#define tnfs_local_truncate(f, size) ftruncate(fileno(f), size)
+#endif
+
+#if TNFS_USE_JOURNAL	// left out by the footprint profile, see tnfs_config.h
+
+/*
+ * Write-back journal: while the server can't be reached, writes, mkdir, rmdir, unlink and rename are appended to a
+ * local journal file and applied to a local overlay directory, so the application keeps working. Once the server
+ * responds again tnfs_journal_replay() sends the journal to the server, entries whose file changed on the server in
+ * the meantime (a different modification time) are moved to a conflicts file instead of overwriting that change.
+ */
+
+#define TNFS_JOURNAL_CONFLICT 1		// tnfs_journal_apply() result: the server copy changed meanwhile
+
+/* the overlay copy of a file, with the ranges of the file it holds */
+struct tnfs_journal_copy {
+    bool     used;
+    uint8_t  refs;			// open handles that seeded the copy
+    uint8_t  count;			// ranges in start and end
+    uint32_t hash;			// tnfs_journal_hash() of the path
+    char     path[TNFS_MAX_PATH_LEN];	// the file, paths with the same hash are told apart by it
+    uint32_t size;			// size of the file, TNFS_JOURNAL_UNKNOWN when it isn't known
+    uint32_t start[TNFS_JOURNAL_EXTENTS];
+    uint32_t end[TNFS_JOURNAL_EXTENTS];	// first byte after each range
+};
+
+/* a file whose modification time was compared during a replay */
+struct tnfs_journal_checked {
+    uint32_t hash;			// tnfs_journal_hash() of the path
+    char     path[TNFS_MAX_PATH_LEN];
+};
+
+/* journal global variables */
+char     tnfs_journal_file[TNFS_MAX_PATH_LEN];		// journal file given to tnfs_journal_open()
+char     tnfs_journal_overlay[TNFS_MAX_PATH_LEN];	// overlay directory given to tnfs_journal_open()
+bool     tnfs_journal_enabled = false;			// true between tnfs_journal_open() and tnfs_journal_close()
+bool     tnfs_journal_replaying = false;		// true while tnfs_journal_replay() is busy
+uint32_t tnfs_journal_entries = 0;			// entries waiting in the journal file and the tail
+uint32_t tnfs_journal_probe = 0;			// netw_millis() of the last attempt to reach the server
+struct tnfs_journal_entry tnfs_journal_tail;		// last write, kept in memory to merge it with the next one
+bool     tnfs_journal_hasTail = false;			// true when tnfs_journal_tail holds a write
+char     tnfs_journal_data[TNFS_BUFFERSIZE];		// data of the tail, during a replay the data of each entry
+struct tnfs_journal_copy tnfs_journal_copies[TNFS_JOURNAL_COPIES];	// files with a copy in the overlay
+struct tnfs_journal_checked tnfs_journal_checked[TNFS_JOURNAL_CHECKED];	// files compared during the current replay
+
+
+/* returns true when mutations may go to the journal, which is never the case during a replay */
+bool tnfs_journal_active()
+{
+    return tnfs_journal_enabled && !tnfs_journal_replaying;
+}
+
+/* returns true when it's time to try the server again */
+bool tnfs_journal_due()
+{
+    uint32_t now = netw_millis();
+
+    if (now - tnfs_journal_probe < TNFS_JOURNAL_PROBE_MS)
+        return false;
+
+    tnfs_journal_probe = now;
+    return true;
+}
+
+/* returns the amount of mutations that still have to be sent to the server */
+uint32_t tnfs_journal_pending()
+{
+    return tnfs_journal_entries;
+}
+
+/* small hash to find the overlay copy of a file, or a file that was compared during a replay, before comparing paths */
+uint32_t tnfs_journal_hash(const char* path)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*path)
+        hash = (hash ^ (uint8_t)*path++) * 16777619u;
+
+    return hash;
+}
+
+/* writes one entry and its data */
+bool tnfs_journal_write(FILE* f, struct tnfs_journal_entry* e, const char* data)
+{
+    uint16_t len1 = strlen(e->path);
+    uint16_t len2 = strlen(e->path2);
+
+    fwrite(&e->op, 1, 1, f);
+    fwrite(&e->flags, 2, 1, f);
+    fwrite(&e->mode, 2, 1, f);
+    fwrite(&e->length, 2, 1, f);
+    fwrite(&e->offset, 4, 1, f);
+    fwrite(&e->mtime, 4, 1, f);
+    fwrite(&len1, 2, 1, f);
+    fwrite(&len2, 2, 1, f);
+    fwrite(e->path, 1, len1, f);
+    fwrite(e->path2, 1, len2, f);
+
+    return fwrite(data, 1, e->length, f) == e->length;
+}
+
+/* reads one entry, its data goes to data which must hold TNFS_BUFFERSIZE bytes, NULL skips the data */
+bool tnfs_journal_readEntry(FILE* f, struct tnfs_journal_entry* e, char* data)
+{
+    uint16_t len1, len2;
+
+    memset(e, 0, sizeof(struct tnfs_journal_entry));
+
+    return fread(&e->op, 1, 1, f) == 1 && fread(&e->flags, 2, 1, f) == 1 && fread(&e->mode, 2, 1, f) == 1
+        && fread(&e->length, 2, 1, f) == 1 && fread(&e->offset, 4, 1, f) == 1 && fread(&e->mtime, 4, 1, f) == 1
+        && fread(&len1, 2, 1, f) == 1 && fread(&len2, 2, 1, f) == 1
+        && len1 < TNFS_MAX_PATH_LEN && len2 < TNFS_MAX_PATH_LEN && e->length <= TNFS_BUFFERSIZE
+        && fread(e->path, 1, len1, f) == len1 && fread(e->path2, 1, len2, f) == len2
+        && (data != NULL ? fread(data, 1, e->length, f) == e->length : fseek(f, e->length, SEEK_CUR) == 0);
+}
+
+/* appends one entry to a journal or conflicts file */
+int tnfs_journal_append(const char* filename, struct tnfs_journal_entry* e, const char* data)
+{
+    FILE* f = fopen(filename, "ab");
+    bool ok;
+
+    if (f == NULL)
+        return -TNFS_EIO;
+
+    ok = tnfs_journal_write(f, e, data);
+    if (fclose(f) != 0 || !ok)
+        return -TNFS_EIO;
+
+    return 0;
+}
+
+/* writes the tail to the journal file */
+int tnfs_journal_flush()
+{
+    if (!tnfs_journal_hasTail)
+        return 0;
+
+    tnfs_journal_hasTail = false;
+
+    return tnfs_journal_append(tnfs_journal_file, &tnfs_journal_tail, tnfs_journal_data);
+}
+
+/* builds the path of a file in the overlay directory, creating the directories in between */
+void tnfs_journal_local(char* dest, const char* path, bool parents)
+{
+    size_t base;
+
+    while (*path == '/')
+        path++;
+
+    snprintf(dest, TNFS_MAX_PATH_LEN * 2, "%s/%s", tnfs_journal_overlay, path);
+    base = strlen(tnfs_journal_overlay) + 1;
+
+    for (size_t i = base; parents && dest[i] != 0; i++) {
+        if (dest[i] == '/') {
+            dest[i] = 0;
+            tnfs_local_mkdir(dest);
+            dest[i] = '/';
+        }
+    }
+}
+
+/* finds the overlay copy of a path, a new one is made when asked. Returns NULL when there is none or no room */
+struct tnfs_journal_copy* tnfs_journal_copy(const char* path, bool create)
+{
+    struct tnfs_journal_copy* unused = NULL;
+    uint32_t hash = tnfs_journal_hash(path);
+
+    for (int i = 0; i < TNFS_JOURNAL_COPIES; i++) {
+        struct tnfs_journal_copy* c = &tnfs_journal_copies[i];
+
+        if (c->used && c->hash == hash && strcmp(c->path, path) == 0)
+            return c;
+        if (!c->used && unused == NULL)
+            unused = c;
+    }
+
+    if (!create || unused == NULL)
+        return NULL;
+
+    memset(unused, 0, sizeof(struct tnfs_journal_copy));
+    unused->used = true;
+    unused->hash = hash;
+    strcpy(unused->path, path);
+    unused->size = TNFS_JOURNAL_UNKNOWN;
+
+    return unused;
+}
+
+/* removes range i of an overlay copy */
+void tnfs_journal_uncover(struct tnfs_journal_copy* c, int i)
+{
+    c->count--;
+    c->start[i] = c->start[c->count];
+    c->end[i] = c->end[c->count];
+}
+
+/*
+ * adds a range to the ranges an overlay copy holds, the ranges it overlaps or touches become part of it. Without room
+ * the smallest range is forgotten, reading it back while offline fails then
+ */
+void tnfs_journal_cover(struct tnfs_journal_copy* c, uint32_t start, uint32_t end)
+{
+    int i = 0, smallest = 0;
+
+    if (c->size != TNFS_JOURNAL_UNKNOWN && end > c->size)
+        c->size = end;
+    if (start >= end)
+        return;
+
+    while (i < c->count) {
+        if (c->start[i] <= end && start <= c->end[i]) {
+            start = c->start[i] < start ? c->start[i] : start;
+            end = c->end[i] > end ? c->end[i] : end;
+            tnfs_journal_uncover(c, i);
+        } else {
+            i++;
+        }
+    }
+
+    if (c->count == TNFS_JOURNAL_EXTENTS) {
+        for (i = 1; i < c->count; i++) {
+            if (c->end[i] - c->start[i] < c->end[smallest] - c->start[smallest])
+                smallest = i;
+        }
+        if (c->end[smallest] - c->start[smallest] > end - start)
+            return;
+        tnfs_journal_uncover(c, smallest);
+    }
+
+    c->start[c->count] = start;
+    c->end[c->count++] = end;
+}
+
+/* sets the size of the file of an overlay copy, the ranges beyond it are gone */
+void tnfs_journal_resize(struct tnfs_journal_copy* c, uint32_t size)
+{
+    int i = 0;
+
+    c->size = size;
+    while (i < c->count && size != TNFS_JOURNAL_UNKNOWN) {
+        if (c->end[i] > size)
+            c->end[i] = size;
+        if (c->start[i] >= c->end[i])
+            tnfs_journal_uncover(c, i);
+        else
+            i++;
+    }
+}
+
+/* writes data at an offset of the local copy of a file, the copy is created when it doesn't exist */
+bool tnfs_journal_store(const char* local, uint32_t offset, const char* data, uint16_t length)
+{
+    FILE* f = fopen(local, "r+b");
+    bool ok;
+
+    if (f == NULL)
+        f = fopen(local, "w+b");
+    if (f == NULL)
+        return false;
+
+    if (offset == TNFS_JOURNAL_APPEND)
+        fseek(f, 0, SEEK_END);
+    else
+        fseek(f, offset, SEEK_SET);
+    ok = fwrite(data, 1, length, f) == length;
+
+    return fclose(f) == 0 && ok;
+}
+
+/* applies a mutation to the overlay, so the local copy shows what the server will show after the replay */
+void tnfs_journal_overlayApply(struct tnfs_journal_entry* e, const char* data)
+{
+    char local[TNFS_MAX_PATH_LEN * 2];
+    char local2[TNFS_MAX_PATH_LEN * 2];
+    struct tnfs_journal_copy* c = NULL;
+    struct tnfs_journal_copy* c2;
+    uint32_t offset;
+    FILE* f;
+
+    tnfs_journal_local(local, e->path, true);
+    if (e->op == TNFS_JOURNAL_OPEN || e->op == TNFS_JOURNAL_WRITE)
+        c = tnfs_journal_copy(e->path, true);
+
+    switch (e->op) {
+        case TNFS_JOURNAL_OPEN:
+            f = fopen(local, (e->flags & TNFS_O_TRUNC) ? "wb" : "ab");
+            if (f != NULL)
+                fclose(f);
+            if (c != NULL && (e->flags & TNFS_O_TRUNC))
+                tnfs_journal_resize(c, 0);
+            break;
+        case TNFS_JOURNAL_WRITE:
+            /* an append lands at the end of the file on the server, which the copy may not know */
+            offset = e->offset;
+            if (offset == TNFS_JOURNAL_APPEND && c != NULL && c->size != TNFS_JOURNAL_UNKNOWN)
+                offset = c->size;
+            if (tnfs_journal_store(local, offset, data, e->length) && c != NULL && offset != TNFS_JOURNAL_APPEND)
+                tnfs_journal_cover(c, offset, offset + e->length);
+            break;
+        case TNFS_JOURNAL_MKDIR:
+            tnfs_local_mkdir(local);
+            break;
+        case TNFS_JOURNAL_RMDIR:
+            tnfs_local_rmdir(local);
+            break;
+        case TNFS_JOURNAL_UNLINK:
+            remove(local);
+            c = tnfs_journal_copy(e->path, false);
+            if (c != NULL)
+                tnfs_journal_resize(c, 0);
+            break;
+        case TNFS_JOURNAL_RENAME:
+            tnfs_journal_local(local2, e->path2, true);
+            rename(local, local2);
+            c = tnfs_journal_copy(e->path, false);
+            c2 = tnfs_journal_copy(e->path2, false);
+            if (c2 != NULL)
+                tnfs_journal_resize(c2, 0);
+            if (c != NULL && c2 == NULL) {
+                c->hash = tnfs_journal_hash(e->path2);
+                strcpy(c->path, e->path2);
+            }
+            break;
+    }
+}
+
+/* adds a mutation to the journal, a write that continues the previous write of the same file is merged with it */
+int tnfs_journal_add(struct tnfs_journal_entry* e, const char* data)
+{
+    struct tnfs_journal_entry* t = &tnfs_journal_tail;
+    int code;
+
+    if (!tnfs_journal_active())
+        return -TNFS_EINVAL;
+
+    tnfs_journal_overlayApply(e, data);
+
+    if (e->op == TNFS_JOURNAL_WRITE && tnfs_journal_hasTail && strcmp(t->path, e->path) == 0
+     && t->length + e->length <= TNFS_JOURNAL_MERGE
+     && (e->offset == TNFS_JOURNAL_APPEND ? t->offset == TNFS_JOURNAL_APPEND : e->offset == t->offset + t->length)) {
+        memcpy(&tnfs_journal_data[t->length], data, e->length);
+        t->length += e->length;
+        return 0;
+    }
+
+    code = tnfs_journal_flush();
+    if (code != 0)
+        return code;
+
+    tnfs_journal_entries++;
+
+    if (e->op == TNFS_JOURNAL_WRITE && e->length <= TNFS_JOURNAL_MERGE) {
+        memcpy(t, e, sizeof(struct tnfs_journal_entry));
+        memcpy(tnfs_journal_data, data, e->length);
+        tnfs_journal_hasTail = true;
+        return 0;
+    }
+
+    return tnfs_journal_append(tnfs_journal_file, e, data);
+}
+
+/*
+ * reads a file back from its overlay copy while the server is away. Only the ranges that were read or written since
+ * the file was opened are there, anything else fails with -TNFS_EIO
+ */
+int tnfs_journal_read(const char* path, uint32_t offset, char* data, uint16_t maxlen)
+{
+    char local[TNFS_MAX_PATH_LEN * 2];
+    struct tnfs_journal_copy* c = tnfs_journal_copy(path, false);
+    FILE* f;
+    size_t length;
+
+    if (c == NULL)
+        return -TNFS_ENOENT;
+
+    for (int i = 0; i < c->count; i++) {
+        if (offset < c->start[i] || offset >= c->end[i])
+            continue;
+        if (maxlen > c->end[i] - offset)
+            maxlen = c->end[i] - offset;
+
+        tnfs_journal_local(local, path, false);
+        f = fopen(local, "rb");
+        if (f == NULL)
+            return -TNFS_EIO;
+        fseek(f, offset, SEEK_SET);
+        length = fread(data, 1, maxlen, f);
+        fclose(f);
+
+        return length > 0 ? (int)length : -TNFS_EIO;
+    }
+
+    return c->size != TNFS_JOURNAL_UNKNOWN && offset >= c->size ? -TNFS_EOF : -TNFS_EIO;
+}
+
+/* returns true when an entry in the journal names the path */
+bool tnfs_journal_refers(const char* path)
+{
+    struct tnfs_journal_entry e;
+    bool found = tnfs_journal_hasTail && strcmp(tnfs_journal_tail.path, path) == 0;
+    FILE* f = found ? NULL : fopen(tnfs_journal_file, "rb");
+
+    while (f != NULL && !found && tnfs_journal_readEntry(f, &e, NULL))
+        found = strcmp(e.path, path) == 0 || strcmp(e.path2, path) == 0;
+    if (f != NULL)
+        fclose(f);
+
+    return found;
+}
+
+/*
+ * starts the overlay copy of a file that is opened for reading and writing while the journal is open. Nothing is
+ * downloaded: what the handle reads and writes from now on goes into the copy as well (see tnfs_journal_mirror()), so
+ * those ranges can be read back once the server went away. size is the size of the file on the server, or
+ * TNFS_JOURNAL_UNKNOWN. A copy on disk that no handle and no journal entry refers to is stale and starts over
+ */
+void tnfs_journal_seed(const char* path, uint32_t size)
+{
+    char local[TNFS_MAX_PATH_LEN * 2];
+    struct tnfs_journal_copy* c = tnfs_journal_copy(path, false);
+
+    if (c == NULL && !tnfs_journal_refers(path)) {
+        tnfs_journal_local(local, path, false);
+        remove(local);
+    }
+    if (c == NULL)
+        c = tnfs_journal_copy(path, true);
+    if (c == NULL)
+        return;
+
+    c->refs++;
+    if (size != TNFS_JOURNAL_UNKNOWN)
+        tnfs_journal_resize(c, size);
+}
+
+/* writes data that was read from or written to the server into the overlay copy of a file, other files are left alone */
+void tnfs_journal_mirror(const char* path, uint32_t offset, const char* data, uint16_t length)
+{
+    char local[TNFS_MAX_PATH_LEN * 2];
+    struct tnfs_journal_copy* c = tnfs_journal_copy(path, false);
+
+    if (c == NULL || (offset == TNFS_JOURNAL_APPEND && c->size == TNFS_JOURNAL_UNKNOWN))
+        return;
+    if (offset == TNFS_JOURNAL_APPEND)
+        offset = c->size;
+
+    tnfs_journal_local(local, path, true);
+    if (tnfs_journal_store(local, offset, data, length))
+        tnfs_journal_cover(c, offset, offset + length);
+}
+
+/* removes the overlay copy of a path once the server has it, and the directories that became empty */
+void tnfs_journal_purge(const char* path)
+{
+    char local[TNFS_MAX_PATH_LEN * 2];
+    size_t base = strlen(tnfs_journal_overlay);
+    struct tnfs_journal_copy* c;
+    char* slash;
+
+    if (*path == 0)
+        return;
+
+    /* a handle that is still open keeps the copy, it fills again with what the handle reads and writes */
+    c = tnfs_journal_copy(path, false);
+    if (c != NULL && c->refs == 0) {
+        c->used = false;
+    } else if (c != NULL) {
+        c->count = 0;
+        c->size = TNFS_JOURNAL_UNKNOWN;
+    }
+
+    tnfs_journal_local(local, path, false);
+    if (remove(local) != 0)
+        tnfs_local_rmdir(local);
+
+    while ((slash = strrchr(local, '/')) != NULL && (size_t)(slash - local) > base) {
+        *slash = 0;
+        if (tnfs_local_rmdir(local) != 0)
+            break;
+    }
+}
+
+/* a handle that seeded an overlay copy was closed, the last one removes the copy unless the journal still needs it */
+void tnfs_journal_release(const char* path)
+{
+    struct tnfs_journal_copy* c = tnfs_journal_copy(path, false);
+
+    if (c == NULL)
+        return;
+    if (c->refs > 0)
+        c->refs--;
+    if (c->refs == 0 && !tnfs_journal_refers(path))
+        tnfs_journal_purge(path);
+}
+
+/* sends one entry to the server, fh and fpath hold the file that is open for consecutive writes */
+int tnfs_journal_apply(struct tnfs_journal_entry* e, const char* data, int* fh, char* fpath, uint8_t* nchecked)
+{
+    struct fstat st;
+    uint32_t hash;
+    bool compare;
+    int code;
+    bool conflict = false;
+
+    /* anything but a write to the open file closes it */
+    if (*fh >= 0 && (e->op != TNFS_JOURNAL_WRITE || strcmp(fpath, e->path) != 0)) {
+        tnfs_close(*fh);
+        *fh = -1;
+    }
+
+    switch (e->op) {
+        case TNFS_JOURNAL_OPEN:
+            *fh = tnfs_open(e->path, e->flags, e->mode);
+            strcpy(fpath, e->path);
+            return *fh < 0 ? *fh : 0;
+
+        case TNFS_JOURNAL_WRITE:
+            if (*fh < 0) {
+                /* compare the modification time once, our own writes of this replay change it */
+                hash = tnfs_journal_hash(e->path);
+                compare = e->mtime != 0;
+                for (int i = 0; compare && i < *nchecked; i++) {
+                    if (tnfs_journal_checked[i].hash == hash && strcmp(tnfs_journal_checked[i].path, e->path) == 0)
+                        compare = false;
+                }
+                if (compare) {
+                    code = tnfs_stat(e->path, &st);
+                    /* our own online writes after the mtime we know may have moved it up to mode seconds */
+                    conflict = code != 0 || st.mtime < e->mtime || st.mtime - e->mtime > e->mode;
+                    if (*nchecked < TNFS_JOURNAL_CHECKED && !conflict) {
+                        tnfs_journal_checked[*nchecked].hash = hash;
+                        strcpy(tnfs_journal_checked[(*nchecked)++].path, e->path);
+                    }
+                }
+                if (conflict)
+                    return TNFS_JOURNAL_CONFLICT;
+
+                *fh = tnfs_open(e->path, TNFS_O_WRONLY | (e->offset == TNFS_JOURNAL_APPEND ? TNFS_O_APPEND : 0), 0);
+                if (*fh < 0)
+                    return *fh;
+                strcpy(fpath, e->path);
+            }
+            if (e->offset != TNFS_JOURNAL_APPEND) {
+                code = tnfs_lseek(*fh, TNFS_SEEK_SET, e->offset);
+                if (code != 0)
+                    return code;
+            }
+            return tnfs_write((char*)data, *fh, e->length);
+
+        /* a directory or file that is already in the wanted state counts as applied */
+        case TNFS_JOURNAL_MKDIR:
+            code = -tnfs_mkdir(e->path);
+            return code == -TNFS_EEXIST ? 0 : code;
+        case TNFS_JOURNAL_RMDIR:
+            code = -tnfs_rmdir(e->path);
+            return code == -TNFS_ENOENT ? 0 : code;
+        case TNFS_JOURNAL_UNLINK:
+            code = tnfs_unlink(e->path);
+            return code == -TNFS_ENOENT ? 0 : code;
+        case TNFS_JOURNAL_RENAME:
+            code = tnfs_rename(e->path, e->path2);
+            return code == -TNFS_ENOENT ? TNFS_JOURNAL_CONFLICT : code;
+    }
+
+    return -TNFS_EINVAL;
+}
+
+/* moves the rest of the journal from offset to the start of the journal file, the applied entries are dropped */
+int tnfs_journal_keep(FILE* f, long offset)
+{
+    struct tnfs_journal_entry e;
+    FILE* out = fopen(tnfs_journal_file, "r+b");
+    bool ok = out != NULL;
+
+    if (!ok) {
+        fclose(f);
+        return -TNFS_EIO;
+    }
+
+    /* every entry is written before the position it was read from */
+    fseek(f, offset, SEEK_SET);
+    while (ok && tnfs_journal_readEntry(f, &e, tnfs_journal_data))
+        ok = tnfs_journal_write(out, &e, tnfs_journal_data);
+
+    ok = ok && fflush(out) == 0 && tnfs_local_truncate(out, ftell(out)) == 0;
+    fclose(f);
+
+    return fclose(out) == 0 && ok ? 0 : -TNFS_EIO;
+}
+
+/* sends the journal to the server, returns 0 when the journal is empty afterwards, -TNFS_EIO when it can't be shortened */
+int tnfs_journal_replay(struct tnfs_journal_result* result)
+{
+    char conflicts[TNFS_MAX_PATH_LEN + 16];
+    char fpath[TNFS_MAX_PATH_LEN] = "";
+    uint8_t nchecked = 0;
+    struct tnfs_journal_result r;
+    struct tnfs_journal_entry e;
+    long position = 0;
+    bool interrupted = false;
+    bool kept = true;
+    int fh = -1;
+    int code;
+    FILE* f;
+
+    memset(&r, 0, sizeof(r));
+    if (result != NULL)
+        memset(result, 0, sizeof(struct tnfs_journal_result));
+
+    if (!tnfs_journal_active())
+        return -TNFS_EINVAL;
+    if (tnfs_journal_flush() != 0)
+        return -TNFS_EIO;
+
+    f = fopen(tnfs_journal_file, "rb");
+    if (f == NULL) {
+        tnfs_journal_entries = 0;
+        return 0;
+    }
+
+    snprintf(conflicts, sizeof(conflicts), "%s.conflicts", tnfs_journal_file);
+    tnfs_journal_replaying = true;
+    tnfs_journal_probe = netw_millis();
+
+    while (true) {
+        position = ftell(f);
+        if (!tnfs_journal_readEntry(f, &e, tnfs_journal_data))
+            break;
+
+        code = tnfs_journal_apply(&e, tnfs_journal_data, &fh, fpath, &nchecked);
+
+        /* an applied entry is done even when the server goes away right after it, sent again it could append twice */
+        if (code == 0) {
+            r.applied++;
+            continue;
+        }
+
+        /* the server went away again, keep this entry and the rest for the next replay */
+        if (!tnfs_isOnline()) {
+            interrupted = true;
+            break;
+        }
+
+        if (code == TNFS_JOURNAL_CONFLICT)
+            r.conflicts++;
+        else
+            r.failed++;
+        tnfs_journal_append(conflicts, &e, tnfs_journal_data);
+    }
+
+    if (fh >= 0)
+        tnfs_close(fh);
+
+    r.remaining = interrupted ? tnfs_journal_entries - r.applied - r.conflicts - r.failed : 0;
+
+    /* the server has everything now, the overlay copies would be stale in the next offline period */
+    if (!interrupted) {
+        rewind(f);
+        while (tnfs_journal_readEntry(f, &e, tnfs_journal_data)) {
+            tnfs_journal_purge(e.path);
+            tnfs_journal_purge(e.path2);
+        }
+        fclose(f);
+        remove(tnfs_journal_file);
+    } else {
+        kept = tnfs_journal_keep(f, position) == 0;	// otherwise the journal file still holds the applied entries
+    }
+
+    if (kept)
+        tnfs_journal_entries = r.remaining;
+    tnfs_journal_replaying = false;
+
+    if (result != NULL)
+        *result = r;
+
+#ifdef DEBUG
+    printf("journal replay: %u applied, %u conflicts, %u failed, %u remaining\n\n", r.applied, r.conflicts, r.failed, r.remaining);
+#endif
+
+    if (!kept)
+        return -TNFS_EIO;
+
+    return r.remaining == 0 ? 0 : -TNFS_EAGAIN;
+}
+
+/* enables the write-back journal, overlay is a local directory that receives the mutations made while offline */
+int tnfs_journal_open(const char* journal, const char* overlay)
+{
+    struct tnfs_journal_entry e;
+    FILE* f;
+
+    if (strlen(journal) + 16 > TNFS_MAX_PATH_LEN || strlen(overlay) >= TNFS_MAX_PATH_LEN)
+        return -TNFS_ENAMETOOLONG;
+
+    strcpy(tnfs_journal_file, journal);
+    strcpy(tnfs_journal_overlay, overlay);
+    tnfs_local_mkdir(overlay);
+
+    /* entries left by an earlier process are still waiting for the server */
+    tnfs_journal_entries = 0;
+    f = fopen(journal, "rb");
+    if (f != NULL) {
+        while (tnfs_journal_readEntry(f, &e, tnfs_journal_data))
+            tnfs_journal_entries++;
+        fclose(f);
+    }
+
+    tnfs_journal_hasTail = false;
+    memset(tnfs_journal_copies, 0, sizeof(tnfs_journal_copies));
+    tnfs_journal_probe = netw_millis();
+    tnfs_journal_enabled = true;
+
+    return 0;
+}
+
+/* writes the last merged write to the journal file and disables the journal */
+void tnfs_journal_close()
+{
+    tnfs_journal_flush();
+    tnfs_journal_enabled = false;
+}
+
+#endif /* TNFS_USE_JOURNAL */
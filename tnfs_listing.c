@@ -0,0 +1,335 @@
+#include <ctype.h>
+#include "include/tnfs_listing.h"
+
+/*
+ * Listings: a directory browser that lets the user change the sort order would list the directory again with other
+ * TNFS_DIRSORT_* options each time. tnfs_listing_load() reads the directory once, unsorted and unfiltered, and
+ * tnfs_listing_sort() orders it locally with the same options as tnfs_opendirx(). The sort builds a 64-bit key for
+ * every entry (folders first bit, then the modification time, the size or the first four characters of the name) and
+ * sorts the keys with a radix sort of one byte per pass. Entries with the same key, like names with the same first four
+ * characters, are sorted again by the next eight characters of their names, and so on, until few are left to compare
+ * one by one.
+ */
+
+#define TNFS_LISTING_FEW 32	// ties of fewer entries are compared whole
+
+/* sort global variables */
+struct tnfs_listing* tnfs_listing_sorting = NULL;	// listing being sorted, for tnfs_listing_compareTies()
+uint8_t  tnfs_listing_sortopts = 0;			// sortopts of the listing being sorted
+
+
+/* adds an entry, returns false when out of memory */
+bool tnfs_listing_add(struct tnfs_listing* l, struct dirx_item* item)
+{
+    uint32_t length = strlen(item->name) + 1;
+    struct tnfs_listing_entry* e;
+    void* grown;
+
+    if (l->count == l->capacity) {
+        grown = realloc(l->entries, (l->capacity * 2 + 256) * sizeof(struct tnfs_listing_entry));
+        if (grown == NULL)
+            return false;
+        l->entries = grown;
+        l->capacity = l->capacity * 2 + 256;
+    }
+    if (l->used + length > l->room) {
+        grown = realloc(l->names, l->room * 2 + length + 4096);
+        if (grown == NULL)
+            return false;
+        l->names = grown;
+        l->room = l->room * 2 + length + 4096;
+    }
+
+    e = &l->entries[l->count++];
+    e->name = l->used;
+    e->size = item->size;
+    e->modified = item->modified;
+    e->created = item->created;
+    e->flags = item->flags;
+    memcpy(&l->names[l->used], item->name, length);
+    l->used += length;
+
+    return true;
+}
+
+/* Frees the memory of a listing */
+void tnfs_listing_free(struct tnfs_listing* l)
+{
+    free(l->entries);
+    free(l->names);
+    free(l->order);
+    memset(l, 0, sizeof(struct tnfs_listing));
+}
+
+/* Reads a whole directory unsorted, diropts can add TNFS_DIROPT_NO_SKIPHIDDEN and TNFS_DIROPT_NO_SKIPSPECIAL */
+int tnfs_listing_load(struct tnfs_listing* l, char* path, uint8_t diropts)
+{
+    struct dirx_data data;
+    struct dirx_item item;
+    char* batches;
+    int code;
+
+    memset(l, 0, sizeof(struct tnfs_listing));
+
+    batches = malloc(2 * TNFS_BUFFERSIZE);
+    if (batches == NULL)
+        return -TNFS_ENOMEM;
+
+    code = tnfs_opendirx(path, "", diropts & ~TNFS_DIROPT_DIR_PATTERN, TNFS_DIRSORT_NONE, &data);
+    if (code != 0) {
+        free(batches);
+        return code;
+    }
+
+    tnfs_prefetchdirx(&data, batches, TNFS_BUFFERSIZE);
+    while ((code = tnfs_nextdirx(&data, &item)) == 0) {
+        if (!tnfs_listing_add(l, &item)) {
+            code = -TNFS_ENOMEM;
+            break;
+        }
+    }
+    tnfs_closedir(data.handle);
+    free(batches);
+
+    if (code != TNFS_EOF) {
+        tnfs_listing_free(l);
+        return code < 0 ? code : -code;
+    }
+
+    /* until the first sort the listing is visible in the order of the server */
+    return tnfs_listing_sort(l, "", 0, TNFS_DIRSORT_NONE);
+}
+
+/* Matches a name with a pattern of characters, ? for any character and * for any amount of characters */
+bool tnfs_listing_match(const char* name, const char* pattern, bool caseSensitive)
+{
+    const char* star = NULL;
+    const char* resume = NULL;
+
+    while (*name) {
+        if (*pattern == '*') {
+            star = pattern++;
+            resume = name;
+        } else if (*pattern == '?' || *pattern == *name
+                || (!caseSensitive && *pattern != 0 && tolower((unsigned char)*pattern) == tolower((unsigned char)*name))) {
+            pattern++;
+            name++;
+        } else if (star != NULL) {
+            pattern = star + 1;
+            name = ++resume;
+        } else {
+            return false;
+        }
+    }
+
+    while (*pattern == '*')
+        pattern++;
+
+    return *pattern == 0;
+}
+
+/* compares two names, without case unless TNFS_DIRSORT_CASE. Names that only differ in case are put in strcmp() order */
+int tnfs_listing_compareNames(const char* a, const char* b, uint8_t sortopts)
+{
+    const char* x = a;
+    const char* y = b;
+
+    if (sortopts & TNFS_DIRSORT_CASE)
+        return strcmp(a, b);
+
+    while (*x && tolower((unsigned char)*x) == tolower((unsigned char)*y)) {
+        x++;
+        y++;
+    }
+    if (tolower((unsigned char)*x) != tolower((unsigned char)*y))
+        return tolower((unsigned char)*x) - tolower((unsigned char)*y);
+
+    return strcmp(a, b);
+}
+
+/* orders two entries with the same key by their whole name */
+int tnfs_listing_compareTies(const void* a, const void* b)
+{
+    struct tnfs_listing* l = tnfs_listing_sorting;
+    int diff = tnfs_listing_compareNames(&l->names[l->entries[*(const uint32_t*)a].name],
+                                         &l->names[l->entries[*(const uint32_t*)b].name], tnfs_listing_sortopts);
+
+    /* the times and sizes are equal, then the names are always ascending */
+    if ((tnfs_listing_sortopts & TNFS_DIRSORT_DESCENDING) && !(tnfs_listing_sortopts & (TNFS_DIRSORT_MODIFIED | TNFS_DIRSORT_SIZE)))
+        return -diff;
+
+    return diff;
+}
+
+/* returns eight characters of a name from at as a number, without case unless TNFS_DIRSORT_CASE. A name that ends
+ * goes on with zeros, so it goes first */
+uint64_t tnfs_listing_nameKey(const char* name, size_t at, uint8_t sortopts)
+{
+    const uint8_t* c = (const uint8_t*)&name[at];
+    uint64_t key = 0;
+
+    for (int i = 0; i < 8; i++) {
+        key = (key << 8) | ((sortopts & TNFS_DIRSORT_CASE) ? *c : tolower(*c));
+        if (*c)
+            c++;
+    }
+
+    return key;
+}
+
+/* returns the sort key of an entry */
+uint64_t tnfs_listing_key(struct tnfs_listing* l, struct tnfs_listing_entry* e, uint8_t diropts, uint8_t sortopts)
+{
+    uint32_t key = 0;
+
+    if (sortopts & TNFS_DIRSORT_MODIFIED)
+        key = e->modified;
+    else if (sortopts & TNFS_DIRSORT_SIZE)
+        key = e->size;
+    else
+        key = tnfs_listing_nameKey(&l->names[e->name], 0, sortopts) >> 32;	// the first four characters
+
+    if (sortopts & TNFS_DIRSORT_DESCENDING)
+        key = ~key;
+
+    /* the folders first bit goes above the key */
+    if (!(diropts & TNFS_DIROPT_NO_FOLDERSFIRST) && !(e->flags & TNFS_DIRENTRY_DIR))
+        return ((uint64_t)1 << 32) | key;
+
+    return key;
+}
+
+/* sorts n keys and their order with a radix sort over the lowest bytes, a pass where all keys have the same byte is
+ * left out. keys2 and order2 are room for n more */
+void tnfs_listing_radix(uint64_t* keys, uint64_t* keys2, uint32_t* order, uint32_t* order2, uint32_t n, int bytes)
+{
+    uint32_t counts[256];
+
+    for (int shift = 0; shift < bytes * 8; shift += 8) {
+        uint32_t sum = 0;
+
+        memset(counts, 0, sizeof(counts));
+        for (uint32_t i = 0; i < n; i++)
+            counts[(keys[i] >> shift) & 0xFF]++;
+        if (counts[(keys[0] >> shift) & 0xFF] == n)
+            continue;
+
+        for (int b = 0; b < 256; b++) {
+            uint32_t c = counts[b];
+            counts[b] = sum;
+            sum += c;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t to = counts[(keys[i] >> shift) & 0xFF]++;
+            keys2[to] = keys[i];
+            order2[to] = order[i];
+        }
+        memcpy(keys, keys2, n * sizeof(uint64_t));
+        memcpy(order, order2, n * sizeof(uint32_t));
+    }
+}
+
+/* orders n entries whose names are the same up to at: by the next eight characters, then the entries that are still
+ * the same by the eight after them, and so on. Few entries, and names that end before at, are compared whole */
+void tnfs_listing_ties(struct tnfs_listing* l, uint32_t* order, uint32_t n, size_t at, uint64_t* keys, uint64_t* keys2,
+                       uint32_t* order2)
+{
+    uint8_t sortopts = tnfs_listing_sortopts;
+
+    if (n < TNFS_LISTING_FEW || strlen(&l->names[l->entries[order[0]].name]) < at) {
+        qsort(order, n, sizeof(uint32_t), tnfs_listing_compareTies);
+        return;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        keys[i] = tnfs_listing_nameKey(&l->names[l->entries[order[i]].name], at, sortopts);
+        if ((sortopts & TNFS_DIRSORT_DESCENDING) && !(sortopts & (TNFS_DIRSORT_MODIFIED | TNFS_DIRSORT_SIZE)))
+            keys[i] = ~keys[i];
+    }
+    tnfs_listing_radix(keys, keys2, order, order2, n, 8);
+
+    for (uint32_t i = 0, j; i < n; i = j) {
+        for (j = i + 1; j < n && keys[j] == keys[i]; j++);
+        if (j - i > 1)
+            tnfs_listing_ties(l, &order[i], j - i, at + 8, &keys[i], &keys2[i], &order2[i]);
+    }
+}
+
+/*
+ * Sorts and filters the listing with the options of tnfs_opendirx(): the pattern applies to files, and also to
+ * directories with TNFS_DIROPT_DIR_PATTERN; folders come first unless TNFS_DIROPT_NO_FOLDERSFIRST; sortopts are the
+ * TNFS_DIRSORT_* flags. Returns the amount of visible entries or -TNFS_ENOMEM
+ */
+int tnfs_listing_sort(struct tnfs_listing* l, const char* pattern, uint8_t diropts, uint8_t sortopts)
+{
+    uint64_t* keys;
+    uint64_t* keys2;
+    uint32_t* order2;
+    uint32_t* grown;
+    uint32_t n = 0;
+
+    grown = realloc(l->order, (l->count > 0 ? l->count : 1) * sizeof(uint32_t));
+    if (grown == NULL)
+        return -TNFS_ENOMEM;
+    l->order = grown;
+
+    /* the visible entries in the order of the server */
+    for (uint32_t i = 0; i < l->count; i++) {
+        if (pattern[0] != 0 && (!(l->entries[i].flags & TNFS_DIRENTRY_DIR) || (diropts & TNFS_DIROPT_DIR_PATTERN))
+         && !tnfs_listing_match(&l->names[l->entries[i].name], pattern, sortopts & TNFS_DIRSORT_CASE))
+            continue;
+        l->order[n++] = i;
+    }
+    l->visible = n;
+
+    if ((sortopts & TNFS_DIRSORT_NONE) || n < 2)
+        return n;
+
+    keys = malloc(2 * n * sizeof(uint64_t));
+    order2 = malloc(n * sizeof(uint32_t));
+    if (keys == NULL || order2 == NULL) {
+        free(keys);
+        free(order2);
+        return -TNFS_ENOMEM;
+    }
+    keys2 = &keys[n];
+
+    for (uint32_t i = 0; i < n; i++)
+        keys[i] = tnfs_listing_key(l, &l->entries[l->order[i]], diropts, sortopts);
+
+    tnfs_listing_radix(keys, keys2, l->order, order2, n, 5);
+
+    /* entries with the same key are ordered on the rest of their names, times and sizes on the whole name */
+    tnfs_listing_sorting = l;
+    tnfs_listing_sortopts = sortopts;
+    for (uint32_t i = 0, j; i < n; i = j) {
+        for (j = i + 1; j < n && keys[j] == keys[i]; j++);
+        if (j - i > 1)
+            tnfs_listing_ties(l, &l->order[i], j - i, (sortopts & (TNFS_DIRSORT_MODIFIED | TNFS_DIRSORT_SIZE)) ? 0 : 4,
+                               &keys[i], &keys2[i], &order2[i]);
+    }
+    tnfs_listing_sorting = NULL;
+
+    free(keys);
+    free(order2);
+
+    return n;
+}
+
+/* Returns the i-th visible entry, the name stays valid until tnfs_listing_free(). False when i is out of range */
+bool tnfs_listing_item(struct tnfs_listing* l, uint32_t i, struct dirx_item* item)
+{
+    struct tnfs_listing_entry* e;
+
+    if (i >= l->visible)
+        return false;
+
+    e = &l->entries[l->order[i]];
+    item->flags = e->flags;
+    item->size = e->size;
+    item->modified = e->modified;
+    item->created = e->created;
+    item->name = &l->names[e->name];
+
+    return true;
+}
@@ -0,0 +1,1010 @@
+#include "include/tnfs_memserver.h"
+
+/*
+ * Memory transport: a stand-in TNFS server inside the process. send() hands the request straight to the server, which
+ * answers it at once into a small queue that recv() takes from, so a request costs no system call and no context
+ * switch. Files and directories live in memory and disappear with the process; tnfs_memserver_put() adds files before
+ * or while the client runs. It is meant to measure the CPU cost of the client itself and to test applications without
+ * a network, not as a real server: there is one session at a time and no limit on its size.
+ *
+ *     tnfs_setTransport(&tnfs_memserver_transport);
+ *     tnfs_connect("memory", false);
+ *     tnfs_mount("/", "", "");
+ *
+ * The nodes are kept in one array: each directory links its entries in a list, and a hash table on directory and name
+ * finds an entry without walking the list. OPENDIRX sorts and filters with tnfs_listing_sort().
+ */
+
+/* a file opened by the client */
+struct tnfs_memserver_file {
+    int32_t  node;	// -1 when the handle is free
+    uint32_t position;
+    uint16_t flags;	// TNFS_O_* given to OPEN
+};
+
+/* a directory opened by the client, with the entries as they were at that moment */
+struct tnfs_memserver_dir {
+    bool     used;
+    bool     extended;		// opened with OPENDIRX, the entries are in listing
+    uint32_t position;		// next entry
+    uint32_t count;		// entries of OPENDIR
+    int32_t* entries;		// nodes of OPENDIR, TNFS_MEMSERVER_DOT and TNFS_MEMSERVER_DOTDOT for . and ..
+    struct tnfs_listing listing;	// entries of OPENDIRX
+};
+
+#define TNFS_MEMSERVER_DOT    -2
+#define TNFS_MEMSERVER_DOTDOT -3
+
+/* server global variables */
+struct tnfs_memserver_node* tnfs_memserver_nodes = NULL;	// all nodes, the root is the first
+uint32_t tnfs_memserver_count = 0;		// nodes in use or in the free list
+uint32_t tnfs_memserver_capacity = 0;		// room in tnfs_memserver_nodes
+int32_t  tnfs_memserver_free = -1;		// free nodes, linked by next
+int32_t  tnfs_memserver_buckets[TNFS_MEMSERVER_BUCKETS];	// first node of each hash bucket
+uint64_t tnfs_memserver_bytes = 0;		// size of all files together
+int32_t  tnfs_memserver_root = 0;		// directory mounted by the session
+uint16_t tnfs_memserver_session = 0;		// session id of the mounted session, zero without one
+uint16_t tnfs_memserver_sessions = TNFS_MEMSERVER_SESSION;	// next session id
+struct tnfs_memserver_file tnfs_memserver_files[TNFS_MEMSERVER_HANDLES];
+struct tnfs_memserver_dir  tnfs_memserver_dirs[TNFS_MEMSERVER_HANDLES];
+
+/* transport global variables */
+bool     tnfs_memserver_connected = false;
+uint8_t  tnfs_memserver_queue[TNFS_MEMSERVER_QUEUE][TNFS_BUFFERSIZE];	// responses that were not received yet
+int      tnfs_memserver_lengths[TNFS_MEMSERVER_QUEUE];
+int      tnfs_memserver_head = 0;		// oldest response in the queue
+int      tnfs_memserver_queued = 0;		// responses in the queue
+uint8_t  tnfs_memserver_lost[TNFS_BUFFERSIZE];	// response of a request that arrived while the queue was full
+char     tnfs_memserver_request[TNFS_BUFFERSIZE + 1];	// the request being handled, always terminated with a zero
+
+
+/* returns the hash bucket of a name in a directory (FNV-1a) */
+uint32_t tnfs_memserver_hash(int32_t dir, const char* name)
+{
+    uint32_t hash = 2166136261u ^ (uint32_t)dir;
+
+    while (*name) {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619u;
+    }
+
+    return hash % TNFS_MEMSERVER_BUCKETS;
+}
+
+/* finds an entry of a directory, returns -1 when there is none */
+int32_t tnfs_memserver_find(int32_t dir, const char* name)
+{
+    int32_t i = tnfs_memserver_buckets[tnfs_memserver_hash(dir, name)];
+
+    for (; i >= 0; i = tnfs_memserver_nodes[i].bucket) {
+        if (tnfs_memserver_nodes[i].parent == dir && strcmp(tnfs_memserver_nodes[i].name, name) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+/* adds a node to the entries of a directory and to the hash table */
+void tnfs_memserver_link(int32_t node, int32_t dir)
+{
+    struct tnfs_memserver_node* n = &tnfs_memserver_nodes[node];
+    uint32_t bucket = tnfs_memserver_hash(dir, n->name);
+
+    n->parent = dir;
+    n->previous = -1;
+    n->next = tnfs_memserver_nodes[dir].child;
+    if (n->next >= 0)
+        tnfs_memserver_nodes[n->next].previous = node;
+    tnfs_memserver_nodes[dir].child = node;
+
+    n->bucket = tnfs_memserver_buckets[bucket];
+    tnfs_memserver_buckets[bucket] = node;
+}
+
+/* removes a node from the entries of its directory and from the hash table */
+void tnfs_memserver_unlink(int32_t node)
+{
+    struct tnfs_memserver_node* n = &tnfs_memserver_nodes[node];
+    int32_t* link = &tnfs_memserver_buckets[tnfs_memserver_hash(n->parent, n->name)];
+
+    while (*link != node)
+        link = &tnfs_memserver_nodes[*link].bucket;
+    *link = n->bucket;
+
+    if (n->previous >= 0)
+        tnfs_memserver_nodes[n->previous].next = n->next;
+    else
+        tnfs_memserver_nodes[n->parent].child = n->next;
+    if (n->next >= 0)
+        tnfs_memserver_nodes[n->next].previous = n->previous;
+
+    n->parent = -1;
+}
+
+/* gives a node that is no longer linked back to the free list */
+void tnfs_memserver_release(int32_t node)
+{
+    struct tnfs_memserver_node* n = &tnfs_memserver_nodes[node];
+
+    tnfs_memserver_bytes -= n->size;
+    free(n->name);
+    free(n->data);
+    memset(n, 0, sizeof(struct tnfs_memserver_node));
+    n->next = tnfs_memserver_free;
+    tnfs_memserver_free = node;
+}
+
+/* creates a file or directory in a directory, returns the node or -1 when out of memory */
+int32_t tnfs_memserver_create(int32_t dir, const char* name, bool isDir, uint16_t mode)
+{
+    struct tnfs_memserver_node* grown;
+    struct tnfs_memserver_node* n;
+    int32_t node;
+
+    if (tnfs_memserver_free >= 0) {
+        node = tnfs_memserver_free;
+        tnfs_memserver_free = tnfs_memserver_nodes[node].next;
+    } else {
+        if (tnfs_memserver_count == tnfs_memserver_capacity) {
+            grown = realloc(tnfs_memserver_nodes, (tnfs_memserver_capacity * 2 + 64) * sizeof(struct tnfs_memserver_node));
+            if (grown == NULL)
+                return -1;
+            tnfs_memserver_nodes = grown;
+            tnfs_memserver_capacity = tnfs_memserver_capacity * 2 + 64;
+        }
+        node = tnfs_memserver_count++;
+    }
+
+    n = &tnfs_memserver_nodes[node];
+    memset(n, 0, sizeof(struct tnfs_memserver_node));
+    n->name = malloc(strlen(name) + 1);
+    if (n->name == NULL) {
+        n->next = tnfs_memserver_free;
+        tnfs_memserver_free = node;
+        return -1;
+    }
+    strcpy(n->name, name);
+    n->child = -1;
+    n->isDir = isDir;
+    n->mode = mode & 07777;
+    n->mtime = n->ctime = (uint32_t)time(NULL);
+
+    if (dir >= 0)
+        tnfs_memserver_link(node, dir);
+    else
+        n->parent = n->next = n->previous = n->bucket = -1;
+
+    return node;
+}
+
+/*
+ * finds the node of a path below the mounted directory, returns -1 when it doesn't exist. dir is the directory that
+ * holds or should hold the last part, which is copied to leaf, or -1 when that directory doesn't exist either
+ */
+int32_t tnfs_memserver_resolve(const char* path, int32_t* dir, char* leaf)
+{
+    int32_t node = tnfs_memserver_root;
+    size_t length;
+
+    *dir = -1;
+    leaf[0] = 0;
+
+    while (true) {
+        path += strspn(path, "/");
+        if (*path == 0)
+            return node;
+
+        length = strcspn(path, "/");
+        if (length >= TNFS_MAX_PATH_LEN || !tnfs_memserver_nodes[node].isDir) {
+            *dir = -1;
+            return -1;
+        }
+        memcpy(leaf, path, length);
+        leaf[length] = 0;
+        path += length;
+        *dir = node;
+
+        if (strcmp(leaf, "..") == 0) {
+            if (node != tnfs_memserver_root)
+                node = tnfs_memserver_nodes[node].parent;
+        } else if (strcmp(leaf, ".") != 0) {
+            node = tnfs_memserver_find(node, leaf);
+        }
+
+        if (node < 0) {
+            if (path[strspn(path, "/")] != 0)
+                *dir = -1;
+            return -1;
+        }
+    }
+}
+
+/* grows the data of a file to hold at least size bytes, returns false when out of memory */
+bool tnfs_memserver_reserve(struct tnfs_memserver_node* n, uint32_t size)
+{
+    uint32_t room = n->room * 2 > size ? n->room * 2 : size;
+    uint8_t* grown;
+
+    if (size <= n->room)
+        return true;
+
+    grown = realloc(n->data, room);
+    if (grown == NULL)
+        return false;
+    n->data = grown;
+    n->room = room;
+
+    return true;
+}
+
+/* closes every handle of the session */
+void tnfs_memserver_closeAll()
+{
+    for (int i = 0; i < TNFS_MEMSERVER_HANDLES; i++) {
+        struct tnfs_memserver_file* f = &tnfs_memserver_files[i];
+        struct tnfs_memserver_dir* d = &tnfs_memserver_dirs[i];
+
+        if (f->node >= 0) {
+            struct tnfs_memserver_node* n = &tnfs_memserver_nodes[f->node];
+            if (--n->opened == 0 && n->detached)
+                tnfs_memserver_release(f->node);
+        }
+        f->node = -1;
+
+        if (d->used) {
+            free(d->entries);
+            tnfs_listing_free(&d->listing);
+        }
+        memset(d, 0, sizeof(struct tnfs_memserver_dir));
+    }
+}
+
+/* Removes every file and directory and ends the session, the server starts with an empty root directory */
+void tnfs_memserver_reset()
+{
+    if (tnfs_memserver_nodes != NULL)
+        tnfs_memserver_closeAll();
+
+    for (uint32_t i = 0; i < tnfs_memserver_count; i++) {
+        free(tnfs_memserver_nodes[i].name);
+        free(tnfs_memserver_nodes[i].data);
+    }
+    free(tnfs_memserver_nodes);
+
+    tnfs_memserver_nodes = NULL;
+    tnfs_memserver_count = 0;
+    tnfs_memserver_capacity = 0;
+    tnfs_memserver_free = -1;
+    tnfs_memserver_bytes = 0;
+    tnfs_memserver_session = 0;
+    memset(tnfs_memserver_buckets, 0xFF, sizeof(tnfs_memserver_buckets));
+    for (int i = 0; i < TNFS_MEMSERVER_HANDLES; i++)
+        tnfs_memserver_files[i].node = -1;
+
+    tnfs_memserver_root = tnfs_memserver_create(-1, "", true, 0755);
+}
+
+/*
+ * Creates or replaces a file with the given contents, the directories on its path are created when needed. mtime zero
+ * is the current time. Returns 0, -TNFS_EISDIR, -TNFS_ENOTDIR or -TNFS_ENOMEM
+ */
+int tnfs_memserver_put(const char* path, const void* data, uint32_t size, uint32_t mtime)
+{
+    char part[TNFS_MAX_PATH_LEN];
+    int32_t dir, node;
+    size_t length;
+
+    if (tnfs_memserver_nodes == NULL)
+        tnfs_memserver_reset();
+    if (tnfs_memserver_root < 0)
+        return -TNFS_ENOMEM;
+
+    /* every part but the last is a directory */
+    dir = 0;
+    while (true) {
+        path += strspn(path, "/");
+        length = strcspn(path, "/");
+        if (length == 0 || length >= TNFS_MAX_PATH_LEN)
+            return -TNFS_ENOENT;
+        memcpy(part, path, length);
+        part[length] = 0;
+        path += length;
+        if (path[strspn(path, "/")] == 0)
+            break;
+
+        node = tnfs_memserver_find(dir, part);
+        if (node < 0)
+            node = tnfs_memserver_create(dir, part, true, 0755);
+        if (node < 0)
+            return -TNFS_ENOMEM;
+        if (!tnfs_memserver_nodes[node].isDir)
+            return -TNFS_ENOTDIR;
+        dir = node;
+    }
+
+    node = tnfs_memserver_find(dir, part);
+    if (node < 0)
+        node = tnfs_memserver_create(dir, part, false, 0644);
+    if (node < 0)
+        return -TNFS_ENOMEM;
+    if (tnfs_memserver_nodes[node].isDir)
+        return -TNFS_EISDIR;
+    if (!tnfs_memserver_reserve(&tnfs_memserver_nodes[node], size))
+        return -TNFS_ENOMEM;
+
+    struct tnfs_memserver_node* n = &tnfs_memserver_nodes[node];
+    memcpy(n->data, data, size);
+    tnfs_memserver_bytes += (int64_t)size - n->size;
+    n->size = size;
+    if (mtime != 0)
+        n->mtime = mtime;
+
+    return 0;
+}
+
+/* returns the open file of a handle in a request, or NULL */
+struct tnfs_memserver_file* tnfs_memserver_getFile(uint8_t handle)
+{
+    if (handle >= TNFS_MEMSERVER_HANDLES || tnfs_memserver_files[handle].node < 0)
+        return NULL;
+
+    return &tnfs_memserver_files[handle];
+}
+
+/* returns the open directory of a handle in a request, or NULL */
+struct tnfs_memserver_dir* tnfs_memserver_getDir(uint8_t handle)
+{
+    if (handle >= TNFS_MEMSERVER_HANDLES || !tnfs_memserver_dirs[handle].used)
+        return NULL;
+
+    return &tnfs_memserver_dirs[handle];
+}
+
+/* returns a free directory handle, or -1 */
+int tnfs_memserver_allocDir()
+{
+    for (int i = 0; i < TNFS_MEMSERVER_HANDLES; i++) {
+        if (!tnfs_memserver_dirs[i].used)
+            return i;
+    }
+
+    return -1;
+}
+
+/* OPENDIR: the entries, with . and .., are taken at once */
+int tnfs_memserver_opendir(const char* path, uint8_t* out)
+{
+    char leaf[TNFS_MAX_PATH_LEN];
+    struct tnfs_memserver_dir* d;
+    int32_t dir;
+    int32_t node = tnfs_memserver_resolve(path, &dir, leaf);
+    int handle = tnfs_memserver_allocDir();
+    uint32_t count = 2;
+
+    if (node < 0)
+        return -TNFS_ENOENT;
+    if (!tnfs_memserver_nodes[node].isDir)
+        return -TNFS_ENOTDIR;
+    if (handle < 0)
+        return -TNFS_EMFILE;
+
+    for (int32_t i = tnfs_memserver_nodes[node].child; i >= 0; i = tnfs_memserver_nodes[i].next)
+        count++;
+
+    d = &tnfs_memserver_dirs[handle];
+    d->entries = malloc(count * sizeof(int32_t));
+    if (d->entries == NULL)
+        return -TNFS_ENOMEM;
+
+    d->entries[0] = TNFS_MEMSERVER_DOT;
+    d->entries[1] = TNFS_MEMSERVER_DOTDOT;
+    count = 2;
+    for (int32_t i = tnfs_memserver_nodes[node].child; i >= 0; i = tnfs_memserver_nodes[i].next)
+        d->entries[count++] = i;
+
+    d->used = true;
+    d->count = count;
+    out[5] = handle;
+
+    return 6;
+}
+
+/* READDIR: one name, entries that were removed since OPENDIR are left out */
+int tnfs_memserver_readdir(struct tnfs_memserver_dir* d, uint8_t* out)
+{
+    const char* name = NULL;
+
+    while (name == NULL) {
+        if (d->position >= d->count)
+            return -TNFS_EOF;
+
+        int32_t node = d->entries[d->position++];
+        if (node == TNFS_MEMSERVER_DOT)
+            name = ".";
+        else if (node == TNFS_MEMSERVER_DOTDOT)
+            name = "..";
+        else
+            name = tnfs_memserver_nodes[node].name;
+    }
+
+    strcpy((char*)&out[5], name);
+
+    return 5 + strlen(name) + 1;
+}
+
+/* OPENDIRX: the entries are sorted and filtered like a TNFS server does */
+int tnfs_memserver_opendirx(const char* path, const char* pattern, uint8_t diropts, uint8_t sortopts, uint8_t* out)
+{
+    char leaf[TNFS_MAX_PATH_LEN];
+    struct tnfs_memserver_dir* d;
+    struct dirx_item item;
+    int32_t dir;
+    int32_t node = tnfs_memserver_resolve(path, &dir, leaf);
+    int handle = tnfs_memserver_allocDir();
+    int visible;
+
+    if (node < 0)
+        return -TNFS_ENOENT;
+    if (!tnfs_memserver_nodes[node].isDir)
+        return -TNFS_ENOTDIR;
+    if (handle < 0)
+        return -TNFS_EMFILE;
+
+    d = &tnfs_memserver_dirs[handle];
+    memset(&d->listing, 0, sizeof(struct tnfs_listing));
+    for (int32_t i = tnfs_memserver_nodes[node].child; i >= 0; i = tnfs_memserver_nodes[i].next) {
+        struct tnfs_memserver_node* n = &tnfs_memserver_nodes[i];
+
+        if (n->name[0] == '.' && !(diropts & TNFS_DIROPT_NO_SKIPHIDDEN))
+            continue;
+        item.flags = (n->isDir ? TNFS_DIRENTRY_DIR : 0) | (n->name[0] == '.' ? TNFS_DIRENTRY_HIDDEN : 0);
+        item.size = n->size;
+        item.modified = n->mtime;
+        item.created = n->ctime;
+        item.name = n->name;
+        if (!tnfs_listing_add(&d->listing, &item)) {
+            tnfs_listing_free(&d->listing);
+            return -TNFS_ENOMEM;
+        }
+    }
+
+    visible = tnfs_listing_sort(&d->listing, pattern, diropts, sortopts);
+    if (visible < 0) {
+        tnfs_listing_free(&d->listing);
+        return visible;
+    }
+
+    d->used = true;
+    d->extended = true;
+    out[5] = handle;
+    out[6] = visible & 0xFF;
+    out[7] = (visible >> 8) & 0xFF;
+
+    return 8;
+}
+
+/* READDIRX: as many entries as the request asks for and fit in the buffer of the client */
+int tnfs_memserver_readdirx(struct tnfs_memserver_dir* d, uint8_t max, uint8_t* out)
+{
+    struct dirx_item item;
+    uint16_t dirpos = d->position;
+    int length = 9;
+    uint8_t count = 0;
+
+    if (d->position >= d->listing.visible)
+        return -TNFS_EOF;
+
+    while ((max == 0 || count < max) && count < 255 && tnfs_listing_item(&d->listing, d->position, &item)) {
+        int size = 13 + strlen(item.name) + 1;
+
+        if (length + size >= TNFS_BUFFERSIZE)
+            break;
+        out[length] = item.flags;
+        memcpy(&out[length + 1], &item.size, 4);
+        memcpy(&out[length + 5], &item.modified, 4);
+        memcpy(&out[length + 9], &item.created, 4);
+        strcpy((char*)&out[length + 13], item.name);
+        length += size;
+        count++;
+        d->position++;
+    }
+
+    out[5] = count;
+    out[6] = d->position >= d->listing.visible ? TNFS_DIRSTATUS_EOF : 0;
+    memcpy(&out[7], &dirpos, 2);
+
+    return length;
+}
+
+/* OPEN */
+int tnfs_memserver_open(const char* path, uint16_t flags, uint16_t mode, uint8_t* out)
+{
+    char leaf[TNFS_MAX_PATH_LEN];
+    int32_t dir;
+    int32_t node = tnfs_memserver_resolve(path, &dir, leaf);
+    int handle = -1;
+
+    for (int i = 0; i < TNFS_MEMSERVER_HANDLES && handle < 0; i++) {
+        if (tnfs_memserver_files[i].node < 0)
+            handle = i;
+    }
+    if (handle < 0)
+        return -TNFS_EMFILE;
+
+    if (node >= 0) {
+        if ((flags & TNFS_O_CREAT) && (flags & TNFS_O_EXCL))
+            return -TNFS_EEXIST;
+        if (tnfs_memserver_nodes[node].isDir)
+            return -TNFS_EISDIR;
+    } else {
+        if (!(flags & TNFS_O_CREAT) || dir < 0)
+            return -TNFS_ENOENT;
+        node = tnfs_memserver_create(dir, leaf, false, mode != 0 ? mode : 0644);
+        if (node < 0)
+            return -TNFS_ENOMEM;
+    }
+
+    struct tnfs_memserver_node* n = &tnfs_memserver_nodes[node];
+    if ((flags & TNFS_O_TRUNC) && (flags & TNFS_O_WRONLY)) {
+        tnfs_memserver_bytes -= n->size;
+        n->size = 0;
+        n->mtime = (uint32_t)time(NULL);
+    }
+    n->opened++;
+
+    tnfs_memserver_files[handle].node = node;
+    tnfs_memserver_files[handle].position = 0;
+    tnfs_memserver_files[handle].flags = flags;
+    out[5] = handle;
+
+    return 6;
+}
+
+/* READ */
+int tnfs_memserver_read(struct tnfs_memserver_file* f, uint16_t length, uint8_t* out)
+{
+    struct tnfs_memserver_node* n = &tnfs_memserver_nodes[f->node];
+
+    if (!(f->flags & TNFS_O_RDONLY))
+        return -TNFS_EBADF;
+    if (f->position >= n->size)
+        return -TNFS_EOF;
+
+    if (length > n->size - f->position)
+        length = n->size - f->position;
+    if (length > TNFS_BUFFERSIZE - 7)
+        length = TNFS_BUFFERSIZE - 7;
+
+    memcpy(&out[5], &length, 2);
+    memcpy(&out[7], &n->data[f->position], length);
+    f->position += length;
+
+    return 7 + length;
+}
+
+/* WRITE */
+int tnfs_memserver_write(struct tnfs_memserver_file* f, uint16_t length, const char* data, uint8_t* out)
+{
+    struct tnfs_memserver_node* n = &tnfs_memserver_nodes[f->node];
+
+    if (!(f->flags & TNFS_O_WRONLY))
+        return -TNFS_EBADF;
+    if (f->flags & TNFS_O_APPEND)
+        f->position = n->size;
+    if (!tnfs_memserver_reserve(n, f->position + length))
+        return -TNFS_ENOSPC;
+
+    /* a write after the end leaves a hole of zeros */
+    if (f->position > n->size)
+        memset(&n->data[n->size], 0, f->position - n->size);
+    memcpy(&n->data[f->position], data, length);
+    f->position += length;
+    if (f->position > n->size) {
+        tnfs_memserver_bytes += f->position - n->size;
+        n->size = f->position;
+    }
+    n->mtime = (uint32_t)time(NULL);
+
+    memcpy(&out[5], &length, 2);
+
+    return 7;
+}
+
+/* STAT */
+int tnfs_memserver_stat(const char* path, uint8_t* out)
+{
+    char leaf[TNFS_MAX_PATH_LEN];
+    int32_t dir;
+    int32_t node = tnfs_memserver_resolve(path, &dir, leaf);
+    struct tnfs_memserver_node* n;
+    uint16_t mode, zero = 0;
+
+    if (node < 0)
+        return -TNFS_ENOENT;
+
+    n = &tnfs_memserver_nodes[node];
+    mode = (n->isDir ? 0040000 : 0100000) | n->mode;
+    memcpy(&out[5], &mode, 2);
+    memcpy(&out[7], &zero, 2);
+    memcpy(&out[9], &zero, 2);
+    memcpy(&out[11], &n->size, 4);
+    memcpy(&out[15], &n->mtime, 4);
+    memcpy(&out[19], &n->mtime, 4);
+    memcpy(&out[23], &n->ctime, 4);
+    memcpy(&out[27], "tnfs\0tnfs\0", 10);
+
+    return 37;
+}
+
+/* LSEEK */
+int tnfs_memserver_lseek(struct tnfs_memserver_file* f, uint8_t whence, int32_t offset, uint8_t* out)
+{
+    int64_t position = offset;
+
+    if (whence == TNFS_SEEK_CUR)
+        position += f->position;
+    else if (whence == TNFS_SEEK_END)
+        position += tnfs_memserver_nodes[f->node].size;
+    else if (whence != TNFS_SEEK_SET)
+        return -TNFS_EINVAL;
+
+    if (position < 0 || position > 0xFFFFFFFF)
+        return -TNFS_EINVAL;
+
+    f->position = (uint32_t)position;
+    memcpy(&out[5], &f->position, 4);
+
+    return 9;
+}
+
+/* UNLINK and RMDIR */
+int tnfs_memserver_remove(const char* path, bool isDir)
+{
+    char leaf[TNFS_MAX_PATH_LEN];
+    int32_t dir;
+    int32_t node = tnfs_memserver_resolve(path, &dir, leaf);
+    struct tnfs_memserver_node* n;
+
+    if (node < 0)
+        return -TNFS_ENOENT;
+
+    n = &tnfs_memserver_nodes[node];
+    if (isDir && !n->isDir)
+        return -TNFS_ENOTDIR;
+    if (!isDir && n->isDir)
+        return -TNFS_EISDIR;
+    if (isDir && (n->child >= 0 || node == tnfs_memserver_root))
+        return n->child >= 0 ? -TNFS_ENOTEMPTY : -TNFS_EBUSY;
+
+    tnfs_memserver_unlink(node);
+    if (n->opened > 0)
+        n->detached = true;
+    else
+        tnfs_memserver_release(node);
+
+    return 0;
+}
+
+/* RENAME, an existing file at the destination is replaced */
+int tnfs_memserver_rename(const char* source, const char* destination)
+{
+    char leaf[TNFS_MAX_PATH_LEN];
+    char target[TNFS_MAX_PATH_LEN];
+    int32_t dir, dest;
+    int32_t node = tnfs_memserver_resolve(source, &dir, leaf);
+    int32_t existing = tnfs_memserver_resolve(destination, &dest, target);
+    char* name;
+    int code;
+
+    if (node < 0 || dest < 0)
+        return -TNFS_ENOENT;
+    if (node == tnfs_memserver_root)
+        return -TNFS_EBUSY;
+    if (existing == node)
+        return 0;
+
+    /* a directory can't move into itself */
+    for (int32_t i = dest; i >= 0; i = tnfs_memserver_nodes[i].parent) {
+        if (i == node)
+            return -TNFS_EINVAL;
+    }
+
+    if (existing >= 0) {
+        if (tnfs_memserver_nodes[existing].isDir)
+            return -TNFS_EISDIR;
+        if ((code = tnfs_memserver_remove(destination, false)) != 0)
+            return code;
+    }
+
+    name = malloc(strlen(target) + 1);
+    if (name == NULL)
+        return -TNFS_ENOMEM;
+    strcpy(name, target);
+
+    tnfs_memserver_unlink(node);
+    free(tnfs_memserver_nodes[node].name);
+    tnfs_memserver_nodes[node].name = name;
+    tnfs_memserver_link(node, dest);
+
+    return 0;
+}
+
+/* handles one request and writes the response to out, returns the length of the response or zero for none */
+int tnfs_memserver_handle(const uint8_t* req, int length, uint8_t* out)
+{
+    char* r = tnfs_memserver_request;
+    char leaf[TNFS_MAX_PATH_LEN];
+    struct tnfs_memserver_file* f = NULL;
+    struct tnfs_memserver_dir* d = NULL;
+    uint16_t session, flags, mode, retry = 1000;
+    uint32_t position, kb;
+    int32_t dir, node;
+    int code;
+
+    if (length < 4)
+        return 0;
+
+    /* the strings of a request are always terminated, also when the client didn't */
+    memcpy(r, req, length);
+    memset(&r[length], 0, length + 16 <= TNFS_BUFFERSIZE ? 16 : TNFS_BUFFERSIZE + 1 - length);
+    memcpy(out, req, 4);
+    memcpy(&session, req, 2);
+
+    if (req[3] == 0x00) {
+        /* MOUNT: a new session on a directory, the handles of the previous one are closed */
+        if (tnfs_memserver_nodes == NULL)
+            tnfs_memserver_reset();
+        tnfs_memserver_closeAll();
+        tnfs_memserver_root = 0;
+        node = length > 6 ? tnfs_memserver_resolve(&r[6], &dir, leaf) : 0;
+        if (node < 0 || !tnfs_memserver_nodes[node].isDir) {
+            out[4] = node < 0 ? TNFS_ENOENT : TNFS_ENOTDIR;
+            return 5;
+        }
+        tnfs_memserver_root = node;
+        tnfs_memserver_session = tnfs_memserver_sessions++;
+        if (tnfs_memserver_session == 0)
+            tnfs_memserver_session = tnfs_memserver_sessions++;
+        memcpy(&out[0], &tnfs_memserver_session, 2);
+        out[4] = 0x00;
+        out[5] = 0x02;
+        out[6] = 0x01;
+        memcpy(&out[7], &retry, 2);
+        return 9;
+    }
+
+    if (session == 0 || session != tnfs_memserver_session) {
+        out[4] = TNFS_ESTALE;
+        return 5;
+    }
+
+    if (tnfs_isFileCommand(req[3]) && length >= 5 && (f = tnfs_memserver_getFile(req[4])) == NULL) {
+        out[4] = TNFS_EBADF;
+        return 5;
+    }
+    if (tnfs_isDirCommand(req[3]) && length >= 5 && (d = tnfs_memserver_getDir(req[4])) == NULL) {
+        out[4] = TNFS_EBADF;
+        return 5;
+    }
+
+    switch (req[3]) {
+        case 0x01: /* UMOUNT */
+            tnfs_memserver_closeAll();
+            tnfs_memserver_session = 0;
+            code = 5;
+            break;
+        case 0x10: /* OPENDIR */
+            code = tnfs_memserver_opendir(&r[4], out);
+            break;
+        case 0x11: /* READDIR */
+            code = d->extended ? -TNFS_EBADF : tnfs_memserver_readdir(d, out);
+            break;
+        case 0x12: /* CLOSEDIR */
+            free(d->entries);
+            tnfs_listing_free(&d->listing);
+            memset(d, 0, sizeof(struct tnfs_memserver_dir));
+            code = 5;
+            break;
+        case 0x13: /* MKDIR */
+            node = tnfs_memserver_resolve(&r[4], &dir, leaf);
+            if (node >= 0)
+                code = -TNFS_EEXIST;
+            else if (dir < 0 || leaf[0] == 0)
+                code = -TNFS_ENOENT;
+            else
+                code = tnfs_memserver_create(dir, leaf, true, 0755) >= 0 ? 5 : -TNFS_ENOMEM;
+            break;
+        case 0x14: /* RMDIR */
+            code = tnfs_memserver_remove(&r[4], true);
+            code = code == 0 ? 5 : code;
+            break;
+        case 0x15: /* TELLDIR */
+            memcpy(&out[5], &d->position, 4);
+            code = 9;
+            break;
+        case 0x16: /* SEEKDIR */
+            memcpy(&position, &r[5], 4);
+            d->position = position;
+            code = 5;
+            break;
+        case 0x17: /* OPENDIRX */
+            code = tnfs_memserver_opendirx(&r[8 + strlen(&r[8]) + 1], &r[8], req[4], req[5], out);
+            break;
+        case 0x18: /* READDIRX */
+            code = d->extended ? tnfs_memserver_readdirx(d, req[5], out) : -TNFS_EBADF;
+            break;
+        case 0x21: /* READ */
+            memcpy(&mode, &r[5], 2);
+            code = tnfs_memserver_read(f, mode, out);
+            break;
+        case 0x22: /* WRITE */
+            memcpy(&mode, &r[5], 2);
+            code = length >= 7 + mode ? tnfs_memserver_write(f, mode, &r[7], out) : -TNFS_EINVAL;
+            break;
+        case 0x23: /* CLOSE */
+            node = f->node;
+            f->node = -1;
+            if (--tnfs_memserver_nodes[node].opened == 0 && tnfs_memserver_nodes[node].detached)
+                tnfs_memserver_release(node);
+            code = 5;
+            break;
+        case 0x24: /* STAT */
+            code = tnfs_memserver_stat(&r[4], out);
+            break;
+        case 0x25: /* LSEEK */
+            memcpy(&position, &r[6], 4);
+            code = tnfs_memserver_lseek(f, req[5], (int32_t)position, out);
+            break;
+        case 0x26: /* UNLINK */
+            code = tnfs_memserver_remove(&r[4], false);
+            code = code == 0 ? 5 : code;
+            break;
+        case 0x27: /* CHMOD */
+            memcpy(&mode, &r[4], 2);
+            node = tnfs_memserver_resolve(&r[6], &dir, leaf);
+            if (node >= 0)
+                tnfs_memserver_nodes[node].mode = mode & 07777;
+            code = node >= 0 ? 5 : -TNFS_ENOENT;
+            break;
+        case 0x28: /* RENAME */
+            code = tnfs_memserver_rename(&r[4], &r[4 + strlen(&r[4]) + 1]);
+            code = code == 0 ? 5 : code;
+            break;
+        case 0x29: /* OPEN */
+            memcpy(&flags, &r[4], 2);
+            memcpy(&mode, &r[6], 2);
+            code = tnfs_memserver_open(&r[8], flags, mode, out);
+            break;
+        case 0x30: /* SIZE */
+        case 0x31: /* FREE */
+            kb = req[3] == 0x30 ? (uint32_t)(tnfs_memserver_bytes / 1024) : 0x7FFFFFFF;
+            memcpy(&out[5], &kb, 4);
+            code = 9;
+            break;
+        default:
+            code = -TNFS_ENOSYS;
+            break;
+    }
+
+    if (code < 0) {
+        out[4] = -code;
+        return 5;
+    }
+
+    out[4] = 0x00;
+
+    return code;
+}
+
+/* transport: makes the stand-in server reachable, host and port don't matter */
+int tnfs_memserver_connect(char* host, int port, bool useTCP)
+{
+    (void)host;
+    (void)port;
+    (void)useTCP;
+
+    if (tnfs_memserver_nodes == NULL)
+        tnfs_memserver_reset();
+
+    tnfs_memserver_queued = 0;
+    tnfs_memserver_connected = tnfs_memserver_root >= 0;
+
+    return tnfs_memserver_connected ? 0 : NETW_ERR_CONNECT;
+}
+
+/* transport: responses that were not received yet are lost, the files stay */
+void tnfs_memserver_disconnect()
+{
+    tnfs_memserver_connected = false;
+    tnfs_memserver_queued = 0;
+}
+
+/*
+ * transport: the server handles the request at once, a response that doesn't fit in the queue is lost. It is built
+ * aside then, the slot it would take is still the oldest response that wasn't received
+ */
+int tnfs_memserver_send(const uint8_t* buffer, int length)
+{
+    int slot = (tnfs_memserver_head + tnfs_memserver_queued) % TNFS_MEMSERVER_QUEUE;
+    int response;
+
+    if (!tnfs_memserver_connected)
+        return NETW_ERR_CLOSED;
+
+    if (tnfs_memserver_queued == TNFS_MEMSERVER_QUEUE) {
+        tnfs_memserver_handle(buffer, length, tnfs_memserver_lost);
+        return length;
+    }
+
+    response = tnfs_memserver_handle(buffer, length, tnfs_memserver_queue[slot]);
+    if (response > 0) {
+        tnfs_memserver_lengths[slot] = response;
+        tnfs_memserver_queued++;
+    }
+
+    return length;
+}
+
+/* transport: takes the oldest response, a response that is larger than the buffer is truncated like a datagram */
+int tnfs_memserver_recv(uint8_t* buffer, int buffer_size)
+{
+    int length;
+
+    if (!tnfs_memserver_connected)
+        return NETW_ERR_CLOSED;
+    if (tnfs_memserver_queued == 0)
+        return NETW_ERR_TIMEOUT;
+
+    length = tnfs_memserver_lengths[tnfs_memserver_head];
+    if (length > buffer_size)
+        length = buffer_size;
+    memcpy(buffer, tnfs_memserver_queue[tnfs_memserver_head], length);
+    tnfs_memserver_head = (tnfs_memserver_head + 1) % TNFS_MEMSERVER_QUEUE;
+    tnfs_memserver_queued--;
+
+    return length;
+}
+
+/* transport: sends a burst */
+int tnfs_memserver_sendBatch(struct netw_datagram* d, int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (tnfs_memserver_send(d[i].buffer, d[i].length) < 0)
+            return i;
+    }
+
+    return count;
+}
+
+/* transport: receives the waiting responses, a truncated one gets a length larger than its buffer like netw.c does */
+int tnfs_memserver_recvBatch(struct netw_datagram* d, int count)
+{
+    int n = 0;
+
+    if (!tnfs_memserver_connected)
+        return NETW_ERR_CLOSED;
+    if (tnfs_memserver_queued == 0)
+        return NETW_ERR_TIMEOUT;
+
+    for (; n < count && tnfs_memserver_queued > 0; n++) {
+        int length = tnfs_memserver_lengths[tnfs_memserver_head];
+
+        d[n].length = length > d[n].size ? d[n].size + 1 : length;
+        memcpy(d[n].buffer, tnfs_memserver_queue[tnfs_memserver_head], length > d[n].size ? d[n].size : length);
+        tnfs_memserver_head = (tnfs_memserver_head + 1) % TNFS_MEMSERVER_QUEUE;
+        tnfs_memserver_queued--;
+    }
+
+    return n;
+}
+
+/* transport: every response is there at once, so there is nothing to wait for */
+void tnfs_memserver_setTimeout(int t)
+{
+    (void)t;
+}
+
+const struct netw_transport tnfs_memserver_transport = {
+    tnfs_memserver_connect, tnfs_memserver_disconnect, tnfs_memserver_send, tnfs_memserver_recv,
+    tnfs_memserver_sendBatch, tnfs_memserver_recvBatch, tnfs_memserver_setTimeout
+};
@@ -0,0 +1,106 @@
+#include "include/tnfs_pool.h"
+
+#if TNFS_USE_PIPELINE	// left out by the footprint profile, see tnfs_config.h
+
+/*
+ * Request descriptors and their buffers come from a pool that is sized once, so pipelined requests don't need a
+ * malloc() and free() for each operation. tnfs_pool_get() and tnfs_pool_put() only move a descriptor between the
+ * free list and the caller.
+ */
+
+/* storage of the default pool, replace it with tnfs_pool_init(&tnfs_default_pool, ...) before the first use */
+struct tnfs_request tnfs_default_requests[TNFS_POOL_REQUESTS];
+uint8_t  tnfs_default_buffers[TNFS_POOL_REQUESTS * TNFS_POOL_BUFSIZE];
+struct tnfs_pool tnfs_default_pool;
+struct tnfs_pool* tnfs_current_pool = NULL;	// pool of the current context, NULL for the default pool
+
+
+/* builds the free list of a pool over caller supplied storage: count descriptors and count * bufsize bytes */
+void tnfs_pool_init(struct tnfs_pool* pool, struct tnfs_request* requests, uint8_t* buffers, uint16_t count, uint16_t bufsize)
+{
+    memset(pool, 0, sizeof(struct tnfs_pool));
+    pool->requests = requests;
+    pool->buffers = buffers;
+    pool->count = count;
+    pool->bufsize = bufsize;
+
+    for (int i = count - 1; i >= 0; i--) {
+        memset(&requests[i], 0, sizeof(struct tnfs_request));
+        requests[i].buffer = &buffers[(uint32_t)i * bufsize];
+        requests[i].next = pool->free;
+        pool->free = &requests[i];
+    }
+}
+
+/* allocates a pool of count descriptors with a buffer of bufsize bytes each in one block, free() releases it */
+struct tnfs_pool* tnfs_pool_create(uint16_t count, uint16_t bufsize)
+{
+    struct tnfs_pool* pool;
+    struct tnfs_request* requests;
+
+    if (count == 0 || bufsize < TNFS_HEADER_SIZE + 4)
+        return NULL;
+
+    pool = malloc(sizeof(struct tnfs_pool) + count * sizeof(struct tnfs_request) + (size_t)count * bufsize);
+    if (pool == NULL)
+        return NULL;
+
+    requests = (struct tnfs_request*)(pool + 1);
+    tnfs_pool_init(pool, requests, (uint8_t*)(requests + count), count, bufsize);
+
+    return pool;
+}
+
+/* takes a descriptor from the pool, NULL when all descriptors are in use */
+struct tnfs_request* tnfs_pool_get(struct tnfs_pool* pool)
+{
+    struct tnfs_request* req = pool->free;
+
+    if (req == NULL) {
+        pool->misses++;
+        return NULL;
+    }
+
+    pool->free = req->next;
+    req->next = NULL;
+    req->user = NULL;
+    req->length = 0;
+    req->status = 0;
+    req->retries = 0;
+    req->state = TNFS_REQ_READY;
+
+    pool->gets++;
+    if (++pool->used > pool->peak)
+        pool->peak = pool->used;
+
+    return req;
+}
+
+/* gives a descriptor back to the pool */
+void tnfs_pool_put(struct tnfs_pool* pool, struct tnfs_request* req)
+{
+    if (req == NULL || req->state == TNFS_REQ_FREE)
+        return;
+
+    req->state = TNFS_REQ_FREE;
+    req->next = pool->free;
+    pool->free = req;
+    pool->used--;
+}
+
+/*
+ * returns the pool of the current context: the one given to tnfs_context_createPool(), otherwise the default pool,
+ * initialized with the static storage unless tnfs_pool_init() configured it already
+ */
+struct tnfs_pool* tnfs_pool_default()
+{
+    if (tnfs_current_pool != NULL)
+        return tnfs_current_pool;
+
+    if (tnfs_default_pool.requests == NULL)
+        tnfs_pool_init(&tnfs_default_pool, tnfs_default_requests, tnfs_default_buffers, TNFS_POOL_REQUESTS, TNFS_POOL_BUFSIZE);
+
+    return &tnfs_default_pool;
+}
+
+#endif /* TNFS_USE_PIPELINE */
@@ -0,0 +1,1752 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <limits.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/xattr.h>
+#include "include/tnfs_preload.h"
+
+#ifndef CLOSE_RANGE_CLOEXEC
+#define CLOSE_RANGE_CLOEXEC (1U << 2)	// from linux/close_range.h, for a C library without close_range()
+#endif
+
+/*
+ * POSIX shim: built as a shared library (./build.sh preload) and loaded with LD_PRELOAD, it takes the calls of an
+ * unmodified program for paths below TNFS_PRELOAD_PREFIX and answers them from a TNFS mount, read-only. The session is
+ * made with tnfs_lazyMount(), so a program that never touches the prefix never talks to the server. An open file is a
+ * read-only block device (tnfs_block_open()) whenever one is free, which gives it a sector cache and read-ahead, and
+ * each descriptor handed out is a real O_PATH descriptor of /dev/null: it can't collide with the descriptors of the
+ * program, and a call the shim doesn't take, like mmap(), fails with EBADF instead of reading nothing. The descriptors
+ * of dup() share the open file and its offset. A child of fork() makes a session of its own on its first request and
+ * opens its files again in it, and a program started with execve() gets the descriptors it inherits handed over in
+ * TNFS_PRELOAD_ENV_FDS. Directories are read with tnfs_listing_load() and kept for TNFS_PRELOAD_TTL_MS: a stat() of an
+ * entry of a listed directory, which is what ls, cp -r and tar do next, is answered from the listing. The listing gives
+ * no permissions, those entries get 0755 for directories and 0644 for files. Everything runs under one lock because
+ * the library is not thread-safe. Linux with glibc only.
+ */
+
+/* what the shim knows about a file or directory */
+struct tnfs_preload_meta {
+    uint16_t mode;	// type and permissions, as S_IFREG | 0644
+    uint16_t uid;
+    uint16_t gid;
+    uint32_t size;
+    uint32_t atime;
+    uint32_t mtime;
+    uint32_t ctime;
+};
+
+/* a file or directory opened below the prefix, shared by the descriptors dup() makes of it */
+struct tnfs_preload_file {
+    uint8_t  refs;		// descriptors of the file, 0 for a free entry
+    bool     dir;
+    bool     stale;		// opened by another process, opened again on the next use
+    struct tnfs_blockdev* block;	// cached reads, NULL when no block device was free
+    int      handle;		// file handle when block is NULL
+    uint32_t remote;		// offset of handle on the server
+    uint32_t position;		// offset as seen by the program
+    struct tnfs_preload_meta meta;
+    char     path[TNFS_MAX_PATH_LEN];	// path on the mount
+};
+
+/* a descriptor handed to the program */
+struct tnfs_preload_desc {
+    int      fd;		// O_PATH descriptor of /dev/null that stands in for the file, -1 for a free entry
+    struct tnfs_preload_file* file;
+};
+
+/* a directory listing kept to answer stat() */
+struct tnfs_preload_listing {
+    char     path[TNFS_MAX_PATH_LEN];	// path on the mount, empty for a free slot
+    struct tnfs_listing listing;
+    uint32_t loaded;		// netw_millis() when the listing was read
+    uint8_t  readers;		// directory streams reading the listing, it is kept while they do
+};
+
+/* a directory stream of opendir() or fdopendir(), handed to the program as DIR* */
+struct tnfs_preload_stream {
+    int      fd;		// descriptor of the directory, -1 for a free stream
+    int      slot;		// listing that is read
+    uint32_t next;		// 0 for ".", 1 for "..", then the entries of the listing
+    struct dirent entry;
+};
+
+/* shim global variables */
+pthread_mutex_t tnfs_preload_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+char     tnfs_preload_prefix[TNFS_MAX_PATH_LEN];
+size_t   tnfs_preload_prefixlen = 0;	// zero while the shim is off
+pid_t    tnfs_preload_pid = 0;		// the process that made the session, only it ends the session
+bool     tnfs_preload_warm = false;	// a warm-start cache file is used
+struct tnfs_preload_file tnfs_preload_files[TNFS_PRELOAD_FILES];
+struct tnfs_preload_desc tnfs_preload_descs[TNFS_PRELOAD_DESCS];
+struct tnfs_preload_listing tnfs_preload_listings[TNFS_PRELOAD_LISTINGS];
+struct tnfs_preload_stream tnfs_preload_streams[TNFS_PRELOAD_STREAMS];
+
+/* declares real as the function of the C library that the shim replaces */
+#define TNFS_PRELOAD_REAL(type, name, args) \
+    static type (*real) args = NULL; \
+    if (real == NULL) \
+        real = (type (*) args)dlsym(RTLD_NEXT, name)
+
+/* fills a struct stat or struct stat64 from a struct tnfs_preload_meta */
+#define TNFS_PRELOAD_FILL(st, m, ino) do { \
+    memset((st), 0, sizeof(*(st))); \
+    (st)->st_dev = 0x544E4653; \
+    (st)->st_ino = (ino); \
+    (st)->st_mode = (m)->mode; \
+    (st)->st_nlink = S_ISDIR((m)->mode) ? 2 : 1; \
+    (st)->st_uid = (m)->uid; \
+    (st)->st_gid = (m)->gid; \
+    (st)->st_size = (m)->size; \
+    (st)->st_blksize = TNFS_BLOCK_RUN * TNFS_BLOCK_SECTOR; \
+    (st)->st_blocks = ((m)->size + 511) / 512; \
+    (st)->st_atime = (m)->atime; \
+    (st)->st_mtime = (m)->mtime; \
+    (st)->st_ctime = (m)->ctime; \
+} while (0)
+
+
+/* FNV-1a hash of a path, the inode number of the shim */
+uint64_t tnfs_preload_inode(const char* path)
+{
+    uint64_t hash = 14695981039346656037ull;
+
+    while (*path)
+        hash = (hash ^ (uint8_t)*path++) * 1099511628211ull;
+
+    return hash != 0 ? hash : 1;
+}
+
+/* the errno value of a negative TNFS error code */
+int tnfs_preload_errno(int code)
+{
+#define TNFS_PRELOAD_ERRNO(e) case TNFS_##e: return e
+
+    switch (-code) {
+        TNFS_PRELOAD_ERRNO(EPERM);
+        TNFS_PRELOAD_ERRNO(ENOENT);
+        TNFS_PRELOAD_ERRNO(ENXIO);
+        TNFS_PRELOAD_ERRNO(E2BIG);
+        TNFS_PRELOAD_ERRNO(EBADF);
+        TNFS_PRELOAD_ERRNO(EAGAIN);
+        TNFS_PRELOAD_ERRNO(ENOMEM);
+        TNFS_PRELOAD_ERRNO(EACCES);
+        TNFS_PRELOAD_ERRNO(EBUSY);
+        TNFS_PRELOAD_ERRNO(EEXIST);
+        TNFS_PRELOAD_ERRNO(ENOTDIR);
+        TNFS_PRELOAD_ERRNO(EISDIR);
+        TNFS_PRELOAD_ERRNO(EINVAL);
+        TNFS_PRELOAD_ERRNO(ENFILE);
+        TNFS_PRELOAD_ERRNO(EMFILE);
+        TNFS_PRELOAD_ERRNO(EFBIG);
+        TNFS_PRELOAD_ERRNO(ENOSPC);
+        TNFS_PRELOAD_ERRNO(ESPIPE);
+        TNFS_PRELOAD_ERRNO(EROFS);
+        TNFS_PRELOAD_ERRNO(ENAMETOOLONG);
+        TNFS_PRELOAD_ERRNO(ENOSYS);
+        TNFS_PRELOAD_ERRNO(ENOTEMPTY);
+        TNFS_PRELOAD_ERRNO(ELOOP);
+        TNFS_PRELOAD_ERRNO(ENODATA);
+        TNFS_PRELOAD_ERRNO(ENOSTR);
+        TNFS_PRELOAD_ERRNO(EPROTO);
+        TNFS_PRELOAD_ERRNO(EBADFD);
+        TNFS_PRELOAD_ERRNO(EUSERS);
+        TNFS_PRELOAD_ERRNO(ENOBUFS);
+        TNFS_PRELOAD_ERRNO(EALREADY);
+        TNFS_PRELOAD_ERRNO(ESTALE);
+        default: return EIO;
+    }
+
+#undef TNFS_PRELOAD_ERRNO
+}
+
+/* sets errno from a negative TNFS error code and returns -1 */
+int tnfs_preload_fail(int code)
+{
+    errno = tnfs_preload_errno(code);
+    return -1;
+}
+
+/* returns the entry of a descriptor, NULL when it isn't one of the shim */
+struct tnfs_preload_desc* tnfs_preload_descriptor(int fd)
+{
+    if (fd < 0)
+        return NULL;
+
+    for (int i = 0; i < TNFS_PRELOAD_DESCS; i++) {
+        if (tnfs_preload_descs[i].fd == fd)
+            return &tnfs_preload_descs[i];
+    }
+
+    return NULL;
+}
+
+/* returns the open file of a descriptor, NULL when it isn't one of the shim */
+struct tnfs_preload_file* tnfs_preload_find(int fd)
+{
+    struct tnfs_preload_desc* d = tnfs_preload_descriptor(fd);
+
+    return d != NULL ? d->file : NULL;
+}
+
+/* returns the directory stream of a DIR*, NULL when it isn't one of the shim */
+struct tnfs_preload_stream* tnfs_preload_stream(DIR* d)
+{
+    struct tnfs_preload_stream* s = (struct tnfs_preload_stream*)d;
+
+    if (s < &tnfs_preload_streams[0] || s >= &tnfs_preload_streams[TNFS_PRELOAD_STREAMS])
+        return NULL;
+
+    return s->fd >= 0 ? s : NULL;
+}
+
+/*
+ * finds the path on the mount for a path of the program, relative to dirfd when it isn't absolute. Returns false when
+ * the path isn't below the prefix, an empty remote when it is too long
+ */
+bool tnfs_preload_path(int dirfd, const char* path, char* remote)
+{
+    struct tnfs_preload_file* d;
+    size_t length;
+    int n;
+
+    if (tnfs_preload_prefixlen == 0 || path == NULL)
+        return false;
+
+    if (path[0] != '/') {
+        d = tnfs_preload_find(dirfd);
+        if (d == NULL || !d->dir)
+            return false;
+        length = strlen(d->path);
+        n = snprintf(remote, TNFS_MAX_PATH_LEN, "%s%s%s", d->path, path[0] && d->path[length - 1] != '/' ? "/" : "", path);
+    } else {
+        if (strncmp(path, tnfs_preload_prefix, tnfs_preload_prefixlen) != 0)
+            return false;
+        path += tnfs_preload_prefixlen;
+        if (path[0] != 0 && path[0] != '/')
+            return false;
+        n = snprintf(remote, TNFS_MAX_PATH_LEN, "%s", path[0] ? path : "/");
+    }
+
+    if (n >= TNFS_MAX_PATH_LEN) {
+        remote[0] = 0;
+        return true;
+    }
+
+    /* "/a/b/" is "/a/b", the root stays "/" */
+    for (length = n; length > 1 && remote[length - 1] == '/'; length--)
+        remote[length - 1] = 0;
+
+    return true;
+}
+
+/* returns the slot of a kept listing of a directory that isn't too old, -1 when there is none */
+int tnfs_preload_kept(const char* path)
+{
+    for (int i = 0; i < TNFS_PRELOAD_LISTINGS; i++) {
+        struct tnfs_preload_listing* k = &tnfs_preload_listings[i];
+
+        if (k->path[0] != 0 && strcmp(k->path, path) == 0 && netw_millis() - k->loaded < TNFS_PRELOAD_TTL_MS)
+            return i;
+    }
+
+    return -1;
+}
+
+/* reads a directory into a slot, unless a listing that isn't too old is kept. Returns the slot or a negative error code */
+int tnfs_preload_list(const char* path)
+{
+    struct tnfs_preload_listing* k;
+    char dir[TNFS_MAX_PATH_LEN];
+    int slot = tnfs_preload_kept(path);
+    int code;
+
+    if (slot >= 0)
+        return slot;
+
+    /* a free slot, or else the oldest one that no stream reads */
+    for (int i = 0; i < TNFS_PRELOAD_LISTINGS; i++) {
+        k = &tnfs_preload_listings[i];
+        if (k->readers > 0)
+            continue;
+        if (k->path[0] == 0) {
+            slot = i;
+            break;
+        }
+        if (slot < 0 || (int32_t)(k->loaded - tnfs_preload_listings[slot].loaded) < 0)
+            slot = i;
+    }
+    if (slot < 0)
+        return -TNFS_EMFILE;
+
+    k = &tnfs_preload_listings[slot];
+    if (k->path[0] != 0)
+        tnfs_listing_free(&k->listing);
+    k->path[0] = 0;
+
+    strcpy(dir, path);
+    code = tnfs_listing_load(&k->listing, dir, TNFS_DIROPT_NO_SKIPHIDDEN | TNFS_DIROPT_NO_SKIPSPECIAL);
+    if (code < 0)
+        return code;
+
+    strcpy(k->path, path);
+    k->loaded = netw_millis();
+
+    return slot;
+}
+
+/* fills meta from an entry of a listing */
+void tnfs_preload_entry(struct tnfs_listing_entry* e, struct tnfs_preload_meta* m)
+{
+    memset(m, 0, sizeof(struct tnfs_preload_meta));
+    m->mode = (e->flags & TNFS_DIRENTRY_DIR) ? S_IFDIR | 0755 : S_IFREG | 0644;
+    m->uid = getuid();
+    m->gid = getgid();
+    m->size = e->size;
+    m->atime = e->modified;
+    m->mtime = e->modified;
+    m->ctime = e->created;
+}
+
+/* looks up a path on the mount, from a kept listing of its directory when there is one. Returns 0 or a negative error code */
+int tnfs_preload_meta(const char* remote, struct tnfs_preload_meta* m)
+{
+    char parent[TNFS_MAX_PATH_LEN];
+    struct tnfs_listing* l;
+    struct fstat st;
+    const char* name;
+    char* slash;
+    int slot, code;
+
+    if (remote[0] == 0)
+        return -TNFS_ENAMETOOLONG;
+
+    slash = strrchr(remote, '/');
+    if (slash != NULL && slash[1] != 0 && strcmp(slash, "/.") != 0 && strcmp(slash, "/..") != 0) {
+        memcpy(parent, remote, slash - remote);
+        parent[slash == remote ? 1 : slash - remote] = 0;
+        slot = tnfs_preload_kept(parent);
+        if (slot >= 0) {
+            l = &tnfs_preload_listings[slot].listing;
+            for (uint32_t i = 0; i < l->count; i++) {
+                name = &l->names[l->entries[i].name];
+                if (strcmp(name, slash + 1) == 0) {
+                    tnfs_preload_entry(&l->entries[i], m);
+                    return 0;
+                }
+            }
+            return -TNFS_ENOENT;
+        }
+    }
+
+    strcpy(parent, remote);
+    code = tnfs_stat(parent, &st);
+    if (code != 0)
+        return code;
+
+    m->mode = st.mode;
+    m->uid = st.uid;
+    m->gid = st.gid;
+    m->size = st.size;
+    m->atime = st.atime;
+    m->mtime = st.mtime;
+    m->ctime = st.ctime;
+
+    return 0;
+}
+
+/* opens the file of an entry on the mount, the path is set. Returns 0 or a negative error code */
+int tnfs_preload_attach(struct tnfs_preload_file* f, bool directory)
+{
+    char path[TNFS_MAX_PATH_LEN];
+    int code;
+
+    f->block = NULL;
+    f->handle = -1;
+    f->remote = 0;
+    code = tnfs_preload_meta(f->path, &f->meta);
+    if (code != 0)
+        return code;
+
+    f->dir = S_ISDIR(f->meta.mode);
+    f->stale = false;
+    if (f->dir)
+        return 0;
+    if (directory)
+        return -TNFS_ENOTDIR;
+
+    strcpy(path, f->path);
+    f->block = tnfs_block_open(path, true);
+    if (f->block != NULL) {
+        f->meta.size = f->block->size;
+        return 0;
+    }
+    f->handle = tnfs_open(path, TNFS_O_RDONLY, 0);
+
+    return f->handle < 0 ? f->handle : 0;
+}
+
+/* looks up a path of the program, or the file of dirfd for an empty path with AT_EMPTY_PATH. Returns 1 when found, 0 when it isn't below the prefix, -1 with errno */
+int tnfs_preload_lookup(int dirfd, const char* path, int flags, struct tnfs_preload_meta* m, uint64_t* ino)
+{
+    char remote[TNFS_MAX_PATH_LEN];
+    struct tnfs_preload_file* f;
+    int code;
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+
+    if (path != NULL && path[0] == 0 && (flags & AT_EMPTY_PATH) && (f = tnfs_preload_find(dirfd)) != NULL) {
+        code = f->stale ? tnfs_preload_attach(f, false) : 0;
+        *m = f->meta;
+        *ino = tnfs_preload_inode(f->path);
+        pthread_mutex_unlock(&tnfs_preload_lock);
+        return code == 0 ? 1 : tnfs_preload_fail(code);
+    }
+    if (!tnfs_preload_path(dirfd, path, remote)) {
+        pthread_mutex_unlock(&tnfs_preload_lock);
+        return 0;
+    }
+
+    code = tnfs_preload_meta(remote, m);
+    *ino = tnfs_preload_inode(remote);
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    return code == 0 ? 1 : tnfs_preload_fail(code);
+}
+
+/* closes an open file, the descriptors stay open */
+void tnfs_preload_release(struct tnfs_preload_file* f)
+{
+    if (f->block != NULL)
+        tnfs_block_close(f->block);
+    else if (f->handle >= 0)
+        tnfs_close(f->handle);
+    f->block = NULL;
+    f->handle = -1;
+}
+
+/* hands out descriptor fd for an open file, returns false when there is no free entry */
+bool tnfs_preload_adopt(int fd, struct tnfs_preload_file* f)
+{
+    for (int i = 0; i < TNFS_PRELOAD_DESCS; i++) {
+        if (tnfs_preload_descs[i].fd < 0) {
+            tnfs_preload_descs[i].fd = fd;
+            tnfs_preload_descs[i].file = f;
+            f->refs++;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* forgets descriptor fd when it is one of the shim, the file is closed with its last descriptor */
+void tnfs_preload_drop(int fd)
+{
+    struct tnfs_preload_desc* d = tnfs_preload_descriptor(fd);
+
+    if (d == NULL)
+        return;
+
+    d->fd = -1;
+    if (--d->file->refs == 0)
+        tnfs_preload_release(d->file);
+}
+
+/* opens a path on the mount for reading, returns the descriptor or -1 with errno */
+int tnfs_preload_open(const char* remote, int flags)
+{
+    TNFS_PRELOAD_REAL(int, "openat", (int, const char*, int, ...));
+    struct tnfs_preload_file* f = NULL;
+    int fd, code;
+
+    for (int i = 0; f == NULL && i < TNFS_PRELOAD_FILES; i++) {
+        if (tnfs_preload_files[i].refs == 0)
+            f = &tnfs_preload_files[i];
+    }
+    if ((flags & O_ACCMODE) != O_RDONLY || (flags & (O_CREAT | O_TRUNC)))
+        return tnfs_preload_fail(-TNFS_EROFS);
+    if (f == NULL)
+        return tnfs_preload_fail(-TNFS_EMFILE);
+
+    strcpy(f->path, remote);
+    f->position = 0;
+    code = tnfs_preload_attach(f, flags & O_DIRECTORY);
+    if (code != 0) {
+        tnfs_preload_release(f);
+        return tnfs_preload_fail(code);
+    }
+
+    fd = real(AT_FDCWD, "/dev/null", O_PATH | (flags & O_CLOEXEC));
+    code = errno;
+    if (fd >= 0 && !tnfs_preload_adopt(fd, f)) {
+        close(fd);
+        fd = -1;
+        code = EMFILE;
+    }
+    if (fd < 0) {
+        tnfs_preload_release(f);
+        errno = code;
+    }
+
+    return fd;
+}
+
+/* reads from an open file at an offset, returns the length or -1 with errno */
+ssize_t tnfs_preload_pread(struct tnfs_preload_file* f, char* data, size_t count, uint32_t offset)
+{
+    char sectors[TNFS_PRELOAD_SECTORS * TNFS_BLOCK_SECTOR];
+    uint32_t sector, skip, n;
+    size_t done = 0;
+    int code;
+
+    if (f->stale && (code = tnfs_preload_attach(f, false)) != 0)
+        return tnfs_preload_fail(code);
+    if (f->dir)
+        return tnfs_preload_fail(-TNFS_EISDIR);
+    if (offset >= f->meta.size)
+        return 0;
+    if (count > f->meta.size - offset)
+        count = f->meta.size - offset;
+
+    while (done < count) {
+        if (f->block != NULL) {
+            sector = (offset + done) / TNFS_BLOCK_SECTOR;
+            skip = (offset + done) % TNFS_BLOCK_SECTOR;
+            n = (skip + count - done + TNFS_BLOCK_SECTOR - 1) / TNFS_BLOCK_SECTOR;
+            if (n > TNFS_PRELOAD_SECTORS)
+                n = TNFS_PRELOAD_SECTORS;
+            code = tnfs_block_read(f->block, sector, n, sectors);
+            if (code != 0)
+                break;
+            n = n * TNFS_BLOCK_SECTOR - skip;
+            if (n > count - done)
+                n = count - done;
+            memcpy(&data[done], &sectors[skip], n);
+        } else {
+            if (f->remote != offset + done) {
+                code = tnfs_lseek(f->handle, TNFS_SEEK_SET, offset + done);
+                if (code != 0)
+                    break;
+                f->remote = offset + done;
+            }
+            n = count - done < sizeof(sectors) ? count - done : sizeof(sectors);
+            code = tnfs_read(&data[done], f->handle, n);
+            if (code == -TNFS_EOF || code == 0)
+                break;
+            if (code < 0)
+                break;
+            n = code;
+            f->remote += n;
+        }
+        done += n;
+    }
+
+    /* what was read before an error still counts */
+    if (done == 0 && done < count && code != -TNFS_EOF && code != 0)
+        return tnfs_preload_fail(code);
+
+    return done;
+}
+
+/* makes a directory stream for descriptor fd of an open directory, NULL with errno */
+DIR* tnfs_preload_opendir(int fd, struct tnfs_preload_file* f)
+{
+    struct tnfs_preload_stream* s = NULL;
+    int slot;
+
+    if (f->stale && (slot = tnfs_preload_attach(f, false)) != 0) {
+        tnfs_preload_fail(slot);
+        return NULL;
+    }
+    if (!f->dir) {
+        tnfs_preload_fail(-TNFS_ENOTDIR);
+        return NULL;
+    }
+    for (int i = 0; s == NULL && i < TNFS_PRELOAD_STREAMS; i++) {
+        if (tnfs_preload_streams[i].fd < 0)
+            s = &tnfs_preload_streams[i];
+    }
+    if (s == NULL) {
+        tnfs_preload_fail(-TNFS_EMFILE);
+        return NULL;
+    }
+
+    slot = tnfs_preload_list(f->path);
+    if (slot < 0) {
+        tnfs_preload_fail(slot);
+        return NULL;
+    }
+
+    tnfs_preload_listings[slot].readers++;
+    s->fd = fd;
+    s->slot = slot;
+    s->next = 0;
+
+    return (DIR*)s;
+}
+
+/* makes the lazy session from the environment, returns 0 or a negative error code */
+int tnfs_preload_session()
+{
+    const char* host = getenv(TNFS_PRELOAD_ENV_HOST);
+    const char* mount = getenv(TNFS_PRELOAD_ENV_MOUNT);
+    const char* tcp = getenv(TNFS_PRELOAD_ENV_TCP);
+
+    /* nothing goes over the network until the program uses the prefix */
+    return tnfs_lazyMount((char*)host, tcp != NULL && strcmp(tcp, "1") == 0, mount != NULL ? mount : "/", "", "");
+}
+
+/* fork() waits for the lock, so the child gets the tables in one piece */
+void tnfs_preload_prepare()
+{
+    pthread_mutex_lock(&tnfs_preload_lock);
+}
+
+void tnfs_preload_parent()
+{
+    pthread_mutex_unlock(&tnfs_preload_lock);
+}
+
+/*
+ * the handles belong to the session of the parent: the child forgets them without a request, makes a session of its
+ * own on its first request and opens its files again in it. The offsets are copies from now on
+ */
+void tnfs_preload_child()
+{
+    /* the lock is owned by the thread of the parent, the child starts with a new one */
+    tnfs_preload_lock = (pthread_mutex_t)PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+    for (int i = 0; i < TNFS_PRELOAD_FILES; i++) {
+        struct tnfs_preload_file* f = &tnfs_preload_files[i];
+
+        if (f->refs == 0)
+            continue;
+        if (f->block != NULL)
+            f->block->handle = -1;
+        f->block = NULL;
+        f->handle = -1;
+        f->stale = true;
+    }
+    tnfs_preload_session();
+    tnfs_preload_pid = getpid();
+}
+
+/*
+ * takes over the descriptors handed over by the program that started this one, see tnfs_preload_handover(). Each line
+ * is "fd file offset type path", lines with the same file share it. A descriptor that isn't an O_PATH descriptor of
+ * /dev/null anymore is left alone
+ */
+void tnfs_preload_inherit(const char* list)
+{
+    TNFS_PRELOAD_REAL(int, "fcntl", (int, int, ...));
+    int map[TNFS_PRELOAD_FILES];
+    struct tnfs_preload_file* f;
+    struct stat st;
+    const char* end;
+    int fd, file, length, flags, i;
+    unsigned int offset;
+    char type;
+
+    for (i = 0; i < TNFS_PRELOAD_FILES; i++)
+        map[i] = -1;
+
+    for (; *list != 0; list = *end != 0 ? end + 1 : end) {
+        end = strchr(list, '\n');
+        if (end == NULL)
+            end = list + strlen(list);
+        if (sscanf(list, "%d %d %u %c %n", &fd, &file, &offset, &type, &length) != 4 || file < 0 || file >= TNFS_PRELOAD_FILES)
+            continue;
+        if (end - list - length <= 0 || end - list - length >= TNFS_MAX_PATH_LEN)
+            continue;
+        flags = real(fd, F_GETFL);
+        if (flags < 0 || !(flags & O_PATH) || fstat(fd, &st) != 0 || !S_ISCHR(st.st_mode) || st.st_rdev != makedev(1, 3))
+            continue;
+
+        if (map[file] < 0) {
+            for (i = 0; i < TNFS_PRELOAD_FILES && tnfs_preload_files[i].refs > 0; i++);
+            if (i == TNFS_PRELOAD_FILES)
+                continue;
+            f = &tnfs_preload_files[i];
+            memcpy(f->path, list + length, end - list - length);
+            f->path[end - list - length] = 0;
+            f->dir = type == 'd';
+            f->stale = true;
+            f->block = NULL;
+            f->handle = -1;
+            f->position = offset;
+            map[file] = i;
+        }
+        tnfs_preload_adopt(fd, &tnfs_preload_files[map[file]]);
+    }
+}
+
+/* starts the shim when the program is loaded, from the environment */
+__attribute__((constructor)) void tnfs_preload_start()
+{
+    const char* host = getenv(TNFS_PRELOAD_ENV_HOST);
+    const char* prefix = getenv(TNFS_PRELOAD_ENV_PREFIX);
+    const char* warm = getenv(TNFS_PRELOAD_ENV_WARM);
+    const char* inherited = getenv(TNFS_PRELOAD_ENV_FDS);
+    size_t length;
+
+    for (int i = 0; i < TNFS_PRELOAD_DESCS; i++)
+        tnfs_preload_descs[i].fd = -1;
+    for (int i = 0; i < TNFS_PRELOAD_STREAMS; i++)
+        tnfs_preload_streams[i].fd = -1;
+
+    if (host == NULL || host[0] == 0)
+        return;
+    if (prefix == NULL || prefix[0] != '/')
+        prefix = TNFS_PRELOAD_PREFIX;
+    for (length = strlen(prefix); length > 1 && prefix[length - 1] == '/'; length--);
+    if (length >= TNFS_MAX_PATH_LEN)
+        return;
+
+    if (warm != NULL && warm[0] != 0)
+        tnfs_preload_warm = tnfs_warm_open(warm) == 0;
+
+    if (tnfs_preload_session() != 0)
+        return;
+
+    memcpy(tnfs_preload_prefix, prefix, length);
+    tnfs_preload_prefix[length] = 0;
+    tnfs_preload_prefixlen = length;
+    tnfs_preload_pid = getpid();
+    pthread_atfork(tnfs_preload_prepare, tnfs_preload_parent, tnfs_preload_child);
+
+    /* the programs this one starts get a list of their own */
+    if (inherited != NULL) {
+        tnfs_preload_inherit(inherited);
+        unsetenv(TNFS_PRELOAD_ENV_FDS);
+    }
+}
+
+/* ends the session when the program exits, a child of fork() ends its own session */
+__attribute__((destructor)) void tnfs_preload_stop()
+{
+    if (tnfs_preload_prefixlen == 0 || getpid() != tnfs_preload_pid)
+        return;
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    for (int i = 0; i < TNFS_PRELOAD_FILES; i++) {
+        if (tnfs_preload_files[i].refs > 0)
+            tnfs_preload_release(&tnfs_preload_files[i]);
+    }
+    tnfs_preload_prefixlen = 0;
+    tnfs_umount();
+    tnfs_disconnect();
+    if (tnfs_preload_warm)
+        tnfs_warm_close();
+    pthread_mutex_unlock(&tnfs_preload_lock);
+}
+
+/*
+ * the environment for a program started with the descriptors of the shim that it inherits in TNFS_PRELOAD_ENV_FDS,
+ * see tnfs_preload_inherit(). Returns envp when there are none, else a copy to free with tnfs_preload_handback()
+ */
+char** tnfs_preload_handover(char* const envp[])
+{
+    TNFS_PRELOAD_REAL(int, "fcntl", (int, int, ...));
+    size_t count = 0, used, size;
+    char** env;
+    char* list;
+    int n = 0;
+
+    for (int i = 0; i < TNFS_PRELOAD_DESCS; i++) {
+        int fd = tnfs_preload_descs[i].fd;
+
+        if (fd >= 0 && !(real(fd, F_GETFD) & FD_CLOEXEC) && strchr(tnfs_preload_descs[i].file->path, '\n') == NULL)
+            n++;
+    }
+    if (n == 0 || tnfs_preload_prefixlen == 0)
+        return (char**)envp;
+
+    while (envp != NULL && envp[count] != NULL)
+        count++;
+    size = sizeof(TNFS_PRELOAD_ENV_FDS) + n * (TNFS_MAX_PATH_LEN + 40);
+    env = malloc((count + 2) * sizeof(char*) + size);
+    if (env == NULL)
+        return (char**)envp;
+
+    list = (char*)&env[count + 2];
+    used = snprintf(list, size, "%s=", TNFS_PRELOAD_ENV_FDS);
+    for (int i = 0; i < TNFS_PRELOAD_DESCS; i++) {
+        struct tnfs_preload_desc* d = &tnfs_preload_descs[i];
+
+        if (d->fd < 0 || (real(d->fd, F_GETFD) & FD_CLOEXEC) || strchr(d->file->path, '\n') != NULL)
+            continue;
+        used += snprintf(list + used, size - used, "%d %d %u %c %s\n", d->fd, (int)(d->file - tnfs_preload_files),
+            d->file->position, d->file->dir ? 'd' : 'f', d->file->path);
+    }
+
+    n = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (strncmp(envp[i], TNFS_PRELOAD_ENV_FDS "=", sizeof(TNFS_PRELOAD_ENV_FDS)) != 0)
+            env[n++] = envp[i];
+    }
+    env[n++] = list;
+    env[n] = NULL;
+
+    return env;
+}
+
+/* frees the environment of tnfs_preload_handover() after an exec that failed, errno stays */
+void tnfs_preload_handback(char** env, char* const envp[])
+{
+    int code = errno;
+
+    if (env != (char**)envp)
+        free(env);
+    errno = code;
+}
+
+
+/* the functions of the C library, for descriptors and paths that aren't the shim's they call the real ones */
+
+int openat(int dirfd, const char* path, int flags, ...)
+{
+    TNFS_PRELOAD_REAL(int, "openat", (int, const char*, int, ...));
+    char remote[TNFS_MAX_PATH_LEN];
+    mode_t mode = 0;
+    va_list args;
+    int fd;
+
+    if (flags & (O_CREAT | O_TMPFILE)) {
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    if (!tnfs_preload_path(dirfd, path, remote)) {
+        pthread_mutex_unlock(&tnfs_preload_lock);
+        return real(dirfd, path, flags, mode);
+    }
+    fd = remote[0] != 0 ? tnfs_preload_open(remote, flags) : tnfs_preload_fail(-TNFS_ENAMETOOLONG);
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    return fd;
+}
+
+int open(const char* path, int flags, ...)
+{
+    mode_t mode = 0;
+    va_list args;
+
+    if (flags & (O_CREAT | O_TMPFILE)) {
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+
+    return openat(AT_FDCWD, path, flags, mode);
+}
+
+int open64(const char* path, int flags, ...) __attribute__((alias("open")));
+int openat64(int dirfd, const char* path, int flags, ...) __attribute__((alias("openat")));
+
+/* the versions of _FORTIFY_SOURCE, they are only used without O_CREAT */
+int __open_2(const char* path, int flags)
+{
+    return openat(AT_FDCWD, path, flags);
+}
+
+int __openat_2(int dirfd, const char* path, int flags)
+{
+    return openat(dirfd, path, flags);
+}
+
+int __open64_2(const char* path, int flags) __attribute__((alias("__open_2")));
+int __openat64_2(int dirfd, const char* path, int flags) __attribute__((alias("__openat_2")));
+
+int close(int fd)
+{
+    TNFS_PRELOAD_REAL(int, "close", (int));
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    tnfs_preload_drop(fd);
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    return real(fd);
+}
+
+/* forgets the descriptors of the shim from first to last, which a close_range() or closefrom() closes */
+void tnfs_preload_dropRange(unsigned int first, unsigned int last)
+{
+    for (int i = 0; i < TNFS_PRELOAD_DESCS; i++) {
+        int fd = tnfs_preload_descs[i].fd;
+
+        if (fd >= 0 && (unsigned int)fd >= first && (unsigned int)fd <= last)
+            tnfs_preload_drop(fd);
+    }
+}
+
+/* with CLOSE_RANGE_CLOEXEC the descriptors stay open until an execve(), which hands them over or not by itself */
+int close_range(unsigned int first, unsigned int last, int flags)
+{
+    TNFS_PRELOAD_REAL(int, "close_range", (unsigned int, unsigned int, int));
+    int code;
+
+    if (real == NULL) {
+        errno = ENOSYS;
+        return -1;
+    }
+
+    /* like close() the files are closed on the server first, the range may hold the socket of the session */
+    pthread_mutex_lock(&tnfs_preload_lock);
+    if (first <= last && !(flags & CLOSE_RANGE_CLOEXEC))
+        tnfs_preload_dropRange(first, last);
+    code = real(first, last, flags);
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    return code;
+}
+
+void closefrom(int first)
+{
+    TNFS_PRELOAD_REAL(void, "closefrom", (int));
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    if (first >= 0)
+        tnfs_preload_dropRange(first, UINT_MAX);
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    if (real != NULL)
+        real(first);
+}
+
+/* a duplicate of a descriptor of the shim shares its file and offset, a descriptor of the shim that dup2() replaces is closed */
+int tnfs_preload_dup(int fd, int copy)
+{
+    struct tnfs_preload_file* f = tnfs_preload_find(fd);
+
+    if (copy < 0 || copy == fd)
+        return copy;
+
+    tnfs_preload_drop(copy);
+    if (f != NULL && !tnfs_preload_adopt(copy, f)) {
+        close(copy);
+        errno = EMFILE;
+        return -1;
+    }
+
+    return copy;
+}
+
+int dup(int fd)
+{
+    TNFS_PRELOAD_REAL(int, "dup", (int));
+    int copy;
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    copy = tnfs_preload_dup(fd, real(fd));
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    return copy;
+}
+
+int dup2(int fd, int copy)
+{
+    TNFS_PRELOAD_REAL(int, "dup2", (int, int));
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    copy = tnfs_preload_dup(fd, real(fd, copy));
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    return copy;
+}
+
+int dup3(int fd, int copy, int flags)
+{
+    TNFS_PRELOAD_REAL(int, "dup3", (int, int, int));
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    copy = tnfs_preload_dup(fd, real(fd, copy, flags));
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    return copy;
+}
+
+/* the argument of every command fits in a pointer, it is passed on as it is */
+int fcntl(int fd, int cmd, ...)
+{
+    TNFS_PRELOAD_REAL(int, "fcntl", (int, int, ...));
+    va_list args;
+    void* arg;
+    int result;
+
+    va_start(args, cmd);
+    arg = va_arg(args, void*);
+    va_end(args);
+
+    if (cmd != F_DUPFD && cmd != F_DUPFD_CLOEXEC)
+        return real(fd, cmd, arg);
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    result = tnfs_preload_dup(fd, real(fd, cmd, arg));
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    return result;
+}
+
+int fcntl64(int fd, int cmd, ...) __attribute__((alias("fcntl")));
+
+ssize_t pread(int fd, void* data, size_t count, off_t offset)
+{
+    TNFS_PRELOAD_REAL(ssize_t, "pread", (int, void*, size_t, off_t));
+    struct tnfs_preload_file* f;
+    ssize_t n;
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    f = tnfs_preload_find(fd);
+    if (f == NULL) {
+        pthread_mutex_unlock(&tnfs_preload_lock);
+        return real(fd, data, count, offset);
+    }
+    n = offset < 0 || offset > UINT32_MAX ? tnfs_preload_fail(-TNFS_EINVAL) : tnfs_preload_pread(f, data, count, offset);
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    return n;
+}
+
+ssize_t pread64(int fd, void* data, size_t count, off_t offset) __attribute__((alias("pread")));
+
+ssize_t read(int fd, void* data, size_t count)
+{
+    TNFS_PRELOAD_REAL(ssize_t, "read", (int, void*, size_t));
+    struct tnfs_preload_file* f;
+    ssize_t n;
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    f = tnfs_preload_find(fd);
+    if (f == NULL) {
+        pthread_mutex_unlock(&tnfs_preload_lock);
+        return real(fd, data, count);
+    }
+    n = tnfs_preload_pread(f, data, count, f->position);
+    if (n > 0)
+        f->position += n;
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    return n;
+}
+
+ssize_t __read_chk(int fd, void* data, size_t count, size_t size)
+{
+    (void)size;
+    return read(fd, data, count);
+}
+
+ssize_t __pread_chk(int fd, void* data, size_t count, off_t offset, size_t size)
+{
+    (void)size;
+    return pread(fd, data, count, offset);
+}
+
+ssize_t __pread64_chk(int fd, void* data, size_t count, off_t offset, size_t size) __attribute__((alias("__pread_chk")));
+
+/* reads into the buffers one after the other from an offset, returns the length or -1 with errno */
+ssize_t tnfs_preload_preadv(struct tnfs_preload_file* f, const struct iovec* iov, int count, uint32_t offset)
+{
+    ssize_t done = 0, n;
+
+    if (count < 0 || count > IOV_MAX)
+        return tnfs_preload_fail(-TNFS_EINVAL);
+
+    for (int i = 0; i < count; i++) {
+        n = tnfs_preload_pread(f, iov[i].iov_base, iov[i].iov_len, offset + done);
+        if (n < 0)
+            return done > 0 ? done : -1;
+        done += n;
+        if ((size_t)n < iov[i].iov_len)
+            break;
+    }
+
+    return done;
+}
+
+/* reads into the buffers at the offset of the file when current is true, sets ours when fd is one of the shim */
+ssize_t tnfs_preload_readv(int fd, const struct iovec* iov, int count, off_t offset, bool current, bool* ours)
+{
+    struct tnfs_preload_file* f;
+    ssize_t n;
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    f = tnfs_preload_find(fd);
+    *ours = f != NULL;
+    if (f == NULL) {
+        n = 0;
+    } else if (current) {
+        n = tnfs_preload_preadv(f, iov, count, f->position);
+        if (n > 0)
+            f->position += n;
+    } else {
+        n = offset < 0 || offset > UINT32_MAX ? tnfs_preload_fail(-TNFS_EINVAL) : tnfs_preload_preadv(f, iov, count, offset);
+    }
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    return n;
+}
+
+ssize_t readv(int fd, const struct iovec* iov, int count)
+{
+    TNFS_PRELOAD_REAL(ssize_t, "readv", (int, const struct iovec*, int));
+    bool ours;
+    ssize_t n = tnfs_preload_readv(fd, iov, count, 0, true, &ours);
+
+    return ours ? n : real(fd, iov, count);
+}
+
+ssize_t preadv(int fd, const struct iovec* iov, int count, off_t offset)
+{
+    TNFS_PRELOAD_REAL(ssize_t, "preadv", (int, const struct iovec*, int, off_t));
+    bool ours;
+    ssize_t n = tnfs_preload_readv(fd, iov, count, offset, false, &ours);
+
+    return ours ? n : real(fd, iov, count, offset);
+}
+
+ssize_t preadv2(int fd, const struct iovec* iov, int count, off_t offset, int flags)
+{
+    TNFS_PRELOAD_REAL(ssize_t, "preadv2", (int, const struct iovec*, int, off_t, int));
+    bool ours;
+    ssize_t n = tnfs_preload_readv(fd, iov, count, offset, offset == -1, &ours);
+
+    /* the flags only tune how the kernel waits, the shim ignores them */
+    return ours ? n : real(fd, iov, count, offset, flags);
+}
+
+ssize_t preadv64(int fd, const struct iovec* iov, int count, off_t offset) __attribute__((alias("preadv")));
+ssize_t preadv64v2(int fd, const struct iovec* iov, int count, off_t offset, int flags) __attribute__((alias("preadv2")));
+
+off_t lseek(int fd, off_t offset, int whence)
+{
+    TNFS_PRELOAD_REAL(off_t, "lseek", (int, off_t, int));
+    struct tnfs_preload_file* f;
+    off_t position;
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    f = tnfs_preload_find(fd);
+    if (f == NULL) {
+        pthread_mutex_unlock(&tnfs_preload_lock);
+        return real(fd, offset, whence);
+    }
+    if (f->stale && (position = tnfs_preload_attach(f, false)) != 0) {
+        position = tnfs_preload_fail(position);
+        pthread_mutex_unlock(&tnfs_preload_lock);
+        return position;
+    }
+
+    switch (whence) {
+        case SEEK_SET:  position = offset; break;
+        case SEEK_CUR:  position = f->position + offset; break;
+        case SEEK_END:  position = f->meta.size + offset; break;
+        case SEEK_DATA: position = offset < f->meta.size ? offset : -2; break;	// no holes
+        case SEEK_HOLE: position = offset < f->meta.size ? (off_t)f->meta.size : -2; break;
+        default:        position = -1; break;
+    }
+
+    if (position == -2) {
+        errno = ENXIO;
+        position = -1;
+    } else if (position < 0 || position > UINT32_MAX) {
+        errno = EINVAL;
+        position = -1;
+    } else {
+        f->position = position;
+    }
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    return position;
+}
+
+off_t lseek64(int fd, off_t offset, int whence) __attribute__((alias("lseek")));
+
+/* copy_file_range() would copy from /dev/null, the program falls back to read() and write() */
+ssize_t copy_file_range(int in, off_t* inoffset, int out, off_t* outoffset, size_t count, unsigned int flags)
+{
+    TNFS_PRELOAD_REAL(ssize_t, "copy_file_range", (int, off_t*, int, off_t*, size_t, unsigned int));
+    bool ours;
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    ours = tnfs_preload_find(in) != NULL || tnfs_preload_find(out) != NULL;
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    if (ours) {
+        errno = EXDEV;
+        return -1;
+    }
+
+    return real(in, inoffset, out, outoffset, count, flags);
+}
+
+ssize_t sendfile(int out, int in, off_t* offset, size_t count)
+{
+    TNFS_PRELOAD_REAL(ssize_t, "sendfile", (int, int, off_t*, size_t));
+    ssize_t (*writer)(int, const void*, size_t) = (ssize_t (*)(int, const void*, size_t))dlsym(RTLD_NEXT, "write");
+    char data[TNFS_PRELOAD_SECTORS * TNFS_BLOCK_SECTOR];
+    struct tnfs_preload_file* f;
+    size_t done = 0;
+    ssize_t n, w;
+    uint32_t position;
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    f = tnfs_preload_find(in);
+    if (f == NULL) {
+        pthread_mutex_unlock(&tnfs_preload_lock);
+        return real(out, in, offset, count);
+    }
+
+    position = offset != NULL ? (uint32_t)*offset : f->position;
+    while (done < count) {
+        n = tnfs_preload_pread(f, data, count - done < sizeof(data) ? count - done : sizeof(data), position);
+        if (n <= 0)
+            break;
+        w = writer(out, data, n);
+        if (w <= 0)
+            break;
+        position += w;
+        done += w;
+        if (w < n)
+            break;
+    }
+    if (offset != NULL)
+        *offset = position;
+    else
+        f->position = position;
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    return done > 0 || count == 0 ? (ssize_t)done : -1;
+}
+
+ssize_t sendfile64(int out, int in, off_t* offset, size_t count) __attribute__((alias("sendfile")));
+
+int fstatat(int dirfd, const char* path, struct stat* st, int flags)
+{
+    TNFS_PRELOAD_REAL(int, "fstatat", (int, const char*, struct stat*, int));
+    struct tnfs_preload_meta m;
+    uint64_t ino;
+    int found = tnfs_preload_lookup(dirfd, path, flags, &m, &ino);
+
+    if (found == 0)
+        return real(dirfd, path, st, flags);
+    if (found < 0)
+        return -1;
+
+    TNFS_PRELOAD_FILL(st, &m, ino);
+
+    return 0;
+}
+
+int fstatat64(int dirfd, const char* path, struct stat64* st, int flags)
+{
+    TNFS_PRELOAD_REAL(int, "fstatat64", (int, const char*, struct stat64*, int));
+    struct tnfs_preload_meta m;
+    uint64_t ino;
+    int found = tnfs_preload_lookup(dirfd, path, flags, &m, &ino);
+
+    if (found == 0)
+        return real(dirfd, path, st, flags);
+    if (found < 0)
+        return -1;
+
+    TNFS_PRELOAD_FILL(st, &m, ino);
+
+    return 0;
+}
+
+int stat(const char* path, struct stat* st)
+{
+    return fstatat(AT_FDCWD, path, st, 0);
+}
+
+int lstat(const char* path, struct stat* st)
+{
+    return fstatat(AT_FDCWD, path, st, AT_SYMLINK_NOFOLLOW);
+}
+
+int fstat(int fd, struct stat* st)
+{
+    return fstatat(fd, "", st, AT_EMPTY_PATH);
+}
+
+int stat64(const char* path, struct stat64* st)
+{
+    return fstatat64(AT_FDCWD, path, st, 0);
+}
+
+int lstat64(const char* path, struct stat64* st)
+{
+    return fstatat64(AT_FDCWD, path, st, AT_SYMLINK_NOFOLLOW);
+}
+
+int fstat64(int fd, struct stat64* st)
+{
+    return fstatat64(fd, "", st, AT_EMPTY_PATH);
+}
+
+/* programs built against a glibc older than 2.33 call these, the version is the same struct stat on 64-bit Linux */
+int __xstat(int version, const char* path, struct stat* st)
+{
+    (void)version;
+    return fstatat(AT_FDCWD, path, st, 0);
+}
+
+int __lxstat(int version, const char* path, struct stat* st)
+{
+    (void)version;
+    return fstatat(AT_FDCWD, path, st, AT_SYMLINK_NOFOLLOW);
+}
+
+int __fxstat(int version, int fd, struct stat* st)
+{
+    (void)version;
+    return fstatat(fd, "", st, AT_EMPTY_PATH);
+}
+
+int __fxstatat(int version, int dirfd, const char* path, struct stat* st, int flags)
+{
+    (void)version;
+    return fstatat(dirfd, path, st, flags);
+}
+
+int __xstat64(int version, const char* path, struct stat64* st)
+{
+    (void)version;
+    return fstatat64(AT_FDCWD, path, st, 0);
+}
+
+int __lxstat64(int version, const char* path, struct stat64* st)
+{
+    (void)version;
+    return fstatat64(AT_FDCWD, path, st, AT_SYMLINK_NOFOLLOW);
+}
+
+int __fxstat64(int version, int fd, struct stat64* st)
+{
+    (void)version;
+    return fstatat64(fd, "", st, AT_EMPTY_PATH);
+}
+
+int __fxstatat64(int version, int dirfd, const char* path, struct stat64* st, int flags)
+{
+    (void)version;
+    return fstatat64(dirfd, path, st, flags);
+}
+
+int statx(int dirfd, const char* path, int flags, unsigned int mask, struct statx* stx)
+{
+    TNFS_PRELOAD_REAL(int, "statx", (int, const char*, int, unsigned int, struct statx*));
+    struct tnfs_preload_meta m;
+    uint64_t ino;
+    int found = tnfs_preload_lookup(dirfd, path, flags, &m, &ino);
+
+    if (found == 0)
+        return real(dirfd, path, flags, mask, stx);
+    if (found < 0)
+        return -1;
+
+    memset(stx, 0, sizeof(struct statx));
+    stx->stx_mask = STATX_BASIC_STATS;
+    stx->stx_blksize = TNFS_BLOCK_RUN * TNFS_BLOCK_SECTOR;
+    stx->stx_nlink = S_ISDIR(m.mode) ? 2 : 1;
+    stx->stx_uid = m.uid;
+    stx->stx_gid = m.gid;
+    stx->stx_mode = m.mode;
+    stx->stx_ino = ino;
+    stx->stx_size = m.size;
+    stx->stx_blocks = (m.size + 511) / 512;
+    stx->stx_atime.tv_sec = m.atime;
+    stx->stx_mtime.tv_sec = m.mtime;
+    stx->stx_ctime.tv_sec = m.ctime;
+    stx->stx_dev_major = 0x544E;
+    stx->stx_dev_minor = 0x4653;
+
+    return 0;
+}
+
+/* the server has no extended attributes, ls -l asks for them to show ACLs */
+ssize_t getxattr(const char* path, const char* name, void* value, size_t size)
+{
+    TNFS_PRELOAD_REAL(ssize_t, "getxattr", (const char*, const char*, void*, size_t));
+    struct tnfs_preload_meta m;
+    uint64_t ino;
+    int found = tnfs_preload_lookup(AT_FDCWD, path, 0, &m, &ino);
+
+    if (found == 0)
+        return real(path, name, value, size);
+    if (found > 0)
+        errno = ENOTSUP;
+
+    return -1;
+}
+
+ssize_t lgetxattr(const char* path, const char* name, void* value, size_t size)
+{
+    TNFS_PRELOAD_REAL(ssize_t, "lgetxattr", (const char*, const char*, void*, size_t));
+    struct tnfs_preload_meta m;
+    uint64_t ino;
+    int found = tnfs_preload_lookup(AT_FDCWD, path, 0, &m, &ino);
+
+    if (found == 0)
+        return real(path, name, value, size);
+    if (found > 0)
+        errno = ENOTSUP;
+
+    return -1;
+}
+
+ssize_t fgetxattr(int fd, const char* name, void* value, size_t size)
+{
+    TNFS_PRELOAD_REAL(ssize_t, "fgetxattr", (int, const char*, void*, size_t));
+    bool ours;
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    ours = tnfs_preload_find(fd) != NULL;
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    if (!ours)
+        return real(fd, name, value, size);
+    errno = ENOTSUP;
+
+    return -1;
+}
+
+ssize_t listxattr(const char* path, char* list, size_t size)
+{
+    TNFS_PRELOAD_REAL(ssize_t, "listxattr", (const char*, char*, size_t));
+    struct tnfs_preload_meta m;
+    uint64_t ino;
+    int found = tnfs_preload_lookup(AT_FDCWD, path, 0, &m, &ino);
+
+    return found == 0 ? real(path, list, size) : found > 0 ? 0 : -1;
+}
+
+ssize_t llistxattr(const char* path, char* list, size_t size)
+{
+    TNFS_PRELOAD_REAL(ssize_t, "llistxattr", (const char*, char*, size_t));
+    struct tnfs_preload_meta m;
+    uint64_t ino;
+    int found = tnfs_preload_lookup(AT_FDCWD, path, 0, &m, &ino);
+
+    return found == 0 ? real(path, list, size) : found > 0 ? 0 : -1;
+}
+
+DIR* fdopendir(int fd)
+{
+    TNFS_PRELOAD_REAL(DIR*, "fdopendir", (int));
+    struct tnfs_preload_file* f;
+    DIR* d;
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    f = tnfs_preload_find(fd);
+    if (f == NULL) {
+        pthread_mutex_unlock(&tnfs_preload_lock);
+        return real(fd);
+    }
+    d = tnfs_preload_opendir(fd, f);
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    return d;
+}
+
+DIR* opendir(const char* path)
+{
+    TNFS_PRELOAD_REAL(DIR*, "opendir", (const char*));
+    char remote[TNFS_MAX_PATH_LEN];
+    DIR* d = NULL;
+    int fd, code;
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    if (!tnfs_preload_path(AT_FDCWD, path, remote)) {
+        pthread_mutex_unlock(&tnfs_preload_lock);
+        return real(path);
+    }
+
+    fd = remote[0] != 0 ? tnfs_preload_open(remote, O_RDONLY | O_DIRECTORY | O_CLOEXEC) : tnfs_preload_fail(-TNFS_ENAMETOOLONG);
+    if (fd >= 0) {
+        d = tnfs_preload_opendir(fd, tnfs_preload_find(fd));
+        if (d == NULL) {
+            code = errno;
+            close(fd);
+            errno = code;
+        }
+    }
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    return d;
+}
+
+struct dirent* readdir(DIR* d)
+{
+    TNFS_PRELOAD_REAL(struct dirent*, "readdir", (DIR*));
+    struct tnfs_preload_stream* s;
+    struct tnfs_preload_listing* k;
+    struct tnfs_listing_entry* e;
+    struct dirent* entry = NULL;
+    const char* name;
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    s = tnfs_preload_stream(d);
+    if (s == NULL) {
+        pthread_mutex_unlock(&tnfs_preload_lock);
+        return real(d);
+    }
+
+    k = &tnfs_preload_listings[s->slot];
+    /* "." and ".." are made up by the shim, in case the server lists them they are left out */
+    while (s->next >= 2 && s->next < 2 + k->listing.count) {
+        name = &k->listing.names[k->listing.entries[s->next - 2].name];
+        if (strcmp(name, ".") != 0 && strcmp(name, "..") != 0)
+            break;
+        s->next++;
+    }
+    if (s->next < 2 + k->listing.count) {
+        entry = &s->entry;
+        memset(entry, 0, sizeof(struct dirent));
+        if (s->next < 2) {
+            name = s->next == 0 ? "." : "..";
+            entry->d_type = DT_DIR;
+        } else {
+            e = &k->listing.entries[s->next - 2];
+            name = &k->listing.names[e->name];
+            entry->d_type = (e->flags & TNFS_DIRENTRY_DIR) ? DT_DIR : DT_REG;
+        }
+        snprintf(entry->d_name, sizeof(entry->d_name), "%s", name);
+        entry->d_ino = tnfs_preload_inode(entry->d_name) ^ tnfs_preload_inode(k->path);
+        entry->d_off = ++s->next;
+        entry->d_reclen = sizeof(struct dirent);
+    }
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    return entry;
+}
+
+/* struct dirent64 is struct dirent on 64-bit Linux */
+struct dirent64* readdir64(DIR* d) __attribute__((alias("readdir")));
+
+void rewinddir(DIR* d)
+{
+    TNFS_PRELOAD_REAL(void, "rewinddir", (DIR*));
+    struct tnfs_preload_stream* s;
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    s = tnfs_preload_stream(d);
+    if (s != NULL)
+        s->next = 0;
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    if (s == NULL)
+        real(d);
+}
+
+int dirfd(DIR* d)
+{
+    TNFS_PRELOAD_REAL(int, "dirfd", (DIR*));
+    struct tnfs_preload_stream* s;
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    s = tnfs_preload_stream(d);
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    return s != NULL ? s->fd : real(d);
+}
+
+int closedir(DIR* d)
+{
+    TNFS_PRELOAD_REAL(int, "closedir", (DIR*));
+    struct tnfs_preload_stream* s;
+    int fd;
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    s = tnfs_preload_stream(d);
+    if (s == NULL) {
+        pthread_mutex_unlock(&tnfs_preload_lock);
+        return real(d);
+    }
+    tnfs_preload_listings[s->slot].readers--;
+    fd = s->fd;
+    s->fd = -1;
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    return close(fd);
+}
+
+/* stdio streams of a file below the prefix read through the descriptor of the shim */
+ssize_t tnfs_preload_cookieRead(void* cookie, char* data, size_t size)
+{
+    return read((int)(intptr_t)cookie, data, size);
+}
+
+int tnfs_preload_cookieSeek(void* cookie, off64_t* offset, int whence)
+{
+    off_t position = lseek((int)(intptr_t)cookie, *offset, whence);
+
+    if (position < 0)
+        return -1;
+    *offset = position;
+
+    return 0;
+}
+
+int tnfs_preload_cookieClose(void* cookie)
+{
+    return close((int)(intptr_t)cookie);
+}
+
+FILE* fopen(const char* path, const char* mode)
+{
+    TNFS_PRELOAD_REAL(FILE*, "fopen", (const char*, const char*));
+    cookie_io_functions_t functions = {tnfs_preload_cookieRead, NULL, tnfs_preload_cookieSeek, tnfs_preload_cookieClose};
+    char remote[TNFS_MAX_PATH_LEN];
+    FILE* stream;
+    int fd;
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    if (!tnfs_preload_path(AT_FDCWD, path, remote)) {
+        pthread_mutex_unlock(&tnfs_preload_lock);
+        return real(path, mode);
+    }
+
+    if (strpbrk(mode, "wa+") != NULL)
+        fd = tnfs_preload_fail(-TNFS_EROFS);
+    else if (remote[0] == 0)
+        fd = tnfs_preload_fail(-TNFS_ENAMETOOLONG);
+    else
+        fd = tnfs_preload_open(remote, O_RDONLY | (strchr(mode, 'e') != NULL ? O_CLOEXEC : 0));
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    if (fd < 0)
+        return NULL;
+
+    stream = fopencookie((void*)(intptr_t)fd, "r", functions);
+    if (stream == NULL)
+        close(fd);
+
+    return stream;
+}
+
+FILE* fopen64(const char* path, const char* mode) __attribute__((alias("fopen")));
+
+FILE* fdopen(int fd, const char* mode)
+{
+    TNFS_PRELOAD_REAL(FILE*, "fdopen", (int, const char*));
+    cookie_io_functions_t functions = {tnfs_preload_cookieRead, NULL, tnfs_preload_cookieSeek, tnfs_preload_cookieClose};
+    bool ours;
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    ours = tnfs_preload_find(fd) != NULL;
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    if (!ours)
+        return real(fd, mode);
+    if (strpbrk(mode, "wa+") != NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return fopencookie((void*)(intptr_t)fd, "r", functions);
+}
+
+/* a program started with the exec functions below gets the descriptors of the shim it inherits, see tnfs_preload_handover() */
+int execve(const char* path, char* const argv[], char* const envp[])
+{
+    TNFS_PRELOAD_REAL(int, "execve", (const char*, char* const[], char* const[]));
+    char** env;
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    env = tnfs_preload_handover(envp);
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    real(path, argv, env);
+    tnfs_preload_handback(env, envp);
+
+    return -1;
+}
+
+int execvpe(const char* file, char* const argv[], char* const envp[])
+{
+    TNFS_PRELOAD_REAL(int, "execvpe", (const char*, char* const[], char* const[]));
+    char** env;
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    env = tnfs_preload_handover(envp);
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    real(file, argv, env);
+    tnfs_preload_handback(env, envp);
+
+    return -1;
+}
+
+int fexecve(int fd, char* const argv[], char* const envp[])
+{
+    TNFS_PRELOAD_REAL(int, "fexecve", (int, char* const[], char* const[]));
+    char** env;
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    env = tnfs_preload_handover(envp);
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    real(fd, argv, env);
+    tnfs_preload_handback(env, envp);
+
+    return -1;
+}
+
+int execv(const char* path, char* const argv[])
+{
+    return execve(path, argv, environ);
+}
+
+int execvp(const char* file, char* const argv[])
+{
+    return execvpe(file, argv, environ);
+}
+
+int posix_spawn(pid_t* pid, const char* path, const posix_spawn_file_actions_t* actions, const posix_spawnattr_t* attr,
+    char* const argv[], char* const envp[])
+{
+    TNFS_PRELOAD_REAL(int, "posix_spawn", (pid_t*, const char*, const posix_spawn_file_actions_t*, const posix_spawnattr_t*,
+        char* const[], char* const[]));
+    char** env;
+    int code;
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    env = tnfs_preload_handover(envp);
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    code = real(pid, path, actions, attr, argv, env);
+    tnfs_preload_handback(env, envp);
+
+    return code;
+}
+
+int posix_spawnp(pid_t* pid, const char* file, const posix_spawn_file_actions_t* actions, const posix_spawnattr_t* attr,
+    char* const argv[], char* const envp[])
+{
+    TNFS_PRELOAD_REAL(int, "posix_spawnp", (pid_t*, const char*, const posix_spawn_file_actions_t*, const posix_spawnattr_t*,
+        char* const[], char* const[]));
+    char** env;
+    int code;
+
+    pthread_mutex_lock(&tnfs_preload_lock);
+    env = tnfs_preload_handover(envp);
+    pthread_mutex_unlock(&tnfs_preload_lock);
+
+    code = real(pid, file, actions, attr, argv, env);
+    tnfs_preload_handback(env, envp);
+
+    return code;
+}
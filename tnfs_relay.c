@@ -0,0 +1,474 @@
+#include "include/tnfs_relay.h"
+
+#if TNFS_USE_PIPELINE && TNFS_USE_CONTEXTS	// left out by the footprint profile, see tnfs_config.h
+
+/*
+ * Relay copy: tnfs_relay_copy() and tnfs_relay_tree() copy files from a mount in one context to a mount in another
+ * context through a few request buffers, the data never lands on a disk. Each lane is a source and a destination
+ * handle on the same part of a file: small files get a lane each, a file of at least two TNFS_RELAY_SEGMENT gets more
+ * lanes that each start at their own offset. Every round sends the writes of the previous round to the destination
+ * with tnfs_sendBatch(), reads the next chunk of all lanes from the source with one burst and only then collects the
+ * responses of the writes, so the destination writes while the source reads. The requests come from a pool of the run,
+ * at most TNFS_RELAY_LANES writes, reads and read data wait in it.
+ */
+
+/* one part of a file being copied */
+struct tnfs_relay_lane {
+    int      src;	// handle in the source context, -1 for a free lane
+    int      dst;	// handle in the destination context
+    uint32_t remaining;	// bytes of the part not read yet
+    uint8_t  writing;	// writes of the lane in flight
+    uint8_t  file;	// slot of the file in the run
+};
+
+/* one file being copied */
+struct tnfs_relay_file {
+    uint8_t  lanes;	// lanes still busy with the file, 0 for a free slot
+    bool     failed;
+};
+
+/* state of one tnfs_relay_copy() or tnfs_relay_tree() run */
+struct tnfs_relay_run {
+    struct tnfs_context* src;
+    struct tnfs_context* dst;
+    struct tnfs_relay_result* result;
+    int      code;				// first error of a file
+    struct tnfs_pool pool;
+    struct tnfs_request requests[3 * TNFS_RELAY_LANES];
+    uint8_t* buffers;
+    struct tnfs_relay_lane lanes[TNFS_RELAY_LANES];
+    struct tnfs_relay_file files[TNFS_RELAY_LANES];
+    struct tnfs_listing* listing;		// the files to copy are the regular files of this listing, or NULL for one file
+    uint32_t next;				// entry of the listing to look at next, for one file 1 once it started
+    char*    from;				// directory of the listing on the source, or the one file
+    char*    to;				// directory on the destination, or the one file
+    uint32_t size;				// size of the one file
+};
+
+
+/* joins a directory and a name, returns false when the path is too long */
+bool tnfs_relay_join(char* path, const char* dir, const char* name)
+{
+    size_t length = strlen(dir);
+    const char* slash = length > 0 && dir[length - 1] == '/' ? "" : "/";
+
+    return snprintf(path, TNFS_MAX_PATH_LEN, "%s%s%s", dir, slash, name) < TNFS_MAX_PATH_LEN;
+}
+
+/* remembers a failed file */
+void tnfs_relay_fail(struct tnfs_relay_run* run, uint8_t file, int code)
+{
+    run->files[file].failed = true;
+    if (run->code == 0)
+        run->code = code;
+}
+
+/* returns the amount of free lanes */
+int tnfs_relay_free(struct tnfs_relay_run* run)
+{
+    int count = 0;
+
+    for (int i = 0; i < TNFS_RELAY_LANES; i++) {
+        if (run->lanes[i].src < 0)
+            count++;
+    }
+
+    return count;
+}
+
+/* finds the next file to copy, returns false when every file started */
+bool tnfs_relay_next(struct tnfs_relay_run* run, char* from, char* to, uint32_t* size)
+{
+    struct tnfs_listing_entry* e;
+    const char* name;
+
+    if (run->listing == NULL) {
+        if (run->next > 0)
+            return false;
+        run->next = 1;
+        strcpy(from, run->from);
+        strcpy(to, run->to);
+        *size = run->size;
+        return true;
+    }
+
+    while (run->next < run->listing->count) {
+        e = &run->listing->entries[run->next++];
+        name = &run->listing->names[e->name];
+        if ((e->flags & TNFS_DIRENTRY_DIR) || strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+            continue;
+        if (!tnfs_relay_join(from, run->from, name) || !tnfs_relay_join(to, run->to, name)) {
+            run->result->failed++;
+            continue;
+        }
+        *size = e->size;
+        return true;
+    }
+
+    return false;
+}
+
+/*
+ * opens a file on both sides with as many lanes as it gets. The first destination handle creates and truncates the
+ * file, the others open it as it is. Returns false when not even one lane could be opened
+ */
+bool tnfs_relay_open(struct tnfs_relay_run* run, char* from, char* to, uint32_t size)
+{
+    uint32_t segments = size / TNFS_RELAY_SEGMENT;
+    uint32_t part, offset;
+    uint8_t file = 0;
+    int first, s, d, code;
+    struct tnfs_relay_lane* lane;
+
+    while (run->files[file].lanes > 0)
+        file++;
+    run->files[file].failed = false;
+
+    if (segments > (uint32_t)tnfs_relay_free(run))
+        segments = tnfs_relay_free(run);
+    if (segments < 1)
+        segments = 1;
+    part = (size / segments + TNFS_RELAY_CHUNK - 1) / TNFS_RELAY_CHUNK * TNFS_RELAY_CHUNK;
+
+    tnfs_context_switch(run->dst);
+    first = tnfs_open(to, TNFS_O_WRONLY | TNFS_O_CREAT | TNFS_O_TRUNC, TNFS_RELAY_MODE);
+    if (first < 0) {
+        tnfs_relay_fail(run, file, first);
+        run->result->failed++;
+        return false;
+    }
+
+    for (uint32_t k = 0; k < segments; k++) {
+        offset = k * part;
+        if (k > 0 && offset >= size)
+            break;
+
+        tnfs_context_switch(run->src);
+        s = tnfs_open(from, TNFS_O_RDONLY, 0);
+        code = s < 0 ? s : (offset > 0 ? tnfs_lseek(s, TNFS_SEEK_SET, offset) : 0);
+
+        tnfs_context_switch(run->dst);
+        d = first;
+        if (code == 0 && k > 0) {
+            d = code = tnfs_open(to, TNFS_O_WRONLY, 0);
+            if (d >= 0 && (code = tnfs_lseek(d, TNFS_SEEK_SET, offset)) < 0)
+                tnfs_close(d);
+        }
+
+        if (code < 0) {
+            if (k == 0)
+                tnfs_close(first);
+            if (s >= 0) {
+                tnfs_context_switch(run->src);
+                tnfs_close(s);
+            }
+            tnfs_relay_fail(run, file, code);
+            break;
+        }
+
+        lane = &run->lanes[0];
+        while (lane->src >= 0)
+            lane++;
+        lane->src = s;
+        lane->dst = d;
+        lane->remaining = size - offset < part ? size - offset : part;
+        lane->writing = 0;
+        lane->file = file;
+        run->files[file].lanes++;
+    }
+
+    if (run->files[file].lanes == 0) {
+        run->result->failed++;
+        return false;
+    }
+
+    return true;
+}
+
+/* closes a lane that is done, the file is counted when its last lane closes */
+void tnfs_relay_close(struct tnfs_relay_run* run, struct tnfs_relay_lane* lane)
+{
+    struct tnfs_relay_file* f = &run->files[lane->file];
+    int code;
+
+    tnfs_context_switch(run->src);
+    tnfs_close(lane->src);
+    tnfs_context_switch(run->dst);
+    code = tnfs_close(lane->dst);
+    if (code < 0)
+        tnfs_relay_fail(run, lane->file, code);
+
+    lane->src = -1;
+    if (--f->lanes == 0) {
+        if (f->failed)
+            run->result->failed++;
+        else
+            run->result->files++;
+    }
+}
+
+/* copies every file the run has to offer, returns when all of them are closed */
+void tnfs_relay_pump(struct tnfs_relay_run* run)
+{
+    struct tnfs_request* writes[TNFS_RELAY_LANES];
+    struct tnfs_request* reads[TNFS_RELAY_LANES];
+    struct tnfs_request* pending[TNFS_RELAY_LANES];
+    uint16_t expected[TNFS_RELAY_LANES];
+    uint16_t lengths[TNFS_RELAY_LANES];
+    struct tnfs_relay_lane* lane;
+    struct tnfs_request* req;
+    char from[TNFS_MAX_PATH_LEN];
+    char to[TNFS_MAX_PATH_LEN];
+    uint32_t size;
+    bool more = true;
+    bool busy;
+    int nw = 0, nr, np, n;
+
+    for (;;) {
+        while (more && tnfs_relay_free(run) > 0) {
+            more = tnfs_relay_next(run, from, to, &size);
+            if (more)
+                tnfs_relay_open(run, from, to, size);
+        }
+
+        /* the writes of the previous round go out first, the destination works on them during the reads */
+        if (nw > 0) {
+            tnfs_context_switch(run->dst);
+            tnfs_sendBatch(writes, nw);
+        }
+
+        /* the next chunk of every lane, read straight into the buffer of the write that will carry it */
+        tnfs_context_switch(run->src);
+        nr = 0;
+        for (int i = 0; i < TNFS_RELAY_LANES; i++) {
+            lane = &run->lanes[i];
+            if (lane->src < 0 || lane->remaining == 0 || run->files[lane->file].failed)
+                continue;
+            req = tnfs_pool_get(&run->pool);
+            n = tnfs_prepareRead(req, lane->src, lane->remaining < TNFS_RELAY_CHUNK ? lane->remaining : TNFS_RELAY_CHUNK);
+            if (n < 0) {
+                tnfs_pool_put(&run->pool, req);
+                tnfs_relay_fail(run, lane->file, n);
+                continue;
+            }
+            req->user = lane;
+            reads[nr++] = req;
+        }
+        if (nr > 0)
+            tnfs_batch(&run->pool, reads, nr);
+
+        np = 0;
+        for (int i = 0; i < nr; i++) {
+            lane = reads[i]->user;
+            req = tnfs_pool_get(&run->pool);
+            n = tnfs_takeRead(reads[i], lane->src, (char*)&req->buffer[7]);
+            tnfs_pool_put(&run->pool, reads[i]);
+            if (n > 0) {
+                lane->remaining -= n < (int)lane->remaining ? (uint32_t)n : lane->remaining;
+                req->user = lane;
+                lengths[np] = n;
+                pending[np++] = req;
+                continue;
+            }
+            tnfs_pool_put(&run->pool, req);
+            if (n == 0 || n == -TNFS_EOF)
+                lane->remaining = 0;	// the file got shorter since it was listed
+            else
+                tnfs_relay_fail(run, lane->file, n);
+        }
+
+        /* the responses of the writes, then the new writes for the next round */
+        tnfs_context_switch(run->dst);
+        if (nw > 0)
+            tnfs_waitBatch(&run->pool, writes, nw);
+        for (int i = 0; i < nw; i++) {
+            lane = writes[i]->user;
+            n = tnfs_takeWrite(writes[i], lane->dst, NULL);
+            if (n > 0)
+                run->result->bytes += n;
+            if (n != expected[i])
+                tnfs_relay_fail(run, lane->file, n < 0 ? n : -TNFS_ENOSPC);
+            lane->writing--;
+            tnfs_pool_put(&run->pool, writes[i]);
+        }
+
+        nw = 0;
+        for (int i = 0; i < np; i++) {
+            lane = pending[i]->user;
+            n = tnfs_prepareWrite(pending[i], lane->dst, (char*)&pending[i]->buffer[7], lengths[i], run->pool.bufsize);
+            if (n < 0 || run->files[lane->file].failed) {
+                tnfs_pool_put(&run->pool, pending[i]);
+                tnfs_relay_fail(run, lane->file, n);
+                continue;
+            }
+            lane->writing++;
+            expected[nw] = lengths[i];
+            writes[nw++] = pending[i];
+        }
+
+        busy = nw > 0;
+        for (int i = 0; i < TNFS_RELAY_LANES; i++) {
+            lane = &run->lanes[i];
+            if (lane->src < 0)
+                continue;
+            if (lane->writing == 0 && (lane->remaining == 0 || run->files[lane->file].failed))
+                tnfs_relay_close(run, lane);
+            else
+                busy = true;
+        }
+
+        if (!busy && !more)
+            break;
+    }
+}
+
+/* prepares a run, returns 0 or -TNFS_ENOMEM */
+int tnfs_relay_init(struct tnfs_relay_run* run, struct tnfs_context* src, struct tnfs_context* dst, struct tnfs_relay_result* result)
+{
+    memset(run, 0, sizeof(struct tnfs_relay_run));
+    memset(result, 0, sizeof(struct tnfs_relay_result));
+
+    run->buffers = malloc(3 * TNFS_RELAY_LANES * TNFS_POOL_BUFSIZE);
+    if (run->buffers == NULL)
+        return -TNFS_ENOMEM;
+
+    tnfs_pool_init(&run->pool, run->requests, run->buffers, 3 * TNFS_RELAY_LANES, TNFS_POOL_BUFSIZE);
+    for (int i = 0; i < TNFS_RELAY_LANES; i++)
+        run->lanes[i].src = -1;
+    run->src = src;
+    run->dst = dst;
+    run->result = result;
+
+    return 0;
+}
+
+/* copies a directory: creates it on the destination, copies its files at the same time and then its subdirectories */
+int tnfs_relay_dir(struct tnfs_relay_run* run, char* from, char* to)
+{
+    struct tnfs_listing listing;
+    struct tnfs_listing_entry* e;
+    const char* name;
+    char subfrom[TNFS_MAX_PATH_LEN];
+    char subto[TNFS_MAX_PATH_LEN];
+    int code = 0;
+
+    /* the root of a mount is always there, tnfs_mkdir() returns a positive code */
+    tnfs_context_switch(run->dst);
+    if (strcmp(to, "/") != 0 && strcmp(to, "") != 0)
+        code = -tnfs_mkdir(to);
+    if (code != 0 && code != -TNFS_EEXIST) {
+        run->result->failed++;
+        return code;
+    }
+    run->result->dirs++;
+
+    tnfs_context_switch(run->src);
+    code = tnfs_listing_load(&listing, from, TNFS_DIROPT_NO_SKIPHIDDEN);
+    if (code < 0) {
+        run->result->failed++;
+        return code;
+    }
+
+    run->listing = &listing;
+    run->next = 0;
+    run->from = from;
+    run->to = to;
+    tnfs_relay_pump(run);
+
+    for (uint32_t i = 0; i < listing.count; i++) {
+        e = &listing.entries[i];
+        name = &listing.names[e->name];
+        if (!(e->flags & TNFS_DIRENTRY_DIR) || strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+            continue;
+        if (!tnfs_relay_join(subfrom, from, name) || !tnfs_relay_join(subto, to, name)) {
+            run->result->failed++;
+            continue;
+        }
+        tnfs_relay_dir(run, subfrom, subto);
+    }
+
+    tnfs_listing_free(&listing);
+
+    return 0;
+}
+
+/*
+ * Copies one file from the mount of context src to the mount of context dst, an existing destination file is
+ * overwritten. The current context is the same afterwards. Returns 0 or a negative error code
+ */
+int tnfs_relay_copy(struct tnfs_context* src, const char* from, struct tnfs_context* dst, const char* to, struct tnfs_relay_result* result)
+{
+    struct tnfs_context* current = tnfs_context_current();
+    struct tnfs_relay_run run;
+    struct fstat st;
+    char source[TNFS_MAX_PATH_LEN];
+    char target[TNFS_MAX_PATH_LEN];
+    int code;
+
+    if (strlen(from) >= TNFS_MAX_PATH_LEN || strlen(to) >= TNFS_MAX_PATH_LEN)
+        return -TNFS_ENAMETOOLONG;
+    strcpy(source, from);
+    strcpy(target, to);
+
+    code = tnfs_relay_init(&run, src, dst, result);
+    if (code != 0)
+        return code;
+
+    tnfs_context_switch(src);
+    code = tnfs_stat(source, &st);
+    if (code == 0 && (st.mode & 0xF000) == 0x4000)
+        code = -TNFS_EISDIR;
+
+    if (code == 0) {
+        run.from = source;
+        run.to = target;
+        run.size = st.size;
+        tnfs_relay_pump(&run);
+        code = run.code;
+    }
+
+    free(run.buffers);
+    tnfs_context_switch(current);
+
+#ifdef DEBUG
+    printf("relay: %s -> %s, %llu bytes, %s\n\n", from, to, (unsigned long long)result->bytes, code == 0 ? "ok" : "failed");
+#endif
+
+    return code;
+}
+
+/*
+ * Copies a directory with everything in it from the mount of context src to the mount of context dst. Existing
+ * directories are used and existing files are overwritten, files that can't be copied are counted in the result. The
+ * current context is the same afterwards. Returns 0 or the negative error code of the directory itself
+ */
+int tnfs_relay_tree(struct tnfs_context* src, const char* from, struct tnfs_context* dst, const char* to, struct tnfs_relay_result* result)
+{
+    struct tnfs_context* current = tnfs_context_current();
+    struct tnfs_relay_run run;
+    char source[TNFS_MAX_PATH_LEN];
+    char target[TNFS_MAX_PATH_LEN];
+    int code;
+
+    if (strlen(from) >= TNFS_MAX_PATH_LEN || strlen(to) >= TNFS_MAX_PATH_LEN)
+        return -TNFS_ENAMETOOLONG;
+    strcpy(source, from);
+    strcpy(target, to);
+
+    code = tnfs_relay_init(&run, src, dst, result);
+    if (code != 0)
+        return code;
+
+    code = tnfs_relay_dir(&run, source, target);
+
+    free(run.buffers);
+    tnfs_context_switch(current);
+
+#ifdef DEBUG
+    printf("relay: %u dirs, %u files, %llu bytes, %u failed\n\n", result->dirs, result->files, (unsigned long long)result->bytes, result->failed);
+#endif
+
+    return code;
+}
+
+#endif /* TNFS_USE_PIPELINE && TNFS_USE_CONTEXTS */
@@ -0,0 +1,252 @@
+#include "include/tnfs_sched.h"
+#include "include/tnfs_timeline.h"
+
+#if TNFS_USE_PIPELINE	// left out by the footprint profile, see tnfs_config.h
+
+/*
+ * Request scheduler: jobs put their requests in the queue of a priority class and tnfs_sched_run() sends them in
+ * rounds of up to TNFS_SCHED_SLOTS requests with tnfs_batch(). The slots of a round go to the classes by weighted fair
+ * queuing: every class has a virtual finish time that grows by the cost of each request divided by its weight, and
+ * the request that would finish first is taken. A class that was idle starts at the current virtual time, so it
+ * can't save up credit, and an interactive request never waits longer than the round that is in flight. Token
+ * buckets optionally limit the bytes per second of a class and of the server connection as a whole.
+ */
+
+#define TNFS_SCHED_SCALE 256	// virtual time units per byte of a class with weight 1
+
+/* token bucket, rate zero means unlimited */
+struct tnfs_sched_bucket {
+    uint32_t rate;	// bytes per second
+    uint32_t burst;	// maximum amount of tokens
+    int64_t  tokens;	// bytes that may be sent now, negative after a request that was larger than the tokens left
+    uint32_t last;	// tnfs_sched_clock() of the last refill
+};
+
+/* queue and state of one priority class */
+struct tnfs_sched_class {
+    struct tnfs_request* head;	// first queued request, linked by next
+    struct tnfs_request* tail;	// last queued request
+    uint16_t queued;		// amount of queued requests
+    uint16_t weight;		// share of the slots compared to the other classes
+    uint64_t finish;		// virtual finish time of the last request taken from this class
+    struct tnfs_sched_bucket bucket;
+};
+
+/* scheduler global variables */
+struct tnfs_sched_class tnfs_sched_classes[TNFS_SCHED_CLASSES] = {
+    { NULL, NULL, 0, 16, 0, { 0, 0, 0, 0 } },	// TNFS_SCHED_INTERACTIVE
+    { NULL, NULL, 0, 4, 0, { 0, 0, 0, 0 } },	// TNFS_SCHED_FOREGROUND
+    { NULL, NULL, 0, 1, 0, { 0, 0, 0, 0 } }	// TNFS_SCHED_BULK
+};
+struct tnfs_sched_bucket tnfs_sched_server = { 0, 0, 0, 0 };	// limit of all classes together
+uint64_t tnfs_sched_vtime = 0;					// latest virtual start time of a request taken
+uint32_t (*tnfs_sched_clock)() = netw_millis;			// milliseconds for the token buckets, a test can replace it
+
+
+/* returns the cost of a request in bytes on the wire, including the data of the response of a READ */
+uint32_t tnfs_sched_cost(struct tnfs_request* req)
+{
+    uint16_t maxlen;
+
+    switch (req->cmd) {
+        case 0x21:
+            memcpy(&maxlen, &req->buffer[5], 2);
+            return TNFS_SCHED_METADATA + maxlen;
+        case 0x22:
+            return TNFS_SCHED_METADATA + req->length;
+        default:
+            return TNFS_SCHED_METADATA;
+    }
+}
+
+/* adds the tokens earned since the last refill */
+void tnfs_sched_refill(struct tnfs_sched_bucket* b, uint32_t now)
+{
+    uint64_t earned;
+
+    if (b->rate == 0)
+        return;
+
+    /* the clock only moves on once a whole token was earned, so slow rates don't lose the fractions */
+    earned = (uint64_t)(now - b->last) * b->rate / 1000;
+    if (earned == 0)
+        return;
+
+    b->last = now;
+    if (earned > b->burst || b->tokens + (int64_t)earned > b->burst)
+        b->tokens = b->burst;
+    else
+        b->tokens += earned;
+}
+
+/* returns the milliseconds until the bucket allows the next request, zero when it allows one now */
+uint32_t tnfs_sched_wait(struct tnfs_sched_bucket* b)
+{
+    if (b->rate == 0 || b->tokens > 0)
+        return 0;
+
+    return (uint32_t)(((uint64_t)(1 - b->tokens) * 1000 + b->rate - 1) / b->rate);
+}
+
+/* takes the cost of a request from a bucket */
+void tnfs_sched_consume(struct tnfs_sched_bucket* b, uint32_t cost)
+{
+    if (b->rate != 0)
+        b->tokens -= cost;
+}
+
+/* Queues a request taken from tnfs_pool_default() in a priority class, it is sent by a later tnfs_sched_run() */
+int tnfs_sched_submit(struct tnfs_request* req, uint8_t cls)
+{
+    struct tnfs_sched_class* c;
+
+    if (cls >= TNFS_SCHED_CLASSES)
+        return -TNFS_EINVAL;
+
+    c = &tnfs_sched_classes[cls];
+    req->next = NULL;
+
+    /* a class that was idle starts at the current virtual time, a backlogged one goes on from its last finish time */
+    if (c->tail == NULL && c->finish < tnfs_sched_vtime)
+        c->finish = tnfs_sched_vtime;
+    if (c->tail == NULL)
+        c->head = req;
+    else
+        c->tail->next = req;
+    c->tail = req;
+    c->queued++;
+    if (tnfs_timeline_used)
+        req->queued = netw_micros();
+
+    return 0;
+}
+
+/* Sets the share of a class, a class with weight 4 gets four times the bytes of a class with weight 1 */
+void tnfs_sched_weight(uint8_t cls, uint16_t weight)
+{
+    if (cls < TNFS_SCHED_CLASSES)
+        tnfs_sched_classes[cls].weight = weight == 0 ? 1 : weight;
+}
+
+/* Limits a class, or with TNFS_SCHED_SERVER all classes together, to rate bytes per second. Zero removes the limit */
+void tnfs_sched_limit(uint8_t cls, uint32_t rate, uint32_t burst)
+{
+    struct tnfs_sched_bucket* b;
+
+    if (cls == TNFS_SCHED_SERVER)
+        b = &tnfs_sched_server;
+    else if (cls < TNFS_SCHED_CLASSES)
+        b = &tnfs_sched_classes[cls].bucket;
+    else
+        return;
+
+    b->rate = rate;
+    b->burst = burst > 0 ? burst : rate;
+    b->tokens = b->burst;
+    b->last = tnfs_sched_clock();
+}
+
+/*
+ * Sends one round of queued requests and calls done for each of them once the responses are in, a request without a
+ * response has status -TNFS_EPROTO. The callback owns the request again and gives it back to the pool or submits it
+ * once more. Returns the amount of requests handled, zero when nothing is queued or the rate limits hold everything
+ * back; tnfs_sched_delay() tells how long.
+ */
+int tnfs_sched_run(tnfs_sched_done done)
+{
+    struct tnfs_request* reqs[TNFS_SCHED_SLOTS];
+    struct tnfs_sched_class* c;
+    uint32_t now = tnfs_sched_clock();
+    uint64_t finish, best_start = 0, best_finish = 0;
+    int best;
+    int n = 0;
+
+    tnfs_sched_refill(&tnfs_sched_server, now);
+    for (int i = 0; i < TNFS_SCHED_CLASSES; i++)
+        tnfs_sched_refill(&tnfs_sched_classes[i].bucket, now);
+
+    while (n < TNFS_SCHED_SLOTS && tnfs_sched_wait(&tnfs_sched_server) == 0) {
+        /* the request with the earliest virtual finish time goes first */
+        best = -1;
+        for (int i = 0; i < TNFS_SCHED_CLASSES; i++) {
+            c = &tnfs_sched_classes[i];
+            if (c->head == NULL || tnfs_sched_wait(&c->bucket) != 0)
+                continue;
+
+            finish = c->finish + (uint64_t)tnfs_sched_cost(c->head) * TNFS_SCHED_SCALE / c->weight;
+            if (best < 0 || finish < best_finish) {
+                best = i;
+                best_start = c->finish;
+                best_finish = finish;
+            }
+        }
+        if (best < 0)
+            break;
+
+        c = &tnfs_sched_classes[best];
+        reqs[n] = c->head;
+        c->head = reqs[n]->next;
+        if (c->head == NULL)
+            c->tail = NULL;
+        c->queued--;
+        reqs[n]->next = NULL;
+        if (tnfs_timeline_used)
+            tnfs_timeline_span(TNFS_SPAN_QUEUED, TNFS_LANE_QUEUED + best, reqs[n]->queued, reqs[n]->id, reqs[n]->cmd, 0);
+
+        c->finish = best_finish;
+        if (best_start > tnfs_sched_vtime)
+            tnfs_sched_vtime = best_start;
+        tnfs_sched_consume(&c->bucket, tnfs_sched_cost(reqs[n]));
+        tnfs_sched_consume(&tnfs_sched_server, tnfs_sched_cost(reqs[n]));
+        n++;
+    }
+
+    if (n == 0)
+        return 0;
+
+    tnfs_batch(tnfs_pool_default(), reqs, n);
+
+    for (int i = 0; i < n; i++) {
+        if (reqs[i]->state != TNFS_REQ_DONE)
+            reqs[i]->status = -TNFS_EPROTO;
+        done(reqs[i]);
+    }
+
+    return n;
+}
+
+/* Returns the milliseconds until tnfs_sched_run() can send a queued request, zero when it can now or nothing is queued */
+uint32_t tnfs_sched_delay()
+{
+    uint32_t now = tnfs_sched_clock();
+    uint32_t delay = 0;
+    uint32_t wait;
+    bool queued = false;
+
+    tnfs_sched_refill(&tnfs_sched_server, now);
+    for (int i = 0; i < TNFS_SCHED_CLASSES; i++) {
+        if (tnfs_sched_classes[i].head == NULL)
+            continue;
+
+        tnfs_sched_refill(&tnfs_sched_classes[i].bucket, now);
+        wait = tnfs_sched_wait(&tnfs_sched_classes[i].bucket);
+        if (!queued || wait < delay)
+            delay = wait;
+        queued = true;
+    }
+
+    if (!queued)
+        return 0;
+
+    wait = tnfs_sched_wait(&tnfs_sched_server);
+
+    return wait > delay ? wait : delay;
+}
+
+/* Returns the amount of requests waiting in a class */
+uint16_t tnfs_sched_queued(uint8_t cls)
+{
+    return cls < TNFS_SCHED_CLASSES ? tnfs_sched_classes[cls].queued : 0;
+}
+
+#endif /* TNFS_USE_PIPELINE */
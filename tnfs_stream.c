@@ -0,0 +1,282 @@
+#include "include/tnfs_stream.h"
+
+/*
+ * Buffered streams: callers that read lines or write small records would send one READ or WRITE request for every
+ * call. A stream collects writes in wbuf and reads ahead into rbuf, so the server only sees requests of
+ * TNFS_STREAM_BUFSIZE bytes. Pending writes are sent on tnfs_fflush(), tnfs_fseek() and tnfs_fclose().
+ */
+
+/* stream global variables */
+struct tnfs_stream tnfs_streams[TNFS_MAX_STREAMS];	// open streams, handle is -1 for a free one
+bool     tnfs_streams_initialized = false;
+
+
+/* sends the buffered writes to the server */
+int tnfs_fflush(struct tnfs_stream* s)
+{
+    int code;
+
+    if (s->wlen == 0)
+        return 0;
+
+    code = tnfs_write(s->wbuf, s->handle, s->wlen);
+    if (code == 0)
+        s->wlen = 0;
+
+    return code;
+}
+
+/* throws away the read ahead data, the server is positioned behind it so it has to seek back */
+int tnfs_dropReadAhead(struct tnfs_stream* s)
+{
+    bool ahead = s->rpos < s->rlen;
+
+    s->rpos = 0;
+    s->rlen = 0;
+    s->eof = false;
+
+    if (ahead && !s->append)
+        return tnfs_lseek(s->handle, TNFS_SEEK_SET, s->position);
+
+    return 0;
+}
+
+/* Opens a buffered stream, mode is "r", "w" or "a" optionally followed by "+" like fopen(). NULL on failure */
+struct tnfs_stream* tnfs_fopen(char* filename, const char* mode)
+{
+    struct tnfs_stream* s = NULL;
+    uint16_t flags;
+    bool update = strchr(mode, '+') != NULL;
+    int handle;
+
+    if (!tnfs_streams_initialized) {
+        for (int i = 0; i < TNFS_MAX_STREAMS; i++)
+            tnfs_streams[i].handle = -1;
+        tnfs_streams_initialized = true;
+    }
+
+    switch (mode[0]) {
+        case 'r': flags = update ? TNFS_O_RDWR : TNFS_O_RDONLY; break;
+        case 'w': flags = (update ? TNFS_O_RDWR : TNFS_O_WRONLY) | TNFS_O_CREAT | TNFS_O_TRUNC; break;
+        case 'a': flags = (update ? TNFS_O_RDWR : TNFS_O_WRONLY) | TNFS_O_CREAT | TNFS_O_APPEND; break;
+        default:  return NULL;
+    }
+
+    for (int i = 0; s == NULL && i < TNFS_MAX_STREAMS; i++) {
+        if (tnfs_streams[i].handle < 0)
+            s = &tnfs_streams[i];
+    }
+    if (s == NULL)
+        return NULL;
+
+    handle = tnfs_open(filename, flags, 0644);
+    if (handle < 0)
+        return NULL;
+
+    s->handle = handle;
+    s->append = mode[0] == 'a';
+    s->eof = false;
+    s->moved = false;
+    s->position = 0;
+    s->rpos = 0;
+    s->rlen = 0;
+    s->wlen = 0;
+
+    /* like fopen() the stream starts at the end, offline that isn't known and it starts at 0 */
+    if (s->append)
+        tnfs_fseek(s, TNFS_SEEK_END, 0);
+
+    return s;
+}
+
+/* Writes the buffered data and closes the stream */
+int tnfs_fclose(struct tnfs_stream* s)
+{
+    int code = tnfs_fflush(s);
+    int closed = tnfs_close(s->handle);
+
+    s->handle = -1;
+
+    return code != 0 ? code : closed;
+}
+
+/* Reads up to size bytes, returns the amount read (zero at the end of the file) or a negative error code */
+int tnfs_fread(void* data, uint16_t size, struct tnfs_stream* s)
+{
+    uint16_t done = 0;
+    uint16_t n;
+    int code = tnfs_fflush(s);
+
+    if (code != 0)
+        return code;
+
+    while (done < size) {
+        if (s->rpos == s->rlen) {
+            if (s->eof)
+                break;
+            code = tnfs_read(s->rbuf, s->handle, TNFS_STREAM_BUFSIZE);
+            if (code == -TNFS_EOF || code == 0) {
+                s->eof = true;
+                break;
+            }
+            if (code < 0)
+                return done > 0 ? done : code;
+            s->rpos = 0;
+            s->rlen = code;
+        }
+
+        n = s->rlen - s->rpos;
+        if (n > size - done)
+            n = size - done;
+        memcpy((char*)data + done, &s->rbuf[s->rpos], n);
+        s->rpos += n;
+        done += n;
+    }
+
+    s->position += done;
+    s->moved = s->moved || done > 0;
+
+    return done;
+}
+
+/* Writes size bytes into the buffer, a full buffer is sent as one request. Returns size or a negative error code */
+int tnfs_fwrite(const void* data, uint16_t size, struct tnfs_stream* s)
+{
+    uint16_t done = 0;
+    uint16_t n;
+    int code = tnfs_dropReadAhead(s);
+
+    if (code != 0)
+        return code;
+
+    /* the data goes to the end anyway, this only brings the position there */
+    if (s->append && s->moved)
+        tnfs_fseek(s, TNFS_SEEK_END, 0);
+
+    while (done < size) {
+        n = TNFS_STREAM_BUFSIZE - s->wlen;
+        if (n > size - done)
+            n = size - done;
+        memcpy(&s->wbuf[s->wlen], (const char*)data + done, n);
+        s->wlen += n;
+        done += n;
+
+        if (s->wlen == TNFS_STREAM_BUFSIZE) {
+            code = tnfs_fflush(s);
+            if (code != 0)
+                return code;
+        }
+    }
+
+    s->position += size;
+
+    return size;
+}
+
+/* Reads one character, returns it as an unsigned value or a negative error code (-TNFS_EOF at the end) */
+int tnfs_fgetc(struct tnfs_stream* s)
+{
+    uint8_t c;
+    int code;
+
+    /* fast path without flushing and copying */
+    if (s->rpos < s->rlen && s->wlen == 0) {
+        s->position++;
+        return (uint8_t)s->rbuf[s->rpos++];
+    }
+
+    code = tnfs_fread(&c, 1, s);
+    if (code == 0)
+        return -TNFS_EOF;
+
+    return code < 0 ? code : c;
+}
+
+/* Reads a line including the newline, at most size - 1 characters. NULL at the end of the file or on an error */
+char* tnfs_fgets(char* str, int size, struct tnfs_stream* s)
+{
+    int i = 0;
+    int c;
+
+    while (i < size - 1) {
+        c = tnfs_fgetc(s);
+        if (c < 0)
+            break;
+        str[i++] = c;
+        if (c == '\n')
+            break;
+    }
+
+    if (i == 0)
+        return NULL;
+
+    str[i] = 0;
+
+    return str;
+}
+
+/* Writes a string without its terminating zero */
+int tnfs_fputs(const char* str, struct tnfs_stream* s)
+{
+    return tnfs_fwrite(str, strlen(str), s);
+}
+
+/* Writes formatted text like fprintf(), the result may be up to TNFS_STREAM_BUFSIZE - 1 characters */
+int tnfs_fprintf(struct tnfs_stream* s, const char* format, ...)
+{
+    char text[TNFS_STREAM_BUFSIZE];
+    va_list args;
+    int length;
+
+    va_start(args, format);
+    length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+
+    if (length < 0 || length >= (int)sizeof(text))
+        return -TNFS_E2BIG;
+
+    return tnfs_fwrite(text, length, s);
+}
+
+/* Writes the buffered data and moves to another position, like fseek() with TNFS_SEEK_SET, _CUR or _END */
+int tnfs_fseek(struct tnfs_stream* s, uint8_t seektype, int32_t offset)
+{
+    int code = tnfs_fflush(s);
+
+    if (code != 0)
+        return code;
+
+    s->rpos = 0;
+    s->rlen = 0;
+    s->eof = false;
+
+    /* the server is ahead of the caller by the read ahead data, so a relative seek becomes an absolute one */
+    if (seektype == TNFS_SEEK_CUR) {
+        seektype = TNFS_SEEK_SET;
+        offset += s->position;
+    }
+
+    code = tnfs_lseek(s->handle, seektype, (uint32_t)offset);
+    if (code != 0)
+        return code;
+    s->moved = seektype != TNFS_SEEK_END || offset != 0;
+
+    if (seektype == TNFS_SEEK_SET) {
+        s->position = offset;
+        return 0;
+    }
+
+    return tnfs_tell(s->handle, &s->position);
+}
+
+/* Returns the position in the file as seen by the caller */
+uint32_t tnfs_ftell(struct tnfs_stream* s)
+{
+    return s->position;
+}
+
+/* Returns true when a read reached the end of the file */
+bool tnfs_feof(struct tnfs_stream* s)
+{
+    return s->eof && s->rpos == s->rlen;
+}
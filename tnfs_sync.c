@@ -0,0 +1,688 @@
+#include "include/tnfs_sync.h"
+#include <sys/stat.h>
+#include <dirent.h>
+#include <utime.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#define tnfs_local_mkdir(path) _mkdir(path)
+#else
+#define tnfs_local_mkdir(path) mkdir(path, 0755)
+#endif
+
+#if TNFS_USE_PIPELINE	// left out by the footprint profile, see tnfs_config.h
+
+/*
+ * Mirror sync: tnfs_sync() lists the remote tree with opendirx(), whose entries already carry size and modification
+ * time, and downloads only the files that differ from the manifest of the previous run, or from the local file when
+ * there is no manifest. Local files that are gone from the server are deleted. The downloads run TNFS_SYNC_PARALLEL
+ * files at a time through tnfs_readv(). The new manifest lists every directory with its children next to each other,
+ * so with TNFS_SYNC_TRUST_DIRS an unchanged directory is taken from the manifest instead of being listed again. Note
+ * that rewriting a file in place doesn't change the modification time of its directory.
+ */
+
+const char TNFS_SYNC_MAGIC[8] = {'T', 'N', 'F', 'S', 'S', 'Y', 'N', 0x01};
+
+#define TNFS_SYNC_DIR     0x01	// the entry is a directory
+#define TNFS_SYNC_PENDING 0x02	// the file has to be downloaded
+#define TNFS_SYNC_FAILED  0x04	// the download failed, leave the file out of the manifest and its directory without a time
+
+/* one file or directory, entry 0 of a list is the synced directory itself with an empty path */
+struct tnfs_sync_entry {
+    uint32_t name;	// offset of the path, relative to the synced directory, in the names of the list
+    uint32_t size;
+    uint32_t mtime;
+    uint32_t first;	// directories: index of the first child
+    uint32_t children;	// directories: amount of children, they follow each other from first on
+    uint8_t  flags;	// TNFS_SYNC_DIR, TNFS_SYNC_PENDING, TNFS_SYNC_FAILED
+};
+
+/* a tree of files and directories with a hash index on the paths */
+struct tnfs_sync_list {
+    struct tnfs_sync_entry* entries;
+    uint32_t count;
+    uint32_t capacity;
+    char*    names;	// all paths, each with a terminating zero
+    uint32_t used;
+    uint32_t room;
+    uint32_t* index;	// open addressing hash table with entry number + 1, zero for an empty slot
+    uint32_t slots;	// size of index, a power of two
+};
+
+/* state of one tnfs_sync() run */
+struct tnfs_sync_run {
+    const char* remote;
+    const char* local;
+    uint8_t  options;
+    bool     manifest;		// the previous run left a manifest
+    struct tnfs_sync_list old;	// manifest of the previous run
+    struct tnfs_sync_list now;	// the tree as found on the server during this run
+    struct tnfs_sync_result* result;
+    char*    batches;		// two buffers for tnfs_prefetchdirx()
+};
+
+/* one file being downloaded */
+struct tnfs_sync_transfer {
+    uint32_t entry;	// index in the list of the run
+    int      handle;	// remote file, -1 for a free transfer slot
+    FILE*    f;		// local temporary file
+};
+
+
+/* FNV-1a hash of a path */
+uint32_t tnfs_sync_hash(const char* path)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*path)
+        hash = (hash ^ (uint8_t)*path++) * 16777619u;
+
+    return hash;
+}
+
+/* returns the path of an entry, valid until the next entry is added */
+const char* tnfs_sync_path(struct tnfs_sync_list* list, uint32_t entry)
+{
+    return &list->names[list->entries[entry].name];
+}
+
+/* finds an entry by its path, returns -1 when the list doesn't have it */
+long tnfs_sync_find(struct tnfs_sync_list* list, const char* path)
+{
+    uint32_t i;
+
+    if (list->slots == 0)
+        return -1;
+
+    for (i = tnfs_sync_hash(path) & (list->slots - 1); list->index[i] != 0; i = (i + 1) & (list->slots - 1)) {
+        if (strcmp(tnfs_sync_path(list, list->index[i] - 1), path) == 0)
+            return list->index[i] - 1;
+    }
+
+    return -1;
+}
+
+/* puts an entry in the hash index */
+void tnfs_sync_insert(struct tnfs_sync_list* list, uint32_t entry)
+{
+    uint32_t i = tnfs_sync_hash(tnfs_sync_path(list, entry)) & (list->slots - 1);
+
+    while (list->index[i] != 0)
+        i = (i + 1) & (list->slots - 1);
+
+    list->index[i] = entry + 1;
+}
+
+/* adds an entry, returns its index or -TNFS_ENOMEM */
+long tnfs_sync_add(struct tnfs_sync_list* list, const char* path, uint32_t size, uint32_t mtime, uint8_t flags)
+{
+    uint32_t length = strlen(path) + 1;
+    struct tnfs_sync_entry* e;
+    void* grown;
+
+    if (list->count == list->capacity) {
+        grown = realloc(list->entries, (list->capacity * 2 + 64) * sizeof(struct tnfs_sync_entry));
+        if (grown == NULL)
+            return -TNFS_ENOMEM;
+        list->entries = grown;
+        list->capacity = list->capacity * 2 + 64;
+    }
+    if (list->used + length > list->room) {
+        grown = realloc(list->names, list->room * 2 + length + 4096);
+        if (grown == NULL)
+            return -TNFS_ENOMEM;
+        list->names = grown;
+        list->room = list->room * 2 + length + 4096;
+    }
+
+    /* keep the hash index at most half full */
+    if ((list->count + 1) * 2 > list->slots) {
+        grown = calloc(list->slots ? list->slots * 2 : 1024, sizeof(uint32_t));
+        if (grown == NULL)
+            return -TNFS_ENOMEM;
+        free(list->index);
+        list->index = grown;
+        list->slots = list->slots ? list->slots * 2 : 1024;
+        for (uint32_t i = 0; i < list->count; i++)
+            tnfs_sync_insert(list, i);
+    }
+
+    e = &list->entries[list->count];
+    memset(e, 0, sizeof(struct tnfs_sync_entry));
+    e->name = list->used;
+    e->size = size;
+    e->mtime = mtime;
+    e->flags = flags;
+    memcpy(&list->names[list->used], path, length);
+    list->used += length;
+
+    tnfs_sync_insert(list, list->count);
+
+    return list->count++;
+}
+
+/* frees the memory of a list */
+void tnfs_sync_free(struct tnfs_sync_list* list)
+{
+    free(list->entries);
+    free(list->names);
+    free(list->index);
+    memset(list, 0, sizeof(struct tnfs_sync_list));
+}
+
+/* returns the length of the parent directory part of a path, zero for an entry of the synced directory itself */
+uint32_t tnfs_sync_parent(const char* path)
+{
+    const char* slash = strrchr(path, '/');
+
+    return slash == NULL ? 0 : slash - path;
+}
+
+/*
+ * reads a manifest. Each entry holds the length of the part of its path it shares with the previous entry, the rest
+ * of the path, the size, the modification time and the flags. Returns false when there is no usable manifest
+ */
+bool tnfs_sync_load(struct tnfs_sync_list* list, const char* filename)
+{
+    char path[TNFS_MAX_PATH_LEN];
+    char magic[8];
+    uint32_t count, size, mtime, previous = 0;
+    uint16_t shared, rest;
+    uint8_t flags;
+    long entry, parent = 0;
+    bool ok;
+    FILE* f = fopen(filename, "rb");
+
+    if (f == NULL)
+        return false;
+
+    ok = fread(magic, 1, 8, f) == 8 && memcmp(magic, TNFS_SYNC_MAGIC, 8) == 0
+      && fread(&mtime, 4, 1, f) == 1 && fread(&count, 4, 1, f) == 1
+      && tnfs_sync_add(list, "", 0, mtime, TNFS_SYNC_DIR) == 0;
+    path[0] = 0;
+
+    for (uint32_t i = 0; ok && i < count; i++) {
+        ok = fread(&shared, 2, 1, f) == 1 && fread(&rest, 2, 1, f) == 1 && shared <= strlen(path)
+          && shared + rest < TNFS_MAX_PATH_LEN && fread(&path[shared], 1, rest, f) == rest
+          && fread(&size, 4, 1, f) == 1 && fread(&mtime, 4, 1, f) == 1 && fread(&flags, 1, 1, f) == 1;
+        if (!ok)
+            break;
+        path[shared + rest] = 0;
+
+        entry = tnfs_sync_add(list, path, size, mtime, flags);
+        if (entry < 0) {
+            ok = false;
+            break;
+        }
+
+        /* the children of a directory follow each other, a new parent starts a new group */
+        if (i == 0 || tnfs_sync_parent(path) != previous || strncmp(path, tnfs_sync_path(list, parent), previous) != 0) {
+            previous = tnfs_sync_parent(path);
+            path[previous] = 0;
+            parent = tnfs_sync_find(list, path);
+            if (previous > 0)
+                path[previous] = '/';
+            if (parent < 0 || list->entries[parent].children > 0) {
+                ok = false;	// the manifest isn't grouped by directory
+                break;
+            }
+            list->entries[parent].first = entry;
+        }
+        list->entries[parent].children++;
+    }
+
+    fclose(f);
+
+    if (!ok)
+        tnfs_sync_free(list);
+
+    return ok;
+}
+
+/* writes a manifest of the tree found during this run, leaving out the files whose download failed */
+int tnfs_sync_save(struct tnfs_sync_list* list, const char* filename)
+{
+    char temp[TNFS_MAX_PATH_LEN + 8];
+    const char* previous = "";
+    const char* path;
+    uint32_t count = 0;
+    uint16_t shared, rest;
+    FILE* f;
+
+    snprintf(temp, sizeof(temp), "%s.tmp", filename);
+    f = fopen(temp, "wb");
+    if (f == NULL)
+        return -TNFS_EIO;
+
+    for (uint32_t i = 1; i < list->count; i++) {
+        if (!(list->entries[i].flags & TNFS_SYNC_FAILED))
+            count++;
+    }
+
+    fwrite(TNFS_SYNC_MAGIC, 1, 8, f);
+    fwrite(&list->entries[0].mtime, 4, 1, f);
+    fwrite(&count, 4, 1, f);
+
+    for (uint32_t i = 1; i < list->count; i++) {
+        struct tnfs_sync_entry* e = &list->entries[i];
+        uint8_t flags = e->flags & TNFS_SYNC_DIR;
+
+        if (e->flags & TNFS_SYNC_FAILED)
+            continue;
+
+        path = tnfs_sync_path(list, i);
+        for (shared = 0; path[shared] != 0 && path[shared] == previous[shared]; shared++);
+        rest = strlen(&path[shared]);
+
+        fwrite(&shared, 2, 1, f);
+        fwrite(&rest, 2, 1, f);
+        fwrite(&path[shared], 1, rest, f);
+        fwrite(&e->size, 4, 1, f);
+        fwrite(&e->mtime, 4, 1, f);
+        fwrite(&flags, 1, 1, f);
+        previous = path;
+    }
+
+    if (fclose(f) != 0) {
+        remove(temp);
+        return -TNFS_EIO;
+    }
+
+    remove(filename);
+    return rename(temp, filename) == 0 ? 0 : -TNFS_EIO;
+}
+
+/* builds the remote or local path of an entry */
+void tnfs_sync_join(char* dest, size_t size, const char* base, const char* path)
+{
+    size_t length = strlen(base);
+
+    if (path[0] == 0 || base[0] == 0)
+        snprintf(dest, size, "%s%s", base, path);
+    else if (length > 0 && base[length - 1] == '/')
+        snprintf(dest, size, "%s%s", base, path);
+    else
+        snprintf(dest, size, "%s/%s", base, path);
+}
+
+/* removes a local file, or a directory with everything in it */
+void tnfs_sync_remove(const char* path)
+{
+    char child[TNFS_MAX_PATH_LEN * 2];
+    struct stat st;
+    struct dirent* d;
+    DIR* dir;
+
+    if (stat(path, &st) != 0)
+        return;
+
+    if (S_ISDIR(st.st_mode)) {
+        dir = opendir(path);
+        while (dir != NULL && (d = readdir(dir)) != NULL) {
+            if (strcmp(d->d_name, ".") != 0 && strcmp(d->d_name, "..") != 0) {
+                snprintf(child, sizeof(child), "%s/%s", path, d->d_name);
+                tnfs_sync_remove(child);
+            }
+        }
+        if (dir != NULL)
+            closedir(dir);
+        rmdir(path);
+    } else {
+        remove(path);
+    }
+}
+
+/* deletes the local files and directories of a directory that aren't on the server */
+void tnfs_sync_prune(struct tnfs_sync_run* run, const char* path)
+{
+    char local[TNFS_MAX_PATH_LEN * 2];
+    char child[TNFS_MAX_PATH_LEN];
+    struct dirent* d;
+    DIR* dir;
+
+    tnfs_sync_join(local, sizeof(local), run->local, path);
+    dir = opendir(local);
+    if (dir == NULL)
+        return;
+
+    while ((d = readdir(dir)) != NULL) {
+        if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0)
+            continue;
+
+        tnfs_sync_join(child, sizeof(child), path, d->d_name);
+        if (tnfs_sync_find(&run->now, child) < 0) {
+            tnfs_sync_join(local, sizeof(local), run->local, child);
+            tnfs_sync_remove(local);
+            run->result->deleted++;
+        }
+    }
+
+    closedir(dir);
+}
+
+/* decides if a file has to be downloaded: the manifest or else the local file must have the same size and time */
+bool tnfs_sync_changed(struct tnfs_sync_run* run, uint32_t entry)
+{
+    char local[TNFS_MAX_PATH_LEN * 2];
+    struct tnfs_sync_entry* e = &run->now.entries[entry];
+    const char* path = tnfs_sync_path(&run->now, entry);
+    long known = tnfs_sync_find(&run->old, path);
+    struct stat st;
+
+    if (known >= 0) {
+        struct tnfs_sync_entry* o = &run->old.entries[known];
+        return (o->flags & TNFS_SYNC_DIR) || o->size != e->size || o->mtime != e->mtime;
+    }
+
+    tnfs_sync_join(local, sizeof(local), run->local, path);
+
+    return stat(local, &st) != 0 || S_ISDIR(st.st_mode) || (uint32_t)st.st_size != e->size || (uint32_t)st.st_mtime != e->mtime;
+}
+
+/* lists a remote directory into the list of this run, returns a negative error code when it could not be listed */
+int tnfs_sync_list(struct tnfs_sync_run* run, uint32_t dir)
+{
+    char remote[TNFS_MAX_PATH_LEN];
+    char path[TNFS_MAX_PATH_LEN];
+    char child[TNFS_MAX_PATH_LEN];
+    struct dirx_data data;
+    struct dirx_item item;
+    uint32_t first = run->now.count;
+    long entry;
+    int code;
+
+    strcpy(path, tnfs_sync_path(&run->now, dir));
+    tnfs_sync_join(remote, sizeof(remote), run->remote, path);
+
+    code = tnfs_opendirx(remote, "", TNFS_DIROPT_NO_SKIPHIDDEN, TNFS_DIRSORT_NONE, &data);
+    if (code != 0)
+        return code;
+
+    tnfs_prefetchdirx(&data, run->batches, TNFS_BUFFERSIZE);
+    while ((code = tnfs_nextdirx(&data, &item)) == 0) {
+        tnfs_sync_join(child, sizeof(child), path, item.name);
+        entry = tnfs_sync_add(&run->now, child, item.size, item.modified, (item.flags & TNFS_DIRENTRY_DIR) ? TNFS_SYNC_DIR : 0);
+        if (entry < 0) {
+            code = entry;
+            break;
+        }
+    }
+    tnfs_closedir(data.handle);
+
+    if (code != TNFS_EOF) {
+        run->now.count = first;	// forget a partial listing, the index still refers to them so rebuild it
+        memset(run->now.index, 0, run->now.slots * sizeof(uint32_t));
+        for (uint32_t i = 0; i < run->now.count; i++)
+            tnfs_sync_insert(&run->now, i);
+        return code < 0 ? code : -code;
+    }
+
+    run->now.entries[dir].first = first;
+    run->now.entries[dir].children = run->now.count - first;
+    run->result->listed++;
+
+    return 0;
+}
+
+/* takes the children of an unchanged directory from the manifest, only the time of subdirectories is asked */
+int tnfs_sync_reuse(struct tnfs_sync_run* run, uint32_t dir, long known)
+{
+    char remote[TNFS_MAX_PATH_LEN];
+    struct tnfs_sync_entry* o = &run->old.entries[known];
+    uint32_t first = run->now.count;
+    struct fstat st;
+    long entry;
+
+    for (uint32_t i = o->first; i < o->first + o->children; i++) {
+        struct tnfs_sync_entry* c = &run->old.entries[i];
+
+        entry = tnfs_sync_add(&run->now, tnfs_sync_path(&run->old, i), c->size, c->mtime, c->flags & TNFS_SYNC_DIR);
+        if (entry < 0)
+            return entry;
+
+        if (c->flags & TNFS_SYNC_DIR) {
+            tnfs_sync_join(remote, sizeof(remote), run->remote, tnfs_sync_path(&run->old, i));
+            run->now.entries[entry].mtime = tnfs_stat(remote, &st) == 0 ? st.mtime : 0;
+        }
+    }
+
+    run->now.entries[dir].first = first;
+    run->now.entries[dir].children = run->now.count - first;
+
+    return 0;
+}
+
+/* walks a remote directory and everything below it */
+int tnfs_sync_walk(struct tnfs_sync_run* run, uint32_t dir)
+{
+    char local[TNFS_MAX_PATH_LEN * 2];
+    char path[TNFS_MAX_PATH_LEN];
+    long known;
+    int code;
+
+    strcpy(path, tnfs_sync_path(&run->now, dir));
+    known = tnfs_sync_find(&run->old, path);
+    run->result->dirs++;
+
+    tnfs_sync_join(local, sizeof(local), run->local, path);
+    tnfs_local_mkdir(local);
+
+    /* a directory with the same time as in the manifest still has the same children */
+    if ((run->options & TNFS_SYNC_TRUST_DIRS) && known >= 0 && (run->old.entries[known].flags & TNFS_SYNC_DIR)
+     && run->old.entries[known].mtime == run->now.entries[dir].mtime && run->now.entries[dir].mtime != 0) {
+        code = tnfs_sync_reuse(run, dir, known);
+    } else {
+        code = tnfs_sync_list(run, dir);
+        if (code == 0 && !(run->options & TNFS_SYNC_NO_DELETE))
+            tnfs_sync_prune(run, path);
+    }
+
+    if (code == -TNFS_ENOMEM)
+        return code;
+
+    /* the manifest must not claim that the children are known, the next run lists the directory again */
+    if (code != 0) {
+        run->now.entries[dir].mtime = 0;
+        run->result->failed++;
+        return 0;
+    }
+
+    for (uint32_t i = run->now.entries[dir].first; i < run->now.entries[dir].first + run->now.entries[dir].children; i++) {
+        if (run->now.entries[i].flags & TNFS_SYNC_DIR) {
+            code = tnfs_sync_walk(run, i);
+            if (code != 0)
+                return code;
+        } else {
+            run->result->files++;
+            if (tnfs_sync_changed(run, i))
+                run->now.entries[i].flags |= TNFS_SYNC_PENDING;
+        }
+    }
+
+    return 0;
+}
+
+/* starts the download of a file, returns false when it could not be started */
+bool tnfs_sync_start(struct tnfs_sync_run* run, struct tnfs_sync_transfer* t, uint32_t entry)
+{
+    char remote[TNFS_MAX_PATH_LEN];
+    char local[TNFS_MAX_PATH_LEN * 2 + 8];
+    const char* path = tnfs_sync_path(&run->now, entry);
+
+    tnfs_sync_join(remote, sizeof(remote), run->remote, path);
+    tnfs_sync_join(local, sizeof(local), run->local, path);
+    strcat(local, ".part");
+
+    t->entry = entry;
+    t->handle = tnfs_open(remote, TNFS_O_RDONLY, 0);
+    if (t->handle < 0)
+        return false;
+
+    t->f = fopen(local, "wb");
+    if (t->f == NULL) {
+        tnfs_close(t->handle);
+        t->handle = -1;
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * marks a download as failed. Its directory must not be taken from the manifest by the next run, which would never
+ * list the file again, so the directory gets no time, like after a failed listing
+ */
+void tnfs_sync_fail(struct tnfs_sync_run* run, uint32_t entry)
+{
+    char parent[TNFS_MAX_PATH_LEN];
+    const char* path = tnfs_sync_path(&run->now, entry);
+    uint32_t length = tnfs_sync_parent(path);
+    long dir = 0;
+
+    if (length > 0 && length < sizeof(parent)) {
+        memcpy(parent, path, length);
+        parent[length] = 0;
+        dir = tnfs_sync_find(&run->now, parent);
+    }
+    if (dir >= 0)
+        run->now.entries[dir].mtime = 0;
+
+    run->now.entries[entry].flags |= TNFS_SYNC_FAILED;
+    run->result->failed++;
+}
+
+/* ends the download of a file, a complete file replaces the local file and gets the time of the remote file */
+void tnfs_sync_finish(struct tnfs_sync_run* run, struct tnfs_sync_transfer* t, bool complete)
+{
+    char local[TNFS_MAX_PATH_LEN * 2];
+    char part[TNFS_MAX_PATH_LEN * 2 + 8];
+    struct tnfs_sync_entry* e = &run->now.entries[t->entry];
+    struct utimbuf times;
+
+    tnfs_close(t->handle);
+    t->handle = -1;
+
+    tnfs_sync_join(local, sizeof(local), run->local, tnfs_sync_path(&run->now, t->entry));
+    snprintf(part, sizeof(part), "%s.part", local);
+
+    complete = fclose(t->f) == 0 && complete;
+    if (complete) {
+        remove(local);
+        complete = rename(part, local) == 0;
+    }
+
+    if (!complete) {
+        remove(part);
+        tnfs_sync_fail(run, t->entry);
+        return;
+    }
+
+    times.actime = e->mtime;
+    times.modtime = e->mtime;
+    utime(local, &times);
+    run->result->downloaded++;
+}
+
+/* downloads all pending files, TNFS_SYNC_PARALLEL at a time with one burst of READ requests */
+void tnfs_sync_download(struct tnfs_sync_run* run)
+{
+    struct tnfs_sync_transfer t[TNFS_SYNC_PARALLEL];
+    char buffers[TNFS_SYNC_PARALLEL][TNFS_BATCH_SLICE];
+    char* data[TNFS_SYNC_PARALLEL];
+    uint8_t handles[TNFS_SYNC_PARALLEL];
+    int results[TNFS_SYNC_PARALLEL];
+    struct tnfs_sync_transfer* active[TNFS_SYNC_PARALLEL];
+    uint32_t next = 1;
+    int n;
+
+    for (int i = 0; i < TNFS_SYNC_PARALLEL; i++)
+        t[i].handle = -1;
+
+    while (true) {
+        /* fill the free transfer slots with pending files */
+        for (int i = 0; i < TNFS_SYNC_PARALLEL; i++) {
+            while (t[i].handle < 0 && next < run->now.count) {
+                if (!(run->now.entries[next].flags & TNFS_SYNC_PENDING)) {
+                    next++;
+                    continue;
+                }
+                run->now.entries[next].flags &= ~TNFS_SYNC_PENDING;
+                if (!tnfs_sync_start(run, &t[i], next))
+                    tnfs_sync_fail(run, next);
+                next++;
+            }
+        }
+
+        n = 0;
+        for (int i = 0; i < TNFS_SYNC_PARALLEL; i++) {
+            if (t[i].handle >= 0) {
+                active[n] = &t[i];
+                handles[n] = t[i].handle;
+                data[n] = buffers[n];
+                n++;
+            }
+        }
+        if (n == 0)
+            break;
+
+        /* tnfs_readv() makes this the largest read that fits the pool buffers */
+        tnfs_readv(handles, data, TNFS_BATCH_SLICE - 7, results, n);
+
+        for (int i = 0; i < n; i++) {
+            if (results[i] > 0 && fwrite(data[i], 1, results[i], active[i]->f) == (size_t)results[i]) {
+                run->result->bytes += results[i];
+            } else {
+                tnfs_sync_finish(run, active[i], results[i] == -TNFS_EOF);
+            }
+        }
+    }
+}
+
+/*
+ * mirrors the remote directory into the local directory. manifest is a local file that remembers the tree between
+ * runs, NULL to compare with the local files instead. Returns 0 or a negative error code when the run was aborted,
+ * files and directories that failed are counted in the result and tried again by the next run.
+ */
+int tnfs_sync(const char* remote, const char* local, const char* manifest, uint8_t options, struct tnfs_sync_result* result)
+{
+    struct tnfs_sync_run run;
+    struct fstat st;
+    int code;
+
+    memset(&run, 0, sizeof(run));
+    memset(result, 0, sizeof(struct tnfs_sync_result));
+    run.remote = remote;
+    run.local = local;
+    run.options = options;
+    run.result = result;
+
+    if (manifest != NULL)
+        run.manifest = tnfs_sync_load(&run.old, manifest);
+
+    run.batches = malloc(2 * TNFS_BUFFERSIZE);
+    code = run.batches == NULL ? -TNFS_ENOMEM : (int)tnfs_sync_add(&run.now, "", 0, 0, TNFS_SYNC_DIR);
+
+    if (code == 0) {
+        run.now.entries[0].mtime = tnfs_stat((char*)remote, &st) == 0 ? st.mtime : 0;
+        code = tnfs_sync_walk(&run, 0);
+    }
+
+    if (code == 0) {
+        tnfs_sync_download(&run);
+        if (manifest != NULL)
+            code = tnfs_sync_save(&run.now, manifest);
+    }
+
+#ifdef DEBUG
+    printf("sync: %u dirs (%u listed), %u files, %u downloaded, %u deleted, %u failed\n\n",
+           result->dirs, result->listed, result->files, result->downloaded, result->deleted, result->failed);
+#endif
+
+    free(run.batches);
+    tnfs_sync_free(&run.old);
+    tnfs_sync_free(&run.now);
+
+    return code;
+}
+
+#endif /* TNFS_USE_PIPELINE */
@@ -0,0 +1,187 @@
+#include "include/tnfs_timeline.h"
+#include "include/tnfs_sched.h"
+#include "include/netw.h"
+
+#if TNFS_USE_METRICS	// left out by the footprint profile, see tnfs_config.h
+
+/*
+ * Timeline: while it runs, the request paths record spans (building a request, each attempt to send it, the wait for
+ * the response, parsing and copying it, the time a request was queued) into a fixed array. tnfs_timeline_export()
+ * writes them as Chrome trace events, a JSON file that chrome://tracing and https://ui.perfetto.dev open, with the
+ * blocking requests, the bursts and every request of a burst on their own lanes. While the timeline is stopped each
+ * place that records a span costs one test of tnfs_timeline_used.
+ */
+
+/* timeline global variables */
+bool     tnfs_timeline_used = false;	// true while spans are recorded
+uint32_t tnfs_timeline_encode = 0;	// netw_micros() at the last tnfs_prepareCommand()
+struct tnfs_span* tnfs_timeline_spans = NULL;
+uint32_t tnfs_timeline_count = 0;	// spans recorded
+uint32_t tnfs_timeline_capacity = 0;	// room in tnfs_timeline_spans
+uint32_t tnfs_timeline_lost = 0;	// spans that didn't fit anymore
+
+const char* TNFS_SPAN_NAMES[] = {
+    "request", "encode", "drain prefetch", "send", "resend", "wait", "recover", "decode", "copy", "in flight", "queued", "burst"
+};
+
+
+/* records a span that started at start and ends now */
+void tnfs_timeline_span(uint8_t kind, uint8_t lane, uint32_t start, uint8_t seq, uint8_t cmd, uint8_t attempt)
+{
+    struct tnfs_span* s;
+
+    if (tnfs_timeline_count == tnfs_timeline_capacity) {
+        tnfs_timeline_lost++;
+        return;
+    }
+
+    s = &tnfs_timeline_spans[tnfs_timeline_count++];
+    s->start = start;
+    s->duration = netw_micros() - start;
+    s->kind = kind;
+    s->lane = lane;
+    s->seq = seq;
+    s->cmd = cmd;
+    s->attempt = attempt;
+}
+
+/* Starts to record spans, up to capacity of them. Returns 0 or -TNFS_ENOMEM */
+int tnfs_timeline_start(uint32_t capacity)
+{
+    struct tnfs_span* spans;
+
+    tnfs_timeline_used = false;
+    spans = realloc(tnfs_timeline_spans, (capacity > 0 ? capacity : 1) * sizeof(struct tnfs_span));
+    if (spans == NULL)
+        return -TNFS_ENOMEM;
+
+    tnfs_timeline_spans = spans;
+    tnfs_timeline_capacity = capacity;
+    tnfs_timeline_count = 0;
+    tnfs_timeline_lost = 0;
+    tnfs_timeline_encode = netw_micros();
+    tnfs_timeline_used = true;
+
+    return 0;
+}
+
+/* Stops recording, the spans so far can still be exported */
+void tnfs_timeline_stop()
+{
+    tnfs_timeline_used = false;
+}
+
+/* Returns the amount of spans that were not recorded because the timeline was full */
+uint32_t tnfs_timeline_dropped()
+{
+    return tnfs_timeline_lost;
+}
+
+/* Stops recording and frees the spans */
+void tnfs_timeline_free()
+{
+    tnfs_timeline_used = false;
+    free(tnfs_timeline_spans);
+    tnfs_timeline_spans = NULL;
+    tnfs_timeline_count = 0;
+    tnfs_timeline_capacity = 0;
+}
+
+/* returns the name of a TNFS command */
+const char* tnfs_timeline_command(uint8_t cmd)
+{
+    switch (cmd) {
+        case 0x00: return "MOUNT";
+        case 0x01: return "UMOUNT";
+        case 0x10: return "OPENDIR";
+        case 0x11: return "READDIR";
+        case 0x12: return "CLOSEDIR";
+        case 0x13: return "MKDIR";
+        case 0x14: return "RMDIR";
+        case 0x15: return "TELLDIR";
+        case 0x16: return "SEEKDIR";
+        case 0x17: return "OPENDIRX";
+        case 0x18: return "READDIRX";
+        case 0x21: return "READ";
+        case 0x22: return "WRITE";
+        case 0x23: return "CLOSE";
+        case 0x24: return "STAT";
+        case 0x25: return "LSEEK";
+        case 0x26: return "UNLINK";
+        case 0x27: return "CHMOD";
+        case 0x28: return "RENAME";
+        case 0x29: return "OPEN";
+        case 0x30: return "SIZE";
+        case 0x31: return "FREE";
+        default:   return "?";
+    }
+}
+
+/* writes the name of a lane as a metadata event */
+void tnfs_timeline_lane(FILE* f, int lane, const char* name, int number)
+{
+    fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"", lane);
+    fprintf(f, name, number);
+    fprintf(f, "\"}},\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"sort_index\":%d}}", lane, lane);
+}
+
+/*
+ * Writes the recorded spans as a Chrome trace event file, times relative to the first span. A request span is named
+ * after its command. Returns 0 or -TNFS_EACCES when the file can't be written
+ */
+int tnfs_timeline_export(char* filename)
+{
+    struct tnfs_span* s;
+    uint32_t first = 0;
+    FILE* f = fopen(filename, "w");
+
+    if (f == NULL)
+        return -TNFS_EACCES;
+
+    for (uint32_t i = 0; i < tnfs_timeline_count; i++) {
+        if (i == 0 || (int32_t)(tnfs_timeline_spans[i].start - first) < 0)
+            first = tnfs_timeline_spans[i].start;
+    }
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"tnfs client\"}}");
+    tnfs_timeline_lane(f, TNFS_LANE_BLOCKING, "requests", 0);
+    tnfs_timeline_lane(f, TNFS_LANE_PREFETCH, "prefetch", 0);
+    tnfs_timeline_lane(f, TNFS_LANE_BATCH, "bursts", 0);
+    for (int i = 0; i < NETW_MAX_BATCH; i++)
+        tnfs_timeline_lane(f, TNFS_LANE_FLIGHT + i, "burst slot %d", i + 1);
+    for (int i = 0; i < TNFS_SCHED_CLASSES; i++)
+        tnfs_timeline_lane(f, TNFS_LANE_QUEUED + i, "scheduler class %d", i);
+
+    for (uint32_t i = 0; i < tnfs_timeline_count; i++) {
+        s = &tnfs_timeline_spans[i];
+        fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"tnfs\",\"pid\":1,\"tid\":%u,\"ts\":%u,",
+                s->kind == TNFS_SPAN_REQUEST ? tnfs_timeline_command(s->cmd) : TNFS_SPAN_NAMES[s->kind], s->lane, s->start - first);
+
+        /* queued requests of one class overlap without nesting, which only asynchronous events can show */
+        if (s->kind == TNFS_SPAN_QUEUED)
+            fprintf(f, "\"ph\":\"b\",\"id\":%u,\"args\":{", i);
+        else
+            fprintf(f, "\"ph\":\"X\",\"dur\":%u,\"args\":{", s->duration);
+
+        if (s->cmd != 0xFF)
+            fprintf(f, "\"command\":\"%s\",\"seq\":%u", tnfs_timeline_command(s->cmd), s->seq);
+        if (s->kind == TNFS_SPAN_BATCH)
+            fprintf(f, "\"requests\":%u", s->attempt);
+        else if (s->attempt > 0)
+            fprintf(f, "%s\"attempt\":%u", s->cmd != 0xFF ? "," : "", s->attempt);
+        fprintf(f, "}}");
+
+        if (s->kind == TNFS_SPAN_QUEUED)
+            fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"tnfs\",\"pid\":1,\"tid\":%u,\"ts\":%u,\"ph\":\"e\",\"id\":%u}",
+                    TNFS_SPAN_NAMES[s->kind], s->lane, s->start - first + s->duration, i);
+    }
+    fprintf(f, "\n]}\n");
+
+    if (fclose(f) != 0)
+        return -TNFS_EACCES;
+
+    return 0;
+}
+
+#endif /* TNFS_USE_METRICS */
@@ -0,0 +1,478 @@
+#include "include/tnfs_trace.h"
+#include "include/netw.h"
+
+#if TNFS_USE_METRICS	// left out by the footprint profile, see tnfs_config.h
+
+/*
+ * Traces: while a trace is running every datagram that goes to or comes from the server is appended to a file, with
+ * the time since the previous datagram in microseconds. The TNFS header of each datagram holds the session, the
+ * sequence number and the command, so requests, retransmissions and their responses can be matched afterwards.
+ *
+ * File: TNFS_TRACE_MAGIC, the unix time of the start (4 bytes), the options (1 byte) and 3 zero bytes, then one record
+ * per datagram: kind (1 byte), time since the previous record, stored length, with TNFS_TRACE_TRUNCATED the original
+ * length, and the stored bytes. The numbers are variable length: 7 bits per byte, the high bit means more follow.
+ *
+ * tnfs_trace_replay() reads a trace and calls the client function that sends each recorded request again, with the
+ * recorded pauses between them, so a workload captured in the field can be repeated against a test server.
+ */
+
+/* trace global variables */
+bool     tnfs_trace_used = false;	// true while a trace is running, checked before each call of tnfs_trace_record()
+FILE*    tnfs_trace_file = NULL;
+uint8_t  tnfs_trace_options = 0;	// options given to tnfs_trace_start()
+uint32_t tnfs_trace_last = 0;		// netw_micros() at the previous record
+
+/* one record of a trace that is being replayed */
+struct tnfs_trace_entry {
+    uint8_t  kind;		// TNFS_TRACE_RECEIVED and/or TNFS_TRACE_TRUNCATED
+    uint64_t time;		// microseconds since the start of the trace
+    uint32_t length;		// stored bytes
+    uint32_t original;		// length of the datagram
+    const uint8_t* data;
+};
+
+/* state of tnfs_trace_replay(): which handle of the replay belongs to a server handle in the trace */
+struct tnfs_trace_replay_state {
+    int16_t  files[256];	// handle of the replay for each server file handle, -1 when not open
+    int16_t  dirs[256];		// handle of the replay for each server directory handle, -1 when not open
+    struct dirx_data dirx[TNFS_MAX_HANDLES];	// listings opened with OPENDIRX, by handle of the replay
+    uint16_t recent[16];	// sequence number and command of the last requests, to skip retransmissions
+    uint8_t  next;		// next slot in recent
+    char     data[TNFS_BUFFERSIZE];	// read, write and readdir buffer
+};
+
+
+/* writes a variable length number */
+void tnfs_trace_putNumber(uint64_t n)
+{
+    do {
+        fputc((n & 0x7F) | (n > 0x7F ? 0x80 : 0x00), tnfs_trace_file);
+        n >>= 7;
+    } while (n > 0);
+}
+
+/* appends one datagram to the trace, kind is zero for requests and TNFS_TRACE_RECEIVED for responses */
+void tnfs_trace_record(uint8_t kind, const uint8_t* data, int length)
+{
+    uint32_t now = netw_micros();
+    int stored = length;
+
+    if (tnfs_trace_file == NULL || length <= 0)
+        return;
+
+    /* the data of READ responses and WRITE requests follows a 7 byte header */
+    if ((tnfs_trace_options & TNFS_TRACE_NO_DATA) && length > TNFS_TRACE_KEPT && length >= 4
+     && data[3] == ((kind & TNFS_TRACE_RECEIVED) ? 0x21 : 0x22)) {
+        stored = TNFS_TRACE_KEPT;
+        kind |= TNFS_TRACE_TRUNCATED;
+    }
+
+    fputc(kind, tnfs_trace_file);
+    tnfs_trace_putNumber(now - tnfs_trace_last);
+    tnfs_trace_putNumber(stored);
+    if (kind & TNFS_TRACE_TRUNCATED)
+        tnfs_trace_putNumber(length);
+    fwrite(data, 1, stored, tnfs_trace_file);
+
+    tnfs_trace_last = now;
+}
+
+/* Starts to write every request and response to a new trace file. Options: TNFS_TRACE_NO_DATA */
+int tnfs_trace_start(char* filename, uint8_t options)
+{
+    uint32_t start = (uint32_t)time(NULL);
+    uint8_t zero[3] = {0, 0, 0};
+
+    tnfs_trace_stop();
+
+    tnfs_trace_file = fopen(filename, "wb");
+    if (tnfs_trace_file == NULL)
+        return -TNFS_EACCES;
+
+    fwrite(TNFS_TRACE_MAGIC, 1, 8, tnfs_trace_file);
+    fwrite(&start, 4, 1, tnfs_trace_file);
+    fwrite(&options, 1, 1, tnfs_trace_file);
+    fwrite(zero, 1, 3, tnfs_trace_file);
+
+    tnfs_trace_options = options;
+    tnfs_trace_last = netw_micros();
+    tnfs_trace_used = true;
+
+    return 0;
+}
+
+/* Stops the running trace, returns -TNFS_EIO when the file could not be written completely */
+int tnfs_trace_stop()
+{
+    int code = 0;
+
+    if (tnfs_trace_file == NULL)
+        return 0;
+
+    if (ferror(tnfs_trace_file))
+        code = -TNFS_EIO;
+    if (fclose(tnfs_trace_file) != 0)
+        code = -TNFS_EIO;
+
+    tnfs_trace_file = NULL;
+    tnfs_trace_used = false;
+
+    return code;
+}
+
+/* reads a variable length number, returns NULL when the trace ends in the middle */
+const uint8_t* tnfs_trace_getNumber(const uint8_t* p, const uint8_t* end, uint64_t* n)
+{
+    *n = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        *n |= (uint64_t)(*p & 0x7F) << shift;
+        if (!(*p++ & 0x80))
+            return p;
+    }
+
+    return NULL;
+}
+
+/* reads the record at p, time is the time of the previous record. Returns the next record or NULL at the end */
+const uint8_t* tnfs_trace_parse(const uint8_t* p, const uint8_t* end, uint64_t time, struct tnfs_trace_entry* e)
+{
+    uint64_t delta, length, original;
+
+    if (p >= end)
+        return NULL;
+
+    e->kind = *p++;
+    if ((p = tnfs_trace_getNumber(p, end, &delta)) == NULL || (p = tnfs_trace_getNumber(p, end, &length)) == NULL)
+        return NULL;
+    original = length;
+    if ((e->kind & TNFS_TRACE_TRUNCATED) && (p = tnfs_trace_getNumber(p, end, &original)) == NULL)
+        return NULL;
+    if (length > (uint64_t)(end - p) || length < 4)
+        return NULL;
+
+    e->time = time + delta;
+    e->length = (uint32_t)length;
+    e->original = (uint32_t)original;
+    e->data = p;
+
+    return p + length;
+}
+
+/* finds the response to a request among the records that follow it, returns false when there is none */
+bool tnfs_trace_findResponse(const uint8_t* p, const uint8_t* end, struct tnfs_trace_entry* req, struct tnfs_trace_entry* resp)
+{
+    uint64_t time = req->time;
+
+    for (int i = 0; i < 64 && (p = tnfs_trace_parse(p, end, time, resp)) != NULL; i++) {
+        time = resp->time;
+        if ((resp->kind & TNFS_TRACE_RECEIVED) && resp->length >= 5
+         && resp->data[2] == req->data[2] && resp->data[3] == req->data[3])
+            return true;
+    }
+
+    return false;
+}
+
+/* returns true when the same request was sent shortly before, which makes this one a retransmission */
+bool tnfs_trace_isRepeated(struct tnfs_trace_replay_state* s, const uint8_t* data)
+{
+    uint16_t id = data[2] << 8 | data[3];
+
+    for (int i = 0; i < 16; i++) {
+        if (s->recent[i] == id)
+            return true;
+    }
+    s->recent[s->next++ % 16] = id;
+
+    return false;
+}
+
+/* returns the handle of the replay for the server handle in byte 4, -1 when it isn't open */
+int tnfs_trace_handle(struct tnfs_trace_replay_state* s, struct tnfs_trace_entry* req, bool isDir)
+{
+    if (req->length < 5)
+        return -1;
+
+    return isDir ? s->dirs[req->data[4]] : s->files[req->data[4]];
+}
+
+/* copies a string from a request into dest, returns an empty string when it doesn't fit or isn't terminated */
+char* tnfs_trace_string(struct tnfs_trace_entry* req, uint32_t offset, char* dest)
+{
+    uint32_t i;
+
+    dest[0] = 0;
+    for (i = offset; i < req->length && i - offset < TNFS_MAX_PATH_LEN; i++) {
+        if (req->data[i] == 0) {
+            memcpy(dest, &req->data[offset], i - offset + 1);
+            break;
+        }
+    }
+
+    return dest;
+}
+
+/*
+ * calls the client function for one recorded request, resp is the recorded response or NULL. Returns the TNFS status
+ * of the call, or -1 when the request can't be replayed
+ */
+int tnfs_trace_call(struct tnfs_trace_replay_state* s, struct tnfs_trace_entry* req, struct tnfs_trace_entry* resp)
+{
+    const uint8_t* d = req->data;
+    char path[TNFS_MAX_PATH_LEN];
+    char path2[TNFS_MAX_PATH_LEN];
+    struct dirx_data dirx;
+    struct fstat st;
+    uint16_t flags, mode, length;
+    uint32_t position;
+    int handle = -1;
+    int code;
+
+    switch (d[3]) {
+        case 0x10: /* OPENDIR */
+            code = tnfs_opendir(tnfs_trace_string(req, 4, path));
+            handle = code;
+            break;
+        case 0x11: /* READDIR */
+            if ((handle = tnfs_trace_handle(s, req, true)) < 0)
+                return -1;
+            code = tnfs_readdir(handle, s->data);
+            break;
+        case 0x12: /* CLOSEDIR */
+            if ((handle = tnfs_trace_handle(s, req, true)) < 0)
+                return -1;
+            code = tnfs_closedir(handle);
+            s->dirs[d[4]] = -1;
+            break;
+        case 0x13: /* MKDIR, like RMDIR, TELLDIR and SEEKDIR it returns a positive error code */
+            code = -tnfs_mkdir(tnfs_trace_string(req, 4, path));
+            break;
+        case 0x14: /* RMDIR */
+            code = -tnfs_rmdir(tnfs_trace_string(req, 4, path));
+            break;
+        case 0x15: /* TELLDIR */
+            if ((handle = tnfs_trace_handle(s, req, true)) < 0)
+                return -1;
+            code = -tnfs_telldir(handle, &position);
+            break;
+        case 0x16: /* SEEKDIR */
+            if ((handle = tnfs_trace_handle(s, req, true)) < 0 || req->length < 9)
+                return -1;
+            memcpy(&position, &d[5], 4);
+            code = -tnfs_seekdir(handle, position);
+            break;
+        case 0x17: /* OPENDIRX, the pattern comes before the path */
+            if (req->length < 9)
+                return -1;
+            tnfs_trace_string(req, 8, path2);
+            tnfs_trace_string(req, 8 + strlen(path2) + 1, path);
+            code = tnfs_opendirx(path, path2, d[4], d[5], &dirx);
+            if (code == 0) {
+                handle = dirx.handle;
+                s->dirx[handle] = dirx;
+            }
+            break;
+        case 0x18: /* READDIRX */
+            if ((handle = tnfs_trace_handle(s, req, true)) < 0)
+                return -1;
+            code = tnfs_readdirx(&s->dirx[handle]);
+            break;
+        case 0x21: /* READ */
+            if ((handle = tnfs_trace_handle(s, req, false)) < 0 || req->length < 7)
+                return -1;
+            memcpy(&length, &d[5], 2);
+            code = tnfs_read(s->data, handle, length < TNFS_BUFFERSIZE ? length : TNFS_BUFFERSIZE);
+            break;
+        case 0x22: /* WRITE, with the recorded data unless the trace left it out */
+            if ((handle = tnfs_trace_handle(s, req, false)) < 0 || req->length < 7)
+                return -1;
+            memcpy(&length, &d[5], 2);
+            if (length > TNFS_BUFFERSIZE)
+                length = TNFS_BUFFERSIZE;
+            memset(s->data, 0, length);
+            if (req->length > 7)
+                memcpy(s->data, &d[7], req->length - 7 < length ? req->length - 7 : length);
+            code = tnfs_write(s->data, handle, length);
+            break;
+        case 0x23: /* CLOSE */
+            if ((handle = tnfs_trace_handle(s, req, false)) < 0)
+                return -1;
+            code = tnfs_close(handle);
+            s->files[d[4]] = -1;
+            break;
+        case 0x24: /* STAT */
+            code = tnfs_stat(tnfs_trace_string(req, 4, path), &st);
+            break;
+        case 0x25: /* LSEEK */
+            if ((handle = tnfs_trace_handle(s, req, false)) < 0 || req->length < 10)
+                return -1;
+            memcpy(&position, &d[6], 4);
+            code = tnfs_lseek(handle, d[5], position);
+            break;
+        case 0x26: /* UNLINK */
+            code = tnfs_unlink(tnfs_trace_string(req, 4, path));
+            break;
+        case 0x27: /* CHMOD */
+            if (req->length < 7)
+                return -1;
+            memcpy(&mode, &d[4], 2);
+            code = tnfs_chmod(mode, tnfs_trace_string(req, 6, path));
+            break;
+        case 0x28: /* RENAME */
+            tnfs_trace_string(req, 4, path);
+            code = tnfs_rename(path, tnfs_trace_string(req, 4 + strlen(path) + 1, path2));
+            break;
+        case 0x29: /* OPEN */
+            if (req->length < 9)
+                return -1;
+            memcpy(&flags, &d[4], 2);
+            memcpy(&mode, &d[6], 2);
+            code = tnfs_open(tnfs_trace_string(req, 8, path), flags, mode);
+            handle = code;
+            break;
+        case 0x30: /* SIZE */
+            code = tnfs_size(&position);
+            break;
+        case 0x31: /* FREE */
+            code = tnfs_free(&position);
+            break;
+        default:   /* mount and umount are left to the caller, other commands are unknown */
+            return -1;
+    }
+
+    /* remember which handle of the replay stands for the server handle in the recorded response */
+    if ((d[3] == 0x10 || d[3] == 0x17 || d[3] == 0x29) && code >= 0 && resp != NULL && resp->length >= 6 && resp->data[4] == 0x00) {
+        if (d[3] == 0x29)
+            s->files[resp->data[5]] = handle;
+        else
+            s->dirs[resp->data[5]] = handle;
+    }
+
+    /* functions return a length or a handle on success and a negative TNFS error code otherwise */
+    return code < 0 ? -code : 0;
+}
+
+/* waits until a moment given by netw_micros(), the last millisecond is spent spinning because sleeps overshoot */
+void tnfs_trace_waitUntil(uint32_t moment)
+{
+    int32_t left;
+
+    while ((left = (int32_t)(moment - netw_micros())) > 0) {
+        if (left < 1000)
+            continue;
+#ifdef _WIN32
+        Sleep(left / 1000 - 1);
+#else
+        struct timespec ts = {(left - 1000) / 1000000, (left - 1000) % 1000000 * 1000};
+        nanosleep(&ts, NULL);
+#endif
+    }
+}
+
+/*
+ * Replays a trace against the mounted server: every recorded request is sent again by calling the client function
+ * that sends it, in the same order and with the same arguments. pace is the percentage of the recorded pause before
+ * each request that is kept, 100 for the recorded timing, 0 for no pauses at all. Handles are translated, mounts are
+ * skipped. Writes, renames and deletes are replayed too, so replay against a copy of the recorded directory tree.
+ * Returns 0, -TNFS_ENOENT when the trace can't be read, -TNFS_EINVAL when it isn't a trace or -TNFS_ENOMEM
+ */
+int tnfs_trace_replay(char* filename, uint16_t pace, struct tnfs_trace_result* result)
+{
+    struct tnfs_trace_replay_state* s;
+    struct tnfs_trace_entry req, resp;
+    const uint8_t* p;
+    const uint8_t* end;
+    uint8_t* trace;
+    uint64_t time = 0, done = 0;
+    uint32_t started, finished, before;
+    bool responded;
+    long size;
+    FILE* f;
+    int status;
+
+    memset(result, 0, sizeof(struct tnfs_trace_result));
+
+    f = fopen(filename, "rb");
+    if (f == NULL)
+        return -TNFS_ENOENT;
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    trace = size >= 16 ? malloc(size) : NULL;
+    s = malloc(sizeof(struct tnfs_trace_replay_state));
+    if (trace == NULL || s == NULL || fread(trace, 1, size, f) != (size_t)size || memcmp(trace, TNFS_TRACE_MAGIC, 8) != 0) {
+        fclose(f);
+        free(trace);
+        free(s);
+        return size < 16 || (trace != NULL && s != NULL) ? -TNFS_EINVAL : -TNFS_ENOMEM;
+    }
+    fclose(f);
+
+    memset(s, 0, sizeof(struct tnfs_trace_replay_state));
+    memset(s->files, 0xFF, sizeof(s->files));
+    memset(s->dirs, 0xFF, sizeof(s->dirs));
+    memset(s->recent, 0xFF, sizeof(s->recent));
+
+    p = &trace[16];
+    end = &trace[size];
+    started = finished = netw_micros();
+
+    while ((p = tnfs_trace_parse(p, end, time, &req)) != NULL) {
+        time = req.time;
+        if (req.kind & TNFS_TRACE_RECEIVED)
+            continue;
+        if (tnfs_trace_isRepeated(s, req.data)) {
+            result->skipped++;
+            continue;
+        }
+
+        responded = tnfs_trace_findResponse(p, end, &req, &resp);
+
+        /* the pause between the end of the previous request and this one, as far as pace keeps it */
+        if (pace > 0 && req.time > done)
+            tnfs_trace_waitUntil(finished + (uint32_t)((req.time - done) * pace / 100));
+
+        before = netw_micros();
+        status = tnfs_trace_call(s, &req, responded ? &resp : NULL);
+        finished = netw_micros();
+        done = responded ? resp.time : req.time;
+
+        if (status < 0) {
+            result->skipped++;
+            continue;
+        }
+        result->replayed++;
+        if (!responded || status != (uint8_t)resp.data[4])
+            result->differed++;
+
+        if (req.data[3] < TNFS_TRACE_COMMANDS) {
+            struct tnfs_trace_stat* c = &result->commands[req.data[3]];
+            c->count++;
+            c->recorded += responded ? resp.time - req.time : 0;
+            c->replayed += finished - before;
+        }
+    }
+
+    result->recorded_ms = (uint32_t)(time / 1000);
+    result->elapsed_ms = (finished - started) / 1000;
+
+#ifdef DEBUG
+    printf("replay: %u requests, %u skipped, %u with another status, %u ms recorded, %u ms replayed\n",
+           result->replayed, result->skipped, result->differed, result->recorded_ms, result->elapsed_ms);
+    for (int i = 0; i < TNFS_TRACE_COMMANDS; i++) {
+        struct tnfs_trace_stat* c = &result->commands[i];
+        if (c->count > 0)
+            printf("  command %02X: %u requests, %llu us recorded, %llu us replayed\n", i, c->count,
+                   (unsigned long long)c->recorded, (unsigned long long)c->replayed);
+    }
+    printf("\n");
+#endif
+
+    free(trace);
+    free(s);
+
+    return 0;
+}
+
+#endif /* TNFS_USE_METRICS */
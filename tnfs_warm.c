@@ -0,0 +1,385 @@
+#include "include/tnfs_warm.h"
+
+#ifdef _WIN32
+#include <process.h>
+#define tnfs_warm_pid() _getpid()
+#else
+#include <unistd.h>
+#define tnfs_warm_pid() getpid()
+#endif
+
+#if TNFS_USE_WARM	// left out by the footprint profile, see tnfs_config.h
+
+/*
+ * Warm-start cache: short-lived processes pay a DNS lookup, a connect and a MOUNT round trip before doing any work.
+ * tnfs_warm_open() restores the server address, the measured round trip time and a few directory listings that an
+ * earlier process saved with tnfs_warm_save(), so the next connect skips resolving and starts with tuned timeouts.
+ */
+
+const char TNFS_WARM_MAGIC[8] = {'T', 'N', 'F', 'S', 'W', 'R', 'M', 0x03};
+
+/* one directory listing, stored as the raw entries of the READDIRX responses */
+struct tnfs_warm_snapshot {
+    char     key[TNFS_WARM_KEY_LEN];	// "host:port" of the server, mounted directory, directory path and match pattern
+    uint16_t keylen;			// length of key including the four terminating zeros, zero for an empty slot
+    uint16_t opts;			// diropts and sortopts (high byte) given to opendirx()
+    uint16_t entries;			// amount of entries in data
+    uint16_t length;			// used bytes in data
+    uint32_t taken;			// time() when the listing was completed
+    char     data[TNFS_WARM_SNAPSHOT_SIZE];
+};
+
+/* warm-start cache global variables */
+char     tnfs_warm_filename[TNFS_MAX_PATH_LEN];			// cache file given to tnfs_warm_open()
+bool     tnfs_warm_enabled = false;				// true between tnfs_warm_open() and tnfs_warm_close()
+struct tnfs_warm_snapshot tnfs_warm_snapshots[TNFS_WARM_SNAPSHOTS];	// completed directory listings
+struct tnfs_warm_snapshot tnfs_warm_pending;			// listing that is being read with nextdirx()
+char     tnfs_warm_server[TNFS_WARM_SERVER_LEN];		// "host:port" the saved timing was measured with
+char     tnfs_warm_current[TNFS_WARM_SERVER_LEN];		// "host:port" connected last, the timing is saved with it
+bool     tnfs_warm_timed = false;				// saved timing that wasn't applied yet
+uint16_t tnfs_warm_srtt, tnfs_warm_rttvar, tnfs_warm_retry;	// the saved timing
+
+
+/* writes "host:port" of the server to name, returns false when there is no server or it doesn't fit */
+bool tnfs_warm_serverName(char* name, const char* host, uint16_t port)
+{
+    int n = snprintf(name, TNFS_WARM_SERVER_LEN, "%s:%u", host, port);
+
+    return host[0] != 0 && n > 0 && n < TNFS_WARM_SERVER_LEN;
+}
+
+/* builds the key of a snapshot of the current server and mount, returns its length or zero when it doesn't fit */
+uint16_t tnfs_warm_key(char* key, const char* path, const char* pattern)
+{
+    char server[TNFS_WARM_SERVER_LEN];
+    const char* host;
+    const char* dir;
+    uint16_t port;
+    size_t length;
+
+    tnfs_getServer(&host, &port, &dir);
+    if (!tnfs_warm_serverName(server, host, port))
+        return 0;
+
+    length = strlen(server) + strlen(dir) + strlen(path) + strlen(pattern) + 4;
+    if (length > TNFS_WARM_KEY_LEN)
+        return 0;
+
+    strcpy(key, server);
+    strcpy(key += strlen(server) + 1, dir);
+    strcpy(key += strlen(dir) + 1, path);
+    strcpy(key += strlen(path) + 1, pattern);
+
+    return (uint16_t)length;
+}
+
+/* finds the snapshot of a directory listing, NULL if it isn't in the cache */
+struct tnfs_warm_snapshot* tnfs_warm_find(const char* key, uint16_t keylen, uint16_t opts)
+{
+    for (int i = 0; i < TNFS_WARM_SNAPSHOTS; i++) {
+        struct tnfs_warm_snapshot* s = &tnfs_warm_snapshots[i];
+
+        if (s->keylen == keylen && s->opts == opts && memcmp(s->key, key, keylen) == 0)
+            return s;
+    }
+
+    return NULL;
+}
+
+/* collects the entries of a READDIRX response, a listing that was read from start to end becomes a snapshot */
+void tnfs_warm_record(const char* path, const char* pattern, uint16_t opts, uint16_t dirpos, uint8_t count, uint8_t status, const char* entries, int length)
+{
+    struct tnfs_warm_snapshot* p = &tnfs_warm_pending;
+    struct tnfs_warm_snapshot* s;
+    char key[TNFS_WARM_KEY_LEN];
+
+    if (!tnfs_warm_enabled)
+        return;
+
+    /* only complete listings are kept, start over when a directory is read from its first entry */
+    if (dirpos == 0) {
+        p->keylen = tnfs_warm_key(p->key, path, pattern);
+        if (p->keylen == 0)
+            return;
+        p->opts = opts;
+        p->entries = 0;
+        p->length = 0;
+    } else if (p->keylen == 0 || dirpos != p->entries || p->opts != opts
+            || tnfs_warm_key(key, path, pattern) != p->keylen || memcmp(key, p->key, p->keylen) != 0) {
+        return;	// the entries of another directory that is read at the same time
+    }
+
+    if (length < 0 || p->length + length > TNFS_WARM_SNAPSHOT_SIZE) {
+        p->keylen = 0;	// too large for the cache
+        return;
+    }
+
+    memcpy(&p->data[p->length], entries, length);
+    p->length += length;
+    p->entries += count;
+
+    if (!(status & TNFS_DIRSTATUS_EOF))
+        return;
+
+    /* replace an older listing of the same directory, otherwise the oldest snapshot */
+    s = tnfs_warm_find(p->key, p->keylen, p->opts);
+    for (int i = 0; s == NULL && i < TNFS_WARM_SNAPSHOTS; i++) {
+        if (tnfs_warm_snapshots[i].keylen == 0)
+            s = &tnfs_warm_snapshots[i];
+    }
+    if (s == NULL) {
+        s = &tnfs_warm_snapshots[0];
+        for (int i = 1; i < TNFS_WARM_SNAPSHOTS; i++) {
+            if (tnfs_warm_snapshots[i].taken < s->taken)
+                s = &tnfs_warm_snapshots[i];
+        }
+    }
+
+    p->taken = (uint32_t)time(NULL);
+    memcpy(s, p, sizeof(struct tnfs_warm_snapshot));
+    p->keylen = 0;
+}
+
+/* starts with the saved timing when it was measured with the server that is connected now */
+void tnfs_warm_connected(const char* host, uint16_t port)
+{
+    if (!tnfs_warm_enabled || !tnfs_warm_serverName(tnfs_warm_current, host, port)) {
+        tnfs_warm_current[0] = 0;
+        return;
+    }
+
+    if (tnfs_warm_timed && strcmp(tnfs_warm_current, tnfs_warm_server) == 0) {
+        tnfs_setTiming(tnfs_warm_srtt, tnfs_warm_rttvar, tnfs_warm_retry);
+        tnfs_warm_timed = false;
+    }
+}
+
+/* returns true when the entries of a snapshot end within its data and their amount matches */
+bool tnfs_warm_valid(const struct tnfs_warm_snapshot* s)
+{
+    uint16_t pos = 0, entries = 0;
+    size_t namelen;
+
+    while (pos < s->length) {
+        if (s->length - pos < 14)
+            return false;
+        namelen = strnlen(&s->data[pos + 13], s->length - pos - 13);
+        if (namelen == (size_t)(s->length - pos - 13))
+            return false;	// no terminating zero
+        pos += namelen + 14;
+        entries++;
+    }
+
+    return entries == s->entries;
+}
+
+/* reads a field from the cache file */
+bool tnfs_warm_read(FILE* f, void* dest, size_t length)
+{
+    return fread(dest, 1, length, f) == length;
+}
+
+/* enables the warm-start cache and restores what an earlier process saved in filename */
+int tnfs_warm_open(const char* filename)
+{
+    FILE* f;
+    char magic[8];
+    char host[256];
+    uint32_t saved;
+    uint16_t srtt, rttvar, retry_time, serverlen, hostlen, port, addrlen;
+    uint8_t timed, tcp, snapshots;
+    struct netw_address addr;
+    bool ok;
+
+    if (strlen(filename) >= TNFS_MAX_PATH_LEN)
+        return -TNFS_ENAMETOOLONG;
+
+    strcpy(tnfs_warm_filename, filename);
+    memset(tnfs_warm_snapshots, 0, sizeof(tnfs_warm_snapshots));
+    tnfs_warm_pending.keylen = 0;
+    tnfs_warm_timed = false;
+    tnfs_warm_current[0] = 0;
+    tnfs_warm_enabled = true;
+
+    /* a missing cache file is a cold start, not an error */
+    f = fopen(filename, "rb");
+    if (f == NULL)
+        return 0;
+
+    ok = tnfs_warm_read(f, magic, 8) && memcmp(magic, TNFS_WARM_MAGIC, 8) == 0
+      && tnfs_warm_read(f, &saved, 4) && (uint32_t)time(NULL) - saved <= TNFS_WARM_MAX_AGE
+      && tnfs_warm_read(f, &timed, 1) && tnfs_warm_read(f, &srtt, 2) && tnfs_warm_read(f, &rttvar, 2) && tnfs_warm_read(f, &retry_time, 2)
+      && tnfs_warm_read(f, &serverlen, 2) && serverlen < TNFS_WARM_SERVER_LEN && tnfs_warm_read(f, tnfs_warm_server, serverlen)
+      && tnfs_warm_read(f, &hostlen, 2) && hostlen < sizeof(host) && tnfs_warm_read(f, host, hostlen);
+
+    /* the timing belongs to one server, tnfs_warm_connected() applies it when that server is connected */
+    if (ok && timed) {
+        tnfs_warm_server[serverlen] = 0;
+        tnfs_warm_srtt = srtt;
+        tnfs_warm_rttvar = rttvar;
+        tnfs_warm_retry = retry_time;
+        tnfs_warm_timed = true;
+    }
+
+    if (ok && hostlen > 0) {
+        host[hostlen] = 0;
+        memset(&addr, 0, sizeof(addr));
+        ok = tnfs_warm_read(f, &port, 2) && tnfs_warm_read(f, &tcp, 1)
+          && tnfs_warm_read(f, &addrlen, 2) && addrlen <= sizeof(addr.addr) && tnfs_warm_read(f, &addr.addr, addrlen);
+        if (ok) {
+            addr.len = addrlen;
+            netw_setCachedAddress(host, port, tcp, &addr);
+        }
+    }
+
+    ok = ok && tnfs_warm_read(f, &snapshots, 1);
+    for (int i = 0; ok && i < snapshots && i < TNFS_WARM_SNAPSHOTS; i++) {
+        struct tnfs_warm_snapshot* s = &tnfs_warm_snapshots[i];
+
+        ok = tnfs_warm_read(f, &s->keylen, 2) && s->keylen <= TNFS_WARM_KEY_LEN && tnfs_warm_read(f, s->key, s->keylen)
+          && tnfs_warm_read(f, &s->opts, 2) && tnfs_warm_read(f, &s->entries, 2) && tnfs_warm_read(f, &s->taken, 4)
+          && tnfs_warm_read(f, &s->length, 2) && s->length <= TNFS_WARM_SNAPSHOT_SIZE && tnfs_warm_read(f, s->data, s->length);
+        if (!ok || !tnfs_warm_valid(s))
+            s->keylen = 0;	// a damaged listing is dropped, the directory is read from the server again
+    }
+
+    fclose(f);
+
+    return 0;
+}
+
+/* writes a field to the cache file */
+bool tnfs_warm_write(FILE* f, const void* src, size_t length)
+{
+    return fwrite(src, 1, length, f) == length;
+}
+
+/*
+ * writes the server address, timing and directory listings to the cache file. Other processes may read it meanwhile,
+ * so it is written to a file of this process first and then renamed over the cache file
+ */
+int tnfs_warm_save()
+{
+    char temp[TNFS_MAX_PATH_LEN + 16];
+    FILE* f;
+    bool ok;
+    const char* host;
+    uint32_t saved = (uint32_t)time(NULL);
+    uint16_t srtt, rttvar, retry_time, serverlen, hostlen = 0, port16, addrlen;
+    uint8_t timed, tcp, snapshots = 0;
+    int port;
+    bool useTCP;
+    struct netw_address addr;
+
+    if (!tnfs_warm_enabled)
+        return -TNFS_EINVAL;
+
+    snprintf(temp, sizeof(temp), "%s.%d", tnfs_warm_filename, (int)tnfs_warm_pid());
+    f = fopen(temp, "wb");
+    if (f == NULL)
+        return -TNFS_EIO;
+
+    /* the timing is saved with the server it was measured with */
+    timed = tnfs_getTiming(&srtt, &rttvar, &retry_time) && tnfs_warm_current[0] != 0;
+    serverlen = timed ? strlen(tnfs_warm_current) : 0;
+    host = netw_getCachedAddress(&port, &useTCP, &addr);
+    if (host != NULL)
+        hostlen = strlen(host);
+
+    ok = tnfs_warm_write(f, TNFS_WARM_MAGIC, 8) && tnfs_warm_write(f, &saved, 4)
+      && tnfs_warm_write(f, &timed, 1) && tnfs_warm_write(f, &srtt, 2) && tnfs_warm_write(f, &rttvar, 2) && tnfs_warm_write(f, &retry_time, 2)
+      && tnfs_warm_write(f, &serverlen, 2) && tnfs_warm_write(f, tnfs_warm_current, serverlen)
+      && tnfs_warm_write(f, &hostlen, 2);
+
+    if (ok && hostlen > 0) {
+        port16 = port;
+        tcp = useTCP;
+        addrlen = addr.len;
+        ok = tnfs_warm_write(f, host, hostlen) && tnfs_warm_write(f, &port16, 2) && tnfs_warm_write(f, &tcp, 1)
+          && tnfs_warm_write(f, &addrlen, 2) && tnfs_warm_write(f, &addr.addr, addrlen);
+    }
+
+    for (int i = 0; i < TNFS_WARM_SNAPSHOTS; i++) {
+        if (tnfs_warm_snapshots[i].keylen > 0)
+            snapshots++;
+    }
+    ok = ok && tnfs_warm_write(f, &snapshots, 1);
+
+    for (int i = 0; ok && i < TNFS_WARM_SNAPSHOTS; i++) {
+        struct tnfs_warm_snapshot* s = &tnfs_warm_snapshots[i];
+
+        if (s->keylen == 0)
+            continue;
+        ok = tnfs_warm_write(f, &s->keylen, 2) && tnfs_warm_write(f, s->key, s->keylen)
+          && tnfs_warm_write(f, &s->opts, 2) && tnfs_warm_write(f, &s->entries, 2) && tnfs_warm_write(f, &s->taken, 4)
+          && tnfs_warm_write(f, &s->length, 2) && tnfs_warm_write(f, s->data, s->length);
+    }
+
+    if (fclose(f) != 0 || !ok) {
+        remove(temp);
+        return -TNFS_EIO;
+    }
+
+    /* rename() replaces the cache file at once, except on Windows which wants it gone first */
+    if (rename(temp, tnfs_warm_filename) != 0) {
+        remove(tnfs_warm_filename);
+        if (rename(temp, tnfs_warm_filename) != 0) {
+            remove(temp);
+            return -TNFS_EIO;
+        }
+    }
+
+    return 0;
+}
+
+/* saves and disables the warm-start cache */
+void tnfs_warm_close()
+{
+    tnfs_warm_save();
+    tnfs_warm_enabled = false;
+}
+
+/* starts reading a directory listing from the cache, returns -TNFS_ENOENT when it isn't cached */
+int tnfs_warm_opendirx(char* path, char* pattern, uint8_t diropts, uint8_t sortopts, struct tnfs_warm_dir* dir)
+{
+    char key[TNFS_WARM_KEY_LEN];
+    uint16_t keylen = tnfs_warm_key(key, path, pattern);
+    struct tnfs_warm_snapshot* s;
+
+    memset(dir, 0, sizeof(struct tnfs_warm_dir));
+
+    s = keylen > 0 ? tnfs_warm_find(key, keylen, diropts | (sortopts << 8)) : NULL;
+    if (!tnfs_warm_enabled || s == NULL)
+        return -TNFS_ENOENT;
+
+    dir->next = s->data;
+    dir->end = &s->data[s->length];
+    dir->entries = s->entries;
+    dir->age = (uint32_t)time(NULL) - s->taken;
+
+    return 0;
+}
+
+/* reads one entry from a cached directory listing, the name stays valid until the listing is replaced */
+int tnfs_warm_nextdirx(struct tnfs_warm_dir* dir, struct dirx_item* xitem)
+{
+    size_t namelen;
+
+    if (dir->next == NULL || dir->end - dir->next < 14)
+        return TNFS_EOF;
+    namelen = strnlen(&dir->next[13], dir->end - dir->next - 13);
+    if (namelen == (size_t)(dir->end - dir->next - 13))
+        return TNFS_EOF;
+
+    xitem->flags = dir->next[0];
+    memcpy(&xitem->size, &dir->next[1], 4);
+    memcpy(&xitem->modified, &dir->next[5], 4);
+    memcpy(&xitem->created, &dir->next[9], 4);
+    xitem->name = (char*)&dir->next[13];
+
+    dir->next += namelen + 14;
+
+    return 0;
+}
+
+#endif /* TNFS_USE_WARM */